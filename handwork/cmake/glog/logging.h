@@ -0,0 +1,70 @@
+// Minimal stand-in for glog, used by the CMake build when glog is not installed. LOG writes to
+// stderr and failed checks abort, which is all the portable sources and the tests need.
+
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace google
+{
+	class LogMessage
+	{
+	public:
+		LogMessage(const char* file, int line, char severity, bool fatal)
+			: mFatal(fatal)
+		{
+			mStream << severity << ' ' << file << ':' << line << "] ";
+		}
+
+		~LogMessage()
+		{
+			mStream << '\n';
+			std::cerr << mStream.str();
+			if (mFatal)
+				std::abort();
+		}
+
+		std::ostream& stream() { return mStream; }
+
+	private:
+		std::ostringstream mStream;
+		bool mFatal;
+	};
+
+	// Turns the stream of a failed check into void, so the check can be the false branch of ?:.
+	struct LogMessageVoidify
+	{
+		void operator&(std::ostream&) {}
+	};
+}	// namespace google
+
+#define GLOG_STUB_SEVERITY_INFO 'I', false
+#define GLOG_STUB_SEVERITY_WARNING 'W', false
+#define GLOG_STUB_SEVERITY_ERROR 'E', false
+#define GLOG_STUB_SEVERITY_FATAL 'F', true
+
+#define LOG(severity) google::LogMessage(__FILE__, __LINE__, GLOG_STUB_SEVERITY_##severity).stream()
+
+#define CHECK(condition) \
+	(condition) ? (void)0 : google::LogMessageVoidify() & LOG(FATAL) << "Check failed: " #condition " "
+#define CHECK_OP(op, a, b) CHECK((a) op (b))
+#define CHECK_EQ(a, b) CHECK_OP(==, a, b)
+#define CHECK_NE(a, b) CHECK_OP(!=, a, b)
+#define CHECK_LT(a, b) CHECK_OP(<, a, b)
+#define CHECK_LE(a, b) CHECK_OP(<=, a, b)
+#define CHECK_GT(a, b) CHECK_OP(>, a, b)
+#define CHECK_GE(a, b) CHECK_OP(>=, a, b)
+
+#if defined(NDEBUG)
+#define DCHECK(condition) while (false) CHECK(condition)
+#else
+#define DCHECK(condition) CHECK(condition)
+#endif
+#define DCHECK_EQ(a, b) DCHECK((a) == (b))
+#define DCHECK_NE(a, b) DCHECK((a) != (b))
+#define DCHECK_LT(a, b) DCHECK((a) < (b))
+#define DCHECK_LE(a, b) DCHECK((a) <= (b))
+#define DCHECK_GT(a, b) DCHECK((a) > (b))
+#define DCHECK_GE(a, b) DCHECK((a) >= (b))
@@ -112,11 +112,11 @@
 //	sky.Roughness = 1.0f;
 //	sky.Metalness = 0.1f;
 //
-//	mRenderResources->AddMaterial(bricks0);
-//	mRenderResources->AddMaterial(tile0);
-//	mRenderResources->AddMaterial(mirror0);
-//	mRenderResources->AddMaterial(skullMat);
-//	mRenderResources->AddMaterial(sky);
+//	MaterialHandle bricks0Handle = mRenderResources->AddMaterial(bricks0);
+//	MaterialHandle tile0Handle = mRenderResources->AddMaterial(tile0);
+//	MaterialHandle mirror0Handle = mRenderResources->AddMaterial(mirror0);
+//	MaterialHandle skullMatHandle = mRenderResources->AddMaterial(skullMat);
+//	MaterialHandle skyHandle = mRenderResources->AddMaterial(sky);
 //
 //	// Add geometry data
 //	GeometryGenerator geoGen;
@@ -216,7 +216,7 @@
 //	drawArgs["cylinder"] = cylinderSubmesh;
 //	drawArgs["quad"] = quadSubmesh;
 //
-//	mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
+//	GeometryHandle shapeGeo = mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
 //
 //
 //	// Add render items
@@ -224,8 +224,8 @@
 //	std::vector<RenderItemData> renderItems;
 //	RenderItemData quadRitem;
 //	quadRitem.World;
-//	quadRitem.MatName = "bricks0";
-//	quadRitem.GeoName = "shapeGeo";
+//	quadRitem.Mat = bricks0Handle;
+//	quadRitem.Geo = shapeGeo;
 //	quadRitem.DrawArgName = "quad";
 //	quadRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(quadRitem);
@@ -238,8 +238,8 @@
 //	boxRitem.World = Matrix4x4::Mul(Translate(Vector3f(0.0f, 0.5f, 0.0f)).GetMatrix(),
 //		Scale(2.0f, 1.0f, 2.0f).GetMatrix());
 //	//XMStoreFloat4x4(&boxRitem.World, XMMatrixScaling(2.0f, 1.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
-//	boxRitem.MatName = "bricks0";
-//	boxRitem.GeoName = "shapeGeo";
+//	boxRitem.Mat = bricks0Handle;
+//	boxRitem.Geo = shapeGeo;
 //	boxRitem.DrawArgName = "box";
 //	boxRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(boxRitem);
@@ -247,8 +247,8 @@
 //	RenderItemData gridRitem;
 //	gridRitem.World = Matrix4x4();
 //	//gridRitem.World = MathHelper::Identity4x4();
-//	gridRitem.MatName = "tile0";
-//	gridRitem.GeoName = "shapeGeo";
+//	gridRitem.Mat = tile0Handle;
+//	gridRitem.Geo = shapeGeo;
 //	gridRitem.DrawArgName = "grid";
 //	gridRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(gridRitem);
@@ -266,29 +266,29 @@
 //
 //		leftCylRitem.World = rightCylWorld;
 //		//XMStoreFloat4x4(&leftCylRitem.World, rightCylWorld);
-//		leftCylRitem.MatName = "bricks0";
-//		leftCylRitem.GeoName = "shapeGeo";
+//		leftCylRitem.Mat = bricks0Handle;
+//		leftCylRitem.Geo = shapeGeo;
 //		leftCylRitem.DrawArgName = "cylinder";
 //		leftCylRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
 //		rightCylRitem.World = leftCylWorld;
 //		//XMStoreFloat4x4(&rightCylRitem.World, leftCylWorld);
-//		rightCylRitem.MatName = "bricks0";
-//		rightCylRitem.GeoName = "shapeGeo";
+//		rightCylRitem.Mat = bricks0Handle;
+//		rightCylRitem.Geo = shapeGeo;
 //		rightCylRitem.DrawArgName = "cylinder";
 //		rightCylRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
 //		leftSphereRitem.World = leftSphereWorld;
 //		//XMStoreFloat4x4(&leftSphereRitem.World, leftSphereWorld);
-//		leftSphereRitem.MatName = "mirror0";
-//		leftSphereRitem.GeoName = "shapeGeo";
+//		leftSphereRitem.Mat = mirror0Handle;
+//		leftSphereRitem.Geo = shapeGeo;
 //		leftSphereRitem.DrawArgName = "sphere";
 //		leftSphereRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
 //		rightSphereRitem.World = rightSphereWorld;
 //		//XMStoreFloat4x4(&rightSphereRitem.World, rightSphereWorld);
-//		rightSphereRitem.MatName = "mirror0";
-//		rightSphereRitem.GeoName = "shapeGeo";
+//		rightSphereRitem.Mat = mirror0Handle;
+//		rightSphereRitem.Geo = shapeGeo;
 //		rightSphereRitem.DrawArgName = "sphere";
 //		rightSphereRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
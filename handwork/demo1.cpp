@@ -96,28 +96,28 @@
 //	matyellow.Albedo = Vector3f(0.83f, 0.58f, 0.05f);
 //	matyellow.Roughness = 0.3f;
 //	matyellow.Metalness = 0.3f;
-//	mRenderResources->AddMaterial(matyellow);
+//	MaterialHandle matyellowHandle = mRenderResources->AddMaterial(matyellow);
 //	
 //	Material matred;
 //	matred.Name = "red";
 //	matred.Albedo = Vector3f(0.89f, 0.09f, 0.37f);
 //	matred.Roughness = 0.3f;
 //	matred.Metalness = 0.6f;
-//	mRenderResources->AddMaterial(matred);
+//	MaterialHandle matredHandle = mRenderResources->AddMaterial(matred);
 //
 //	Material matblue;
 //	matblue.Name = "blue";
 //	matblue.Albedo = Vector3f(0.09f, 0.41f, 0.93f);
 //	matblue.Roughness = 0.3f;
 //	matblue.Metalness = 0.6f;
-//	mRenderResources->AddMaterial(matblue);
+//	MaterialHandle matblueHandle = mRenderResources->AddMaterial(matblue);
 //
 //	Material matgreen;
 //	matgreen.Name = "green";
 //	matgreen.Albedo = Vector3f(0.07f, 0.78f, 0.27f);
 //	matgreen.Roughness = 0.3f;
 //	matgreen.Metalness = 0.6f;
-//	mRenderResources->AddMaterial(matgreen);
+//	MaterialHandle matgreenHandle = mRenderResources->AddMaterial(matgreen);
 //
 //#pragma endregion Add Materials
 //
@@ -143,7 +143,7 @@
 //	std::vector<std::uint32_t> indices;
 //	indices.insert(indices.end(), std::begin(MeshIndices), std::end(MeshIndices));
 //
-//	mRenderResources->AddGeometryData(vertices, indices, drawArgs, "mesh");
+//	GeometryHandle meshGeo = mRenderResources->AddGeometryData(vertices, indices, drawArgs, "mesh");
 //
 //	// Add common shape geometry data
 //	GeometryGenerator geoGen;
@@ -207,7 +207,7 @@
 //	indices.insert(indices.end(), std::begin(cylinder.Indices32), std::end(cylinder.Indices32));
 //	indices.insert(indices.end(), std::begin(quad.Indices32), std::end(quad.Indices32));
 //
-//	mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
+//	GeometryHandle shapeGeo = mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
 //
 //#pragma endregion Add Geometry
 //
@@ -216,17 +216,17 @@
 //	// Add render items
 //	std::vector<RenderItemData> renderItems;
 //
-//	auto boundBox = mRenderResources->GetMeshGeometry("mesh")->DrawArgs["mesh"].BoxBounds;
-//	auto center = Vector3f(boundBox.Center.x, boundBox.Center.y, boundBox.Center.z);
-//	auto extent = Vector3f(boundBox.Extents.x, boundBox.Extents.y, boundBox.Extents.z);
+//	auto boundBox = mRenderResources->GetMeshGeometry(meshGeo)->DrawArgs["mesh"].Bounds;
+//	auto center = boundBox.Center();
+//	auto extent = boundBox.Extent();
 //	float scale = 8.0f / MaxComponent(extent);
 //	Matrix4x4 worldBase = Matrix4x4::Mul(RotateY(0.0f).GetMatrix(),
 //		Matrix4x4::Mul(Scale(scale, scale, scale).GetMatrix(), Translate(-center).GetMatrix()));
 //
 //	RenderItemData meshRitem;
 //	meshRitem.World = worldBase;
-//	meshRitem.MatName = "yellow";
-//	meshRitem.GeoName = "mesh";
+//	meshRitem.Mat = matyellowHandle;
+//	meshRitem.Geo = meshGeo;
 //	meshRitem.DrawArgName = "mesh";
 //	meshRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(meshRitem);
@@ -13,6 +13,7 @@
 #include "mesh/meshtopology.h"
 #include "utility/stringprint.h"
 #include "mesh/subdivision.h"
+#include "rendering/geometryoptimizer.h"
 
 using namespace handwork;
 using namespace handwork::rendering;
@@ -98,28 +99,28 @@ void MyApp::AddRenderData() {
 	matyellow.Albedo = Vector3f(0.83f, 0.58f, 0.05f);
 	matyellow.Roughness = 0.3f;
 	matyellow.Metalness = 0.05f;
-	mRenderResources->AddMaterial(matyellow);
+	MaterialHandle matyellowHandle = mRenderResources->AddMaterial(matyellow);
 
 	Material matred;
 	matred.Name = "red";
 	matred.Albedo = Vector3f(0.89f, 0.09f, 0.37f);
 	matred.Roughness = 0.3f;
 	matred.Metalness = 0.08f;
-	mRenderResources->AddMaterial(matred);
+	MaterialHandle matredHandle = mRenderResources->AddMaterial(matred);
 
 	Material matblue;
 	matblue.Name = "blue";
 	matblue.Albedo = Vector3f(0.09f, 0.41f, 0.93f);
 	matblue.Roughness = 0.3f;
 	matblue.Metalness = 0.07f;
-	mRenderResources->AddMaterial(matblue);
+	MaterialHandle matblueHandle = mRenderResources->AddMaterial(matblue);
 
 	Material matgreen;
 	matgreen.Name = "green";
 	matgreen.Albedo = Vector3f(0.07f, 0.78f, 0.27f);
 	matgreen.Roughness = 0.3f;
 	matgreen.Metalness = 0.06f;
-	mRenderResources->AddMaterial(matgreen);
+	MaterialHandle matgreenHandle = mRenderResources->AddMaterial(matgreen);
 
 #pragma endregion Add Materials
 
@@ -152,8 +153,11 @@ void MyApp::AddRenderData() {
 	}
 	std::vector<std::uint32_t> indices;
 	indices.insert(indices.end(), std::begin(topology->Indices), std::end(topology->Indices));
+	BuildSubmeshLods(vertices, indices, drawArgs);
+	// The refiner emits the faces quad by quad, reorder them for the vertex cache.
+	OptimizeGeometry(vertices, indices, drawArgs);
 
-	mRenderResources->AddGeometryData(vertices, indices, drawArgs, "mesh");
+	GeometryHandle meshGeo = mRenderResources->AddGeometryData(vertices, indices, drawArgs, "mesh");
 
 	// Add common shape geometry data
 	GeometryGenerator geoGen;
@@ -213,8 +217,11 @@ void MyApp::AddRenderData() {
 	indices.insert(indices.end(), std::begin(sphere.Indices32), std::end(sphere.Indices32));
 	indices.insert(indices.end(), std::begin(cylinder.Indices32), std::end(cylinder.Indices32));
 	indices.insert(indices.end(), std::begin(quad.Indices32), std::end(quad.Indices32));
+	// The joint spheres are drawn thousands of times, far ones take coarser levels.
+	BuildSubmeshLods(vertices, indices, drawArgs);
+	OptimizeGeometry(vertices, indices, drawArgs);
 
-	mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
+	GeometryHandle shapeGeo = mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
 
 #pragma endregion Add Geometry
 
@@ -223,17 +230,17 @@ void MyApp::AddRenderData() {
 	// Add render items
 	std::vector<RenderItemData> renderItems;
 
-	auto boundBox = mRenderResources->GetMeshGeometry("mesh")->DrawArgs["mesh"].BoxBounds;
-	auto center = Vector3f(boundBox.Center.x, boundBox.Center.y, boundBox.Center.z);
-	auto extent = Vector3f(boundBox.Extents.x, boundBox.Extents.y, boundBox.Extents.z);
+	auto boundBox = mRenderResources->GetMeshGeometry(meshGeo)->DrawArgs["mesh"].Bounds;
+	auto center = boundBox.Center();
+	auto extent = boundBox.Extent();
 	float scale = 8.0f / MaxComponent(extent);
 	Matrix4x4 worldBase = Matrix4x4::Mul(RotateY(0.0f).GetMatrix(),
 		Matrix4x4::Mul(Scale(scale, scale, scale).GetMatrix(), Translate(-center).GetMatrix()));
 
 	RenderItemData meshRitem;
 	meshRitem.World = worldBase;
-	meshRitem.MatName = "yellow";
-	meshRitem.GeoName = "mesh";
+	meshRitem.Mat = matyellowHandle;
+	meshRitem.Geo = meshGeo;
 	meshRitem.DrawArgName = "mesh";
 	meshRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	renderItems.push_back(meshRitem);
@@ -243,13 +250,13 @@ void MyApp::AddRenderData() {
 	auto limitsData = reinterpret_cast<const Vector3f*>(MeshSubDiv->EvaluateLimit(nLimitSD));
 	renderItems.clear();
 	RenderItemData pointInstItem;
-	pointInstItem.GeoName = "shapeGeo";
+	pointInstItem.Geo = shapeGeo;
 	pointInstItem.DrawArgName = "sphere";
 	pointInstItem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	pointInstItem.Instances.resize(nLimitSD);
 	for (int i = 0; i < nLimitSD; ++i) {
 		auto& inst = pointInstItem.Instances[i];
-		inst.MatName = "blue";
+		inst.Mat = matblueHandle;
 		inst.World = Matrix4x4::Mul(worldBase, Matrix4x4::Mul(Translate(*(limitsData + i * 3)).GetMatrix(), Scale(0.5f, 0.5f, 0.5f).GetMatrix()));
 		//inst.World = ConvertToXMFLOAT4X4(worldBase);
 	}
@@ -295,8 +302,8 @@ void MyApp::AddRenderData() {
 
 			RenderItemData boneRitem;
 			boneRitem.World = Matrix4x4::Mul(worldBase, boneWorld);
-			boneRitem.MatName = "green";
-			boneRitem.GeoName = "shapeGeo";
+			boneRitem.Mat = matgreenHandle;
+			boneRitem.Geo = shapeGeo;
 			boneRitem.DrawArgName = "cylinder";
 			boneRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 			renderItems.push_back(boneRitem);
@@ -305,8 +312,8 @@ void MyApp::AddRenderData() {
 		RenderItemData jointRitem;
 		jointRitem.World = Matrix4x4::Mul(Matrix4x4::Mul(worldBase, Translate(jointsWorldPos[i]).GetMatrix()),
 			Scale(jointScale, jointScale, jointScale).GetMatrix());
-		jointRitem.MatName = "red";
-		jointRitem.GeoName = "shapeGeo";
+		jointRitem.Mat = matredHandle;
+		jointRitem.Geo = shapeGeo;
 		jointRitem.DrawArgName = "sphere";
 		jointRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 		renderItems.push_back(jointRitem);
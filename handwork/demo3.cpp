@@ -14,6 +14,7 @@
 //#include "mesh/meshtopology.h"
 //#include "utility/stringprint.h"
 //#include "mesh/subdivision.h"
+//#include "rendering/depthutil.h"
 //
 //using namespace handwork;
 //using namespace handwork::rendering;
@@ -113,11 +114,11 @@
 //	sky.Roughness = 1.0f;
 //	sky.Metalness = 0.1f;
 //
-//	mRenderResources->AddMaterial(bricks0);
-//	mRenderResources->AddMaterial(tile0);
-//	mRenderResources->AddMaterial(mirror0);
-//	mRenderResources->AddMaterial(skullMat);
-//	mRenderResources->AddMaterial(sky);
+//	MaterialHandle bricks0Handle = mRenderResources->AddMaterial(bricks0);
+//	MaterialHandle tile0Handle = mRenderResources->AddMaterial(tile0);
+//	MaterialHandle mirror0Handle = mRenderResources->AddMaterial(mirror0);
+//	MaterialHandle skullMatHandle = mRenderResources->AddMaterial(skullMat);
+//	MaterialHandle skyHandle = mRenderResources->AddMaterial(sky);
 //
 //	// Add geometry data
 //	GeometryGenerator geoGen;
@@ -217,15 +218,15 @@
 //	drawArgs["cylinder"] = cylinderSubmesh;
 //	drawArgs["quad"] = quadSubmesh;
 //
-//	mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
+//	GeometryHandle shapeGeo = mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
 //
 //	// Add render items
 //
 //	std::vector<RenderItemData> renderItems;
 //	RenderItemData quadRitem;
 //	quadRitem.World;
-//	quadRitem.MatName = "bricks0";
-//	quadRitem.GeoName = "shapeGeo";
+//	quadRitem.Mat = bricks0Handle;
+//	quadRitem.Geo = shapeGeo;
 //	quadRitem.DrawArgName = "quad";
 //	quadRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(quadRitem);
@@ -238,8 +239,8 @@
 //	boxRitem.World = Matrix4x4::Mul(Translate(Vector3f(0.0f, 0.5f, 0.0f)).GetMatrix(),
 //		Scale(2.0f, 1.0f, 2.0f).GetMatrix());
 //	//XMStoreFloat4x4(&boxRitem.World, XMMatrixScaling(2.0f, 1.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
-//	boxRitem.MatName = "bricks0";
-//	boxRitem.GeoName = "shapeGeo";
+//	boxRitem.Mat = bricks0Handle;
+//	boxRitem.Geo = shapeGeo;
 //	boxRitem.DrawArgName = "box";
 //	boxRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(boxRitem);
@@ -247,8 +248,8 @@
 //	RenderItemData gridRitem;
 //	gridRitem.World = Matrix4x4();
 //	//gridRitem.World = MathHelper::Identity4x4();
-//	gridRitem.MatName = "tile0";
-//	gridRitem.GeoName = "shapeGeo";
+//	gridRitem.Mat = tile0Handle;
+//	gridRitem.Geo = shapeGeo;
 //	gridRitem.DrawArgName = "grid";
 //	gridRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(gridRitem);
@@ -266,29 +267,29 @@
 //
 //		leftCylRitem.World = rightCylWorld;
 //		//XMStoreFloat4x4(&leftCylRitem.World, rightCylWorld);
-//		leftCylRitem.MatName = "bricks0";
-//		leftCylRitem.GeoName = "shapeGeo";
+//		leftCylRitem.Mat = bricks0Handle;
+//		leftCylRitem.Geo = shapeGeo;
 //		leftCylRitem.DrawArgName = "cylinder";
 //		leftCylRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
 //		rightCylRitem.World = leftCylWorld;
 //		//XMStoreFloat4x4(&rightCylRitem.World, leftCylWorld);
-//		rightCylRitem.MatName = "bricks0";
-//		rightCylRitem.GeoName = "shapeGeo";
+//		rightCylRitem.Mat = bricks0Handle;
+//		rightCylRitem.Geo = shapeGeo;
 //		rightCylRitem.DrawArgName = "cylinder";
 //		rightCylRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
 //		leftSphereRitem.World = leftSphereWorld;
 //		//XMStoreFloat4x4(&leftSphereRitem.World, leftSphereWorld);
-//		leftSphereRitem.MatName = "mirror0";
-//		leftSphereRitem.GeoName = "shapeGeo";
+//		leftSphereRitem.Mat = mirror0Handle;
+//		leftSphereRitem.Geo = shapeGeo;
 //		leftSphereRitem.DrawArgName = "sphere";
 //		leftSphereRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
 //		rightSphereRitem.World = rightSphereWorld;
 //		//XMStoreFloat4x4(&rightSphereRitem.World, rightSphereWorld);
-//		rightSphereRitem.MatName = "mirror0";
-//		rightSphereRitem.GeoName = "shapeGeo";
+//		rightSphereRitem.Mat = mirror0Handle;
+//		rightSphereRitem.Geo = shapeGeo;
 //		rightSphereRitem.DrawArgName = "sphere";
 //		rightSphereRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //
@@ -307,5 +308,13 @@
 //	mRenderResources->Update();
 //	mRenderResources->Render();
 //	auto res = mDeviceResources->RetrieveRenderTargetBuffer();
-//	mDeviceResources->SaveToLocalImage(res, "screenshot.bmp");
+//	mDeviceResources->SaveToLocalImage(res, "screenshot.png");
+//	delete res;
+//
+//	// The depth buffer can also be read back directly, as view space depth in full float precision.
+//	std::vector<float> depth;
+//	mRenderResources->RetrieveLinearDepthBuffer(depth);
+//	Vector2i size = mDeviceResources->GetRenderTargetSize();
+//	depth::WriteRawFloat("depth.raw", depth.data(), size.x, size.y);
+//	depth::WritePgm16("depth.pgm", depth.data(), size.x, size.y, mCamera->GetFarZ());
 //}
\ No newline at end of file
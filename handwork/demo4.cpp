@@ -119,7 +119,7 @@
 //	mat0.Albedo = Vector3f(0.976, 0.937f, 0.380f);
 //	mat0.Roughness = 0.6f;
 //	mat0.Metalness = 0.8f;
-//	mRenderResources->AddMaterial(mat0);
+//	MaterialHandle mat0Handle = mRenderResources->AddMaterial(mat0);
 //
 //	// Add geometry data
 //	GeometryGenerator geoGen;
@@ -141,14 +141,14 @@
 //	std::unordered_map<std::string, SubmeshGeometry> drawArgs;
 //	drawArgs["sphere"] = sphereSubmesh;
 //
-//	mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
+//	GeometryHandle shapeGeo = mRenderResources->AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
 //
 //	// Add render items
 //	std::vector<RenderItemData> renderItems;
 //	RenderItemData sphereRitem;
 //	sphereRitem.World = Scale(4.0f, 4.0f, 4.0f).GetMatrix();
-//	sphereRitem.MatName = "mat0";
-//	sphereRitem.GeoName = "shapeGeo";
+//	sphereRitem.Mat = mat0Handle;
+//	sphereRitem.Geo = shapeGeo;
 //	sphereRitem.DrawArgName = "sphere";
 //	sphereRitem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 //	renderItems.push_back(sphereRitem);
@@ -0,0 +1,147 @@
+// Demonstrate headless rendering, which needs neither a GPU nor a window. It renders a small scene from
+// several camera poses on the CPU backend and saves the images and the linear depth of the first view.
+// This demo is the entry point of the portable CMake build and runs on any platform.
+// Usage: demo5 [output prefix] [view count]
+
+#include <cstdlib>
+
+#include "utility/utility.h"
+#include "utility/transform.h"
+#include "utility/stringprint.h"
+#include "rendering/headlessrenderer.h"
+#include "rendering/cpubackend.h"
+#include "rendering/geogenerator.h"
+#include "rendering/meshlod.h"
+#include "rendering/geometryoptimizer.h"
+#include "rendering/depthutil.h"
+#include "rendering/imagewriter.h"
+
+using namespace handwork;
+using namespace handwork::rendering;
+
+static void AppendMesh(const GeometryGenerator::MeshData& mesh, const std::string& name, std::vector<Vertex>& vertices,
+	std::vector<std::uint32_t>& indices, std::unordered_map<std::string, SubmeshGeometry>& drawArgs) {
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)mesh.Indices32.size();
+	submesh.VertexCount = (UINT)mesh.Vertices.size();
+	submesh.StartIndexLocation = (UINT)indices.size();
+	submesh.BaseVertexLocation = (INT)vertices.size();
+	drawArgs[name] = submesh;
+
+	for (auto& v : mesh.Vertices) {
+		Vertex vertex;
+		vertex.Pos = v.Position;
+		vertex.Normal = v.Normal;
+		vertex.TangentU = v.TangentU;
+		vertices.push_back(vertex);
+	}
+	indices.insert(indices.end(), mesh.Indices32.begin(), mesh.Indices32.end());
+}
+
+int main(int argc, char* argv[]) {
+	std::string prefix = argc > 1 ? argv[1] : "demo5_";
+	int viewCount = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 8;
+	const int width = 640;
+	const int height = 480;
+
+	auto backend = std::make_shared<CpuBackend>(width, height);
+	auto camera = std::make_shared<Camera>(45.0f, 0.5f, 100.0f);
+	HeadlessRenderer renderer(backend, camera);
+
+	// Add materials
+	Material ground;
+	ground.Name = "ground";
+	ground.Albedo = Vector3f(0.9f, 0.9f, 1.0f);
+	ground.Roughness = 0.8f;
+	ground.Metalness = 0.1f;
+
+	Material copper;
+	copper.Name = "copper";
+	copper.Albedo = Vector3f(0.95f, 0.64f, 0.54f);
+	copper.Roughness = 0.3f;
+	copper.Metalness = 0.9f;
+
+	Material plastic;
+	plastic.Name = "plastic";
+	plastic.Albedo = Vector3f(0.2f, 0.4f, 0.9f);
+	plastic.Roughness = 0.4f;
+	plastic.Metalness = 0.1f;
+
+	MaterialHandle groundHandle = renderer.AddMaterial(ground);
+	MaterialHandle copperHandle = renderer.AddMaterial(copper);
+	MaterialHandle plasticHandle = renderer.AddMaterial(plastic);
+
+	// Add geometry data
+	GeometryGenerator geoGen;
+	std::vector<Vertex> vertices;
+	std::vector<std::uint32_t> indices;
+	std::unordered_map<std::string, SubmeshGeometry> drawArgs;
+	AppendMesh(geoGen.CreateGrid(20.0f, 20.0f, 40, 40), "grid", vertices, indices, drawArgs);
+	AppendMesh(geoGen.CreateBox(1.0f, 1.0f, 1.0f, 2), "box", vertices, indices, drawArgs);
+	AppendMesh(geoGen.CreateSphere(0.5f, 32, 32), "sphere", vertices, indices, drawArgs);
+	BuildSubmeshLods(vertices, indices, drawArgs);
+	OptimizeGeometry(vertices, indices, drawArgs);
+	GeometryHandle shapeGeo = renderer.AddGeometryData(vertices, indices, drawArgs, "shapeGeo");
+
+	// Add render items
+	std::vector<RenderItemData> renderItems;
+	RenderItemData gridItem;
+	gridItem.Name = "grid";
+	gridItem.Mat = groundHandle;
+	gridItem.Geo = shapeGeo;
+	gridItem.DrawArgName = "grid";
+	renderItems.push_back(gridItem);
+
+	RenderItemData boxItem;
+	boxItem.Name = "box";
+	boxItem.World = Matrix4x4::Mul(Translate(Vector3f(0.0f, 1.0f, 0.0f)).GetMatrix(), Scale(2.0f, 2.0f, 2.0f).GetMatrix());
+	boxItem.Mat = copperHandle;
+	boxItem.Geo = shapeGeo;
+	boxItem.DrawArgName = "box";
+	renderItems.push_back(boxItem);
+	renderer.AddRenderItem(renderItems, RenderLayer::Opaque);
+
+	renderItems.clear();
+	RenderItemData sphereItem;
+	sphereItem.Name = "spheres";
+	sphereItem.Geo = shapeGeo;
+	sphereItem.DrawArgName = "sphere";
+	for (int i = 0; i < 8; ++i) {
+		for (int j = 0; j < 8; ++j) {
+			Instance inst;
+			inst.World = Translate(Vector3f(-7.0f + 2.0f * i, 0.5f, -7.0f + 2.0f * j)).GetMatrix();
+			inst.Mat = (i + j) % 2 == 0 ? plasticHandle : copperHandle;
+			sphereItem.Instances.push_back(inst);
+		}
+	}
+	renderItems.push_back(sphereItem);
+	renderer.AddRenderItem(renderItems, RenderLayer::OpaqueInst);
+
+	// Render the views on a circle around the scene.
+	std::vector<Camera> cameras(viewCount, *camera);
+	for (int i = 0; i < viewCount; ++i) {
+		float phi = 2.0f * Pi * i / viewCount;
+		cameras[i].LookAt(Vector3f(14.0f * std::cos(phi), 8.0f, 14.0f * std::sin(phi)), Vector3f(0.0f, 0.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f));
+	}
+	std::vector<RetrieveImageData> images;
+	renderer.RenderViews(cameras, images);
+
+	ImageWriter writer;
+	for (int i = 0; i < viewCount; ++i)
+		writer.Write(StringPrintf("%sview%d.png", prefix.c_str(), i), std::move(images[i]));
+
+	*camera = cameras[0];
+	renderer.Update();
+	renderer.Render();
+	std::vector<float> depth;
+	renderer.RetrieveLinearDepthBuffer(depth);
+	bool depthWritten = depth::WritePgm16(prefix + "depth0.pgm", depth.data(), width, height, camera->GetFarZ());
+
+	writer.Flush();
+	if (writer.GetFailedCount() > 0 || !depthWritten) {
+		LOG(ERROR) << "Failed to write the output of demo5.";
+		return 1;
+	}
+	LOG(INFO) << StringPrintf("Wrote %d views to %s*.", viewCount, prefix.c_str());
+	return 0;
+}
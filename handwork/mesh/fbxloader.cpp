@@ -1,31 +1,29 @@
 // Fbx file importer.
 
 #include "fbxloader.h"
+#include "skeletonjoints.h"
 #include "fbxsdk.h"
 #include "../utility/transform.h"
+#include "../utility/parallel.h"
+#include "../rendering/gametimer.h"
 
 namespace handwork
 {
-	// Struct declaration
-	struct JointInfo
+	// Accumulated time in seconds spent in each import stage.
+	struct ImportTimings
 	{
-		JointInfo() : Valid(false)
-		{}
-
-		std::string Name;
-		int Parent;
-		Matrix4x4 GlobalBindposeInverse;
-		FbxCluster* Cluster;
-		bool Valid;
-		Vector3f Translation;
-		Vector3f Scaling;
-		Vector3f Rotation;
-	};
-
-	struct MeshVI
-	{
-		std::vector<MeshVertex> Vertices;
-		std::vector<int> Indices;
+		float Load = 0.0f;
+		float Triangulate = 0.0f;
+		float Bake = 0.0f;
+		float Skeleton = 0.0f;
+		float Position = 0.0f;
+		float Index = 0.0f;
+		float Normal = 0.0f;
+		float Tangent = 0.0f;
+		float UV = 0.0f;
+		float Joint = 0.0f;
+		float Split = 0.0f;
+		float Emit = 0.0f;
 	};
 
 	// Helper methods
@@ -45,44 +43,168 @@ namespace handwork
 		return Vector3f((float)v[0], (float)v[1], (float)v[2]);
 	}
 
-	int FindJoint(const std::string& name, const std::vector<JointInfo>& skeletonInfo)
+	// Bulk double4 -> float3 conversion. Plain strided loops over the raw buffer instead of
+	// the SDK accessors, so the compiler is free to vectorize them.
+	static_assert(sizeof(FbxVector4) == 4 * sizeof(double), "Unexpected FbxVector4 layout.");
+
+	void ConvertToVector3f(const FbxVector4* src, int count, Vector3f* dst)
 	{
-		for (int i = 0; i < (int)skeletonInfo.size(); ++i)
+		if (count <= 0)
+			return;
+		const double* s = reinterpret_cast<const double*>(src);
+		float* d = &dst[0].x;
+		for (int i = 0; i < count; ++i)
 		{
-			if (skeletonInfo[i].Name == name)
-				return i;
+			d[i * 3 + 0] = (float)s[i * 4 + 0];
+			d[i * 3 + 1] = (float)s[i * 4 + 1];
+			d[i * 3 + 2] = (float)s[i * 4 + 2];
 		}
-		return -1;
 	}
 
+	void GatherToVector3f(const FbxVector4* src, const int* indices, int count, Vector3f* dst)
+	{
+		if (count <= 0)
+			return;
+		const double* s = reinterpret_cast<const double*>(src);
+		float* d = &dst[0].x;
+		for (int i = 0; i < count; ++i)
+		{
+			const double* v = s + (size_t)indices[i] * 4;
+			d[i * 3 + 0] = (float)v[0];
+			d[i * 3 + 1] = (float)v[1];
+			d[i * 3 + 2] = (float)v[2];
+		}
+	}
+
+	void ConvertToVector2f(const FbxVector2* src, int count, Vector2f* dst)
+	{
+		if (count <= 0)
+			return;
+		const double* s = reinterpret_cast<const double*>(src);
+		float* d = &dst[0].x;
+		for (int i = 0; i < count; ++i)
+		{
+			d[i * 2 + 0] = (float)s[i * 2 + 0];
+			d[i * 2 + 1] = (float)s[i * 2 + 1];
+		}
+	}
+
+	void GatherToVector2f(const FbxVector2* src, const int* indices, int count, Vector2f* dst)
+	{
+		if (count <= 0)
+			return;
+		const double* s = reinterpret_cast<const double*>(src);
+		float* d = &dst[0].x;
+		for (int i = 0; i < count; ++i)
+		{
+			const double* v = s + (size_t)indices[i] * 2;
+			d[i * 2 + 0] = (float)v[0];
+			d[i * 2 + 1] = (float)v[1];
+		}
+	}
+
+	// Overloads so that the layer element readers can be shared by every element type.
+	inline void ConvertElementArray(const FbxVector4* src, int count, Vector3f* dst) { ConvertToVector3f(src, count, dst); }
+	inline void ConvertElementArray(const FbxVector2* src, int count, Vector2f* dst) { ConvertToVector2f(src, count, dst); }
+	inline void GatherElementArray(const FbxVector4* src, const int* indices, int count, Vector3f* dst) { GatherToVector3f(src, indices, count, dst); }
+	inline void GatherElementArray(const FbxVector2* src, const int* indices, int count, Vector2f* dst) { GatherToVector2f(src, indices, count, dst); }
+
 	// Method pre-declaration 
 	void BakeTRS(FbxNode* rootNode);
 	void BakeConfigure(FbxNode* node);
 	void ProcessSkeletonHierarchyRecursively(FbxNode* node, int myIndex, int inParentIndex, std::vector<JointInfo>& skeletonInfo);
-	void ProcessSkeletonEliminationRecursively(FbxNode* node, std::vector<JointInfo>& skeletonInfo);
-	void ProcessNode(FbxNode* node, std::vector<JointInfo>& skeletonInfo, std::vector<MeshVI*>& meshVICache);
-	void ProcessMesh(FbxNode* node, std::vector<JointInfo>& skeletonInfo, std::vector<MeshVI*>& meshVICache);
-	void ProcessJoints(FbxNode* node, std::vector<MeshVertex>& vertices, std::vector<JointInfo>& skeletonInfo);
-	void PackVI(std::vector<MeshVI*>& meshVICache, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+	void ProcessSkeletonEliminationRecursively(FbxNode* node, std::vector<JointInfo>& skeletonInfo,
+		std::vector<FbxCluster*>& jointClusters, const JointIndexMap& jointIndices);
+	bool ImportFbxImpl(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, std::vector<int>* controlPoints);
+	void ProcessNode(FbxNode* node, std::vector<JointInfo>& skeletonInfo, const JointIndexMap& jointIndices, const MeshChunkCallback& onMesh, bool splitSeams, ImportTimings& timings);
+	void ProcessMesh(FbxNode* node, std::vector<JointInfo>& skeletonInfo, const JointIndexMap& jointIndices, const MeshChunkCallback& onMesh, bool splitSeams, ImportTimings& timings);
+	void ProcessJoints(FbxNode* node, std::vector<MeshVertex>& vertices, std::vector<JointInfo>& skeletonInfo, const JointIndexMap& jointIndices);
 	void ReadPosition(FbxMesh* mesh, std::vector<MeshVertex>& vertices, const Transform& world);
 	void ReadIndex(FbxMesh* mesh, std::vector<int>& indices);
-	void ReadNormal(FbxMesh* mesh, std::vector<MeshVertex>& vertices, const Transform& world, bool reGenerate = true);
-	void ReadTangent(FbxMesh* mesh, std::vector<MeshVertex>& vertices, const Transform& world, bool reGenerate = true);
+	template <typename FbxType, typename T>
+	bool ReadElement(FbxMesh* mesh, FbxLayerElementTemplate<FbxType>* element, const char* elementName, bool perCorner, std::vector<T>& values);
+	bool ReadNormal(FbxMesh* mesh, const Transform& world, bool perCorner, std::vector<Vector3f>& normals, bool reGenerate = true);
+	bool ReadTangent(FbxMesh* mesh, const Transform& world, bool perCorner, std::vector<Vector3f>& tangents, bool reGenerate = true);
+	bool ReadUV(FbxMesh* mesh, bool perCorner, std::vector<Vector2f>& uvs);
+	void SplitSeams(const std::vector<MeshVertex>& controlPointVertices, const std::vector<int>& corners,
+		const std::vector<Vector3f>& normals, const std::vector<Vector3f>& tangents, const std::vector<Vector2f>& uvs, MeshChunk& result);
 
 	bool ImportFbx(const std::string& filename, float& fileScale, std::vector<MeshJoint>& skeleton,
 		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
 	{
-		return ImportFbx(filename.c_str(), fileScale, skeleton, meshVertices, meshIndices);
+		return ImportFbxImpl(filename.c_str(), fileScale, skeleton, meshVertices, meshIndices, nullptr);
 	}
 
 	bool ImportFbx(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
 		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
 	{
-		skeleton.clear();
+		return ImportFbxImpl(filename, fileScale, skeleton, meshVertices, meshIndices, nullptr);
+	}
+
+	bool ImportFbx(const std::string& filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, std::vector<int>& controlPoints)
+	{
+		return ImportFbxImpl(filename.c_str(), fileScale, skeleton, meshVertices, meshIndices, &controlPoints);
+	}
+
+	bool ImportFbx(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, std::vector<int>& controlPoints)
+	{
+		return ImportFbxImpl(filename, fileScale, skeleton, meshVertices, meshIndices, &controlPoints);
+	}
+
+	bool ImportFbx(const std::string& filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		const MeshChunkCallback& onMesh, bool splitSeams)
+	{
+		return ImportFbx(filename.c_str(), fileScale, skeleton, onMesh, splitSeams);
+	}
+
+	bool ImportFbxImpl(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, std::vector<int>* controlPoints)
+	{
 		meshVertices.clear();
 		meshIndices.clear();
+		if (controlPoints)
+			controlPoints->clear();
+
+		// Append every mesh as it is streamed in, offsetting its indices and control points.
+		int controlPointOffset = 0;
+		auto append = [&](MeshChunk& chunk)
+		{
+			int offset = (int)meshVertices.size();
+			meshVertices.insert(meshVertices.end(),
+				std::make_move_iterator(chunk.Vertices.begin()), std::make_move_iterator(chunk.Vertices.end()));
+			meshIndices.reserve(meshIndices.size() + chunk.Indices.size());
+			for (int index : chunk.Indices)
+				meshIndices.push_back(index + offset);
+
+			if (controlPoints)
+			{
+				controlPoints->reserve(controlPoints->size() + chunk.ControlPoints.size());
+				for (int controlPoint : chunk.ControlPoints)
+					controlPoints->push_back(controlPoint + controlPointOffset);
+			}
+			controlPointOffset += chunk.ControlPointCount;
+		};
+
+		if (!ImportFbx(filename, fileScale, skeleton, append, controlPoints != nullptr))
+			return false;
+
+		LOG(INFO) << StringPrintf("Read vertex number %d", meshVertices.size());
+		LOG(INFO) << StringPrintf("Read triangle face number %d", meshIndices.size() / 3);
+		return true;
+	}
+
+	bool ImportFbx(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		const MeshChunkCallback& onMesh, bool splitSeams)
+	{
+		skeleton.clear();
 
 		LOG(INFO) << "Start Import fbx mesh from " << filename << ".";
+		ImportTimings timings;
+		rendering::GameTimer timer;
+		timer.Reset();
 
 		// Initialize the SDK manager. This object handles memory management.
 		FbxManager* sdkManager = FbxManager::Create();
@@ -110,6 +232,8 @@ namespace handwork
 
 		// The file is imported, so get rid of the importer.
 		importer->Destroy();
+		timer.Stop();
+		timings.Load = timer.TotalTime();
 
 		// do NOT use FbxSystemUnit::ConvertScene(lScene), which just simply set transform.scale of root nodes.
 		if (scene->GetGlobalSettings().GetSystemUnit() == FbxSystemUnit::mm)
@@ -127,8 +251,11 @@ namespace handwork
 		}
 
 		// Convert mesh, NURBS and patch into triangle mesh
+		timer.Reset();
 		FbxGeometryConverter geomConverter(sdkManager);
 		geomConverter.Triangulate(scene, /*replace*/true);
+		timer.Stop();
+		timings.Triangulate = timer.TotalTime();
 		// Split meshes per material, so that we only have one material per mesh.
 		// However, this method will fail sometimes due to the FBK SDK issues. So
 		// we still need to manage multi material in one mesh.
@@ -144,9 +271,13 @@ namespace handwork
 		}
 
 		// Bake fbx data.
+		timer.Reset();
 		BakeTRS(rootNode);
+		timer.Stop();
+		timings.Bake = timer.TotalTime();
 
 		// Process skeleton hierarchy.
+		timer.Reset();
 		std::vector<JointInfo> skeletonInfo;
 		for (int childIndex = 0; childIndex < rootNode->GetChildCount(); ++childIndex)
 		{
@@ -154,64 +285,48 @@ namespace handwork
 			ProcessSkeletonHierarchyRecursively(currNode, 0, -1, skeletonInfo);
 		}
 
-		// Eliminate skeleton.
+		// Eliminate skeleton, the cluster of each joint is kept next to it.
+		JointIndexMap jointIndices;
+		BuildJointIndexMap(skeletonInfo, jointIndices);
+		std::vector<FbxCluster*> jointClusters(skeletonInfo.size(), nullptr);
 		for (int childIndex = 0; childIndex < rootNode->GetChildCount(); ++childIndex)
 		{
 			FbxNode* currNode = rootNode->GetChild(childIndex);
-			ProcessSkeletonEliminationRecursively(currNode, skeletonInfo);
+			ProcessSkeletonEliminationRecursively(currNode, skeletonInfo, jointClusters, jointIndices);
 		}
-		std::vector<int> newPos(skeletonInfo.size(), -1);
-		std::vector<JointInfo> temp;
-		for (int i = 0; i < (int)skeletonInfo.size(); ++i)
-		{
-			auto& item = skeletonInfo[i];
-			if (item.Parent >= 0 && !skeletonInfo[item.Parent].Valid)
-				item.Valid = false;
-			if (!item.Valid)
-				continue;
 
-			newPos[i] = (int)temp.size();
-			if (item.Parent < 0)
-				temp.push_back(item);
-			else
-			{
-				item.Parent = newPos[item.Parent];
-				CHECK_GE(item.Parent, 0);
-				temp.push_back(item);
-			}
+		// Compact valid joints in place, new positions never exceed old ones so the clusters
+		// can follow in the same order.
+		std::vector<int> newPos;
+		int validCount = CompactJoints(skeletonInfo, newPos);
+		for (int i = 0; i < (int)newPos.size(); ++i)
+		{
+			if (newPos[i] >= 0)
+				jointClusters[newPos[i]] = jointClusters[i];
 		}
-		skeletonInfo.clear();
-		skeletonInfo = temp;
+		jointClusters.resize(validCount);
+		BuildJointIndexMap(skeletonInfo, jointIndices);
 
 		// Get joint translation, rotation and scale.
-		for(auto& item : skeletonInfo)
+		for (int i = 0; i < validCount; ++i)
 		{
-			FbxNode* linkNode = item.Cluster->GetLink();
+			auto& item = skeletonInfo[i];
+			FbxNode* linkNode = jointClusters[i]->GetLink();
 			item.Translation = ConvertToVector3f(linkNode->LclTranslation.Get());
 			item.Rotation = ConvertToVector3f(linkNode->LclRotation.Get());
 			item.Scaling = ConvertToVector3f(linkNode->LclScaling.Get());
 		}
+		timer.Stop();
+		timings.Skeleton = timer.TotalTime();
 		LOG(INFO) << StringPrintf("Read joint number %d", skeletonInfo.size());
 
-		// Process nodes
-		std::vector<MeshVI*> meshVICache;
+		// Process nodes, every mesh is emitted and released as soon as it is read.
 		for (int i = 0; i < rootNode->GetChildCount(); i++)
-			ProcessNode(rootNode->GetChild(i), skeletonInfo, meshVICache);
+			ProcessNode(rootNode->GetChild(i), skeletonInfo, jointIndices, onMesh, splitSeams, timings);
 		
 		// Destroy the SDK manager and all the other objects it was handling.
 		sdkManager->Destroy();
 
-		// Pack mesh vertices and indices.
-		PackVI(meshVICache, meshVertices, meshIndices);
-		LOG(INFO) << StringPrintf("Read vertex number %d", meshVertices.size());
-		LOG(INFO) << StringPrintf("Read triangle face number %d", meshIndices.size() / 3);
-
-
-		// Free memory
-		for (int i = 0; i < (int)meshVICache.size(); ++i)
-			delete meshVICache[i];
-		meshVICache.clear();
-
 		// Pack skeleton data
 		skeleton.resize(skeletonInfo.size());
 		for (int i = 0; i < (int)skeletonInfo.size(); ++i)
@@ -224,6 +339,10 @@ namespace handwork
 			skeleton[i].Scaling = skeletonInfo[i].Scaling;
 		}
 
+		LOG(INFO) << StringPrintf("Import time in seconds. Load: %f, triangulate: %f, bake: %f, skeleton: %f, "
+			"position: %f, index: %f, normal: %f, tangent: %f, uv: %f, joint: %f, split: %f, emit: %f.",
+			timings.Load, timings.Triangulate, timings.Bake, timings.Skeleton, timings.Position,
+			timings.Index, timings.Normal, timings.Tangent, timings.UV, timings.Joint, timings.Split, timings.Emit);
 		LOG(INFO) << "Finish Import fbx mesh.";
 		
 		return true;
@@ -303,7 +422,8 @@ namespace handwork
 		}
 	}
 
-	void ProcessSkeletonEliminationRecursively(FbxNode* node, std::vector<JointInfo>& skeletonInfo)
+	void ProcessSkeletonEliminationRecursively(FbxNode* node, std::vector<JointInfo>& skeletonInfo,
+		std::vector<FbxCluster*>& jointClusters, const JointIndexMap& jointIndices)
 	{
 		if (node->GetNodeAttribute() && node->GetNodeAttribute()->GetAttributeType() && node->GetNodeAttribute()->GetAttributeType() == FbxNodeAttribute::eMesh)
 		{
@@ -321,31 +441,31 @@ namespace handwork
 				{
 					FbxCluster* cluster = skin->GetCluster(clusterIndex);
 					std::string jointName = cluster->GetLink()->GetName();
-					int jointIndex = FindJoint(jointName, skeletonInfo);
+					int jointIndex = FindJoint(jointName, jointIndices);
 					if (jointIndex < 0)
 					{
 						Warning("JointInfo name not found in skeleton in mesh %s", node->GetName());
 						continue;
 					}
-					skeletonInfo[jointIndex].Cluster = cluster;
+					jointClusters[jointIndex] = cluster;
 					skeletonInfo[jointIndex].Valid = true;
 				}
 			}
 		}
 		for (int i = 0; i < node->GetChildCount(); i++)
 		{
-			ProcessSkeletonEliminationRecursively(node->GetChild(i), skeletonInfo);
+			ProcessSkeletonEliminationRecursively(node->GetChild(i), skeletonInfo, jointClusters, jointIndices);
 		}
 	}
 
-	void ProcessNode(FbxNode* node, std::vector<JointInfo>& skeletonInfo, std::vector<MeshVI*>& meshVICache)
+	void ProcessNode(FbxNode* node, std::vector<JointInfo>& skeletonInfo, const JointIndexMap& jointIndices, const MeshChunkCallback& onMesh, bool splitSeams, ImportTimings& timings)
 	{
 		if (node->GetNodeAttribute())
 		{
 			switch (node->GetNodeAttribute()->GetAttributeType())
 			{
 			case FbxNodeAttribute::eMesh:
-				ProcessMesh(node, skeletonInfo, meshVICache);
+				ProcessMesh(node, skeletonInfo, jointIndices, onMesh, splitSeams, timings);
 				break;
 			default:
 				break;
@@ -354,11 +474,11 @@ namespace handwork
 
 		for (int i = 0; i < node->GetChildCount(); ++i)
 		{
-			ProcessNode(node->GetChild(i), skeletonInfo, meshVICache);
+			ProcessNode(node->GetChild(i), skeletonInfo, jointIndices, onMesh, splitSeams, timings);
 		}
 	}
 
-	void ProcessMesh(FbxNode* node, std::vector<JointInfo>& skeletonInfo, std::vector<MeshVI*>& meshVICache)
+	void ProcessMesh(FbxNode* node, std::vector<JointInfo>& skeletonInfo, const JointIndexMap& jointIndices, const MeshChunkCallback& onMesh, bool splitSeams, ImportTimings& timings)
 	{
 		FbxMesh* mesh = node->GetMesh();
 		if (mesh == nullptr)
@@ -373,26 +493,89 @@ namespace handwork
 		auto tf = node->EvaluateGlobalTransform(FbxTime(0.0f), FbxNode::eDestinationPivot);
 		Transform world(ConvertToMatrix4X4(tf));
 
-		// Load material
-		MeshVI* currentVI = new MeshVI();
-		auto& vertices = currentVI->Vertices;
-		auto& indices = currentVI->Indices;
-		vertices.resize(controlPointsCount);
-		indices.reserve(triangleCount * 3);
+		// Control point vertices and the control point of each polygon vertex.
+		std::vector<MeshVertex> vertices(controlPointsCount);
+		std::vector<int> corners;
+		corners.reserve(triangleCount * 3);
 
-		// Read positions, indices, normals and tangents
+		// Read positions, indices, normals, tangents and uvs. When splitting seams the attributes
+		// are kept per polygon vertex, otherwise they are resolved to control points.
+		rendering::GameTimer timer;
+		timer.Reset();
 		ReadPosition(mesh, vertices, world);
-		ReadIndex(mesh, indices);
-		ReadNormal(mesh, vertices, world, true);
-		ReadTangent(mesh, vertices, world, true);
+		timer.Stop();
+		timings.Position += timer.TotalTime();
+
+		timer.Reset();
+		ReadIndex(mesh, corners);
+		timer.Stop();
+		timings.Index += timer.TotalTime();
+
+		std::vector<Vector3f> normals;
+		timer.Reset();
+		ReadNormal(mesh, world, splitSeams, normals, true);
+		timer.Stop();
+		timings.Normal += timer.TotalTime();
+
+		std::vector<Vector3f> tangents;
+		timer.Reset();
+		ReadTangent(mesh, world, splitSeams, tangents, true);
+		timer.Stop();
+		timings.Tangent += timer.TotalTime();
+
+		std::vector<Vector2f> uvs;
+		timer.Reset();
+		ReadUV(mesh, splitSeams, uvs);
+		timer.Stop();
+		timings.UV += timer.TotalTime();
 		
 		// Process joint information
-		ProcessJoints(node, vertices, skeletonInfo);
+		timer.Reset();
+		ProcessJoints(node, vertices, skeletonInfo, jointIndices);
+		timer.Stop();
+		timings.Joint += timer.TotalTime();
+
+		MeshChunk chunk;
+		chunk.Name = node->GetName();
+		chunk.ControlPointCount = controlPointsCount;
+		if (splitSeams)
+		{
+			timer.Reset();
+			SplitSeams(vertices, corners, normals, tangents, uvs, chunk);
+			timer.Stop();
+			timings.Split += timer.TotalTime();
+		}
+		else
+		{
+			for (int i = 0; i < (int)normals.size(); ++i)
+				vertices[i].Normal = normals[i];
+			for (int i = 0; i < (int)tangents.size(); ++i)
+				vertices[i].Tangent = tangents[i];
+			for (int i = 0; i < (int)uvs.size(); ++i)
+				vertices[i].UV = uvs[i];
+			chunk.Vertices = std::move(vertices);
+			chunk.Indices = std::move(corners);
+		}
 
-		meshVICache.push_back(currentVI);
+		// Release the intermediate data before handing the mesh out.
+		vertices = std::vector<MeshVertex>();
+		corners = std::vector<int>();
+		normals = std::vector<Vector3f>();
+		tangents = std::vector<Vector3f>();
+		uvs = std::vector<Vector2f>();
+
+		timer.Reset();
+		onMesh(chunk);
+		timer.Stop();
+		timings.Emit += timer.TotalTime();
+
+		// The SDK copy is not needed anymore, unless the mesh is instanced by other nodes. The skin
+		// and its clusters are separate objects, so the skeleton is not affected.
+		if (mesh->GetNodeCount() <= 1)
+			mesh->Destroy();
 	}
 
-	void ProcessJoints(FbxNode* node, std::vector<MeshVertex>& vertices, std::vector<JointInfo>& skeletonInfo)
+	void ProcessJoints(FbxNode* node, std::vector<MeshVertex>& vertices, std::vector<JointInfo>& skeletonInfo, const JointIndexMap& jointIndices)
 	{
 		FbxMesh* mesh = node->GetMesh();
 		int deformerNum = mesh->GetDeformerCount();
@@ -409,7 +592,7 @@ namespace handwork
 			{
 				FbxCluster* cluster = skin->GetCluster(clusterIndex);
 				std::string jointName = cluster->GetLink()->GetName();
-				int jointIndex = FindJoint(jointName, skeletonInfo);
+				int jointIndex = FindJoint(jointName, jointIndices);
 				if (jointIndex < 0)
 				{
 					Warning("Valid joint name not found in skeleton for mesh %s", node->GetName());
@@ -447,226 +630,331 @@ namespace handwork
 		}
 	}
 
-	void PackVI(std::vector<MeshVI*>& meshVICache, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
+	void ReadPosition(FbxMesh* mesh, std::vector<MeshVertex>& vertices, const Transform& world)
 	{
-		int meshNum = (int)meshVICache.size();
-		if (meshNum == 0)
-			return;
+		int controlPointsCount = mesh->GetControlPointsCount();
+		std::vector<Vector3f> positions(controlPointsCount);
+		ConvertToVector3f(mesh->GetControlPoints(), controlPointsCount, positions.data());
+		world.TransformArray(positions.data(), controlPointsCount, VectorType::Point);
 
-		// Process single subset MeshVI
-		int offset = 0;
-		for (int i = 0; i < meshNum; ++i)
-		{
-			auto& currentVertices = meshVICache[i]->Vertices;
-			auto& currentIndices = meshVICache[i]->Indices;
+		for (int i = 0; i < controlPointsCount; ++i)
+			vertices[i].Position = positions[i];
+	}
 
-			meshVertices.insert(meshVertices.end(), currentVertices.begin(), currentVertices.end());
-			std::transform(currentIndices.begin(), currentIndices.end(), currentIndices.begin(),
-				[offset](int a) { return a + offset; });
-			meshIndices.insert(meshIndices.end(), currentIndices.begin(), currentIndices.end());
-			
-			offset += (int)currentVertices.size();
-		}
+	void ReadIndex(FbxMesh* mesh, std::vector<int>& indices)
+	{
+		const int* polygonVertices = mesh->GetPolygonVertices();
+		int polygonVertexCount = mesh->GetPolygonVertexCount();
+		indices.assign(polygonVertices, polygonVertices + polygonVertexCount);
 	}
 
-	void ReadPosition(FbxMesh* mesh, std::vector<MeshVertex>& vertices, const Transform& world)
+	template <typename FbxType, typename T>
+	bool ReadElement(FbxMesh* mesh, FbxLayerElementTemplate<FbxType>* element, const char* elementName, bool perCorner, std::vector<T>& values)
 	{
-		FbxVector4* pCtrlPoint = mesh->GetControlPoints();
 		int controlPointsCount = mesh->GetControlPointsCount();
+		int polygonVertexCount = mesh->GetPolygonVertexCount();
 
-		for (int i = 0; i < controlPointsCount; ++i)
+		// Number of elements in the mapped array.
+		int mappedCount = 0;
+		switch (element->GetMappingMode())
 		{
-			vertices[i].Position.x = (float)pCtrlPoint[i][0];
-			vertices[i].Position.y = (float)pCtrlPoint[i][1];
-			vertices[i].Position.z = (float)pCtrlPoint[i][2];
-			vertices[i].Position = world(vertices[i].Position, VectorType::Point);
+		case FbxGeometryElement::eByControlPoint:
+			mappedCount = controlPointsCount;
+			break;
+		case FbxGeometryElement::eByPolygonVertex:
+			mappedCount = polygonVertexCount;
+			break;
+		default:
+			Warning("Unsupport %s mapping mode for mesh %s", elementName, mesh->GetName());
+			return false;
 		}
-	}
-
-	void ReadIndex(FbxMesh* mesh, std::vector<int>& indices)
-	{
-		int triangleCount = mesh->GetPolygonCount();
 
-		for (int i = 0; i < triangleCount; ++i)
-			for (int j = 0; j < 3; j++)
+		// Resolve the reference mode into one value per mapped element.
+		std::vector<T> mapped(mappedCount);
+		auto& directArray = element->GetDirectArray();
+		FbxLayerElementArrayReadLock<FbxType> directLock(directArray);
+		const FbxType* direct = directLock.GetData();
+		switch (element->GetReferenceMode())
+		{
+		case FbxGeometryElement::eDirect:
+			if (directArray.GetCount() < mappedCount)
 			{
-				int ctrlPointIndex = mesh->GetPolygonVertex(i, j);
-				indices.push_back(ctrlPointIndex);
+				Warning("Invalid %s direct array for mesh %s", elementName, mesh->GetName());
+				return false;
 			}
+			ConvertElementArray(direct, mappedCount, mapped.data());
+			break;
+		case FbxGeometryElement::eIndexToDirect:
+		{
+			auto& indexArray = element->GetIndexArray();
+			if (indexArray.GetCount() < mappedCount)
+			{
+				Warning("Invalid %s index array for mesh %s", elementName, mesh->GetName());
+				return false;
+			}
+			FbxLayerElementArrayReadLock<int> indexLock(indexArray);
+			GatherElementArray(direct, indexLock.GetData(), mappedCount, mapped.data());
+		}
+		break;
+		default:
+			Warning("Unsupport %s reference mode for mesh %s", elementName, mesh->GetName());
+			return false;
+		}
+
+		bool byControlPoint = element->GetMappingMode() == FbxGeometryElement::eByControlPoint;
+		if (byControlPoint != perCorner)
+		{
+			values = std::move(mapped);
+			return true;
+		}
+
+		const int* polygonVertices = mesh->GetPolygonVertices();
+		if (perCorner)
+		{
+			// Expand control point values to every polygon vertex.
+			values.resize(polygonVertexCount);
+			for (int i = 0; i < polygonVertexCount; ++i)
+				values[i] = mapped[polygonVertices[i]];
+			return true;
+		}
+
+		// Scatter polygon vertex values to their control points, the last polygon vertex wins.
+		values.assign(controlPointsCount, T());
+		for (int i = 0; i < polygonVertexCount; ++i)
+			values[polygonVertices[i]] = mapped[i];
+		return true;
 	}
 
-	void ReadNormal(FbxMesh* mesh, std::vector<MeshVertex>& vertices, const Transform& world, bool reGenerate)
+	bool ReadNormal(FbxMesh* mesh, const Transform& world, bool perCorner, std::vector<Vector3f>& normals, bool reGenerate)
 	{
 		if (mesh->GetElementNormalCount() < 1)
 		{
 			Warning("Lack Normal in mesh %s", mesh->GetName());
 			if (!reGenerate)
-				return;
+				return false;
 			if (!mesh->GenerateNormals())
 			{
 				Warning("Regenerate normal failed for mesh %s", mesh->GetName());
-				return;
+				return false;
 			}
 		}
 
-		FbxGeometryElementNormal* leNormal = mesh->GetElementNormal(0);
-		int controlPointsCount = mesh->GetControlPointsCount();
-		int triangleCount = mesh->GetPolygonCount();
-		int vertexCounter = 0;
+		if (!ReadElement(mesh, mesh->GetElementNormal(0), "normal", perCorner, normals))
+			return false;
+		world.TransformArray(normals.data(), (int)normals.size(), VectorType::Normal);
+		return true;
+	}
 
-		switch (leNormal->GetMappingMode())
+	bool ReadTangent(FbxMesh* mesh, const Transform& world, bool perCorner, std::vector<Vector3f>& tangents, bool reGenerate)
+	{
+		if (mesh->GetElementTangentCount() < 1)
 		{
-		case FbxGeometryElement::eByControlPoint:
-			switch (leNormal->GetReferenceMode())
+			Warning("Lack Tangent in mesh %s", mesh->GetName());
+			if (!reGenerate)
+				return false;
+			if (!mesh->GenerateTangentsDataForAllUVSets())
 			{
-			case FbxGeometryElement::eDirect:
-				for (int i = 0; i < controlPointsCount; ++i)
-				{
-					vertices[i].Normal.x = (float)leNormal->GetDirectArray()[i][0];
-					vertices[i].Normal.y = (float)leNormal->GetDirectArray()[i][1];
-					vertices[i].Normal.z = (float)leNormal->GetDirectArray()[i][2];
-					vertices[i].Normal = world(vertices[i].Normal, VectorType::Normal);
-				}
-				break;
-			case FbxGeometryElement::eIndexToDirect:
-				for (int i = 0; i < controlPointsCount; ++i)
-				{
-					int id = leNormal->GetIndexArray()[i];
-					vertices[i].Normal.x = (float)leNormal->GetDirectArray()[id][0];
-					vertices[i].Normal.y = (float)leNormal->GetDirectArray()[id][1];
-					vertices[i].Normal.z = (float)leNormal->GetDirectArray()[id][2];
-					vertices[i].Normal = world(vertices[i].Normal, VectorType::Normal);
-				}
-				break;
-			default:
-				Warning("Unsupport normal reference mode for mesh %s", mesh->GetName());
+				Warning("Regenerate tangent failed for mesh %s", mesh->GetName());
+				return false;
 			}
-			break;
+		}
 
-		case FbxGeometryElement::eByPolygonVertex:
+		if (!ReadElement(mesh, mesh->GetElementTangent(0), "tangent", perCorner, tangents))
+			return false;
+		world.TransformArray(tangents.data(), (int)tangents.size(), VectorType::Vector);
+		return true;
+	}
+
+	bool ReadUV(FbxMesh* mesh, bool perCorner, std::vector<Vector2f>& uvs)
+	{
+		if (mesh->GetElementUVCount() < 1)
 		{
-			switch (leNormal->GetReferenceMode())
-			{
-			case FbxGeometryElement::eDirect:
-				for (int i = 0; i < triangleCount; ++i)
-					for (int j = 0; j < 3; j++)
-					{
-						int ctrlPointIndex = mesh->GetPolygonVertex(i, j);
-						vertices[ctrlPointIndex].Normal.x = (float)leNormal->GetDirectArray()[vertexCounter][0];
-						vertices[ctrlPointIndex].Normal.y = (float)leNormal->GetDirectArray()[vertexCounter][1];
-						vertices[ctrlPointIndex].Normal.z = (float)leNormal->GetDirectArray()[vertexCounter][2];
-						vertices[ctrlPointIndex].Normal = world(vertices[ctrlPointIndex].Normal, VectorType::Normal);
-						++vertexCounter;
-					}
-				break;
-			case FbxGeometryElement::eIndexToDirect:
-				for (int i = 0; i < triangleCount; ++i)
-					for (int j = 0; j < 3; j++)
-					{
-						int ctrlPointIndex = mesh->GetPolygonVertex(i, j);
-						int id = leNormal->GetIndexArray()[vertexCounter];
-						vertices[ctrlPointIndex].Normal.x = (float)leNormal->GetDirectArray()[id][0];
-						vertices[ctrlPointIndex].Normal.y = (float)leNormal->GetDirectArray()[id][1];
-						vertices[ctrlPointIndex].Normal.z = (float)leNormal->GetDirectArray()[id][2];
-						vertices[ctrlPointIndex].Normal = world(vertices[ctrlPointIndex].Normal, VectorType::Normal);
-						++vertexCounter;
-					}
-				break;
-			default:
-				Warning("Unsupport normal reference mode for mesh %s", mesh->GetName());
-			}
+			Warning("Lack UV in mesh %s", mesh->GetName());
+			return false;
 		}
-		break;
 
-		default:
-			Warning("Unsupport normal mapping mode for mesh %s", mesh->GetName());
+		return ReadElement(mesh, mesh->GetElementUV(0), "uv", perCorner, uvs);
+	}
+
+	// Attributes of one polygon vertex which decide whether two corners of the same control point
+	// can share a vertex. Compared bitwise, so only exactly equal values are welded.
+	struct CornerKey
+	{
+		Vector3f Normal;
+		Vector3f Tangent;
+		Vector2f UV;
+	};
+	static_assert(sizeof(CornerKey) == 8 * sizeof(float), "CornerKey must not have padding.");
+
+	inline uint64_t HashCornerKey(const CornerKey& key)
+	{
+		// FNV-1a over the raw 32 bit words.
+		const uint32_t* words = reinterpret_cast<const uint32_t*>(&key);
+		uint64_t hash = 14695981039346656037ull;
+		for (int i = 0; i < 8; ++i)
+		{
+			hash ^= words[i];
+			hash *= 1099511628211ull;
 		}
+		return hash;
 	}
 
-	void ReadTangent(FbxMesh* mesh, std::vector<MeshVertex>& vertices, const Transform& world, bool reGenerate)
+	// Split control points into one vertex per unique (control point, normal, tangent, uv) tuple.
+	// Polygon vertices are bucketed by control point with a parallel counting sort. The corners of each
+	// bucket are then deduplicated in an open addressing table of their own, in expected linear time,
+	// and the buckets are processed in parallel. Buckets of a few corners are scanned instead. Output
+	// vertices stay ordered by control point, and inside a control point by the first corner using
+	// them.
+	void SplitSeams(const std::vector<MeshVertex>& controlPointVertices, const std::vector<int>& corners,
+		const std::vector<Vector3f>& normals, const std::vector<Vector3f>& tangents, const std::vector<Vector2f>& uvs, MeshChunk& result)
 	{
-		if (mesh->GetElementTangentCount() < 1)
+		int controlPointsCount = (int)controlPointVertices.size();
+		int cornerCount = (int)corners.size();
+		bool hasNormal = (int)normals.size() == cornerCount;
+		bool hasTangent = (int)tangents.size() == cornerCount;
+		bool hasUV = (int)uvs.size() == cornerCount;
+		const int chunkSize = 4096;
+
+		// Build corner keys and their hashes.
+		std::vector<CornerKey> keys(cornerCount);
+		std::vector<uint64_t> hashes(cornerCount);
+		ParallelForRange([&](int64_t begin, int64_t end)
 		{
-			Warning("Lack Tangent in mesh %s", mesh->GetName());
-			if (!reGenerate)
-				return;
-			if (!mesh->GenerateTangentsDataForAllUVSets())
+			for (int64_t i = begin; i < end; ++i)
 			{
-				Warning("Regenerate tangent failed for mesh %s", mesh->GetName());
-				return;
+				CornerKey& key = keys[i];
+				key.Normal = hasNormal ? normals[i] : Vector3f(0, 0, 0);
+				key.Tangent = hasTangent ? tangents[i] : Vector3f(0, 0, 0);
+				key.UV = hasUV ? uvs[i] : Vector2f(0, 0);
+				hashes[i] = HashCornerKey(key);
 			}
-		}
+		}, cornerCount, chunkSize);
 
-		FbxGeometryElementTangent* leTangent = mesh->GetElementTangent(0);
-		int controlPointsCount = mesh->GetControlPointsCount();
-		int triangleCount = mesh->GetPolygonCount();
-		int vertexCounter = 0;
+		// Counting sort corners by control point. The scatter claims slots with atomic cursors, so the
+		// order inside a bucket is restored before the dedup.
+		std::vector<int> bucketStart(controlPointsCount + 1, 0);
+		std::vector<int> sorted(cornerCount);
+		{
+			std::vector<std::atomic<int>> counts(controlPointsCount);
+			ParallelForRange([&](int64_t begin, int64_t end)
+			{
+				for (int64_t i = begin; i < end; ++i)
+					counts[corners[i]].fetch_add(1, std::memory_order_relaxed);
+			}, cornerCount, chunkSize);
+			ParallelForRange([&](int64_t begin, int64_t end)
+			{
+				for (int64_t cp = begin; cp < end; ++cp)
+					bucketStart[cp + 1] = counts[cp].load(std::memory_order_relaxed);
+			}, controlPointsCount, chunkSize);
+			ParallelPrefixSum(bucketStart.data() + 1, controlPointsCount, chunkSize);
+			ParallelForRange([&](int64_t begin, int64_t end)
+			{
+				for (int64_t cp = begin; cp < end; ++cp)
+					counts[cp].store(bucketStart[cp], std::memory_order_relaxed);
+			}, controlPointsCount, chunkSize);
+			ParallelForRange([&](int64_t begin, int64_t end)
+			{
+				for (int64_t i = begin; i < end; ++i)
+					sorted[counts[corners[i]].fetch_add(1, std::memory_order_relaxed)] = (int)i;
+			}, cornerCount, chunkSize);
+		}
 
-		switch (leTangent->GetMappingMode())
+		// Dedup inside each bucket. localId is the index of the unique tuple inside its bucket and
+		// representative marks the first corner of every unique tuple.
+		std::vector<int> localId(cornerCount);
+		std::vector<uint8_t> representative(cornerCount, 0);
+		std::vector<int> uniqueCount(controlPointsCount + 1, 0);
+		auto sameCorner = [&keys, &hashes](int a, int b)
 		{
-		case FbxGeometryElement::eByControlPoint:
-			switch (leTangent->GetReferenceMode())
+			return hashes[a] == hashes[b] && memcmp(&keys[a], &keys[b], sizeof(CornerKey)) == 0;
+		};
+		ParallelForRange([&](int64_t begin, int64_t end)
+		{
+			// Buckets of up to MaxScanBucket corners are searched linearly, larger ones through a table
+			// of slots holding indices into uniques, -1 when empty. The table is at most half full.
+			const int MaxScanBucket = 8;
+			std::vector<int> slots;
+			std::vector<int> uniques;
+			for (int64_t cp = begin; cp < end; ++cp)
 			{
-			case FbxGeometryElement::eDirect:
-				for (int i = 0; i < controlPointsCount; ++i)
+				int* bucket = sorted.data() + bucketStart[cp];
+				int size = bucketStart[cp + 1] - bucketStart[cp];
+				std::sort(bucket, bucket + size);
+				bool useTable = size > MaxScanBucket;
+				uint32_t mask = 0;
+				if (useTable)
 				{
-					vertices[i].Tangent.x = (float)leTangent->GetDirectArray()[i][0];
-					vertices[i].Tangent.y = (float)leTangent->GetDirectArray()[i][1];
-					vertices[i].Tangent.z = (float)leTangent->GetDirectArray()[i][2];
-					vertices[i].Tangent = world(vertices[i].Tangent, VectorType::Vector);
+					mask = (uint32_t)RoundUpPow2(2 * size) - 1;
+					slots.assign(mask + 1, -1);
 				}
-				break;
-			case FbxGeometryElement::eIndexToDirect:
-				for (int i = 0; i < controlPointsCount; ++i)
+				uniques.clear();
+				for (int s = 0; s < size; ++s)
 				{
-					int id = leTangent->GetIndexArray()[i];
-					vertices[i].Tangent.x = (float)leTangent->GetDirectArray()[id][0];
-					vertices[i].Tangent.y = (float)leTangent->GetDirectArray()[id][1];
-					vertices[i].Tangent.z = (float)leTangent->GetDirectArray()[id][2];
-					vertices[i].Tangent = world(vertices[i].Tangent, VectorType::Vector);
-				}
-				break;
-			default:
-				Warning("Unsupport tangent reference mode for mesh %s", mesh->GetName());
-			}
-			break;
-
-		case FbxGeometryElement::eByPolygonVertex:
-			switch (leTangent->GetReferenceMode())
-			{
-			case FbxGeometryElement::eDirect:
-				for (int i = 0; i < triangleCount; ++i)
-					for (int j = 0; j < 3; j++)
+					int c = bucket[s];
+					int id = -1;
+					uint32_t slot = 0;
+					if (useTable)
 					{
-						int ctrlPointIndex = mesh->GetPolygonVertex(i, j);
-						vertices[ctrlPointIndex].Tangent.x = (float)leTangent->GetDirectArray()[vertexCounter][0];
-						vertices[ctrlPointIndex].Tangent.y = (float)leTangent->GetDirectArray()[vertexCounter][1];
-						vertices[ctrlPointIndex].Tangent.z = (float)leTangent->GetDirectArray()[vertexCounter][2];
-						vertices[ctrlPointIndex].Tangent = world(vertices[ctrlPointIndex].Tangent, VectorType::Vector);
-						++vertexCounter;
+						// The low bits of FNV-1a only depend on the low bits of the words, which are zero
+						// for floats of few significant bits, so probe with the high ones.
+						for (slot = (uint32_t)(hashes[c] >> 32) & mask; slots[slot] >= 0; slot = (slot + 1) & mask)
+						{
+							if (sameCorner(uniques[slots[slot]], c))
+							{
+								id = slots[slot];
+								break;
+							}
+						}
 					}
-				break;
-			case FbxGeometryElement::eIndexToDirect:
-				for (int i = 0; i < triangleCount; ++i)
-					for (int j = 0; j < 3; j++)
+					else
 					{
-						int ctrlPointIndex = mesh->GetPolygonVertex(i, j);
-						int id = leTangent->GetIndexArray()[vertexCounter];
-						vertices[ctrlPointIndex].Tangent.x = (float)leTangent->GetDirectArray()[id][0];
-						vertices[ctrlPointIndex].Tangent.y = (float)leTangent->GetDirectArray()[id][1];
-						vertices[ctrlPointIndex].Tangent.z = (float)leTangent->GetDirectArray()[id][2];
-						vertices[ctrlPointIndex].Tangent = world(vertices[ctrlPointIndex].Tangent, VectorType::Vector);
-						++vertexCounter;
+						for (int u = 0; u < (int)uniques.size() && id < 0; ++u)
+							id = sameCorner(uniques[u], c) ? u : -1;
 					}
-				break;
-			default:
-				Warning("Unsupport tangent reference mode for mesh %s", mesh->GetName());
+					if (id < 0)
+					{
+						id = (int)uniques.size();
+						uniques.push_back(c);
+						representative[c] = 1;
+						if (useTable)
+							slots[slot] = id;
+					}
+					localId[c] = id;
+				}
+				uniqueCount[cp + 1] = (int)uniques.size();
 			}
-			break;
-
-		default:
-			Warning("Unsupport tangent mapping mode for mesh %s", mesh->GetName());
-		}
+		}, controlPointsCount, chunkSize);
+
+		// Vertex base of each control point.
+		ParallelPrefixSum(uniqueCount.data() + 1, controlPointsCount, chunkSize);
+		const std::vector<int>& vertexBase = uniqueCount;
+		int vertexCount = vertexBase[controlPointsCount];
+
+		// Emit vertices, the remap to control points and the new index buffer.
+		auto& vertices = result.Vertices;
+		auto& indices = result.Indices;
+		auto& controlPoints = result.ControlPoints;
+		vertices.resize(vertexCount);
+		indices.resize(cornerCount);
+		controlPoints.resize(vertexCount);
+		ParallelForRange([&](int64_t begin, int64_t end)
+		{
+			for (int64_t i = begin; i < end; ++i)
+			{
+				int cp = corners[i];
+				int v = vertexBase[cp] + localId[i];
+				indices[i] = v;
+				if (!representative[i])
+					continue;
+				MeshVertex& vertex = vertices[v];
+				vertex.Position = controlPointVertices[cp].Position;
+				vertex.Normal = keys[i].Normal;
+				vertex.Tangent = keys[i].Tangent;
+				vertex.UV = keys[i].UV;
+				vertex.BlendInfo = controlPointVertices[cp].BlendInfo;
+				controlPoints[v] = cp;
+			}
+		}, cornerCount, chunkSize);
 	}
 
-}	// namespace handwork
\ No newline at end of file
+}	// namespace handwork
@@ -5,52 +5,46 @@
 #include "../utility/utility.h"
 #include "../utility/transform.h"
 #include "../utility/geometry.h"
+#include "meshvertex.h"
+#include <functional>
 
 namespace handwork
 {
-	struct MeshJoint
+	// One mesh of a streamed import. The callback owns the data and may move it out.
+	struct MeshChunk
 	{
-		MeshJoint() : Parent(-1) {}
-		MeshJoint(std::string name, int parent, Matrix4x4 m)
-			: Name(name), Parent(parent), GlobalBindposeInverse(m) {}
-
 		std::string Name;
-		int Parent;
-		Matrix4x4 GlobalBindposeInverse;	// Transform matrix from mesh space to bone space
-		// The transformation order is TRzRyRxS*v.
-		Vector3f Translation;	// Local translation matrix
-		Vector3f Scaling;		// Local scaling matrix 
-		Vector3f Rotation;		// Local 3 axis rotation in degree
-	};
-
-	struct MeshBlendPair
-	{
-		MeshBlendPair() : Index(-1), Weight(-1.0f) {}
-		MeshBlendPair(int index, float weight) 
-			: Index(index), Weight(weight) {}
-
-		int Index;
-		float Weight;
+		std::vector<MeshVertex> Vertices;
+		std::vector<int> Indices;			// Local to Vertices.
+		std::vector<int> ControlPoints;		// Control point of each vertex, only filled when splitting seams.
+		int ControlPointCount = 0;
 	};
 
-	struct MeshVertex
-	{
-		MeshVertex() : Position(0, 0, 0), Normal(0, 0, 0), Tangent(0, 0, 0)
-		{
-			BlendInfo.reserve(4);
-		}
-
-		Vector3f Position;
-		Vector3f Normal;
-		Vector3f Tangent;
-		std::vector<MeshBlendPair> BlendInfo;
-	};
+	typedef std::function<void(MeshChunk& chunk)> MeshChunkCallback;
 
 	bool ImportFbx(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
 		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
 
 	bool ImportFbx(const std::string& filename, float& fileScale, std::vector<MeshJoint>& skeleton,
 		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+
+	// Import with vertices split along hard edges and UV seams. Each unique (control point, normal,
+	// tangent, uv) tuple becomes one vertex. controlPoints maps every vertex back to its control point,
+	// so controlPoints[meshIndices[i]] gives the welded index buffer for topology and subdivision.
+	bool ImportFbx(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, std::vector<int>& controlPoints);
+
+	bool ImportFbx(const std::string& filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, std::vector<int>& controlPoints);
+
+	// Streaming import. Every mesh is handed to onMesh as soon as it is read and its SDK data is
+	// released right after, so at most one mesh of intermediate data is alive at any time. The
+	// bind poses come from the skin clusters, so skeleton is only complete once the call returns.
+	bool ImportFbx(const char* filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		const MeshChunkCallback& onMesh, bool splitSeams = false);
+
+	bool ImportFbx(const std::string& filename, float& fileScale, std::vector<MeshJoint>& skeleton,
+		const MeshChunkCallback& onMesh, bool splitSeams = false);
 		
 }	// namespace dhandwork
 
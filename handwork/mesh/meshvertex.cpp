@@ -0,0 +1,36 @@
+// Mesh vertex and skeleton data shared by the mesh importers.
+
+#include "meshvertex.h"
+#include "../utility/parallel.h"
+
+namespace handwork
+{
+	void ComputeVertexNormals(std::vector<MeshVertex>& meshVertices, const std::vector<int>& meshIndices)
+	{
+		for (auto& vertex : meshVertices)
+			vertex.Normal = Vector3f(0, 0, 0);
+
+		// The cross product length is twice the triangle area, which gives the weighting for free.
+		for (size_t i = 0; i + 2 < meshIndices.size(); i += 3)
+		{
+			MeshVertex& v0 = meshVertices[meshIndices[i]];
+			MeshVertex& v1 = meshVertices[meshIndices[i + 1]];
+			MeshVertex& v2 = meshVertices[meshIndices[i + 2]];
+			Vector3f n = Cross(v1.Position - v0.Position, v2.Position - v0.Position);
+			v0.Normal += n;
+			v1.Normal += n;
+			v2.Normal += n;
+		}
+
+		ParallelForRange([&](int64_t begin, int64_t end)
+		{
+			for (int64_t i = begin; i < end; ++i)
+			{
+				Vector3f& n = meshVertices[i].Normal;
+				if (n.LengthSquared() > 0)
+					n = Normalize(n);
+			}
+		}, (int64_t)meshVertices.size(), 4096);
+	}
+
+}	// namespace handwork
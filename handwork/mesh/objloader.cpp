@@ -0,0 +1,271 @@
+// Wavefront obj file importer.
+
+#include "objloader.h"
+#include "textparse.h"
+#include "../utility/mappedfile.h"
+#include "../utility/parallel.h"
+#include <chrono>
+
+namespace handwork
+{
+	// Face corner as written in the file. Negative obj indices are relative to the attributes
+	// read so far, they are stored relative to the start of the chunk and flagged, because the
+	// chunk does not know its global offset while parsing.
+	struct ObjCorner
+	{
+		static const int Missing = INT32_MIN;
+		enum { Position = 0, UV = 1, Normal = 2 };
+
+		int Index[3];
+		uint8_t Relative;
+	};
+
+	// Everything parsed from one piece of the file.
+	struct ObjChunk
+	{
+		std::vector<Vector3f> Positions;
+		std::vector<Vector2f> UVs;
+		std::vector<Vector3f> Normals;
+		std::vector<ObjCorner> Corners;	// Three per triangle.
+		int BadLines = 0;
+	};
+
+	// Parse "v", "v/vt", "v//vn" or "v/vt/vn".
+	static bool ParseObjCorner(const char*& p, const char* end, const int* localCounts, ObjCorner& corner)
+	{
+		corner.Relative = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			corner.Index[k] = ObjCorner::Missing;
+			if (k > 0)
+			{
+				if (p >= end || *p != '/')
+					continue;
+				++p;
+			}
+
+			int value;
+			if (!ParseInt(p, end, value))
+			{
+				if (k == 0)
+					return false;
+				continue;
+			}
+			if (value < 0)
+			{
+				corner.Index[k] = localCounts[k] + value;
+				corner.Relative |= 1 << k;
+			}
+			else if (value > 0)
+				corner.Index[k] = value - 1;
+			else
+				return false;
+		}
+		return true;
+	}
+
+	static void ParseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+	{
+		std::vector<ObjCorner> polygon;
+		while (p < end)
+		{
+			SkipLineSpace(p, end);
+			const char* lineEnd = FindLineEnd(p, end);
+			if ((lineEnd - p >= 2 && IsLineSpace(p[1])) || (lineEnd - p >= 3 && IsLineSpace(p[2])))
+			{
+				bool ok = true;
+				if (p[0] == 'v' && IsLineSpace(p[1]))
+				{
+					const char* s = p + 2;
+					Vector3f v;
+					for (int i = 0; i < 3 && ok; ++i)
+					{
+						SkipLineSpace(s, lineEnd);
+						ok = ParseFloat(s, lineEnd, v[i]);
+					}
+					if (ok)
+						chunk.Positions.push_back(v);
+				}
+				else if (p[0] == 'v' && p[1] == 't')
+				{
+					const char* s = p + 3;
+					Vector2f uv(0, 0);
+					SkipLineSpace(s, lineEnd);
+					ok = ParseFloat(s, lineEnd, uv.x);
+					SkipLineSpace(s, lineEnd);
+					ParseFloat(s, lineEnd, uv.y);
+					if (ok)
+						chunk.UVs.push_back(uv);
+				}
+				else if (p[0] == 'v' && p[1] == 'n')
+				{
+					const char* s = p + 3;
+					Vector3f n;
+					for (int i = 0; i < 3 && ok; ++i)
+					{
+						SkipLineSpace(s, lineEnd);
+						ok = ParseFloat(s, lineEnd, n[i]);
+					}
+					if (ok)
+						chunk.Normals.push_back(n);
+				}
+				else if (p[0] == 'f' && IsLineSpace(p[1]))
+				{
+					const char* s = p + 2;
+					int localCounts[3] = { (int)chunk.Positions.size(), (int)chunk.UVs.size(), (int)chunk.Normals.size() };
+					polygon.clear();
+					for (;;)
+					{
+						SkipLineSpace(s, lineEnd);
+						if (s >= lineEnd)
+							break;
+						ObjCorner corner;
+						if (!ParseObjCorner(s, lineEnd, localCounts, corner))
+						{
+							ok = false;
+							break;
+						}
+						polygon.push_back(corner);
+					}
+					ok = ok && polygon.size() >= 3;
+					if (ok)
+					{
+						// Fan triangulation.
+						for (size_t i = 1; i + 1 < polygon.size(); ++i)
+						{
+							chunk.Corners.push_back(polygon[0]);
+							chunk.Corners.push_back(polygon[i]);
+							chunk.Corners.push_back(polygon[i + 1]);
+						}
+					}
+				}
+				if (!ok)
+					++chunk.BadLines;
+			}
+			p = lineEnd < end ? lineEnd + 1 : end;
+		}
+	}
+
+	bool ImportObj(const std::string& filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
+	{
+		return ImportObj(filename.c_str(), meshVertices, meshIndices);
+	}
+
+	bool ImportObj(const char* filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
+	{
+		meshVertices.clear();
+		meshIndices.clear();
+
+		LOG(INFO) << "Start Import obj mesh from " << filename << ".";
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+
+		MappedFile file;
+		if (!file.Open(filename))
+			return false;
+		const char* begin = file.Data();
+		const char* end = begin + file.Size();
+
+		// Parse pieces of about 1MB split on line boundaries in parallel.
+		const size_t pieceSize = 1 << 20;
+		int chunkCount = (int)std::max<size_t>(1, std::min<size_t>(file.Size() / pieceSize, 1024));
+		std::vector<const char*> splits;
+		SplitLines(begin, end, chunkCount, splits);
+		std::vector<ObjChunk> chunks(chunkCount);
+		ParallelFor([&](int64_t i)
+		{
+			ParseObjChunk(splits[i], splits[i + 1], chunks[i]);
+		}, chunkCount);
+
+		// Global offsets of every chunk.
+		std::vector<int> positionBase(chunkCount + 1, 0), uvBase(chunkCount + 1, 0), normalBase(chunkCount + 1, 0);
+		std::vector<int64_t> cornerBase(chunkCount + 1, 0);
+		int badLines = 0;
+		for (int i = 0; i < chunkCount; ++i)
+		{
+			positionBase[i + 1] = positionBase[i] + (int)chunks[i].Positions.size();
+			uvBase[i + 1] = uvBase[i] + (int)chunks[i].UVs.size();
+			normalBase[i + 1] = normalBase[i] + (int)chunks[i].Normals.size();
+			cornerBase[i + 1] = cornerBase[i] + (int64_t)chunks[i].Corners.size();
+			badLines += chunks[i].BadLines;
+		}
+		if (badLines > 0)
+			Warning("Skip %d malformed lines in obj file %s", badLines, filename);
+
+		int positionCount = positionBase[chunkCount];
+		int64_t cornerCount = cornerBase[chunkCount];
+		if (positionCount == 0 || cornerCount == 0)
+		{
+			Error("No triangle found in obj file %s", filename);
+			return false;
+		}
+
+		// Gather attributes and resolve corner indices.
+		std::vector<Vector2f> uvs(uvBase[chunkCount]);
+		std::vector<Vector3f> normals(normalBase[chunkCount]);
+		std::vector<ObjCorner> corners(cornerCount);
+		meshVertices.resize(positionCount);
+		meshIndices.resize(cornerCount);
+		std::atomic<int> badIndices(0);
+		ParallelFor([&](int64_t c)
+		{
+			const ObjChunk& chunk = chunks[c];
+			for (size_t i = 0; i < chunk.Positions.size(); ++i)
+				meshVertices[positionBase[c] + i].Position = chunk.Positions[i];
+			std::copy(chunk.UVs.begin(), chunk.UVs.end(), uvs.begin() + uvBase[c]);
+			std::copy(chunk.Normals.begin(), chunk.Normals.end(), normals.begin() + normalBase[c]);
+
+			const int bases[3] = { positionBase[c], uvBase[c], normalBase[c] };
+			const int counts[3] = { positionCount, uvBase[chunkCount], normalBase[chunkCount] };
+			int bad = 0;
+			for (size_t i = 0; i < chunk.Corners.size(); ++i)
+			{
+				ObjCorner corner = chunk.Corners[i];
+				for (int k = 0; k < 3; ++k)
+				{
+					if (corner.Index[k] == ObjCorner::Missing)
+						continue;
+					if (corner.Relative & (1 << k))
+						corner.Index[k] += bases[k];
+					if (corner.Index[k] < 0 || corner.Index[k] >= counts[k])
+					{
+						corner.Index[k] = k == ObjCorner::Position ? 0 : ObjCorner::Missing;
+						++bad;
+					}
+				}
+				corners[cornerBase[c] + i] = corner;
+				meshIndices[cornerBase[c] + i] = corner.Index[ObjCorner::Position];
+			}
+			badIndices += bad;
+		}, chunkCount);
+		chunks.clear();
+
+		if (badIndices > 0)
+		{
+			Error("Invalid face index in obj file %s", filename);
+			meshVertices.clear();
+			meshIndices.clear();
+			return false;
+		}
+
+		// Resolve attributes to positions, the last corner wins.
+		for (const ObjCorner& corner : corners)
+		{
+			MeshVertex& vertex = meshVertices[corner.Index[ObjCorner::Position]];
+			if (corner.Index[ObjCorner::UV] != ObjCorner::Missing)
+				vertex.UV = uvs[corner.Index[ObjCorner::UV]];
+			if (corner.Index[ObjCorner::Normal] != ObjCorner::Missing)
+				vertex.Normal = normals[corner.Index[ObjCorner::Normal]];
+		}
+		if (normals.empty())
+			ComputeVertexNormals(meshVertices, meshIndices);
+
+		LOG(INFO) << StringPrintf("Read vertex number %d", meshVertices.size());
+		LOG(INFO) << StringPrintf("Read triangle face number %d", meshIndices.size() / 3);
+		LOG(INFO) << StringPrintf("Time for import obj mesh in seconds: %f",
+			std::chrono::duration<float>(Clock::now() - start).count());
+		LOG(INFO) << "Finish Import obj mesh.";
+		return true;
+	}
+
+}	// namespace handwork
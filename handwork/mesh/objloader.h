@@ -0,0 +1,18 @@
+// Wavefront obj file importer.
+
+#pragma once
+
+#include "meshvertex.h"
+
+namespace handwork
+{
+	// Import all groups of the file as one triangle mesh, polygons are fan triangulated. There is one
+	// vertex per obj position index, so faces sharing a position share the vertex like fbx control
+	// points and the result can be fed to MeshTopology directly. Equal positions written twice in the
+	// file are not welded. The last face corner using a position index decides its normal and uv.
+	// Normals are generated when the file has none.
+	bool ImportObj(const char* filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+
+	bool ImportObj(const std::string& filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+
+}	// namespace handwork
@@ -0,0 +1,517 @@
+// Stanford ply file importer.
+
+#include "plyloader.h"
+#include "textparse.h"
+#include "../utility/mappedfile.h"
+#include "../utility/parallel.h"
+#include <chrono>
+
+namespace handwork
+{
+	enum class PlyFormat { Ascii, BinaryLittleEndian, BinaryBigEndian };
+
+	enum class PlyType { Invalid, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+	struct PlyProperty
+	{
+		std::string Name;
+		PlyType Type = PlyType::Invalid;
+		PlyType CountType = PlyType::Invalid;	// Only valid for list properties.
+		bool IsList = false;
+	};
+
+	struct PlyElement
+	{
+		std::string Name;
+		int64_t Count = 0;
+		std::vector<PlyProperty> Properties;
+	};
+
+	static PlyType ParsePlyType(const std::string& name)
+	{
+		if (name == "char" || name == "int8") return PlyType::Int8;
+		if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+		if (name == "short" || name == "int16") return PlyType::Int16;
+		if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+		if (name == "int" || name == "int32") return PlyType::Int32;
+		if (name == "uint" || name == "uint32") return PlyType::UInt32;
+		if (name == "float" || name == "float32") return PlyType::Float32;
+		if (name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	static int PlyTypeSize(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: case PlyType::UInt8: return 1;
+		case PlyType::Int16: case PlyType::UInt16: return 2;
+		case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+		case PlyType::Float64: return 8;
+		default: return 0;
+		}
+	}
+
+	// Read one binary value, the caller checks the bounds.
+	template <typename T>
+	inline T ReadPlyRaw(const char* p, bool swap)
+	{
+		T value;
+		char bytes[sizeof(T)];
+		memcpy(bytes, p, sizeof(T));
+		if (swap)
+			std::reverse(bytes, bytes + sizeof(T));
+		memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+
+	inline double ReadPlyValue(const char* p, PlyType type, bool swap)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: return (double)ReadPlyRaw<int8_t>(p, swap);
+		case PlyType::UInt8: return (double)ReadPlyRaw<uint8_t>(p, swap);
+		case PlyType::Int16: return (double)ReadPlyRaw<int16_t>(p, swap);
+		case PlyType::UInt16: return (double)ReadPlyRaw<uint16_t>(p, swap);
+		case PlyType::Int32: return (double)ReadPlyRaw<int32_t>(p, swap);
+		case PlyType::UInt32: return (double)ReadPlyRaw<uint32_t>(p, swap);
+		case PlyType::Float32: return (double)ReadPlyRaw<float>(p, swap);
+		case PlyType::Float64: return ReadPlyRaw<double>(p, swap);
+		default: return 0.0;
+		}
+	}
+
+	static std::string NextWord(const char*& p, const char* end)
+	{
+		SkipLineSpace(p, end);
+		const char* s = p;
+		while (p < end && !IsLineSpace(*p) && *p != '\n')
+			++p;
+		return std::string(s, p);
+	}
+
+	// Parse the header, on success body points to the first byte after "end_header".
+	static bool ParsePlyHeader(const char* begin, const char* end, PlyFormat& format,
+		std::vector<PlyElement>& elements, const char*& body, const char* filename)
+	{
+		const char* p = begin;
+		if (NextWord(p, end) != "ply")
+		{
+			Error("Invalid ply file %s", filename);
+			return false;
+		}
+		SkipLine(p, end);
+
+		bool hasFormat = false;
+		while (p < end)
+		{
+			const char* lineEnd = FindLineEnd(p, end);
+			std::string keyword = NextWord(p, lineEnd);
+			if (keyword == "format")
+			{
+				std::string name = NextWord(p, lineEnd);
+				if (name == "ascii")
+					format = PlyFormat::Ascii;
+				else if (name == "binary_little_endian")
+					format = PlyFormat::BinaryLittleEndian;
+				else if (name == "binary_big_endian")
+					format = PlyFormat::BinaryBigEndian;
+				else
+				{
+					Error("Unsupport ply format %s in file %s", name.c_str(), filename);
+					return false;
+				}
+				hasFormat = true;
+			}
+			else if (keyword == "element")
+			{
+				PlyElement element;
+				element.Name = NextWord(p, lineEnd);
+				std::string count = NextWord(p, lineEnd);
+				const char* s = count.c_str();
+				int value = 0;
+				if (!ParseInt(s, s + count.size(), value) || value < 0)
+				{
+					Error("Invalid ply element %s in file %s", element.Name.c_str(), filename);
+					return false;
+				}
+				element.Count = value;
+				elements.push_back(element);
+			}
+			else if (keyword == "property")
+			{
+				if (elements.empty())
+				{
+					Error("Ply property without element in file %s", filename);
+					return false;
+				}
+				PlyProperty property;
+				std::string type = NextWord(p, lineEnd);
+				if (type == "list")
+				{
+					property.IsList = true;
+					property.CountType = ParsePlyType(NextWord(p, lineEnd));
+					type = NextWord(p, lineEnd);
+				}
+				property.Type = ParsePlyType(type);
+				property.Name = NextWord(p, lineEnd);
+				if (property.Type == PlyType::Invalid || (property.IsList && property.CountType == PlyType::Invalid))
+				{
+					Error("Unsupport ply property %s in file %s", property.Name.c_str(), filename);
+					return false;
+				}
+				elements.back().Properties.push_back(property);
+			}
+			else if (keyword == "end_header")
+			{
+				SkipLine(p, end);
+				body = p;
+				if (!hasFormat)
+				{
+					Error("Missing ply format in file %s", filename);
+					return false;
+				}
+				return true;
+			}
+			// comment, obj_info and unknown keywords are ignored.
+			p = lineEnd < end ? lineEnd + 1 : end;
+		}
+
+		Error("Missing ply end_header in file %s", filename);
+		return false;
+	}
+
+	static int FindPlyProperty(const PlyElement& element, std::initializer_list<const char*> names)
+	{
+		for (const char* name : names)
+		{
+			for (int i = 0; i < (int)element.Properties.size(); ++i)
+			{
+				if (element.Properties[i].Name == name)
+					return i;
+			}
+		}
+		return -1;
+	}
+
+	// Property slots of the vertex element: x, y, z, nx, ny, nz, u, v.
+	struct PlyVertexLayout
+	{
+		int Slots[8];
+		bool HasNormal() const { return Slots[3] >= 0 && Slots[4] >= 0 && Slots[5] >= 0; }
+		bool HasUV() const { return Slots[6] >= 0 && Slots[7] >= 0; }
+	};
+
+	static PlyVertexLayout GetPlyVertexLayout(const PlyElement& element)
+	{
+		PlyVertexLayout layout;
+		layout.Slots[0] = FindPlyProperty(element, { "x" });
+		layout.Slots[1] = FindPlyProperty(element, { "y" });
+		layout.Slots[2] = FindPlyProperty(element, { "z" });
+		layout.Slots[3] = FindPlyProperty(element, { "nx" });
+		layout.Slots[4] = FindPlyProperty(element, { "ny" });
+		layout.Slots[5] = FindPlyProperty(element, { "nz" });
+		layout.Slots[6] = FindPlyProperty(element, { "u", "s", "texture_u", "texture_s" });
+		layout.Slots[7] = FindPlyProperty(element, { "v", "t", "texture_v", "texture_t" });
+		return layout;
+	}
+
+	static void StorePlyVertex(const double* values, const PlyVertexLayout& layout, MeshVertex& vertex)
+	{
+		vertex.Position = Vector3f((float)values[layout.Slots[0]], (float)values[layout.Slots[1]], (float)values[layout.Slots[2]]);
+		if (layout.HasNormal())
+			vertex.Normal = Vector3f((float)values[layout.Slots[3]], (float)values[layout.Slots[4]], (float)values[layout.Slots[5]]);
+		if (layout.HasUV())
+			vertex.UV = Vector2f((float)values[layout.Slots[6]], (float)values[layout.Slots[7]]);
+	}
+
+	// Fan triangulate one polygon into indices, returns false on invalid vertex index.
+	inline bool AddPlyPolygon(const int* polygon, int count, int vertexCount, std::vector<int>& indices)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if (polygon[i] < 0 || polygon[i] >= vertexCount)
+				return false;
+		}
+		for (int i = 1; i + 1 < count; ++i)
+		{
+			indices.push_back(polygon[0]);
+			indices.push_back(polygon[i]);
+			indices.push_back(polygon[i + 1]);
+		}
+		return true;
+	}
+
+	// Binary body reader. Vertices with fixed size records are decoded in parallel, every other
+	// element is walked sequentially because list properties make their records variable sized.
+	static bool ReadPlyBinary(const char* p, const char* end, bool swap, const std::vector<PlyElement>& elements,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, const char* filename)
+	{
+		std::vector<int> polygon;
+		for (const PlyElement& element : elements)
+		{
+			bool fixedSize = true;
+			int stride = 0;
+			for (const PlyProperty& property : element.Properties)
+			{
+				fixedSize = fixedSize && !property.IsList;
+				stride += PlyTypeSize(property.Type);
+			}
+
+			if (element.Name == "vertex" && fixedSize)
+			{
+				if ((int64_t)(end - p) < element.Count * stride)
+				{
+					Error("Unexpected end of ply file %s", filename);
+					return false;
+				}
+				PlyVertexLayout layout = GetPlyVertexLayout(element);
+				std::vector<int> offsets;
+				for (int i = 0, offset = 0; i < (int)element.Properties.size(); ++i)
+				{
+					offsets.push_back(offset);
+					offset += PlyTypeSize(element.Properties[i].Type);
+				}
+				meshVertices.resize(element.Count);
+				const char* data = p;
+				ParallelForRange([&](int64_t begin, int64_t end)
+				{
+					std::vector<double> values(element.Properties.size());
+					for (int64_t i = begin; i < end; ++i)
+					{
+						const char* record = data + i * stride;
+						for (int k = 0; k < (int)values.size(); ++k)
+							values[k] = ReadPlyValue(record + offsets[k], element.Properties[k].Type, swap);
+						StorePlyVertex(values.data(), layout, meshVertices[i]);
+					}
+				}, element.Count, 8192);
+				p += element.Count * stride;
+				continue;
+			}
+
+			bool isVertex = element.Name == "vertex";
+			bool isFace = element.Name == "face";
+			int indexProperty = isFace ? FindPlyProperty(element, { "vertex_indices", "vertex_index" }) : -1;
+			PlyVertexLayout layout = GetPlyVertexLayout(element);
+			std::vector<double> values(element.Properties.size());
+			if (isVertex)
+				meshVertices.resize(element.Count);
+			if (isFace)
+				meshIndices.reserve(element.Count * 3);
+			for (int64_t i = 0; i < element.Count; ++i)
+			{
+				for (int k = 0; k < (int)element.Properties.size(); ++k)
+				{
+					const PlyProperty& property = element.Properties[k];
+					int count = 1;
+					if (property.IsList)
+					{
+						int countSize = PlyTypeSize(property.CountType);
+						if (end - p < countSize)
+						{
+							Error("Unexpected end of ply file %s", filename);
+							return false;
+						}
+						count = (int)ReadPlyValue(p, property.CountType, swap);
+						p += countSize;
+					}
+					int size = PlyTypeSize(property.Type);
+					if (count < 0 || (int64_t)(end - p) < (int64_t)count * size)
+					{
+						Error("Unexpected end of ply file %s", filename);
+						return false;
+					}
+					if (!property.IsList)
+						values[k] = ReadPlyValue(p, property.Type, swap);
+					if (k == indexProperty)
+					{
+						polygon.resize(count);
+						for (int j = 0; j < count; ++j)
+							polygon[j] = (int)ReadPlyValue(p + j * size, property.Type, swap);
+						if (!AddPlyPolygon(polygon.data(), count, (int)meshVertices.size(), meshIndices))
+						{
+							Error("Invalid face index in ply file %s", filename);
+							return false;
+						}
+					}
+					p += count * size;
+				}
+				if (isVertex)
+					StorePlyVertex(values.data(), layout, meshVertices[i]);
+			}
+		}
+		return true;
+	}
+
+	// Ascii body reader, one element record per line. Vertex lines are located first and then
+	// parsed in parallel.
+	static bool ReadPlyAscii(const char* p, const char* end, const std::vector<PlyElement>& elements,
+		std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices, const char* filename)
+	{
+		std::vector<int> polygon;
+		for (const PlyElement& element : elements)
+		{
+			std::vector<const char*> lines;
+			lines.reserve(element.Count + 1);
+			for (int64_t i = 0; i < element.Count; ++i)
+			{
+				if (p >= end)
+				{
+					Error("Unexpected end of ply file %s", filename);
+					return false;
+				}
+				lines.push_back(p);
+				SkipLine(p, end);
+			}
+			lines.push_back(p);
+
+			if (element.Name == "vertex")
+			{
+				PlyVertexLayout layout = GetPlyVertexLayout(element);
+				meshVertices.resize(element.Count);
+				std::atomic<int> badLines(0);
+				ParallelForRange([&](int64_t begin, int64_t end)
+				{
+					std::vector<double> values(element.Properties.size());
+					for (int64_t i = begin; i < end; ++i)
+					{
+						const char* s = lines[i];
+						const char* lineEnd = lines[i + 1];
+						for (int k = 0; k < (int)values.size(); ++k)
+						{
+							float value = 0.0f;
+							SkipLineSpace(s, lineEnd);
+							if (element.Properties[k].IsList || !ParseFloat(s, lineEnd, value))
+							{
+								++badLines;
+								break;
+							}
+							values[k] = value;
+						}
+						StorePlyVertex(values.data(), layout, meshVertices[i]);
+					}
+				}, element.Count, 8192);
+				if (badLines > 0)
+				{
+					Error("Invalid vertex in ply file %s", filename);
+					return false;
+				}
+			}
+			else if (element.Name == "face")
+			{
+				int indexProperty = FindPlyProperty(element, { "vertex_indices", "vertex_index" });
+				meshIndices.reserve(element.Count * 3);
+				for (int64_t i = 0; i < element.Count; ++i)
+				{
+					const char* s = lines[i];
+					const char* lineEnd = lines[i + 1];
+					for (int k = 0; k < (int)element.Properties.size(); ++k)
+					{
+						int count = 1;
+						SkipLineSpace(s, lineEnd);
+						if (element.Properties[k].IsList && !ParseInt(s, lineEnd, count))
+							count = -1;
+						polygon.resize(std::max(count, 0));
+						bool ok = count >= 0;
+						for (int j = 0; j < count && ok; ++j)
+						{
+							SkipLineSpace(s, lineEnd);
+							if (k == indexProperty)
+								ok = ParseInt(s, lineEnd, polygon[j]);
+							else
+							{
+								float value;
+								ok = ParseFloat(s, lineEnd, value);
+							}
+						}
+						if (ok && k == indexProperty)
+							ok = AddPlyPolygon(polygon.data(), count, (int)meshVertices.size(), meshIndices);
+						if (!ok)
+						{
+							Error("Invalid face in ply file %s", filename);
+							return false;
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	bool ImportPly(const std::string& filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
+	{
+		return ImportPly(filename.c_str(), meshVertices, meshIndices);
+	}
+
+	bool ImportPly(const char* filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
+	{
+		meshVertices.clear();
+		meshIndices.clear();
+
+		LOG(INFO) << "Start Import ply mesh from " << filename << ".";
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+
+		MappedFile file;
+		if (!file.Open(filename))
+			return false;
+		const char* begin = file.Data();
+		const char* end = begin + file.Size();
+
+		PlyFormat format = PlyFormat::Ascii;
+		std::vector<PlyElement> elements;
+		const char* body = nullptr;
+		if (!ParsePlyHeader(begin, end, format, elements, body, filename))
+			return false;
+
+		// Faces refer to the vertex element, which has to come first.
+		int vertexElement = -1, faceElement = -1;
+		for (int i = 0; i < (int)elements.size(); ++i)
+		{
+			if (elements[i].Name == "vertex" && vertexElement < 0)
+				vertexElement = i;
+			else if (elements[i].Name == "face" && faceElement < 0)
+				faceElement = i;
+		}
+		if (vertexElement < 0 || faceElement < vertexElement)
+		{
+			Error("Missing vertex or face element in ply file %s", filename);
+			return false;
+		}
+		const PlyElement& vertex = elements[vertexElement];
+		PlyVertexLayout layout = GetPlyVertexLayout(vertex);
+		if (layout.Slots[0] < 0 || layout.Slots[1] < 0 || layout.Slots[2] < 0)
+		{
+			Error("Missing vertex position in ply file %s", filename);
+			return false;
+		}
+		if (FindPlyProperty(elements[faceElement], { "vertex_indices", "vertex_index" }) < 0)
+		{
+			Error("Missing face vertex indices in ply file %s", filename);
+			return false;
+		}
+
+		bool ok = false;
+		if (format == PlyFormat::Ascii)
+			ok = ReadPlyAscii(body, end, elements, meshVertices, meshIndices, filename);
+		else
+			ok = ReadPlyBinary(body, end, format == PlyFormat::BinaryBigEndian, elements, meshVertices, meshIndices, filename);
+		if (!ok)
+		{
+			meshVertices.clear();
+			meshIndices.clear();
+			return false;
+		}
+
+		if (!layout.HasNormal())
+			ComputeVertexNormals(meshVertices, meshIndices);
+
+		LOG(INFO) << StringPrintf("Read vertex number %d", meshVertices.size());
+		LOG(INFO) << StringPrintf("Read triangle face number %d", meshIndices.size() / 3);
+		LOG(INFO) << StringPrintf("Time for import ply mesh in seconds: %f",
+			std::chrono::duration<float>(Clock::now() - start).count());
+		LOG(INFO) << "Finish Import ply mesh.";
+		return true;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,16 @@
+// Stanford ply file importer.
+
+#pragma once
+
+#include "meshvertex.h"
+
+namespace handwork
+{
+	// Import ascii and binary (both endians) ply files. Reads position, normal and uv of the
+	// vertex element and fan triangulates the face element. Normals are generated when the file
+	// has none.
+	bool ImportPly(const char* filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+
+	bool ImportPly(const std::string& filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+
+}	// namespace handwork
@@ -0,0 +1,554 @@
+// Simplify triangle meshes into chains of levels of detail with quadric error metrics.
+
+#include "simplify.h"
+#include "meshtopology.h"
+#include "../utility/bounds.h"
+#include "../utility/parallel.h"
+
+namespace handwork
+{
+	namespace
+	{
+		enum VertexKind : uint8_t
+		{
+			Interior,
+			Boundary,
+			Locked
+		};
+
+		// Boundary planes weigh more than the faces, so boundaries keep their shape.
+		const double BoundaryWeight = 10.0;
+		// Collapses turning a triangle by more than about 75 degrees are rejected.
+		const float MinNormalCos = 0.25f;
+
+		// Sum of weighted squared distances to planes. Weight sums the weights of the face planes, so
+		// the error is the mean squared distance.
+		struct Quadric
+		{
+			double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+			double b0 = 0.0, b1 = 0.0, b2 = 0.0, c = 0.0;
+			double Weight = 0.0;
+
+			void AddPlane(const Vector3f& n, double d, double weight, bool counted)
+			{
+				a00 += weight * n.x * n.x;
+				a01 += weight * n.x * n.y;
+				a02 += weight * n.x * n.z;
+				a11 += weight * n.y * n.y;
+				a12 += weight * n.y * n.z;
+				a22 += weight * n.z * n.z;
+				b0 += weight * n.x * d;
+				b1 += weight * n.y * d;
+				b2 += weight * n.z * d;
+				c += weight * d * d;
+				if (counted)
+					Weight += weight;
+			}
+
+			void Add(const Quadric& q)
+			{
+				a00 += q.a00; a01 += q.a01; a02 += q.a02;
+				a11 += q.a11; a12 += q.a12; a22 += q.a22;
+				b0 += q.b0; b1 += q.b1; b2 += q.b2;
+				c += q.c;
+				Weight += q.Weight;
+			}
+
+			double Error(const Vector3f& p) const
+			{
+				double x = p.x, y = p.y, z = p.z;
+				double e = a00 * x * x + a11 * y * y + a22 * z * z +
+					2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+					2.0 * (b0 * x + b1 * y + b2 * z) + c;
+				return Weight > 0.0 ? std::max(e, 0.0) / Weight : 0.0;
+			}
+		};
+
+		// Spread the low 10 bits of v to every third bit.
+		inline uint32_t LeftShift3(uint32_t v)
+		{
+			v = (v | (v << 16)) & 0x030000FF;
+			v = (v | (v << 8)) & 0x0300F00F;
+			v = (v | (v << 4)) & 0x030C30C3;
+			v = (v | (v << 2)) & 0x09249249;
+			return v;
+		}
+
+		struct Collapse
+		{
+			uint32_t From;
+			uint32_t To;
+			double Cost;
+		};
+
+		// A cluster of a level in the local vertex numbering of the cluster.
+		struct Cluster
+		{
+			std::vector<uint32_t> Vertices;
+			std::vector<uint32_t> Indices;
+			// Bit e is set if edge e of the triangle is a boundary edge.
+			std::vector<uint8_t> BoundaryEdges;
+			double MaxCost = 0.0;
+		};
+
+		class ClusterSimplifier
+		{
+		public:
+			ClusterSimplifier(Cluster& cluster, const std::vector<Vector3f>& positions, const std::vector<uint8_t>& kinds,
+				std::vector<Quadric>& quadrics)
+				: mCluster(cluster)
+			{
+				size_t count = cluster.Vertices.size();
+				mPositions.resize(count);
+				mKinds.resize(count);
+				mQuadrics.resize(count);
+				for (size_t i = 0; i < count; ++i)
+				{
+					uint32_t v = cluster.Vertices[i];
+					mPositions[i] = positions[v];
+					mKinds[i] = kinds[v];
+					mQuadrics[i] = quadrics[v];
+				}
+			}
+
+			// Collapse edges until the cluster has targetTriangles or no collapse stays below maxCost.
+			void Run(uint32_t targetTriangles, double maxCost)
+			{
+				size_t count = mPositions.size();
+				mRemap.resize(count);
+				mTouched.resize(count);
+				for (;;)
+				{
+					uint32_t triangleCount = (uint32_t)(mCluster.Indices.size() / 3);
+					if (triangleCount <= targetTriangles)
+						break;
+					BuildAdjacency();
+					CollectCollapses();
+					if (mCollapses.empty())
+						break;
+					std::sort(mCollapses.begin(), mCollapses.end(),
+						[](const Collapse& a, const Collapse& b) { return a.Cost < b.Cost; });
+
+					for (uint32_t i = 0; i < (uint32_t)count; ++i)
+						mRemap[i] = i;
+					std::fill(mTouched.begin(), mTouched.end(), 0);
+					uint32_t applied = 0;
+					for (const Collapse& collapse : mCollapses)
+					{
+						if (collapse.Cost > maxCost || triangleCount <= targetTriangles)
+							break;
+						if (mTouched[collapse.From] || mTouched[collapse.To])
+							continue;
+						uint32_t removed = 0;
+						if (!CanCollapse(collapse.From, collapse.To, removed))
+							continue;
+						mRemap[collapse.From] = collapse.To;
+						mQuadrics[collapse.To].Add(mQuadrics[collapse.From]);
+						mTouched[collapse.From] = 1;
+						mTouched[collapse.To] = 1;
+						mCluster.MaxCost = std::max(mCluster.MaxCost, collapse.Cost);
+						triangleCount -= std::min(removed, triangleCount);
+						++applied;
+					}
+					if (applied == 0)
+						break;
+					ApplyRemap();
+				}
+			}
+
+			// Hand the quadrics of the vertices only this cluster uses back.
+			void StoreQuadrics(std::vector<Quadric>& quadrics) const
+			{
+				for (size_t i = 0; i < mPositions.size(); ++i)
+				{
+					if (mKinds[i] != Locked)
+						quadrics[mCluster.Vertices[i]] = mQuadrics[i];
+				}
+			}
+
+		private:
+			void BuildAdjacency()
+			{
+				size_t count = mPositions.size();
+				mAdjacencyOffsets.assign(count + 1, 0);
+				for (uint32_t v : mCluster.Indices)
+					++mAdjacencyOffsets[v + 1];
+				for (size_t i = 0; i < count; ++i)
+					mAdjacencyOffsets[i + 1] += mAdjacencyOffsets[i];
+				mAdjacency.resize(mCluster.Indices.size());
+				mFill.assign(mAdjacencyOffsets.begin(), mAdjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < mCluster.Indices.size(); ++i)
+					mAdjacency[mFill[mCluster.Indices[i]]++] = (uint32_t)(i / 3);
+			}
+
+			bool Allowed(uint32_t from, bool boundaryEdge) const
+			{
+				if (mKinds[from] == Locked)
+					return false;
+				return mKinds[from] == Interior || boundaryEdge;
+			}
+
+			double Cost(uint32_t from, uint32_t to) const
+			{
+				Quadric q = mQuadrics[from];
+				q.Add(mQuadrics[to]);
+				return q.Error(mPositions[to]);
+			}
+
+			void CollectCollapses()
+			{
+				mCollapses.clear();
+				const std::vector<uint32_t>& indices = mCluster.Indices;
+				for (size_t t = 0; t < indices.size() / 3; ++t)
+				{
+					for (int e = 0; e < 3; ++e)
+					{
+						uint32_t a = indices[3 * t + e];
+						uint32_t b = indices[3 * t + (e + 1) % 3];
+						bool boundaryEdge = (mCluster.BoundaryEdges[t] >> e) & 1;
+						// Interior edges are seen from both triangles, take them once.
+						if (!boundaryEdge && a > b)
+							continue;
+						bool ab = Allowed(a, boundaryEdge);
+						bool ba = Allowed(b, boundaryEdge);
+						if (!ab && !ba)
+							continue;
+						double costAB = ab ? Cost(a, b) : Infinity;
+						double costBA = ba ? Cost(b, a) : Infinity;
+						if (costAB <= costBA)
+							mCollapses.push_back({ a, b, costAB });
+						else
+							mCollapses.push_back({ b, a, costBA });
+					}
+				}
+			}
+
+			// Vertices of the triangles around v after the collapses so far, without v.
+			void Neighbors(uint32_t v, std::vector<uint32_t>& neighbors) const
+			{
+				neighbors.clear();
+				for (uint32_t i = mAdjacencyOffsets[v]; i < mAdjacencyOffsets[v + 1]; ++i)
+				{
+					const uint32_t* tri = &mCluster.Indices[3 * mAdjacency[i]];
+					for (int c = 0; c < 3; ++c)
+					{
+						uint32_t w = mRemap[tri[c]];
+						if (w != v)
+							neighbors.push_back(w);
+					}
+				}
+				std::sort(neighbors.begin(), neighbors.end());
+				neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+			}
+
+			// The collapse has to keep the surface manifold, the vertices around the edge may only be
+			// shared by the triangles on it, and must not fold any triangle over.
+			bool CanCollapse(uint32_t from, uint32_t to, uint32_t& removed)
+			{
+				removed = 0;
+				const Vector3f& target = mPositions[to];
+				for (uint32_t i = mAdjacencyOffsets[from]; i < mAdjacencyOffsets[from + 1]; ++i)
+				{
+					const uint32_t* tri = &mCluster.Indices[3 * mAdjacency[i]];
+					uint32_t v[3] = { mRemap[tri[0]], mRemap[tri[1]], mRemap[tri[2]] };
+					if (v[0] == to || v[1] == to || v[2] == to)
+					{
+						++removed;
+						continue;
+					}
+					Vector3f p0 = mPositions[v[0]], p1 = mPositions[v[1]], p2 = mPositions[v[2]];
+					Vector3f before = Cross(p1 - p0, p2 - p0);
+					for (int c = 0; c < 3; ++c)
+					{
+						if (v[c] == from)
+							(c == 0 ? p0 : c == 1 ? p1 : p2) = target;
+					}
+					Vector3f after = Cross(p1 - p0, p2 - p0);
+					float lengths = before.Length() * after.Length();
+					if (lengths <= 0.0f || Dot(before, after) < MinNormalCos * lengths)
+						return false;
+				}
+				if (removed == 0)
+					return false;
+
+				Neighbors(from, mNeighborsFrom);
+				Neighbors(to, mNeighborsTo);
+				uint32_t shared = 0;
+				for (size_t i = 0, j = 0; i < mNeighborsFrom.size() && j < mNeighborsTo.size();)
+				{
+					if (mNeighborsFrom[i] < mNeighborsTo[j])
+						++i;
+					else if (mNeighborsTo[j] < mNeighborsFrom[i])
+						++j;
+					else
+					{
+						++shared;
+						++i;
+						++j;
+					}
+				}
+				return shared == removed;
+			}
+
+			void ApplyRemap()
+			{
+				std::vector<uint32_t>& indices = mCluster.Indices;
+				std::vector<uint8_t>& boundaryEdges = mCluster.BoundaryEdges;
+				size_t kept = 0;
+				for (size_t t = 0; t < indices.size() / 3; ++t)
+				{
+					uint32_t a = mRemap[indices[3 * t]];
+					uint32_t b = mRemap[indices[3 * t + 1]];
+					uint32_t c = mRemap[indices[3 * t + 2]];
+					if (a == b || b == c || c == a)
+						continue;
+					indices[3 * kept] = a;
+					indices[3 * kept + 1] = b;
+					indices[3 * kept + 2] = c;
+					boundaryEdges[kept] = boundaryEdges[t];
+					++kept;
+				}
+				indices.resize(3 * kept);
+				boundaryEdges.resize(kept);
+			}
+
+			Cluster& mCluster;
+			std::vector<Vector3f> mPositions;
+			std::vector<uint8_t> mKinds;
+			std::vector<Quadric> mQuadrics;
+			std::vector<uint32_t> mRemap;
+			std::vector<uint8_t> mTouched;
+			std::vector<uint32_t> mAdjacencyOffsets;
+			std::vector<uint32_t> mAdjacency;
+			std::vector<uint32_t> mFill;
+			std::vector<Collapse> mCollapses;
+			std::vector<uint32_t> mNeighborsFrom;
+			std::vector<uint32_t> mNeighborsTo;
+		};
+
+		// Topology of the triangles of a level: the kind of every vertex and the boundary edges of every
+		// triangle. Return false if the triangles are not an oriented manifold.
+		bool AnalyzeTopology(const std::vector<Vector3f>& positions, const std::vector<uint32_t>& indices,
+			const std::vector<char>& seams, std::vector<uint8_t>& kinds, std::vector<uint8_t>& boundaryEdges)
+		{
+			// MeshTopology wants every vertex used, so number the used ones densely. Every directed edge
+			// may appear once, otherwise faces are wound inconsistently or an edge has more than two.
+			std::vector<uint32_t> dense(positions.size(), UINT32_MAX);
+			std::vector<int> denseIndices(indices.size());
+			std::vector<Vector3f> densePositions;
+			std::vector<uint64_t> edges;
+			edges.reserve(indices.size());
+			for (size_t i = 0; i < indices.size(); ++i)
+			{
+				uint32_t v = indices[i];
+				if (dense[v] == UINT32_MAX)
+				{
+					dense[v] = (uint32_t)densePositions.size();
+					densePositions.push_back(positions[v]);
+				}
+				denseIndices[i] = (int)dense[v];
+				uint32_t next = indices[i % 3 == 2 ? i - 2 : i + 1];
+				if (v == next)
+					return false;
+				edges.push_back(((uint64_t)v << 32) | next);
+			}
+			std::sort(edges.begin(), edges.end());
+			if (std::adjacent_find(edges.begin(), edges.end()) != edges.end())
+				return false;
+
+			MeshTopology topology((int)indices.size(), denseIndices.data(), (int)densePositions.size(), densePositions.data());
+			SDFace* faces = topology.GetFaces();
+			SDVertex* vertices = topology.GetVertices();
+			kinds.assign(positions.size(), Locked);
+			for (size_t v = 0; v < positions.size(); ++v)
+			{
+				if (dense[v] != UINT32_MAX && !seams[v])
+					kinds[v] = vertices[dense[v]].boundary ? Boundary : Interior;
+			}
+			boundaryEdges.resize(indices.size() / 3);
+			for (size_t t = 0; t < indices.size() / 3; ++t)
+			{
+				uint8_t mask = 0;
+				for (int e = 0; e < 3; ++e)
+				{
+					if (!faces[t].f[e])
+						mask |= 1 << e;
+				}
+				boundaryEdges[t] = mask;
+			}
+			return true;
+		}
+	}	// namespace
+
+	bool SimplifyLevels(const Vector3f* positions, size_t positionStride, uint32_t vertexCount,
+		const uint32_t* indices, size_t indexCount, const SimplifyOptions& options, std::vector<SimplifiedLevel>& levels)
+	{
+		levels.clear();
+		std::vector<Vector3f> points(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+			points[i] = *(const Vector3f*)((const char*)positions + i * positionStride);
+		std::vector<uint32_t> current(indices, indices + indexCount - indexCount % 3);
+		for (uint32_t v : current)
+			CHECK(v < vertexCount);
+
+		// Seam vertices share their position with others.
+		std::vector<uint32_t> order(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&points](uint32_t a, uint32_t b)
+		{
+			const Vector3f& p = points[a];
+			const Vector3f& q = points[b];
+			return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+		});
+		std::vector<char> seams(vertexCount);
+		for (uint32_t i = 1; i < vertexCount; ++i)
+		{
+			if (points[order[i]] == points[order[i - 1]])
+				seams[order[i]] = seams[order[i - 1]] = 1;
+		}
+
+		std::vector<uint8_t> kinds;
+		std::vector<uint8_t> boundaryEdges;
+		if (!AnalyzeTopology(points, current, seams, kinds, boundaryEdges))
+			return false;
+
+		// Quadrics of the full mesh, faces weighted by area and boundaries by their squared length.
+		std::vector<Quadric> quadrics(vertexCount);
+		Bounds3f bounds;
+		for (size_t t = 0; t < current.size() / 3; ++t)
+		{
+			const uint32_t* tri = &current[3 * t];
+			Vector3f p[3] = { points[tri[0]], points[tri[1]], points[tri[2]] };
+			Vector3f n = Cross(p[1] - p[0], p[2] - p[0]);
+			float area = 0.5f * n.Length();
+			if (area <= 0.0f)
+				continue;
+			n = Normalize(n);
+			for (int c = 0; c < 3; ++c)
+			{
+				quadrics[tri[c]].AddPlane(n, -Dot(n, p[0]), area, true);
+				bounds = Union(bounds, p[c]);
+			}
+			for (int e = 0; e < 3; ++e)
+			{
+				if (!((boundaryEdges[t] >> e) & 1))
+					continue;
+				Vector3f edge = p[(e + 1) % 3] - p[e];
+				float length = edge.Length();
+				if (length <= 0.0f)
+					continue;
+				Vector3f m = Normalize(Cross(edge, n));
+				double weight = BoundaryWeight * length * length;
+				quadrics[tri[e]].AddPlane(m, -Dot(m, p[e]), weight, false);
+				quadrics[tri[(e + 1) % 3]].AddPlane(m, -Dot(m, p[e]), weight, false);
+			}
+		}
+
+		Vector3f extent = bounds.Diagonal();
+		double maxCost = (double)options.MaxError * options.MaxError;
+		uint32_t clusterSize = std::max(options.ClusterTriangles, 64u);
+		std::vector<uint32_t> codes;
+		std::vector<uint32_t> triangles;
+		std::vector<uint32_t> owners(vertexCount);
+		std::vector<Cluster> clusters;
+		float error = 0.0f;
+		for (int level = 0; level < options.MaxLevels; ++level)
+		{
+			uint32_t triangleCount = (uint32_t)(current.size() / 3);
+			uint32_t target = std::max(options.MinTriangles, (uint32_t)(triangleCount * options.LevelRatio));
+			if (triangleCount <= target)
+				break;
+			// Collapses that remove a triangle with two boundary edges open up new boundary edges.
+			if (level > 0 && !AnalyzeTopology(points, current, seams, kinds, boundaryEdges))
+				break;
+
+			// Order the triangles along a Morton curve of their centers and cut the order into clusters,
+			// every other level starts with half a cluster.
+			codes.resize(triangleCount);
+			triangles.resize(triangleCount);
+			for (uint32_t t = 0; t < triangleCount; ++t)
+			{
+				Vector3f center = (points[current[3 * t]] + points[current[3 * t + 1]] + points[current[3 * t + 2]]) / 3.0f;
+				Vector3f o = bounds.Offset(center);
+				uint32_t x = (uint32_t)Clamp(o.x * 1023.0f, 0.0f, 1023.0f);
+				uint32_t y = (uint32_t)Clamp(o.y * 1023.0f, 0.0f, 1023.0f);
+				uint32_t z = (uint32_t)Clamp(o.z * 1023.0f, 0.0f, 1023.0f);
+				codes[t] = extent.x > 0.0f || extent.y > 0.0f || extent.z > 0.0f ?
+					(LeftShift3(z) << 2) | (LeftShift3(y) << 1) | LeftShift3(x) : 0;
+				triangles[t] = t;
+			}
+			std::stable_sort(triangles.begin(), triangles.end(), [&codes](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+
+			uint32_t firstSize = level % 2 == 1 ? clusterSize / 2 : clusterSize;
+			uint32_t clusterCount = triangleCount <= firstSize ? 1 : 1 + (triangleCount - firstSize + clusterSize - 1) / clusterSize;
+			clusters.resize(clusterCount);
+			std::fill(owners.begin(), owners.end(), UINT32_MAX);
+			std::vector<uint8_t> levelKinds = kinds;
+			for (uint32_t c = 0; c < clusterCount; ++c)
+			{
+				uint32_t begin = c == 0 ? 0 : firstSize + (c - 1) * clusterSize;
+				uint32_t end = std::min(triangleCount, c == 0 ? firstSize : begin + clusterSize);
+				Cluster& cluster = clusters[c];
+				cluster.Vertices.clear();
+				cluster.Indices.clear();
+				cluster.BoundaryEdges.clear();
+				cluster.MaxCost = 0.0;
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					uint32_t t = triangles[i];
+					for (int k = 0; k < 3; ++k)
+					{
+						uint32_t v = current[3 * t + k];
+						cluster.Indices.push_back(v);
+						// Vertices used by more than one cluster stay in place during this level.
+						if (owners[v] == UINT32_MAX)
+							owners[v] = c;
+						else if (owners[v] != c)
+							levelKinds[v] = Locked;
+					}
+					cluster.BoundaryEdges.push_back(boundaryEdges[t]);
+				}
+			}
+
+			ParallelFor([&](int64_t c)
+			{
+				Cluster& cluster = clusters[c];
+				// Number the vertices of the cluster densely.
+				cluster.Vertices = cluster.Indices;
+				std::sort(cluster.Vertices.begin(), cluster.Vertices.end());
+				cluster.Vertices.erase(std::unique(cluster.Vertices.begin(), cluster.Vertices.end()), cluster.Vertices.end());
+				for (uint32_t& v : cluster.Indices)
+					v = (uint32_t)(std::lower_bound(cluster.Vertices.begin(), cluster.Vertices.end(), v) - cluster.Vertices.begin());
+
+				ClusterSimplifier simplifier(cluster, points, levelKinds, quadrics);
+				uint32_t clusterTriangles = (uint32_t)(cluster.Indices.size() / 3);
+				uint32_t clusterTarget = (uint32_t)std::ceil((double)clusterTriangles * target / triangleCount);
+				simplifier.Run(clusterTarget, maxCost);
+				simplifier.StoreQuadrics(quadrics);
+				for (uint32_t& v : cluster.Indices)
+					v = cluster.Vertices[v];
+			}, (int64_t)clusterCount, 1);
+
+			std::vector<uint32_t> next;
+			double levelCost = 0.0;
+			for (const Cluster& cluster : clusters)
+			{
+				next.insert(next.end(), cluster.Indices.begin(), cluster.Indices.end());
+				levelCost = std::max(levelCost, cluster.MaxCost);
+			}
+			// Give up on levels that barely shrink, the next ones would not either.
+			uint32_t nextCount = (uint32_t)(next.size() / 3);
+			if (nextCount == 0 || nextCount > triangleCount - (triangleCount - target) / 4)
+				break;
+
+			error = std::max(error, (float)std::sqrt(levelCost));
+			levels.emplace_back();
+			levels.back().Indices = next;
+			levels.back().Error = error;
+			current.swap(next);
+		}
+		return true;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,42 @@
+// Simplify triangle meshes into chains of levels of detail with quadric error metrics.
+
+#pragma once
+
+#include "../utility/utility.h"
+#include "../utility/geometry.h"
+
+namespace handwork
+{
+	struct SimplifyOptions
+	{
+		// Each level keeps about this fraction of the triangles of the level before.
+		float LevelRatio = 0.5f;
+		// Levels after the full mesh at most.
+		int MaxLevels = 4;
+		// No level has fewer triangles.
+		uint32_t MinTriangles = 32;
+		// Object space distance no level deviates further from the full mesh.
+		float MaxError = Infinity;
+		// Triangles of a cluster, the clusters of a level are simplified in parallel.
+		uint32_t ClusterTriangles = 4096;
+	};
+
+	struct SimplifiedLevel
+	{
+		std::vector<uint32_t> Indices;
+		// Object space distance the level deviates from the full mesh, estimated by the quadrics.
+		float Error = 0.0f;
+	};
+
+	// Simplify an indexed triangle list by Garland-Heckbert edge collapses into levels of fewer and
+	// fewer triangles. A vertex collapses onto a neighbor and is never moved, so all levels index the
+	// vertices of the full mesh. Boundary edges only collapse along the boundary, and vertices sharing
+	// their position with other vertices stay in place, so the sides of an attribute seam never part.
+	// Each level is cut into spatially coherent clusters that are simplified in parallel with their
+	// borders locked, and the clusters of the next level are offset so the borders move. Stops early
+	// when a level cannot get below the ratio. Return false if the mesh is not an oriented manifold,
+	// which the adjacency of MeshTopology needs. Positions are positionStride bytes apart.
+	bool SimplifyLevels(const Vector3f* positions, size_t positionStride, uint32_t vertexCount,
+		const uint32_t* indices, size_t indexCount, const SimplifyOptions& options, std::vector<SimplifiedLevel>& levels);
+
+}	// namespace handwork
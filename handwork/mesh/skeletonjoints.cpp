@@ -0,0 +1,50 @@
+// Joint bookkeeping of the skeleton importers that does not depend on the file format.
+
+#include "skeletonjoints.h"
+
+namespace handwork
+{
+	void BuildJointIndexMap(const std::vector<JointInfo>& skeletonInfo, JointIndexMap& jointIndices)
+	{
+		jointIndices.clear();
+		jointIndices.reserve(skeletonInfo.size());
+		// Keep the first joint for duplicated names.
+		for (int i = 0; i < (int)skeletonInfo.size(); ++i)
+			jointIndices.emplace(skeletonInfo[i].Name, i);
+	}
+
+	int FindJoint(const std::string& name, const JointIndexMap& jointIndices)
+	{
+		auto it = jointIndices.find(name);
+		return it == jointIndices.end() ? -1 : it->second;
+	}
+
+	int CompactJoints(std::vector<JointInfo>& skeletonInfo, std::vector<int>& newPos)
+	{
+		// Parents always precede their children, so a joint is dropped when its parent was
+		// dropped, which newPos already records.
+		newPos.assign(skeletonInfo.size(), -1);
+		int validCount = 0;
+		for (int i = 0; i < (int)skeletonInfo.size(); ++i)
+		{
+			auto& item = skeletonInfo[i];
+			if (item.Parent >= 0 && newPos[item.Parent] < 0)
+				item.Valid = false;
+			if (!item.Valid)
+				continue;
+
+			if (item.Parent >= 0)
+			{
+				item.Parent = newPos[item.Parent];
+				CHECK_GE(item.Parent, 0);
+			}
+			newPos[i] = validCount;
+			if (validCount != i)
+				skeletonInfo[validCount] = std::move(item);
+			++validCount;
+		}
+		skeletonInfo.resize(validCount);
+		return validCount;
+	}
+
+}	// namespace handwork
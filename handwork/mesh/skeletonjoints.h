@@ -0,0 +1,40 @@
+// Joint bookkeeping of the skeleton importers that does not depend on the file format.
+
+#pragma once
+
+#include "../utility/utility.h"
+#include "../utility/transform.h"
+#include "../utility/geometry.h"
+#include <unordered_map>
+
+namespace handwork
+{
+	// Joint of an imported skeleton, Parent indexes the same array and precedes the joint.
+	struct JointInfo
+	{
+		JointInfo() : Parent(-1), Valid(false)
+		{}
+
+		std::string Name;
+		int Parent;
+		Matrix4x4 GlobalBindposeInverse;
+		bool Valid;
+		Vector3f Translation;
+		Vector3f Scaling;
+		Vector3f Rotation;
+	};
+
+	// Joint name to index in skeletonInfo. Built once per skeleton layout, so looking up the
+	// joint of every cluster does not scan the whole skeleton.
+	typedef std::unordered_map<std::string, int> JointIndexMap;
+
+	void BuildJointIndexMap(const std::vector<JointInfo>& skeletonInfo, JointIndexMap& jointIndices);
+	// Index of the first joint with the name, -1 when there is none.
+	int FindJoint(const std::string& name, const JointIndexMap& jointIndices);
+
+	// Drop invalid joints and every joint below one, in place and keeping the order. newPos gets
+	// the new index of each old joint, -1 for dropped ones, so per joint data kept elsewhere can
+	// follow. Returns the number of joints left.
+	int CompactJoints(std::vector<JointInfo>& skeletonInfo, std::vector<int>& newPos);
+
+}	// namespace handwork
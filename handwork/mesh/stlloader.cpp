@@ -0,0 +1,148 @@
+// Binary stl file importer.
+
+#include "stlloader.h"
+#include "../utility/mappedfile.h"
+#include "../utility/parallel.h"
+#include <chrono>
+#include <unordered_map>
+
+namespace handwork
+{
+	// Binary stl layout: 80 byte header, uint32 triangle count, then per triangle a normal, three
+	// corners (all float3) and a uint16 attribute, 50 bytes in total. Little endian.
+	static const size_t StlHeaderSize = 84;
+	static const size_t StlTriangleSize = 50;
+
+	struct StlPositionKey
+	{
+		uint32_t Bits[3];
+
+		bool operator==(const StlPositionKey& other) const
+		{
+			return Bits[0] == other.Bits[0] && Bits[1] == other.Bits[1] && Bits[2] == other.Bits[2];
+		}
+	};
+
+	struct StlPositionHash
+	{
+		size_t operator()(const StlPositionKey& key) const
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (int i = 0; i < 3; ++i)
+			{
+				hash ^= key.Bits[i];
+				hash *= 1099511628211ull;
+			}
+			return (size_t)hash;
+		}
+	};
+
+	bool ImportStl(const std::string& filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
+	{
+		return ImportStl(filename.c_str(), meshVertices, meshIndices);
+	}
+
+	bool ImportStl(const char* filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices)
+	{
+		meshVertices.clear();
+		meshIndices.clear();
+
+		LOG(INFO) << "Start Import stl mesh from " << filename << ".";
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+
+		MappedFile file;
+		if (!file.Open(filename))
+			return false;
+		const char* data = file.Data();
+		if (file.Size() < StlHeaderSize)
+		{
+			Error("Invalid stl file %s", filename);
+			return false;
+		}
+		uint32_t triangleCount;
+		memcpy(&triangleCount, data + 80, sizeof(uint32_t));
+		if (file.Size() < StlHeaderSize + (size_t)triangleCount * StlTriangleSize)
+		{
+			// Ascii files start with "solid", but so do some binary ones, so only the size is trusted.
+			if (file.Size() >= 5 && memcmp(data, "solid", 5) == 0)
+				Error("Ascii stl is not supported, file %s", filename);
+			else
+				Error("Unexpected end of stl file %s", filename);
+			return false;
+		}
+		if (triangleCount == 0)
+		{
+			Error("No triangle found in stl file %s", filename);
+			return false;
+		}
+
+		// Decode corner positions and their hashes in parallel.
+		int64_t cornerCount = (int64_t)triangleCount * 3;
+		std::vector<StlPositionKey> keys(cornerCount);
+		std::vector<size_t> hashes(cornerCount);
+		const char* triangles = data + StlHeaderSize;
+		ParallelForRange([&](int64_t begin, int64_t end)
+		{
+			StlPositionHash hasher;
+			for (int64_t i = begin; i < end; ++i)
+			{
+				const char* corner = triangles + (i / 3) * StlTriangleSize + 12 + (i % 3) * 12;
+				memcpy(keys[i].Bits, corner, 12);
+				// Weld +0 and -0.
+				for (int k = 0; k < 3; ++k)
+				{
+					if (keys[i].Bits[k] == 0x80000000u)
+						keys[i].Bits[k] = 0;
+				}
+				hashes[i] = hasher(keys[i]);
+			}
+		}, cornerCount, 8192);
+
+		// Weld corners, the first corner of every position creates the vertex.
+		struct PrecomputedHash
+		{
+			const std::vector<StlPositionKey>* Keys;
+			const std::vector<size_t>* Hashes;
+			size_t operator()(int corner) const { return (*Hashes)[corner]; }
+		};
+		struct CornerEqual
+		{
+			const std::vector<StlPositionKey>* Keys;
+			bool operator()(int a, int b) const { return (*Keys)[a] == (*Keys)[b]; }
+		};
+		std::unordered_map<int, int, PrecomputedHash, CornerEqual> welded(
+			(size_t)cornerCount / 4, PrecomputedHash{ &keys, &hashes }, CornerEqual{ &keys });
+		meshIndices.resize(cornerCount);
+		std::vector<int> firstCorners;
+		firstCorners.reserve((size_t)cornerCount / 4);
+		for (int i = 0; i < (int)cornerCount; ++i)
+		{
+			auto result = welded.emplace(i, (int)firstCorners.size());
+			if (result.second)
+				firstCorners.push_back(i);
+			meshIndices[i] = result.first->second;
+		}
+
+		meshVertices.resize(firstCorners.size());
+		ParallelForRange([&](int64_t begin, int64_t end)
+		{
+			for (int64_t i = begin; i < end; ++i)
+			{
+				float p[3];
+				memcpy(p, keys[firstCorners[i]].Bits, 12);
+				meshVertices[i].Position = Vector3f(p[0], p[1], p[2]);
+			}
+		}, (int64_t)firstCorners.size(), 8192);
+
+		ComputeVertexNormals(meshVertices, meshIndices);
+
+		LOG(INFO) << StringPrintf("Read vertex number %d", meshVertices.size());
+		LOG(INFO) << StringPrintf("Read triangle face number %d", meshIndices.size() / 3);
+		LOG(INFO) << StringPrintf("Time for import stl mesh in seconds: %f",
+			std::chrono::duration<float>(Clock::now() - start).count());
+		LOG(INFO) << "Finish Import stl mesh.";
+		return true;
+	}
+
+}	// namespace handwork
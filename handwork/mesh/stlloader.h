@@ -0,0 +1,16 @@
+// Binary stl file importer.
+
+#pragma once
+
+#include "meshvertex.h"
+
+namespace handwork
+{
+	// Import a binary stl file. Stl stores three separate corners per triangle, corners with
+	// bitwise equal positions are welded so that the result can be fed to MeshTopology. Normals
+	// are generated from the welded mesh, the stored face normals are ignored.
+	bool ImportStl(const char* filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+
+	bool ImportStl(const std::string& filename, std::vector<MeshVertex>& meshVertices, std::vector<int>& meshIndices);
+
+}	// namespace handwork
@@ -0,0 +1,145 @@
+// Hand written text parsing for the plain text mesh formats.
+
+#pragma once
+
+#include "../utility/utility.h"
+
+namespace handwork
+{
+	// All functions work on a [p, end) range, mapped files are not null terminated. The parse
+	// functions advance p past the consumed characters and leave it untouched on failure.
+
+	inline bool IsDigit(char c) { return (unsigned)(c - '0') <= 9; }
+	inline bool IsLineSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline void SkipLineSpace(const char*& p, const char* end)
+	{
+		while (p < end && IsLineSpace(*p))
+			++p;
+	}
+
+	inline const char* FindLineEnd(const char* p, const char* end)
+	{
+		const char* e = (const char*)memchr(p, '\n', end - p);
+		return e ? e : end;
+	}
+
+	// Move p to the start of the next line.
+	inline void SkipLine(const char*& p, const char* end)
+	{
+		p = FindLineEnd(p, end);
+		if (p < end)
+			++p;
+	}
+
+	// Split [begin, end) into at most count pieces whose boundaries fall right after a line break.
+	// splits receives count + 1 entries, empty pieces are possible.
+	inline void SplitLines(const char* begin, const char* end, int count, std::vector<const char*>& splits)
+	{
+		splits.resize(count + 1);
+		splits[0] = begin;
+		size_t size = end - begin;
+		for (int i = 1; i < count; ++i)
+		{
+			const char* p = std::max(begin + size * i / count, splits[i - 1]);
+			if (p > begin && p < end && p[-1] != '\n')
+				SkipLine(p, end);
+			splits[i] = p;
+		}
+		splits[count] = end;
+	}
+
+	inline bool ParseInt(const char*& p, const char* end, int& value)
+	{
+		const char* s = p;
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			negative = *s == '-';
+			++s;
+		}
+		if (s == end || !IsDigit(*s))
+			return false;
+
+		int64_t v = 0;
+		while (s < end && IsDigit(*s))
+		{
+			if (v < INT32_MAX)
+				v = v * 10 + (*s - '0');
+			++s;
+		}
+		v = std::min(v, (int64_t)INT32_MAX);
+		value = (int)(negative ? -v : v);
+		p = s;
+		return true;
+	}
+
+	inline bool ParseFloat(const char*& p, const char* end, float& value)
+	{
+		static const double powersOf10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		const char* s = p;
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			negative = *s == '-';
+			++s;
+		}
+
+		// Collect up to 18 significant digits, the rest only moves the exponent.
+		const uint64_t mantissaLimit = 100000000000000000ull;
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		bool hasDigits = false;
+		while (s < end && IsDigit(*s))
+		{
+			if (mantissa < mantissaLimit)
+				mantissa = mantissa * 10 + (*s - '0');
+			else
+				++exponent;
+			hasDigits = true;
+			++s;
+		}
+		if (s < end && *s == '.')
+		{
+			++s;
+			while (s < end && IsDigit(*s))
+			{
+				if (mantissa < mantissaLimit)
+				{
+					mantissa = mantissa * 10 + (*s - '0');
+					--exponent;
+				}
+				hasDigits = true;
+				++s;
+			}
+		}
+		if (!hasDigits)
+			return false;
+
+		if (s < end && (*s == 'e' || *s == 'E'))
+		{
+			const char* e = s + 1;
+			int exp = 0;
+			if (ParseInt(e, end, exp))
+			{
+				exponent += exp;
+				s = e;
+			}
+		}
+
+		double v = (double)mantissa;
+		if (mantissa != 0 && exponent != 0)
+		{
+			int absExponent = std::abs(exponent);
+			double scale = absExponent <= 22 ? powersOf10[absExponent] : std::pow(10.0, (double)std::min(absExponent, 400));
+			v = exponent < 0 ? v / scale : v * scale;
+		}
+		value = (float)(negative ? -v : v);
+		p = s;
+		return true;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,335 @@
+#include "vertexcache.h"
+
+namespace handwork
+{
+	namespace
+	{
+		// Scoring of Forsyth's optimizer: vertices of the last triangle score a little lower than the
+		// next ones in the cache so strips do not turn back, and vertices with few triangles left get
+		// a boost so the optimizer finishes them off instead of leaving single triangles behind.
+		const int MaxCacheSize = 32;
+		const int MaxValence = 32;
+		const float CacheDecayPower = 1.5f;
+		const float LastTriangleScore = 0.75f;
+		const float ValenceBoostScale = 2.0f;
+		const float ValenceBoostPower = 0.5f;
+
+		struct ScoreTables
+		{
+			ScoreTables()
+			{
+				for (int i = 0; i < MaxCacheSize; ++i)
+				{
+					if (i < 3)
+						Cache[i] = LastTriangleScore;
+					else
+						Cache[i] = std::pow(1.0f - (float)(i - 3) / (MaxCacheSize - 3), CacheDecayPower);
+				}
+				Valence[0] = 0.0f;
+				for (int i = 1; i <= MaxValence; ++i)
+					Valence[i] = ValenceBoostScale * std::pow((float)i, -ValenceBoostPower);
+			}
+
+			float Score(int cachePosition, uint32_t remaining) const
+			{
+				// Vertices without triangles left must never attract the optimizer.
+				if (remaining == 0)
+					return -1.0f;
+				float score = cachePosition >= 0 ? Cache[cachePosition] : 0.0f;
+				return score + Valence[std::min(remaining, (uint32_t)MaxValence)];
+			}
+
+			float Cache[MaxCacheSize];
+			float Valence[MaxValence + 1];
+		};
+
+		// FIFO cache of cacheSize entries, a vertex is in the cache while fewer than cacheSize misses
+		// happened since it was last transformed.
+		class FifoCache
+		{
+		public:
+			FifoCache(uint32_t vertexCount, uint32_t cacheSize)
+				: mTimestamps(vertexCount, 0), mTime(cacheSize + 1), mCacheSize(cacheSize)
+			{
+			}
+
+			void Reset() { mTime += mCacheSize + 1; }
+
+			// Return true on a miss.
+			bool Access(uint32_t v)
+			{
+				if (mTime - mTimestamps[v] <= mCacheSize)
+					return false;
+				mTimestamps[v] = mTime++;
+				return true;
+			}
+
+		private:
+			std::vector<uint32_t> mTimestamps;
+			uint32_t mTime;
+			uint32_t mCacheSize;
+		};
+	}	// namespace
+
+	VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+	{
+		VertexCacheStats stats;
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0)
+			return stats;
+
+		FifoCache cache(vertexCount, std::max(cacheSize, 1u));
+		std::vector<char> used(vertexCount, 0);
+		uint32_t usedCount = 0;
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			uint32_t v = indices[i];
+			CHECK(v < vertexCount);
+			if (cache.Access(v))
+				++stats.TransformedVertices;
+			if (!used[v])
+			{
+				used[v] = 1;
+				++usedCount;
+			}
+		}
+		stats.TriangleCount = (uint32_t)triangleCount;
+		stats.VertexCount = usedCount;
+		stats.Acmr = (float)stats.TransformedVertices / triangleCount;
+		stats.Atvr = (float)stats.TransformedVertices / usedCount;
+		return stats;
+	}
+
+	void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+		std::vector<uint32_t>* clusters)
+	{
+		static const ScoreTables tables;
+		uint32_t triangleCount = (uint32_t)(indexCount / 3);
+		if (clusters)
+			clusters->clear();
+		if (triangleCount == 0)
+			return;
+		// destination may be indices.
+		std::vector<uint32_t> source(indices, indices + 3 * (size_t)triangleCount);
+
+		// Triangles of every vertex, the ones not emitted yet are kept at the front of its list.
+		std::vector<uint32_t> remaining(vertexCount, 0);
+		for (uint32_t v : source)
+		{
+			CHECK(v < vertexCount);
+			++remaining[v];
+		}
+		std::vector<uint32_t> offsets(vertexCount + 1, 0);
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			offsets[v + 1] = offsets[v] + remaining[v];
+		std::vector<uint32_t> adjacency(source.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < source.size(); ++i)
+			adjacency[fill[source[i]]++] = (uint32_t)(i / 3);
+
+		std::vector<float> vertexScores(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			vertexScores[v] = tables.Score(-1, remaining[v]);
+		std::vector<float> triangleScores(triangleCount);
+		for (uint32_t t = 0; t < triangleCount; ++t)
+			triangleScores[t] = vertexScores[source[3 * t]] + vertexScores[source[3 * t + 1]] + vertexScores[source[3 * t + 2]];
+		std::vector<char> emitted(triangleCount, 0);
+
+		uint32_t cache[MaxCacheSize + 3];
+		uint32_t cacheSize = 0;
+		uint32_t newCache[MaxCacheSize + 3];
+		uint32_t cursor = 0;
+		uint32_t best = UINT32_MAX;
+		for (uint32_t out = 0; out < triangleCount; ++out)
+		{
+			if (best == UINT32_MAX)
+			{
+				// Nothing in the cache has triangles left, start over at the next triangle in input order.
+				while (emitted[cursor])
+					++cursor;
+				best = cursor;
+				if (clusters)
+					clusters->push_back(out);
+			}
+
+			const uint32_t* tri = &source[3 * best];
+			destination[3 * out] = tri[0];
+			destination[3 * out + 1] = tri[1];
+			destination[3 * out + 2] = tri[2];
+			emitted[best] = 1;
+
+			// Take the triangle out of the lists of its vertices.
+			for (int c = 0; c < 3; ++c)
+			{
+				uint32_t v = tri[c];
+				uint32_t* list = &adjacency[offsets[v]];
+				for (uint32_t i = 0; i < remaining[v]; ++i)
+				{
+					if (list[i] == best)
+					{
+						std::swap(list[i], list[remaining[v] - 1]);
+						--remaining[v];
+						break;
+					}
+				}
+			}
+
+			// The vertices of the triangle move to the front of the LRU cache.
+			uint32_t newCacheSize = 0;
+			for (int c = 0; c < 3; ++c)
+			{
+				if (std::find(newCache, newCache + newCacheSize, tri[c]) == newCache + newCacheSize)
+					newCache[newCacheSize++] = tri[c];
+			}
+			for (uint32_t i = 0; i < cacheSize; ++i)
+			{
+				uint32_t v = cache[i];
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					newCache[newCacheSize++] = v;
+			}
+
+			// Rescore the vertices whose position or triangle count changed, including the ones that
+			// fell out of the cache, and hand the change on to their triangles.
+			for (uint32_t i = 0; i < newCacheSize; ++i)
+			{
+				uint32_t v = newCache[i];
+				int position = i < (uint32_t)MaxCacheSize ? (int)i : -1;
+				float score = tables.Score(position, remaining[v]);
+				float delta = score - vertexScores[v];
+				vertexScores[v] = score;
+				const uint32_t* list = &adjacency[offsets[v]];
+				for (uint32_t j = 0; j < remaining[v]; ++j)
+					triangleScores[list[j]] += delta;
+			}
+
+			// The next triangle is the best one using a vertex in the cache.
+			cacheSize = std::min(newCacheSize, (uint32_t)MaxCacheSize);
+			best = UINT32_MAX;
+			float bestScore = -Infinity;
+			for (uint32_t i = 0; i < cacheSize; ++i)
+			{
+				uint32_t v = newCache[i];
+				const uint32_t* list = &adjacency[offsets[v]];
+				for (uint32_t j = 0; j < remaining[v]; ++j)
+				{
+					if (triangleScores[list[j]] > bestScore)
+					{
+						bestScore = triangleScores[list[j]];
+						best = list[j];
+					}
+				}
+			}
+			std::copy(newCache, newCache + cacheSize, cache);
+		}
+	}
+
+	void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vector3f* positions, size_t positionStride,
+		uint32_t vertexCount, const std::vector<uint32_t>& clusters, float threshold)
+	{
+		uint32_t triangleCount = (uint32_t)(indexCount / 3);
+		if (triangleCount == 0)
+			return;
+		auto position = [positions, positionStride](uint32_t v) -> const Vector3f&
+		{
+			return *(const Vector3f*)((const char*)positions + v * positionStride);
+		};
+
+		// Split the clusters where the ACMR of the part so far is already close to that of the whole
+		// cluster, cutting there hardly costs cache efficiency.
+		std::vector<uint32_t> bounds = clusters;
+		if (bounds.empty() || bounds[0] != 0)
+			bounds.insert(bounds.begin(), 0);
+		bounds.push_back(triangleCount);
+		FifoCache cache(vertexCount, 16);
+		std::vector<uint32_t> splits;
+		for (size_t c = 0; c + 1 < bounds.size(); ++c)
+		{
+			uint32_t begin = bounds[c], end = bounds[c + 1];
+			if (begin >= end)
+				continue;
+			cache.Reset();
+			uint32_t misses = 0;
+			for (uint32_t i = 3 * begin; i < 3 * end; ++i)
+				misses += cache.Access(indices[i]) ? 1 : 0;
+			float clusterAcmr = (float)misses / (end - begin);
+
+			cache.Reset();
+			splits.push_back(begin);
+			uint32_t start = begin;
+			misses = 0;
+			for (uint32_t t = begin; t + 1 < end; ++t)
+			{
+				for (int k = 0; k < 3; ++k)
+					misses += cache.Access(indices[3 * t + k]) ? 1 : 0;
+				if ((float)misses / (t + 1 - start) <= threshold * clusterAcmr)
+				{
+					splits.push_back(t + 1);
+					start = t + 1;
+					misses = 0;
+					cache.Reset();
+				}
+			}
+		}
+		splits.push_back(triangleCount);
+
+		// Center of the mesh and the area weighted center and normal of every cluster.
+		Vector3f meshCenter;
+		float meshArea = 0.0f;
+		uint32_t clusterCount = (uint32_t)splits.size() - 1;
+		std::vector<float> keys(clusterCount);
+		std::vector<Vector3f> centers(clusterCount);
+		std::vector<Vector3f> normals(clusterCount);
+		for (uint32_t c = 0; c < clusterCount; ++c)
+		{
+			Vector3f center, normal;
+			float area = 0.0f;
+			for (uint32_t t = splits[c]; t < splits[c + 1]; ++t)
+			{
+				const Vector3f& p0 = position(indices[3 * t]);
+				const Vector3f& p1 = position(indices[3 * t + 1]);
+				const Vector3f& p2 = position(indices[3 * t + 2]);
+				Vector3f n = Cross(p1 - p0, p2 - p0);
+				float a = n.Length();
+				center += (p0 + p1 + p2) * (a / 3.0f);
+				normal += n;
+				area += a;
+			}
+			meshCenter += center;
+			meshArea += area;
+			centers[c] = area > 0.0f ? center / area : position(indices[3 * splits[c]]);
+			normals[c] = normal;
+		}
+		if (meshArea > 0.0f)
+			meshCenter /= meshArea;
+		for (uint32_t c = 0; c < clusterCount; ++c)
+		{
+			float length = normals[c].Length();
+			keys[c] = length > 0.0f ? Dot(centers[c] - meshCenter, normals[c]) / length : 0.0f;
+		}
+
+		std::vector<uint32_t> order(clusterCount);
+		for (uint32_t c = 0; c < clusterCount; ++c)
+			order[c] = c;
+		std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+		std::vector<uint32_t> source(indices, indices + 3 * (size_t)triangleCount);
+		uint32_t* out = indices;
+		for (uint32_t c : order)
+		{
+			out = std::copy(source.begin() + 3 * (size_t)splits[c], source.begin() + 3 * (size_t)splits[c + 1], out);
+		}
+	}
+
+	uint32_t OrderVertexFetch(const uint32_t* indices, size_t indexCount, std::vector<uint32_t>& remap, uint32_t numbered)
+	{
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			uint32_t v = indices[i];
+			CHECK(v < remap.size());
+			if (remap[v] == UINT32_MAX)
+				remap[v] = numbered++;
+		}
+		return numbered;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,44 @@
+// Reorder indexed triangle lists for the post transform vertex cache, overdraw and vertex fetch.
+
+#pragma once
+
+#include "../utility/utility.h"
+#include "../utility/geometry.h"
+
+namespace handwork
+{
+	// Vertex shader invocations of an index buffer drawn through a FIFO post transform cache. Acmr is
+	// the average per triangle, 0.5 at best for large regular meshes and 3 at worst. Atvr is the
+	// average per vertex referenced, 1 at best.
+	struct VertexCacheStats
+	{
+		uint32_t TriangleCount = 0;
+		// Distinct vertices the triangles reference.
+		uint32_t VertexCount = 0;
+		uint32_t TransformedVertices = 0;
+		float Acmr = 0.0f;
+		float Atvr = 0.0f;
+	};
+
+	VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+	// Reorder the triangles for vertex cache reuse with the scoring of Forsyth's linear speed vertex
+	// cache optimization, destination may be indices. clusters receives the first triangle of every run
+	// the optimizer had to start away from the vertices in its cache, beginning with 0.
+	void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+		std::vector<uint32_t>* clusters = nullptr);
+
+	// Reorder the clusters of a cache optimized index buffer in place so triangles facing away from
+	// the center of the mesh come first, which lets them occlude the ones behind them from most views.
+	// Clusters are split further where that costs at most threshold times their ACMR (Sander et al.,
+	// Fast Triangle Reordering for Vertex Locality and Reduced Overdraw). Positions are positionStride
+	// bytes apart.
+	void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vector3f* positions, size_t positionStride,
+		uint32_t vertexCount, const std::vector<uint32_t>& clusters, float threshold = 1.05f);
+
+	// Number vertices in the order indices first use them, so vertex fetch walks the vertex buffer
+	// forward. remap[v] is the new position of vertex v, UINT32_MAX for vertices not numbered yet. Call
+	// it again with further index ranges to go on numbering. Return the number of vertices numbered.
+	uint32_t OrderVertexFetch(const uint32_t* indices, size_t indexCount, std::vector<uint32_t>& remap, uint32_t numbered = 0);
+
+}	// namespace handwork
@@ -369,6 +369,13 @@ namespace handwork
 					L"    fps: " + fpsStr +
 					L"   mspf: " + mspfStr;
 
+				// CPU breakdown of the last frame.
+				const RenderStats& stats = mRenderResources->GetRenderStats();
+				wchar_t stageText[256];
+				swprintf_s(stageText, L"   cpu ms wait %.2f items %.2f mats %.2f pass %.2f cull %.2f record %.2f",
+					stats.WaitMs, stats.ItemUpdateMs, stats.MaterialUpdateMs, stats.PassUpdateMs, stats.CullMs, stats.RecordMs);
+				windowText += stageText;
+
 				SetWindowText(mhMainWnd, windowText.c_str());
 
 				// Reset for next average.
@@ -2,9 +2,10 @@
 
 #pragma once
 
-#include "MathHelper.h"
+#include "mathhelper.h"
 
 #define MaxLights 16
+#define MaxCascades 4
 
 namespace handwork
 {
@@ -55,6 +56,15 @@ namespace handwork
 			// indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
 			// are spot lights for a maximum of MaxLights per object.
 			Light Lights[MaxLights];
+
+			// Shadow cascades of the first light. Cascade i covers view depths up to CascadeSplits[i]
+			// and maps world space to its tile of the shadow map atlas.
+			Matrix4x4 CascadeTransforms[MaxCascades];
+			Vector4f CascadeSplits = { 0.0f, 0.0f, 0.0f, 0.0f };
+			UINT CascadeCount = 0;
+			UINT CascadePad0;
+			UINT CascadePad1;
+			UINT CascadePad2;
 		};
 
 		struct SsaoConstants
@@ -4,8 +4,6 @@ namespace handwork
 {
 	namespace rendering
 	{
-		using namespace DirectX;
-
 		Camera::Camera(float fovY, float zn, float zf)
 		{
 			mFovY = fovY;
@@ -6,7 +6,7 @@
 
 #pragma once
 
-#include "d3dUtil.h"
+#include "mathhelper.h"
 
 namespace handwork
 {
@@ -0,0 +1,123 @@
+#include "cpubackend.h"
+#include "../utility/stringprint.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		CpuBackend::CpuBackend(int width, int height)
+		{
+			Resize(width, height);
+		}
+
+		void CpuBackend::Resize(int width, int height)
+		{
+			CHECK(width > 0 && height > 0);
+			mWidth = width;
+			mHeight = height;
+			mRasterizer.Resize(width, height);
+		}
+
+		BufferHandle CpuBackend::CreateBuffer(BufferType type, size_t byteSize, const void* initData)
+		{
+			std::unique_ptr<CpuBuffer> buffer = std::make_unique<CpuBuffer>();
+			buffer->Type = type;
+			buffer->Data.resize(byteSize);
+			if (initData)
+				memcpy(buffer->Data.data(), initData, byteSize);
+			return HandleCast<BackendBuffer>(mBuffers.Add(std::move(buffer)));
+		}
+
+		void CpuBackend::UpdateBuffer(BufferHandle buffer, size_t byteOffset, size_t byteSize, const void* data)
+		{
+			CpuBuffer* b = mBuffers.Get(HandleCast<CpuBuffer>(buffer));
+			CHECK(b && byteOffset + byteSize <= b->Data.size());
+			memcpy(b->Data.data() + byteOffset, data, byteSize);
+		}
+
+		void CpuBackend::DestroyBuffer(BufferHandle buffer)
+		{
+			mBuffers.Remove(HandleCast<CpuBuffer>(buffer));
+		}
+
+		void CpuBackend::BeginFrame(const FrameSetup& setup)
+		{
+			mSetup = setup;
+			mDraws.clear();
+		}
+
+		void CpuBackend::Draw(const DrawCommand& draw)
+		{
+			mDraws.push_back(draw);
+		}
+
+		uint64_t CpuBackend::Submit()
+		{
+			const MaterialData* materials = nullptr;
+			size_t materialCount = 0;
+			CpuBuffer* materialBuffer = GetBuffer(mSetup.Materials, BufferType::Material);
+			if (materialBuffer)
+			{
+				materials = reinterpret_cast<const MaterialData*>(materialBuffer->Data.data());
+				materialCount = materialBuffer->Data.size() / sizeof(MaterialData);
+			}
+
+			// Resolve the buffers of the recorded draws.
+			mRasterDraws.clear();
+			for (const DrawCommand& draw : mDraws)
+			{
+				CpuBuffer* vb = GetBuffer(draw.VertexBuffer, BufferType::Vertex);
+				CpuBuffer* ib = GetBuffer(draw.IndexBuffer, BufferType::Index);
+				CpuBuffer* instb = GetBuffer(draw.InstanceBuffer, BufferType::Instance);
+				if (!vb || !ib || !instb)
+					continue;
+
+				size_t indexCount = ib->Data.size() / sizeof(uint32_t);
+				size_t instanceCount = instb->Data.size() / sizeof(InstanceData);
+				if ((size_t)draw.StartIndexLocation + draw.IndexCount > indexCount ||
+					(size_t)draw.FirstInstance + draw.InstanceCount > instanceCount)
+				{
+					LOG(ERROR) << "Draw reads past the end of its index or instance buffer.";
+					continue;
+				}
+
+				RasterDraw rasterDraw;
+				rasterDraw.Vertices = reinterpret_cast<const Vertex*>(vb->Data.data());
+				rasterDraw.VertexCount = vb->Data.size() / sizeof(Vertex);
+				rasterDraw.Indices = reinterpret_cast<const uint32_t*>(ib->Data.data()) + draw.StartIndexLocation;
+				rasterDraw.IndexCount = draw.IndexCount;
+				rasterDraw.BaseVertexLocation = draw.BaseVertexLocation;
+				rasterDraw.Instances = reinterpret_cast<const InstanceData*>(instb->Data.data()) + draw.FirstInstance;
+				rasterDraw.InstanceCount = draw.InstanceCount;
+				mRasterDraws.push_back(rasterDraw);
+			}
+
+			mRasterizer.Render(mSetup, mRasterDraws, materials, materialCount);
+			mDraws.clear();
+			return ++mFence;
+		}
+
+		void CpuBackend::ReadbackColor(RetrieveImageData& image)
+		{
+			mRasterizer.ReadbackColor(image);
+		}
+
+		void CpuBackend::ReadbackDepth(std::vector<float>& depth)
+		{
+			mRasterizer.ReadbackDepth(depth);
+		}
+
+		CpuBackend::CpuBuffer* CpuBackend::GetBuffer(BufferHandle buffer, BufferType type) const
+		{
+			CpuBuffer* b = mBuffers.Get(HandleCast<CpuBuffer>(buffer));
+			if (b && b->Type != type)
+			{
+				LOG(ERROR) << StringPrintf("Buffer %u is bound as type %d but was created as type %d.",
+					buffer.Index, (int)type, (int)b->Type);
+				return nullptr;
+			}
+			return b;
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,57 @@
+// Headless render backend that rasterizes on the CPU, for machines without a GPU.
+
+#pragma once
+
+#include "tilerasterizer.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Buffers live in system memory and Submit rasterizes the frame with the TileRasterizer before
+		// it returns, so every fence is complete by the time it is returned. The output mirrors the depth
+		// only and the opaque passes of the D3D12 renderer without shadows and SSAO.
+		class CpuBackend : public RenderBackend
+		{
+		public:
+			CpuBackend(int width, int height);
+
+			void Resize(int width, int height) override;
+			Vector2i GetRenderTargetSize() const override { return Vector2i(mWidth, mHeight); }
+
+			BufferHandle CreateBuffer(BufferType type, size_t byteSize, const void* initData) override;
+			void UpdateBuffer(BufferHandle buffer, size_t byteOffset, size_t byteSize, const void* data) override;
+			void DestroyBuffer(BufferHandle buffer) override;
+
+			void BeginFrame(const FrameSetup& setup) override;
+			void Draw(const DrawCommand& draw) override;
+			uint64_t Submit() override;
+			uint64_t GetCompletedFence() const override { return mFence; }
+			void WaitForFence(uint64_t) override {}
+
+			void ReadbackColor(RetrieveImageData& image) override;
+			void ReadbackDepth(std::vector<float>& depth) override;
+
+		private:
+			struct CpuBuffer
+			{
+				BufferType Type;
+				std::vector<uint8_t> Data;
+			};
+
+			CpuBuffer* GetBuffer(BufferHandle buffer, BufferType type) const;
+
+			HandlePool<CpuBuffer> mBuffers;
+
+			int mWidth = 0;
+			int mHeight = 0;
+			TileRasterizer mRasterizer;
+
+			FrameSetup mSetup;
+			std::vector<DrawCommand> mDraws;
+			std::vector<RasterDraw> mRasterDraws;
+			uint64_t mFence = 0;
+		};
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -3,6 +3,7 @@
 #include "d3dutil.h"
 #include <comdef.h>
 #include <fstream>
+#include <emmintrin.h>
 
 namespace handwork
 {
@@ -127,6 +128,24 @@ namespace handwork
 			return FunctionName + L" failed in " + Filename + L"; line " + std::to_wstring(LineNumber) + L"; error: " + msg;
 		}
 
+		void d3dUtil::StreamCopy(void* dest, const void* src, size_t byteSize)
+		{
+			if ((reinterpret_cast<uintptr_t>(dest) & 15) != 0 || (byteSize & 15) != 0)
+			{
+				memcpy(dest, src, byteSize);
+				return;
+			}
+			__m128i* d = reinterpret_cast<__m128i*>(dest);
+			const __m128i* s = reinterpret_cast<const __m128i*>(src);
+			for (size_t i = 0; i < byteSize / 16; ++i)
+				_mm_stream_si128(d + i, _mm_loadu_si128(s + i));
+		}
+
+		void d3dUtil::StreamFence()
+		{
+			_mm_sfence();
+		}
+
 		BoundingBox d3dUtil::MergeBoundingBox(const std::vector<DirectX::BoundingBox>& boxList)
 		{
 			BoundingBox temp0, temp1;
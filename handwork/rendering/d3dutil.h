@@ -17,6 +17,7 @@
 #include <vector>
 #include <array>
 #include <unordered_map>
+#include <map>
 #include <cstdint>
 #include <fstream>
 #include <sstream>
@@ -24,6 +25,11 @@
 #include "d3dx12.h"
 #include "MathHelper.h"
 #include "bridgestructs.h"
+#include "scenetypes.h"
+#include "meshlod.h"
+#include "../utility/bvh.h"
+#include "../utility/handle.h"
+#include "../utility/dirtyranges.h"
 
 #pragma warning(disable : 4244)
 
@@ -31,8 +37,6 @@ namespace handwork
 {
 	namespace rendering
 	{
-		const int gNumFrameResources = 3;
-
 		inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 		{
 			if (obj)
@@ -101,6 +105,12 @@ namespace handwork
 				const std::string& entrypoint,
 				const std::string& target);
 
+			// Copy into write combined memory such as mapped upload heaps with non temporal stores, so the
+			// destination lines are never read into the cache. Destinations and sizes that are not 16 byte
+			// aligned fall back to memcpy. The writing thread calls StreamFence() before the data is used.
+			static void StreamCopy(void* dest, const void* src, size_t byteSize);
+			static void StreamFence();
+
 			// Merge bounding box / sphere
 			static DirectX::BoundingBox MergeBoundingBox(const std::vector<DirectX::BoundingBox>& boxList);
 			static DirectX::BoundingSphere MergeBoundingSphere(const std::vector<DirectX::BoundingSphere>& sphereList);
@@ -141,27 +151,12 @@ namespace handwork
 			int LineNumber = -1;
 		};
 
-		// Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
-		// geometries are stored in one vertex and index buffer.  It provides the offsets
-		// and data needed to draw a subset of geometry stores in the vertex and index 
-		// buffers so that we can implement the technique described by Figure 6.3.
-		struct SubmeshGeometry
-		{
-			UINT IndexCount = 0;
-			UINT VertexCount = 0;
-			UINT StartIndexLocation = 0;
-			INT BaseVertexLocation = 0;
-
-			// Bounding box of the geometry defined by this submesh. 
-			// This is used in later chapters of the book.
-			DirectX::BoundingBox BoxBounds;
-			DirectX::BoundingSphere SphereBounds;
-		};
-
 		struct MeshGeometry
 		{
 			// Give it a name so we can look it up by name.
 			std::string Name;
+			// Unique index used to group draws by geometry.
+			UINT GeoIndex = 0;
 
 			// System memory copies.  Use Blobs because the vertex/index format can be generic.
 			// It is up to the client to cast appropriately.  
@@ -213,44 +208,14 @@ namespace handwork
 			}
 		};
 
-		// Simple struct to represent a material for our demos.  A production 3D engine
-		// would likely create a class hierarchy of Materials.
-		struct Material
-		{
-			// Unique material name for lookup.
-			std::string Name;
-
-			// Index into constant buffer corresponding to this material.
-			int MatCBIndex = -1;
-
-			// Dirty flag indicating the material has changed and we need to update the constant buffer.
-			// Because we have a material constant buffer for each FrameResource, we have to apply the
-			// update to each FrameResource.  Thus, when we modify a material we should set 
-			// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-			int NumFramesDirty = gNumFrameResources;
-
-			// Material constant buffer data used for shading.
-			Vector3f Albedo = { 1.0f, 1.0f, 1.0f };	//Fresnel/Diffuse
-			float Roughness = 0.5f;
-			float Metalness = 0.5f;
-		};
-
-		// Simple struct to represent a instance specific data.
-		struct Instance
-		{
-			Matrix4x4 World;
-			std::string MatName;
-		};
-
-		struct RenderItemData
+		// Views the render items are culled against. Each view packs its visible instances into its
+		// own region of the instance buffer, None draws everything. Shadow cascade i uses Shadow + i.
+		enum class CullView : int
 		{
-			std::string Name;
-			Matrix4x4 World;
-			std::string MatName;
-			std::string GeoName;
-			std::string DrawArgName;
-			D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-			std::vector<Instance> Instances;
+			Camera = 0,
+			Shadow,
+			Count = Shadow + MaxCascades,
+			None = Count
 		};
 
 		// Lightweight structure stores parameters to draw a shape.  This will
@@ -292,6 +257,36 @@ namespace handwork
 			// Instance drawing.
 			std::vector<InstanceData> Instances;
 			UINT InstCBIndex = -1;
+			// Instances still to be copied into the instance buffer of each frame resource.
+			DirtyRanges DirtyInstances[gNumFrameResources];
+
+			// Layer the item is drawn in and its position in the layer list.
+			int LayerIndex = -1;
+			int LayerPosition = -1;
+
+			// Items with the same batch index share geometry, submesh and topology. Visible non-instanced
+			// items of a batch are merged into one instanced draw.
+			UINT BatchIndex = 0;
+
+			// Level of detail selected for the camera this frame, of the item or of each instance. The
+			// shadow views draw the same levels.
+			int Lod = 0;
+			std::vector<uint8_t> InstanceLods;
+
+			// World space bounds for culling, refreshed together with the object data.
+			Bounds3f Bounds;
+			// First primitive of this item in the scene BVH, one per instance for instanced items.
+			// Items outside the BVH are never culled.
+			int BVHPrimOffset = -1;
+			// Result of culling against each view for non-instanced items.
+			bool Visible[(int)CullView::Count] = {};
+
+			// Indices of the instances inside each view. The visible instances are packed into the
+			// region of the view in the instance buffer every frame.
+			std::vector<int> VisibleInstances[(int)CullView::Count];
+			UINT VisibleInstanceCount[(int)CullView::Count] = {};
+			// The packed instances are ordered by level of detail, these count them per level.
+			UINT VisibleLodCounts[(int)CullView::Count][MaxLodLevels] = {};
 		};
 
 #ifndef ThrowIfFailed
@@ -0,0 +1,106 @@
+#include "depthutil.h"
+#include "../utility/stringprint.h"
+#include <cstdio>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HANDWORK_DEPTH_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace handwork
+{
+	namespace rendering
+	{
+		namespace depth
+		{
+			void UnpackDepth24(const BYTE* data, UINT width, UINT height, UINT pitch, float* deviceDepth)
+			{
+				const float scale = 1.0f / 16777215.0f;
+				for (UINT y = 0; y < height; ++y)
+				{
+					const uint32_t* row = reinterpret_cast<const uint32_t*>(data + (size_t)y * pitch);
+					float* out = deviceDepth + (size_t)y * width;
+					UINT x = 0;
+#if HANDWORK_DEPTH_SSE
+					const __m128i mask = _mm_set1_epi32(0xffffff);
+					const __m128 scale4 = _mm_set1_ps(scale);
+					for (; x + 4 <= width; x += 4)
+					{
+						__m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+						__m128 value = _mm_cvtepi32_ps(_mm_and_si128(texels, mask));
+						_mm_storeu_ps(out + x, _mm_mul_ps(value, scale4));
+					}
+#endif
+					for (; x < width; ++x)
+						out[x] = (float)(row[x] & 0xffffff) * scale;
+				}
+			}
+
+			void LinearizeDepth(const float* deviceDepth, float* viewDepth, size_t count, float nearZ, float farZ)
+			{
+				// Perspective maps view depth z to d = f / (f - n) - f * n / ((f - n) * z), so
+				// z = f * n / (f - d * (f - n)).
+				const float fn = farZ * nearZ;
+				const float range = farZ - nearZ;
+				size_t i = 0;
+#if HANDWORK_DEPTH_SSE
+				const __m128 fn4 = _mm_set1_ps(fn);
+				const __m128 range4 = _mm_set1_ps(range);
+				const __m128 far4 = _mm_set1_ps(farZ);
+				for (; i + 4 <= count; i += 4)
+				{
+					__m128 d = _mm_loadu_ps(deviceDepth + i);
+					__m128 denom = _mm_sub_ps(far4, _mm_mul_ps(d, range4));
+					_mm_storeu_ps(viewDepth + i, _mm_div_ps(fn4, denom));
+				}
+#endif
+				for (; i < count; ++i)
+					viewDepth[i] = fn / (farZ - deviceDepth[i] * range);
+			}
+
+			bool WriteRawFloat(const std::string& file, const float* depth, int width, int height)
+			{
+				FILE* fp = fopen(file.c_str(), "wb");
+				if (!fp)
+				{
+					LOG(ERROR) << StringPrintf("Cannot open \"%s\" for writing.", file.c_str());
+					return false;
+				}
+				size_t count = (size_t)width * height;
+				bool ok = fwrite(depth, sizeof(float), count, fp) == count;
+				fclose(fp);
+				return ok;
+			}
+
+			bool WritePgm16(const std::string& file, const float* depth, int width, int height, float maxDepth)
+			{
+				FILE* fp = fopen(file.c_str(), "wb");
+				if (!fp)
+				{
+					LOG(ERROR) << StringPrintf("Cannot open \"%s\" for writing.", file.c_str());
+					return false;
+				}
+				fprintf(fp, "P5\n%d %d\n65535\n", width, height);
+
+				// PGM stores 16 bit samples most significant byte first.
+				const float scale = 65535.0f / maxDepth;
+				std::vector<uint8_t> row(2 * (size_t)width);
+				bool ok = true;
+				for (int y = 0; y < height && ok; ++y)
+				{
+					const float* in = depth + (size_t)y * width;
+					for (int x = 0; x < width; ++x)
+					{
+						uint16_t v = (uint16_t)Clamp(in[x] * scale + 0.5f, 0.0f, 65535.0f);
+						row[2 * x] = (uint8_t)(v >> 8);
+						row[2 * x + 1] = (uint8_t)(v & 0xff);
+					}
+					ok = fwrite(row.data(), 1, row.size(), fp) == row.size();
+				}
+				fclose(fp);
+				return ok;
+			}
+		}	// namespace depth
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,30 @@
+// Conversion and export of read back depth buffers, shared by the D3D12 and the headless renderer.
+
+#pragma once
+
+#include "scenetypes.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Device depth is the post projection depth in [0, 1] of the perspective projection of Camera,
+		// 1 for pixels nothing was drawn to. View depth is the distance along the view direction.
+		namespace depth
+		{
+			// Convert the 24 bit unorm depth in the low bits of the 32 bit texels of a D24S8 read back,
+			// rows are pitch bytes apart, to width * height packed floats.
+			void UnpackDepth24(const BYTE* data, UINT width, UINT height, UINT pitch, float* deviceDepth);
+
+			// Map device depth to view depth, nearZ and farZ are the planes of the projection. Can run
+			// in place, empty pixels end up at farZ.
+			void LinearizeDepth(const float* deviceDepth, float* viewDepth, size_t count, float nearZ, float farZ);
+
+			// Write packed rows of depth as raw little endian float32 without header.
+			bool WriteRawFloat(const std::string& file, const float* depth, int width, int height);
+			// Write a 16 bit binary PGM with depth in [0, maxDepth] mapped to [0, 65535], larger values clamp.
+			bool WritePgm16(const std::string& file, const float* depth, int width, int height, float maxDepth);
+		}	// namespace depth
+
+	}	// namespace rendering
+}	// namespace handwork
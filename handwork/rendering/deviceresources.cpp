@@ -1,55 +1,8 @@
 ﻿// Manage device related resources for DirectX.
 
 #include "deviceresources.h"
-#include <wincodec.h>
-
-
-namespace DirectX
-{
-	IWICImagingFactory2* _GetWIC()
-	{
-		static INIT_ONCE s_initOnce = INIT_ONCE_STATIC_INIT;
-
-		IWICImagingFactory2* factory = nullptr;
-		(void)InitOnceExecuteOnce(&s_initOnce,
-			[](PINIT_ONCE, PVOID, PVOID *factory) -> BOOL
-		{
-			return SUCCEEDED(CoCreateInstance(
-				CLSID_WICImagingFactory2,
-				nullptr,
-				CLSCTX_INPROC_SERVER,
-				__uuidof(IWICImagingFactory2),
-				factory)) ? TRUE : FALSE;
-		}, nullptr, reinterpret_cast<LPVOID*>(&factory));
-
-		return factory;
-	}
-
-	class auto_delete_file_wic
-	{
-	public:
-		auto_delete_file_wic(Microsoft::WRL::ComPtr<IWICStream>& hFile, LPCWSTR szFile) : m_filename(szFile), m_handle(hFile) {}
-
-		auto_delete_file_wic(const auto_delete_file_wic&) = delete;
-		auto_delete_file_wic& operator=(const auto_delete_file_wic&) = delete;
-
-		~auto_delete_file_wic()
-		{
-			if (m_filename)
-			{
-				m_handle.Reset();
-				DeleteFileW(m_filename);
-			}
-		}
-
-		void clear() { m_filename = 0; }
-
-	private:
-		LPCWSTR m_filename;
-		Microsoft::WRL::ComPtr<IWICStream>& m_handle;
-	};
-
-} // namespace DirectX
+#include "depthutil.h"
+#include "imagewriter.h"
 
 
 namespace handwork
@@ -161,6 +114,8 @@ namespace handwork
 			// calling Reset.
 			mCommandList->Close();
 
+			mReadBackQueue = std::make_unique<ReadBackQueue>(this);
+
 			// Create rtv and dsv heap
 			// 2 for swap chain,  1 for screen normal map, 2 for ambient maps.
 			D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
@@ -424,42 +379,8 @@ namespace handwork
 				mCommandList->ResourceBarrier(2, barriers);
 			}
 
-			// Create read back buffers. Readback resources must be buffers.
-			D3D12_RESOURCE_DESC referdesc = mSwapChainBuffer[0]->GetDesc();
-			UINT64 totalResourceSize = 0;
-			UINT64 fpRowPitch = 0;
-			UINT fpRowCount = 0;
-			md3dDevice->GetCopyableFootprints(	// Get the rowcount, pitch and size of the top mip
-				&referdesc,
-				0,
-				1,
-				0,
-				nullptr,
-				&fpRowCount,
-				&fpRowPitch,
-				&totalResourceSize);
-			UINT64 dstRowPitch = (fpRowPitch + 255) & ~0xFF;	// Round up the srcPitch to multiples of 256
-			mReadBackRowPitch = dstRowPitch;
-			// Create read back buffer for render target.
-			D3D12_RESOURCE_DESC readBackDesc;
-			readBackDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-			readBackDesc.Alignment = referdesc.Alignment;
-			readBackDesc.Width = dstRowPitch * referdesc.Height;
-			readBackDesc.Height = 1;
-			readBackDesc.DepthOrArraySize = 1;
-			readBackDesc.MipLevels = 1;
-			readBackDesc.Format = DXGI_FORMAT_UNKNOWN;
-			readBackDesc.SampleDesc.Count = 1;
-			readBackDesc.SampleDesc.Quality = 0;
-			readBackDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-			readBackDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-			ThrowIfFailed(md3dDevice->CreateCommittedResource(
-				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
-				D3D12_HEAP_FLAG_NONE,
-				&readBackDesc,
-				D3D12_RESOURCE_STATE_COPY_DEST,
-				nullptr,
-				IID_PPV_ARGS(mReadBackBuffer.GetAddressOf())));
+			// Keep read back buffers for the render target ready, earlier requests keep their own buffers.
+			mReadBackQueue->Reserve(ReadBackQueue::InitialBufferCount, mSwapChainBuffer[0].Get());
 
 			// Update the viewport transform to cover the client area.
 			mScreenViewport.TopLeftX = 0;
@@ -507,6 +428,12 @@ namespace handwork
 		}
 
 		void DeviceResources::FlushCommandQueue()
+		{
+			// Wait until the GPU has completed commands up to this fence point.
+			WaitForFence(Signal());
+		}
+
+		UINT64 DeviceResources::Signal()
 		{
 			// Advance the fence value to mark commands up to this fence point.
 			mCurrentFence++;
@@ -515,19 +442,20 @@ namespace handwork
 			// are on the GPU timeline, the new fence point won't be set until the GPU finishes
 			// processing all the commands prior to this Signal().
 			ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
+			mReadBackQueue->OnSignal(mCurrentFence);
+			return mCurrentFence;
+		}
 
-			// Wait until the GPU has completed commands up to this fence point.
-			if (mFence->GetCompletedValue() < mCurrentFence)
-			{
-				HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-
-				// Fire event when GPU hits current fence.  
-				ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+		void DeviceResources::WaitForFence(UINT64 fence)
+		{
+			if (fence == 0 || mFence->GetCompletedValue() >= fence)
+				return;
 
-				// Wait until the GPU hits current fence event is fired.
-				WaitForSingleObject(eventHandle, INFINITE);
-				CloseHandle(eventHandle);
-			}
+			// Fire event when GPU hits the fence and wait for it.
+			HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+			ThrowIfFailed(mFence->SetEventOnCompletion(fence, eventHandle));
+			WaitForSingleObject(eventHandle, INFINITE);
+			CloseHandle(eventHandle);
 		}
 
 		// Determine the dimensions of the render target and whether it will be scaled down.
@@ -554,6 +482,8 @@ namespace handwork
 		// Recreate all device resources and set them back to the current state.
 		void DeviceResources::HandleDeviceLost()
 		{
+			// Outstanding read back tickets are lost with the device.
+			mReadBackQueue.reset();
 			mSwapChain.Reset();
 			mCommandQueue.Reset();
 			mCommandList.Reset();
@@ -603,39 +533,47 @@ namespace handwork
 		}
 
 		// Prepare presentation work.
-		void DeviceResources::PreparePresent(bool clearDepth)
+		void DeviceResources::PreparePresent(bool clearDepth, ID3D12GraphicsCommandList* cmdList)
 		{
-			mCommandList->RSSetViewports(1, &mScreenViewport);
-			mCommandList->RSSetScissorRects(1, &mScissorRect);
+			if (!cmdList)
+				cmdList = mCommandList.Get();
 
 			// Indicate a state transition on the resource usage.
 			if (mMsaaQuality <= 0)
 			{
-				mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 					D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 				// WE ALREADY WROTE THE DEPTH INFO TO THE DEPTH BUFFER IN DrawNormalsAndDepth,
 				// SO DO NOT CLEAR DEPTH.
 				if(clearDepth)
-					mCommandList->ClearDepthStencilView(Dsv(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+					cmdList->ClearDepthStencilView(Dsv(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 			}
 			else
 			{
-				mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentOffScreenBuffer(),
+				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentOffScreenBuffer(),
 					D3D12_RESOURCE_STATE_RESOLVE_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
-				mCommandList->ClearDepthStencilView(DsvMS(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+				cmdList->ClearDepthStencilView(DsvMS(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 			}
 
 			// Clear the back buffer.
-			mCommandList->ClearRenderTargetView(CurrentRtv(), DirectX::Colors::Black, 0, nullptr);
+			cmdList->ClearRenderTargetView(CurrentRtv(), DirectX::Colors::Black, 0, nullptr);
+
+			BindRenderTargets(cmdList);
+		}
+
+		void DeviceResources::BindRenderTargets(ID3D12GraphicsCommandList* cmdList)
+		{
+			cmdList->RSSetViewports(1, &mScreenViewport);
+			cmdList->RSSetScissorRects(1, &mScissorRect);
 
 			// Specify the buffers we are going to render to.
 			if (mMsaaQuality <= 0)
 			{
-				mCommandList->OMSetRenderTargets(1, &CurrentRtv(), true, &Dsv());
+				cmdList->OMSetRenderTargets(1, &CurrentRtv(), true, &Dsv());
 			}
 			else
 			{
-				mCommandList->OMSetRenderTargets(1, &CurrentRtv(), true, &DsvMS());
+				cmdList->OMSetRenderTargets(1, &CurrentRtv(), true, &DsvMS());
 			}
 		}
 
@@ -689,6 +627,7 @@ namespace handwork
 			// Because we are on the GPU timeline, the new fence point won't be 
 			// set until the GPU finishes processing all the commands prior to this Signal().
 			mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+			mReadBackQueue->OnSignal(mCurrentFence);
 
 			// If the device was removed either by a disconnection or a driver upgrade, we 
 			// must recreate all device resources.
@@ -705,108 +644,45 @@ namespace handwork
 		// Read back the render target buffer.
 		RetrieveImageData* DeviceResources::RetrieveRenderTargetBuffer()
 		{
-			// Reset command list.
-			ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+			ReadBackTicket ticket = RequestRenderTargetReadBack();
+			mReadBackQueue->Wait(ticket);
 
+			RetrieveImageData* res = new RetrieveImageData();
+			mReadBackQueue->Copy(ticket, *res);
+			mReadBackQueue->Release(ticket);
+			return res;
+		}
+
+		ReadBackTicket DeviceResources::RequestRenderTargetReadBack(ReadBackCallback callback)
+		{
 			// Note that the swap chain has already been swapped. So what we actually need to fetch is the previous back buffer.
 			ID3D12Resource* sourceBuffer = mSwapChainBuffer[(mCurrBackBuffer + SwapChainBufferCount - 1) % SwapChainBufferCount].Get();
+			return mReadBackQueue->Request(sourceBuffer, callback);
+		}
 
-			// Transition the resource.
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(sourceBuffer,
-				D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_SOURCE));
-			// Get the copy target location.
-			D3D12_RESOURCE_DESC referdesc = sourceBuffer->GetDesc();
-			D3D12_PLACED_SUBRESOURCE_FOOTPRINT bufferFootprint = {};
-			bufferFootprint.Footprint.Width = static_cast<UINT>(referdesc.Width);
-			bufferFootprint.Footprint.Height = referdesc.Height;
-			bufferFootprint.Footprint.Depth = 1;
-			bufferFootprint.Footprint.RowPitch = static_cast<UINT>(mReadBackRowPitch);
-			bufferFootprint.Footprint.Format = referdesc.Format;
-
-			CD3DX12_TEXTURE_COPY_LOCATION copyDest(mReadBackBuffer.Get(), bufferFootprint);
-			CD3DX12_TEXTURE_COPY_LOCATION copySrc(sourceBuffer, 0);
-
-			// Copy the texture
-			mCommandList->CopyTextureRegion(&copyDest, 0, 0, 0, &copySrc, nullptr);
-
-			// Transition the resource.
-			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(sourceBuffer,
-				D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_PRESENT));
-
-			// Wait to finish.
-			ThrowIfFailed(mCommandList->Close());
-			ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-			mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-			FlushCommandQueue();
+		ReadBackTicket DeviceResources::RequestDepthReadBack(ReadBackCallback callback)
+		{
+			// The MSAA depth buffer cannot be copied, RenderResources renders the single sample depth
+			// buffer for MSAA as well.
+			return mReadBackQueue->Request(mDepthStencilBuffer.Get(), callback, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		}
 
-			RetrieveImageData* res = new RetrieveImageData();
-			res->Width = static_cast<UINT>(referdesc.Width);
-			res->Height = static_cast<UINT>(referdesc.Height);
-			res->Pitch = static_cast<UINT>(mReadBackRowPitch);
-			res->Data.resize(res->Pitch * res->Height);
-			BYTE* mMappedData = nullptr;
-			ThrowIfFailed(mReadBackBuffer->Map(0, &CD3DX12_RANGE(0, mReadBackRowPitch * referdesc.Height), reinterpret_cast<void**>(&mMappedData)));
-			memcpy(&res->Data[0], mMappedData, res->Data.size());
-			mReadBackBuffer->Unmap(0, &CD3DX12_RANGE(0, 0));
+		void DeviceResources::RetrieveDepthBuffer(std::vector<float>& depth)
+		{
+			ReadBackTicket ticket = RequestDepthReadBack();
+			mReadBackQueue->Wait(ticket);
 
-			return res;
+			ReadBackData data;
+			mReadBackQueue->Map(ticket, data);
+			depth.resize((size_t)data.Width * data.Height);
+			depth::UnpackDepth24(data.Data, data.Width, data.Height, data.Pitch, depth.data());
+			mReadBackQueue->Release(ticket);
 		}
 
-		// Save a read back texture buffer to local image using WIC.
+		// Save a read back texture buffer to a local image, the format follows the file extension.
 		void DeviceResources::SaveToLocalImage(RetrieveImageData* data, const std::string& file)
 		{
-			std::wstring lname = AnsiToWString(file);
-			auto fileName = lname.c_str();
-
-			// The source data format is always treated as 32RGBA. We use bmp natie codec. It will encode as 32BGRA format. So we should do a conversion.
-			WICPixelFormatGUID pfGuid = GUID_WICPixelFormat32bppRGBA;
-			WICPixelFormatGUID targetGuid = GUID_WICPixelFormat32bppBGRA;
-			wchar_t* optFormatName = L"EnableV5Header32bppBGRA";
-
-			auto pWIC = DirectX::_GetWIC();
-			if (!pWIC)
-			{
-				LOG(ERROR) << "Cannot get the WIC factory.";
-				return;
-			}
-
-			ComPtr<IWICStream> stream;
-			ThrowIfFailed(pWIC->CreateStream(stream.GetAddressOf()));
-			ThrowIfFailed(stream->InitializeFromFilename(fileName, GENERIC_WRITE));
-			DirectX::auto_delete_file_wic delonfail(stream, fileName);
-			ComPtr<IWICBitmapEncoder> encoder;
-			ThrowIfFailed(pWIC->CreateEncoder(GUID_ContainerFormatBmp, nullptr, encoder.GetAddressOf()));
-			ThrowIfFailed(encoder->Initialize(stream.Get(), WICBitmapEncoderNoCache));
-			ComPtr<IWICBitmapFrameEncode> frame;
-			ComPtr<IPropertyBag2> props;
-			ThrowIfFailed(encoder->CreateNewFrame(frame.GetAddressOf(), props.GetAddressOf()));
-
-			// Opt-in to the WIC2 support for writing 32-bit Windows BMP files with an alpha channel
-			PROPBAG2 option = {};
-			option.pstrName = optFormatName;
-			VARIANT varValue;
-			varValue.vt = VT_BOOL;
-			varValue.boolVal = VARIANT_TRUE;
-			(void)props->Write(1, &option, &varValue);
-
-			ThrowIfFailed(frame->Initialize(props.Get()));
-			ThrowIfFailed(frame->SetSize(static_cast<UINT>(data->Width), data->Height));
-			ThrowIfFailed(frame->SetResolution(72, 72));
-			ThrowIfFailed(frame->SetPixelFormat(&targetGuid));
-
-			// Do conversion.
-			ComPtr<IWICBitmap> source;
-			ThrowIfFailed(pWIC->CreateBitmapFromMemory(static_cast<UINT>(data->Width), data->Height, pfGuid,
-				static_cast<UINT>(data->Pitch), static_cast<UINT>(data->Pitch * data->Height), &(data->Data[0]), source.GetAddressOf()));
-			ComPtr<IWICFormatConverter> FC;
-			ThrowIfFailed(pWIC->CreateFormatConverter(FC.GetAddressOf()));
-			ThrowIfFailed(FC->Initialize(source.Get(), targetGuid, WICBitmapDitherTypeNone, nullptr, 0, WICBitmapPaletteTypeMedianCut));
-			WICRect rect = { 0, 0, static_cast<INT>(data->Width), static_cast<INT>(data->Height) };
-			ThrowIfFailed(frame->WriteSource(FC.Get(), &rect));
-
-			ThrowIfFailed(frame->Commit());
-			ThrowIfFailed(encoder->Commit());
-			delonfail.clear();
+			WriteImage(file, MakeImageView(*data));
 		}
 
 		CD3DX12_CPU_DESCRIPTOR_HANDLE DeviceResources::CurrentRtv() const
@@ -866,11 +742,6 @@ namespace handwork
 			return mDepthStencilBufferMS.Get();
 		}
 
-		ID3D12Resource* DeviceResources::ReadBackBuffer() const
-		{
-			return mReadBackBuffer.Get();
-		}
-
 		// Be sure to pick up the first adapter that supports D3D12, use the following code.
 		void DeviceResources::GetHardwareAdapter(IDXGIFactory4* pFactory, IDXGIAdapter1** ppAdapter)
 		{
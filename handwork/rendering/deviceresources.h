@@ -3,6 +3,8 @@
 #pragma once
 
 #include "d3dUtil.h"
+#include "renderbackend.h"
+#include "readbackqueue.h"
 
 namespace handwork
 {
@@ -24,15 +26,6 @@ namespace handwork
 			MSAAx8
 		};
 
-		class RetrieveImageData
-		{
-		public:
-			UINT Width;
-			UINT Height;
-			UINT Pitch;
-			std::vector<BYTE> Data;
-		};
-
 		class DeviceResources
 		{
 		public:
@@ -43,9 +36,18 @@ namespace handwork
 			void HandleDeviceLost();
 			void RegisterDeviceNotify(IDeviceNotify* deviceNotify);
 			void Trim();
-			void PreparePresent(bool clearDepth = false);
+			// Move the render target into the render target state, clear it and bind it. Commands go to
+			// cmdList, or the command list of the device when it is nullptr.
+			void PreparePresent(bool clearDepth = false, ID3D12GraphicsCommandList* cmdList = nullptr);
+			// Bind the viewport and the prepared render target without clearing, for command lists that
+			// continue drawing to it.
+			void BindRenderTargets(ID3D12GraphicsCommandList* cmdList);
 			void Present(UINT64& currentFrameFence);
 			void FlushCommandQueue();
+			// Signal the next fence value on the queue and return it without waiting.
+			UINT64 Signal();
+			// Block until the GPU reached the fence value, 0 never blocks.
+			void WaitForFence(UINT64 fence);
 
 			// Device accessors.
 			Vector2i GetRenderTargetSize() const { return mRenderTargetSize; }
@@ -74,7 +76,6 @@ namespace handwork
 			ID3D12Resource* DepthStencilBuffer() const;
 			ID3D12Resource* CurrentOffScreenBuffer() const;
 			ID3D12Resource* DepthStencilBufferMS() const;
-			ID3D12Resource* ReadBackBuffer() const;
 			void ManualSwapBackBuffers(){ mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount; }
 
 			UINT GetRtvSize() const { return mRtvDescriptorSize; }
@@ -89,6 +90,14 @@ namespace handwork
 
 			// Note that the result need to be manually freed.
 			RetrieveImageData* RetrieveRenderTargetBuffer();
+			// Asynchronous read back of the last presented or discrete rendered frame, which never blocks.
+			ReadBackTicket RequestRenderTargetReadBack(ReadBackCallback callback = nullptr);
+			// Asynchronous read back of the single sample depth buffer, 24 bit unorm depth in the low bits of
+			// 32 bit texels, see depth::UnpackDepth24.
+			ReadBackTicket RequestDepthReadBack(ReadBackCallback callback = nullptr);
+			// Post projection depth of the last frame, packed rows of floats.
+			void RetrieveDepthBuffer(std::vector<float>& depth);
+			ReadBackQueue* GetReadBackQueue() const { return mReadBackQueue.get(); }
 			void SaveToLocalImage(RetrieveImageData* data, const std::string& file);
 
 		private:
@@ -138,8 +147,7 @@ namespace handwork
 			UINT mMsaaQuality;
 
 			// Readback
-			Microsoft::WRL::ComPtr<ID3D12Resource> mReadBackBuffer;
-			UINT64 mReadBackRowPitch = 0;
+			std::unique_ptr<ReadBackQueue> mReadBackQueue;
 
 			// Direct3D properties.
 			D3D_DRIVER_TYPE md3dDriverType = D3D_DRIVER_TYPE_HARDWARE;
@@ -6,11 +6,19 @@ namespace handwork
 {
 	namespace rendering
 	{
-		FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount)
+		FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount,
+			UINT recordJobCount)
 		{
 			ThrowIfFailed(device->CreateCommandAllocator(
 				D3D12_COMMAND_LIST_TYPE_DIRECT,
 				IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+			RecordCmdListAllocs.resize(recordJobCount);
+			for (auto& alloc : RecordCmdListAllocs)
+			{
+				ThrowIfFailed(device->CreateCommandAllocator(
+					D3D12_COMMAND_LIST_TYPE_DIRECT,
+					IID_PPV_ARGS(alloc.GetAddressOf())));
+			}
 
 			PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, std::max(passCount, (UINT)1), true);
 			SsaoCB = std::make_unique<UploadBuffer<SsaoConstants>>(device, 1, true);
@@ -13,7 +13,8 @@ namespace handwork
 		struct FrameResource
 		{
 		public:
-			FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT instaceCount);
+			FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT instaceCount,
+				UINT recordJobCount = 1);
 			FrameResource(const FrameResource& rhs) = delete;
 			FrameResource& operator=(const FrameResource& rhs) = delete;
 			~FrameResource();
@@ -21,6 +22,8 @@ namespace handwork
 			// We cannot reset the allocator until the GPU is done processing the commands.
 			// So each frame needs their own allocator.
 			Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+			// The command lists recorded in parallel need one allocator each.
+			std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> RecordCmdListAllocs;
 
 			// We cannot update a cbuffer until the GPU is done processing the commands
 			// that reference it.  So each frame needs their own cbuffers.
@@ -0,0 +1,128 @@
+#include "geometryoptimizer.h"
+#include "../utility/stringprint.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		namespace
+		{
+			struct Range
+			{
+				UINT Start;
+				UINT Count;
+
+				bool operator<(const Range& rhs) const { return Start < rhs.Start || (Start == rhs.Start && Count < rhs.Count); }
+				bool operator==(const Range& rhs) const { return Start == rhs.Start && Count == rhs.Count; }
+			};
+
+			// Sort and merge equal ranges, return false if any two of the rest overlap.
+			bool MakeDisjoint(std::vector<Range>& ranges)
+			{
+				std::sort(ranges.begin(), ranges.end());
+				ranges.erase(std::unique(ranges.begin(), ranges.end()), ranges.end());
+				for (size_t i = 1; i < ranges.size(); ++i)
+				{
+					if (ranges[i - 1].Start + ranges[i - 1].Count > ranges[i].Start)
+						return false;
+				}
+				return true;
+			}
+
+			void Accumulate(VertexCacheStats& total, const VertexCacheStats& stats)
+			{
+				total.TriangleCount += stats.TriangleCount;
+				total.VertexCount += stats.VertexCount;
+				total.TransformedVertices += stats.TransformedVertices;
+				total.Acmr = total.TriangleCount > 0 ? (float)total.TransformedVertices / total.TriangleCount : 0.0f;
+				total.Atvr = total.VertexCount > 0 ? (float)total.TransformedVertices / total.VertexCount : 0.0f;
+			}
+		}	// namespace
+
+		GeometryOptimizeStats OptimizeGeometry(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+			const std::unordered_map<std::string, SubmeshGeometry>& drawArgs, bool reduceOverdraw)
+		{
+			GeometryOptimizeStats stats;
+
+			// The index ranges drawn from every vertex range.
+			std::vector<Range> vertexRanges;
+			std::vector<Range> indexRanges;
+			std::vector<std::pair<Range, Range>> uses;
+			for (auto& e : drawArgs)
+			{
+				const SubmeshGeometry& submesh = e.second;
+				CHECK(submesh.BaseVertexLocation >= 0 && submesh.BaseVertexLocation + submesh.VertexCount <= vertices.size());
+				Range vertexRange = { (UINT)submesh.BaseVertexLocation, submesh.VertexCount };
+				vertexRanges.push_back(vertexRange);
+				uses.push_back(std::make_pair(vertexRange, Range{ submesh.StartIndexLocation, submesh.IndexCount }));
+				for (const SubmeshLod& lod : submesh.Lods)
+					uses.push_back(std::make_pair(vertexRange, Range{ lod.StartIndexLocation, lod.IndexCount }));
+			}
+			for (auto& use : uses)
+			{
+				CHECK(use.second.Start + use.second.Count <= indices.size());
+				indexRanges.push_back(use.second);
+			}
+			// Every index range has to belong to a single vertex range.
+			std::sort(uses.begin(), uses.end());
+			uses.erase(std::unique(uses.begin(), uses.end()), uses.end());
+			if (!MakeDisjoint(vertexRanges) || !MakeDisjoint(indexRanges) || indexRanges.size() != uses.size())
+			{
+				LOG(ERROR) << "Draw args of the geometry partly overlap, it is not optimized.";
+				return stats;
+			}
+
+			std::vector<uint32_t> clusters;
+			std::vector<uint32_t> remap;
+			std::vector<Vertex> ordered;
+			for (const Range& vertexRange : vertexRanges)
+			{
+				if (vertexRange.Count == 0)
+					continue;
+				Vertex* rangeVertices = vertices.data() + vertexRange.Start;
+				auto first = std::lower_bound(uses.begin(), uses.end(), std::make_pair(vertexRange, Range{ 0, 0 }));
+				auto last = first;
+				while (last != uses.end() && last->first == vertexRange)
+					++last;
+
+				// Triangles first, their order decides the order of the vertices.
+				remap.assign(vertexRange.Count, UINT32_MAX);
+				uint32_t numbered = 0;
+				for (auto use = first; use != last; ++use)
+				{
+					uint32_t* rangeIndices = indices.data() + use->second.Start;
+					size_t count = use->second.Count;
+					Accumulate(stats.Before, AnalyzeVertexCache(rangeIndices, count, vertexRange.Count));
+					OptimizeVertexCache(rangeIndices, rangeIndices, count, vertexRange.Count, &clusters);
+					if (reduceOverdraw)
+						OptimizeOverdraw(rangeIndices, count, &rangeVertices[0].Pos, sizeof(Vertex), vertexRange.Count, clusters);
+					numbered = OrderVertexFetch(rangeIndices, count, remap, numbered);
+					++stats.IndexRanges;
+				}
+
+				// Vertices no triangle uses go last.
+				for (uint32_t& r : remap)
+				{
+					if (r == UINT32_MAX)
+						r = numbered++;
+				}
+				ordered.resize(vertexRange.Count);
+				for (uint32_t v = 0; v < vertexRange.Count; ++v)
+					ordered[remap[v]] = rangeVertices[v];
+				std::copy(ordered.begin(), ordered.end(), rangeVertices);
+				for (auto use = first; use != last; ++use)
+				{
+					uint32_t* rangeIndices = indices.data() + use->second.Start;
+					for (UINT i = 0; i < use->second.Count; ++i)
+						rangeIndices[i] = remap[rangeIndices[i]];
+					Accumulate(stats.After, AnalyzeVertexCache(rangeIndices, use->second.Count, vertexRange.Count));
+				}
+			}
+
+			LOG(INFO) << StringPrintf("Optimized %u index ranges, %u triangles: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f.",
+				stats.IndexRanges, stats.After.TriangleCount, stats.Before.Acmr, stats.After.Acmr, stats.Before.Atvr, stats.After.Atvr);
+			return stats;
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
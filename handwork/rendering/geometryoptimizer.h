@@ -0,0 +1,31 @@
+// Reorder the index and vertex buffers of a geometry for the vertex cache, overdraw and vertex fetch
+// before it is added to a renderer.
+
+#pragma once
+
+#include "scenetypes.h"
+#include "../mesh/vertexcache.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Vertex cache statistics of all index ranges together, before and after.
+		struct GeometryOptimizeStats
+		{
+			VertexCacheStats Before;
+			VertexCacheStats After;
+			UINT IndexRanges = 0;
+		};
+
+		// Reorder the triangles of every index range of drawArgs, their levels of detail included, for the
+		// vertex cache and, if reduceOverdraw, so front facing clusters come first. Then renumber the
+		// vertices of every vertex range in the order its triangles first use them. Draw args sharing a
+		// range have to share it exactly, geometries whose ranges partly overlap are left alone and
+		// logged. Call it after BuildSubmeshLods and before adding the geometry, the ACMR and ATVR before
+		// and after are logged.
+		GeometryOptimizeStats OptimizeGeometry(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+			const std::unordered_map<std::string, SubmeshGeometry>& drawArgs, bool reduceOverdraw = true);
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,349 @@
+#include "headlessrenderer.h"
+#include "depthutil.h"
+#include "meshlod.h"
+#include "../utility/stringprint.h"
+#include <chrono>
+
+namespace handwork
+{
+	namespace rendering
+	{
+		HeadlessRenderer::HeadlessRenderer(const std::shared_ptr<RenderBackend>& backend, const std::shared_ptr<Camera>& camera,
+			bool depthOnlyMode) :
+			mBackend(backend),
+			mCamera(camera),
+			mDepthOnlyMode(depthOnlyMode)
+		{
+			CHECK(mBackend != nullptr && mCamera != nullptr);
+
+			// Same default lights as the D3D12 renderer.
+			mAmbientLight = { 0.4f, 0.4f, 0.4f, 1.0f };
+			mDirectLights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
+			mDirectLights[0].Strength = { 0.4f, 0.4f, 0.5f };
+			mDirectLights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
+			mDirectLights[1].Strength = { 0.1f, 0.1f, 0.1f };
+			mDirectLights[2].Direction = { 0.0f, -0.707f, -0.707f };
+			mDirectLights[2].Strength = { 0.0f, 0.0f, 0.0f };
+
+			Vector2i renderSize = mBackend->GetRenderTargetSize();
+			mCamera->SetLens((float)renderSize.x / renderSize.y);
+		}
+
+		HeadlessRenderer::~HeadlessRenderer()
+		{
+			mBackend->WaitForFence(mFrameFence);
+			for (size_t i = 0; i < mGeometries.SlotCount(); ++i)
+			{
+				SceneGeometry* geo = mGeometries.At(i);
+				if (!geo)
+					continue;
+				mBackend->DestroyBuffer(geo->VertexBuffer);
+				mBackend->DestroyBuffer(geo->IndexBuffer);
+			}
+			if (mMaterialBuffer.IsValid())
+				mBackend->DestroyBuffer(mMaterialBuffer);
+			if (mInstanceBuffer.IsValid())
+				mBackend->DestroyBuffer(mInstanceBuffer);
+		}
+
+		void HeadlessRenderer::SetLights(Light* lights)
+		{
+			mDirectLights[0] = lights[0];
+			mDirectLights[1] = lights[1];
+			mDirectLights[2] = lights[2];
+		}
+
+		void HeadlessRenderer::SetRenderSize(int width, int height)
+		{
+			mBackend->WaitForFence(mFrameFence);
+			mBackend->Resize(width, height);
+			mCamera->SetLens((float)width / height);
+		}
+
+		MaterialHandle HeadlessRenderer::AddMaterial(const Material& mat)
+		{
+			// Every frame uploads to the same buffer.
+			return mMaterials.Add(mat, 1);
+		}
+
+		GeometryHandle HeadlessRenderer::AddGeometryData(
+			const std::vector<Vertex>& vertices,
+			const std::vector<std::uint32_t>& indices,
+			const std::unordered_map<std::string, SubmeshGeometry>& drawArgs,
+			const std::string& name)
+		{
+			auto geo = std::make_unique<SceneGeometry>();
+			geo->Name = name;
+			geo->VertexBuffer = mBackend->CreateBuffer(BufferType::Vertex, vertices.size() * sizeof(Vertex), vertices.data());
+			geo->IndexBuffer = mBackend->CreateBuffer(BufferType::Index, indices.size() * sizeof(std::uint32_t), indices.data());
+
+			geo->DrawArgs = drawArgs;
+			ComputeSubmeshBounds(vertices, geo->DrawArgs);
+
+			GeometryHandle handle = HandleCast<MeshGeometry>(mGeometries.Add(std::move(geo)));
+			mGeometryNames.Add(name, handle);
+			return handle;
+		}
+
+		std::vector<RenderItemHandle> HeadlessRenderer::AddRenderItem(const std::vector<RenderItemData>& renderItems, const RenderLayer layer)
+		{
+			std::vector<RenderItemHandle> handles;
+			handles.reserve(renderItems.size());
+			for (auto& e : renderItems)
+			{
+				SceneGeometry* geo = mGeometries.Get(HandleCast<SceneGeometry>(e.Geo));
+				Material* mat = nullptr;
+				SubmeshGeometry* subMesh = ResolveRenderItem(e, geo ? &geo->DrawArgs : nullptr, mMaterials, &mat);
+				if (!subMesh)
+				{
+					handles.push_back(RenderItemHandle());
+					continue;
+				}
+				if (e.PrimitiveType != gTriangleListTopology)
+					LOG(ERROR) << StringPrintf("Render item \"%s\" is not a triangle list, drawing it as one.", e.Name.c_str());
+
+				auto item = std::make_unique<SceneItem>();
+				item->Name = e.Name;
+				item->Geo = geo;
+				item->SubMesh = subMesh;
+				item->Layer = layer;
+				if (e.Instances.size() == 0)
+				{
+					// Non-instanced items take a single element of the instance buffer.
+					item->Instances.resize(1);
+					item->Instances[0].World = e.World;
+					item->Instances[0].MaterialIndex = mat->MatCBIndex;
+				}
+				else
+				{
+					mMaterials.ResolveInstances(e.Instances, item->Instances, e.Name);
+					item->Instanced = true;
+				}
+				item->InstanceOffset = AllocateInstanceRange((UINT)item->Instances.size());
+
+				RenderItemHandle handle = HandleCast<RenderItem>(mItems.Add(std::move(item)));
+				mRenderItemNames.Add(e.Name, handle);
+				handles.push_back(handle);
+			}
+			return handles;
+		}
+
+		bool HeadlessRenderer::RemoveRenderItem(RenderItemHandle handle)
+		{
+			SceneItem* item = mItems.Get(HandleCast<SceneItem>(handle));
+			if (!item)
+				return false;
+
+			mInstanceRanges.Free(item->InstanceOffset, (UINT)item->Instances.size());
+			mRenderItemNames.Remove(item->Name, handle);
+			mItems.Remove(HandleCast<SceneItem>(handle));
+			return true;
+		}
+
+		bool HeadlessRenderer::UpdateRenderItemWorld(RenderItemHandle handle, const Matrix4x4& world)
+		{
+			SceneItem* item = mItems.Get(HandleCast<SceneItem>(handle));
+			if (!item || item->Instanced)
+				return false;
+
+			item->Instances[0].World = world;
+			item->Dirty = true;
+			return true;
+		}
+
+		bool HeadlessRenderer::UpdateInstances(RenderItemHandle handle, const std::vector<Instance>& instances)
+		{
+			SceneItem* item = mItems.Get(HandleCast<SceneItem>(handle));
+			if (!item || !item->Instanced || instances.size() == 0)
+				return false;
+
+			UINT oldCount = (UINT)item->Instances.size();
+			mMaterials.ResolveInstances(instances, item->Instances, item->Name);
+
+			if (item->Instances.size() != oldCount)
+			{
+				mInstanceRanges.Free(item->InstanceOffset, oldCount);
+				item->InstanceOffset = AllocateInstanceRange((UINT)item->Instances.size());
+			}
+			item->Dirty = true;
+			return true;
+		}
+
+		void HeadlessRenderer::Update()
+		{
+			// The buffers are shared by all frames, so the previous frame has to be done with them.
+			mBackend->WaitForFence(mFrameFence);
+			EnsureBufferCapacity();
+
+			for (size_t i = 0; i < mMaterials.SlotCount(); ++i)
+			{
+				Material* mat = mMaterials.At(i);
+				if (!mat || mat->NumFramesDirty == 0)
+					continue;
+				MaterialData matData;
+				matData.Albedo = mat->Albedo;
+				matData.Roughness = mat->Roughness;
+				matData.Metalness = mat->Metalness;
+				mBackend->UpdateBuffer(mMaterialBuffer, mat->MatCBIndex * sizeof(MaterialData), sizeof(MaterialData), &matData);
+				mat->NumFramesDirty = 0;
+			}
+
+			for (size_t i = 0; i < mItems.SlotCount(); ++i)
+			{
+				SceneItem* item = mItems.At(i);
+				if (!item || !item->Dirty)
+					continue;
+				mBackend->UpdateBuffer(mInstanceBuffer, item->InstanceOffset * sizeof(InstanceData),
+					item->Instances.size() * sizeof(InstanceData), item->Instances.data());
+				item->Dirty = false;
+			}
+
+			// There is no App to rebuild the view matrix of the camera each frame.
+			mCamera->UpdateViewMatrix();
+			Vector2i renderSize = mBackend->GetRenderTargetSize();
+			Matrix4x4 view = mCamera->GetView();
+			Matrix4x4 proj = mCamera->GetProj();
+			Matrix4x4 viewProj = Matrix4x4::Mul(proj, view);
+			mPass.View = view;
+			mPass.InvView = Inverse(view);
+			mPass.Proj = proj;
+			mPass.InvProj = Inverse(proj);
+			mPass.ViewProj = viewProj;
+			mPass.InvViewProj = Inverse(viewProj);
+			mPass.EyePosW = mCamera->GetPosition();
+			mPass.RenderTargetSize = Vector2f((float)renderSize.x, (float)renderSize.y);
+			mPass.InvRenderTargetSize = Vector2f(1.0f / renderSize.x, 1.0f / renderSize.y);
+			mPass.NearZ = mCamera->GetNearZ();
+			mPass.FarZ = mCamera->GetFarZ();
+			mLodScale = LodScale(mCamera->GetFovY(), (float)renderSize.y, mLodPixelError);
+			mPass.AmbientLight = mAmbientLight;
+			mPass.Lights[0] = mDirectLights[0];
+			mPass.Lights[1] = mDirectLights[1];
+			mPass.Lights[2] = mDirectLights[2];
+		}
+
+		void HeadlessRenderer::Render()
+		{
+			FrameSetup setup;
+			setup.Pass = mPass;
+			setup.Materials = mMaterialBuffer;
+			setup.DepthOnly = mDepthOnlyMode;
+			mBackend->BeginFrame(setup);
+
+			for (size_t i = 0; i < mItems.SlotCount(); ++i)
+			{
+				SceneItem* item = mItems.At(i);
+				if (!item || item->Layer == RenderLayer::Debug)
+					continue;
+
+				DrawCommand draw;
+				draw.VertexBuffer = item->Geo->VertexBuffer;
+				draw.IndexBuffer = item->Geo->IndexBuffer;
+				draw.InstanceBuffer = mInstanceBuffer;
+				// Instances share one draw, they keep the full submesh.
+				int lod = item->Instanced ? 0 : SelectLod(*item->SubMesh, item->Instances[0].World, mPass.EyePosW, mLodScale, mPass.NearZ);
+				GetLodRange(*item->SubMesh, lod, &draw.IndexCount, &draw.StartIndexLocation);
+				draw.BaseVertexLocation = item->SubMesh->BaseVertexLocation;
+				draw.FirstInstance = item->InstanceOffset;
+				draw.InstanceCount = (UINT)item->Instances.size();
+				mBackend->Draw(draw);
+			}
+
+			mFrameFence = mBackend->Submit();
+		}
+
+		RetrieveImageData* HeadlessRenderer::RetrieveRenderTargetBuffer()
+		{
+			mBackend->WaitForFence(mFrameFence);
+			RetrieveImageData* image = new RetrieveImageData();
+			mBackend->ReadbackColor(*image);
+			return image;
+		}
+
+		void HeadlessRenderer::RetrieveDepthBuffer(std::vector<float>& depth)
+		{
+			mBackend->WaitForFence(mFrameFence);
+			mBackend->ReadbackDepth(depth);
+		}
+
+		void HeadlessRenderer::RetrieveLinearDepthBuffer(std::vector<float>& depth)
+		{
+			RetrieveDepthBuffer(depth);
+			depth::LinearizeDepth(depth.data(), depth.data(), depth.size(), mCamera->GetNearZ(), mCamera->GetFarZ());
+		}
+
+		ViewBatchStats HeadlessRenderer::RenderViews(const std::vector<Camera>& cameras, std::vector<RetrieveImageData>& images)
+		{
+			typedef std::chrono::steady_clock Clock;
+			ViewBatchStats stats;
+			Clock::time_point batchStart = Clock::now();
+			images.resize(cameras.size());
+			Camera savedCamera = *mCamera;
+
+			for (size_t i = 0; i < cameras.size(); ++i)
+			{
+				*mCamera = cameras[i];
+				Update();
+				Render();
+
+				Clock::time_point waitStart = Clock::now();
+				mBackend->WaitForFence(mFrameFence);
+				stats.WaitMs += std::chrono::duration<float, std::milli>(Clock::now() - waitStart).count();
+				mBackend->ReadbackColor(images[i]);
+			}
+
+			*mCamera = savedCamera;
+
+			stats.Views = (UINT)cameras.size();
+			stats.TotalMs = std::chrono::duration<float, std::milli>(Clock::now() - batchStart).count();
+			if (stats.TotalMs > 0.0f)
+				stats.ViewsPerSecond = 1000.0f * stats.Views / stats.TotalMs;
+			LOG(INFO) << StringPrintf("Rendered %u views in %.1f ms, %.1f views/s, %.1f ms waiting for read back.",
+				stats.Views, stats.TotalMs, stats.ViewsPerSecond, stats.WaitMs);
+			return stats;
+		}
+
+		UINT HeadlessRenderer::AllocateInstanceRange(UINT count)
+		{
+			uint32_t offset;
+			if (!mInstanceRanges.Allocate(count, &offset))
+			{
+				// The buffer is recreated by the next Update, so there is no need to compact.
+				UINT capacity = mInstanceRanges.Capacity();
+				mInstanceRanges.Grow(std::max(std::max(capacity * 2, capacity + count), 64u));
+				CHECK(mInstanceRanges.Allocate(count, &offset));
+			}
+			return offset;
+		}
+
+		void HeadlessRenderer::EnsureBufferCapacity()
+		{
+			if (mMaterials.Count() > mMaterialCapacity || !mMaterialBuffer.IsValid())
+			{
+				if (mMaterialBuffer.IsValid())
+					mBackend->DestroyBuffer(mMaterialBuffer);
+				mMaterialCapacity = std::max(std::max(mMaterialCapacity * 2, mMaterials.Count()), 16u);
+				mMaterialBuffer = mBackend->CreateBuffer(BufferType::Material, mMaterialCapacity * sizeof(MaterialData), nullptr);
+				for (size_t i = 0; i < mMaterials.SlotCount(); ++i)
+				{
+					if (Material* mat = mMaterials.At(i))
+						mat->NumFramesDirty = 1;
+				}
+			}
+
+			if (mInstanceRanges.Capacity() > mInstanceCapacity || !mInstanceBuffer.IsValid())
+			{
+				if (mInstanceBuffer.IsValid())
+					mBackend->DestroyBuffer(mInstanceBuffer);
+				mInstanceCapacity = std::max(mInstanceRanges.Capacity(), 64u);
+				mInstanceBuffer = mBackend->CreateBuffer(BufferType::Instance, mInstanceCapacity * sizeof(InstanceData), nullptr);
+				for (size_t i = 0; i < mItems.SlotCount(); ++i)
+				{
+					if (SceneItem* item = mItems.At(i))
+						item->Dirty = true;
+				}
+			}
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,109 @@
+// Platform independent renderer front end, drives any RenderBackend without a window.
+
+#pragma once
+
+#include "renderbackend.h"
+#include "scenetables.h"
+#include "camera.h"
+#include "../utility/slotallocator.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Mirror of the RenderResources discrete mode workflow for machines without a GPU: add data,
+		// then Update, Render and retrieve the targets for every camera pose. Items of the opaque and
+		// wireframe layers are drawn solid, the debug layer is skipped. There are no shadows or SSAO.
+		class HeadlessRenderer
+		{
+		public:
+			HeadlessRenderer(const std::shared_ptr<RenderBackend>& backend, const std::shared_ptr<Camera>& camera,
+				bool depthOnlyMode = false);
+			~HeadlessRenderer();
+
+			void SetLights(Light* lights);
+			// Resize the backend targets and the camera aspect ratio.
+			void SetRenderSize(int width, int height);
+
+			// Same semantics as the RenderResources methods of the same names.
+			MaterialHandle AddMaterial(const Material& mat);
+			GeometryHandle AddGeometryData(const std::vector<Vertex>& vertices, const std::vector<std::uint32_t>& indices,
+				const std::unordered_map<std::string, SubmeshGeometry>& drawArgs, const std::string& name);
+			std::vector<RenderItemHandle> AddRenderItem(const std::vector<RenderItemData>& renderItems, const RenderLayer layer);
+			bool RemoveRenderItem(RenderItemHandle handle);
+			bool UpdateRenderItemWorld(RenderItemHandle handle, const Matrix4x4& world);
+			bool UpdateInstances(RenderItemHandle handle, const std::vector<Instance>& instances);
+			Material* GetMaterial(MaterialHandle handle) const { return mMaterials.Get(handle); }
+			MaterialHandle FindMaterial(const std::string& name) const { return mMaterials.Find(name); }
+			GeometryHandle FindMeshGeometry(const std::string& name) const { return mGeometryNames.Find(name); }
+			RenderItemHandle FindRenderItem(const std::string& name) const { return mRenderItemNames.Find(name); }
+
+			// Upload changed materials and items and the pass constants of the camera.
+			void Update();
+			void Render();
+			// Note that the result need to be manually freed.
+			RetrieveImageData* RetrieveRenderTargetBuffer();
+			void RetrieveDepthBuffer(std::vector<float>& depth);
+			// View space depth from the near and far planes of the camera.
+			void RetrieveLinearDepthBuffer(std::vector<float>& depth);
+			// Same batch interface as RenderResources::RenderViews. The CPU backend finishes every frame in
+			// Submit, so the views simply run one after another into the images.
+			ViewBatchStats RenderViews(const std::vector<Camera>& cameras, std::vector<RetrieveImageData>& images);
+
+			RenderBackend* GetBackend() const { return mBackend.get(); }
+			// Error in pixels the levels of detail of non-instanced items may show, 0 draws the full submeshes.
+			void SetLodPixelError(float pixels) { mLodPixelError = pixels; }
+
+		private:
+			struct SceneGeometry
+			{
+				std::string Name;
+				BufferHandle VertexBuffer;
+				BufferHandle IndexBuffer;
+				std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
+			};
+
+			struct SceneItem
+			{
+				std::string Name;
+				SceneGeometry* Geo = nullptr;
+				const SubmeshGeometry* SubMesh = nullptr;
+				// One entry for non-instanced items.
+				std::vector<InstanceData> Instances;
+				UINT InstanceOffset = 0;
+				RenderLayer Layer = RenderLayer::Opaque;
+				bool Instanced = false;
+				bool Dirty = true;
+			};
+
+			UINT AllocateInstanceRange(UINT count);
+			void EnsureBufferCapacity();
+
+			std::shared_ptr<RenderBackend> mBackend;
+			std::shared_ptr<Camera> mCamera;
+			bool mDepthOnlyMode;
+
+			MaterialTable mMaterials;
+			HandlePool<SceneGeometry> mGeometries;
+			HandlePool<SceneItem> mItems;
+			NameTable<MeshGeometry> mGeometryNames;
+			NameTable<RenderItem> mRenderItemNames;
+
+			// Instance ranges in the instance buffer. It and the material buffer are recreated with
+			// doubled capacity when they run out.
+			RangeAllocator mInstanceRanges;
+			BufferHandle mMaterialBuffer;
+			BufferHandle mInstanceBuffer;
+			UINT mMaterialCapacity = 0;
+			UINT mInstanceCapacity = 0;
+
+			Light mDirectLights[3];
+			Vector4f mAmbientLight;
+			PassConstants mPass;
+			uint64_t mFrameFence = 0;
+			float mLodPixelError = 1.0f;
+			float mLodScale = 0.0f;
+		};
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,735 @@
+#include "imagewriter.h"
+#include "../utility/stringprint.h"
+#include <cstdio>
+#include <cctype>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HANDWORK_IMAGE_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace handwork
+{
+	namespace rendering
+	{
+		namespace
+		{
+			void PutU16LE(std::vector<BYTE>& out, uint32_t v)
+			{
+				out.push_back((BYTE)v);
+				out.push_back((BYTE)(v >> 8));
+			}
+
+			void PutU32LE(std::vector<BYTE>& out, uint32_t v)
+			{
+				PutU16LE(out, v);
+				PutU16LE(out, v >> 16);
+			}
+
+			void PutU32BE(std::vector<BYTE>& out, uint32_t v)
+			{
+				out.push_back((BYTE)(v >> 24));
+				out.push_back((BYTE)(v >> 16));
+				out.push_back((BYTE)(v >> 8));
+				out.push_back((BYTE)v);
+			}
+
+			void PutString(std::vector<BYTE>& out, const std::string& s)
+			{
+				out.insert(out.end(), s.begin(), s.end());
+			}
+
+			const BYTE* Row(const ImageView& image, UINT y)
+			{
+				return static_cast<const BYTE*>(image.Data) + (size_t)y * image.Pitch;
+			}
+
+			uint32_t Crc32(const BYTE* data, size_t size, uint32_t crc)
+			{
+				struct Table
+				{
+					uint32_t Entries[256];
+					Table()
+					{
+						for (uint32_t n = 0; n < 256; ++n)
+						{
+							uint32_t c = n;
+							for (int k = 0; k < 8; ++k)
+								c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+							Entries[n] = c;
+						}
+					}
+				};
+				static const Table table;
+
+				crc = ~crc;
+				for (size_t i = 0; i < size; ++i)
+					crc = table.Entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+				return ~crc;
+			}
+
+			uint32_t Adler32(const BYTE* data, size_t size)
+			{
+				// 5552 is the largest block whose sums cannot overflow 32 bits before the modulo.
+				uint32_t a = 1, b = 0;
+				while (size > 0)
+				{
+					size_t block = std::min(size, (size_t)5552);
+					for (size_t i = 0; i < block; ++i)
+					{
+						a += data[i];
+						b += a;
+					}
+					a %= 65521;
+					b %= 65521;
+					data += block;
+					size -= block;
+				}
+				return (b << 16) | a;
+			}
+
+			// Deflate bits are packed starting at the least significant bit of each byte.
+			class BitWriter
+			{
+			public:
+				BitWriter(std::vector<BYTE>& out) : mOut(out) {}
+
+				void Put(uint32_t bits, int count)
+				{
+					mBits |= (uint64_t)bits << mCount;
+					mCount += count;
+					while (mCount >= 8)
+					{
+						mOut.push_back((BYTE)mBits);
+						mBits >>= 8;
+						mCount -= 8;
+					}
+				}
+
+				void Finish()
+				{
+					if (mCount > 0)
+						mOut.push_back((BYTE)mBits);
+					mBits = 0;
+					mCount = 0;
+				}
+
+			private:
+				std::vector<BYTE>& mOut;
+				uint64_t mBits = 0;
+				int mCount = 0;
+			};
+
+			const int LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+				67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			const int LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			const int DistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+				1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			const int DistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+			// Fixed Huffman codes of RFC 1951 3.2.6, bit reversed so they can be written least significant
+			// bit first, and the symbols of every match length and distance.
+			struct DeflateTables
+			{
+				uint16_t LitCode[288];
+				uint8_t LitBits[288];
+				uint16_t DistCode[30];
+				uint8_t LengthSymbol[259];
+				uint8_t DistSymbol[32769];
+
+				static uint32_t Reverse(uint32_t code, int bits)
+				{
+					uint32_t r = 0;
+					for (int i = 0; i < bits; ++i, code >>= 1)
+						r = (r << 1) | (code & 1);
+					return r;
+				}
+
+				DeflateTables()
+				{
+					for (int s = 0; s < 288; ++s)
+					{
+						uint32_t code;
+						int bits;
+						if (s < 144) { code = 0x30 + s; bits = 8; }
+						else if (s < 256) { code = 0x190 + s - 144; bits = 9; }
+						else if (s < 280) { code = s - 256; bits = 7; }
+						else { code = 0xc0 + s - 280; bits = 8; }
+						LitCode[s] = (uint16_t)Reverse(code, bits);
+						LitBits[s] = (uint8_t)bits;
+					}
+					for (int d = 0; d < 30; ++d)
+						DistCode[d] = (uint16_t)Reverse(d, 5);
+					for (int i = 0; i < 29; ++i)
+					{
+						int end = i + 1 < 29 ? LengthBase[i + 1] : 259;
+						for (int len = LengthBase[i]; len < end; ++len)
+							LengthSymbol[len] = (uint8_t)i;
+					}
+					for (int i = 0; i < 30; ++i)
+					{
+						int end = i + 1 < 30 ? DistBase[i + 1] : 32769;
+						for (int dist = DistBase[i]; dist < end; ++dist)
+							DistSymbol[dist] = (uint8_t)i;
+					}
+				}
+			};
+
+			// One block of fixed Huffman codes with greedy matching against the last position of every
+			// 3 byte hash. Like the fastest zlib level it trades ratio for speed, only the positions
+			// inside short matches are hashed.
+			void Deflate(const BYTE* data, size_t size, std::vector<BYTE>& out)
+			{
+				static const DeflateTables tables;
+				const int HashBits = 15;
+				const size_t WindowSize = 32768;
+				const size_t MaxMatch = 258;
+
+				BitWriter bits(out);
+				// Final block, fixed Huffman codes.
+				bits.Put(1, 1);
+				bits.Put(1, 2);
+
+				auto putLiteral = [&](int symbol)
+				{
+					bits.Put(tables.LitCode[symbol], tables.LitBits[symbol]);
+				};
+				auto hash = [&](size_t i)
+				{
+					uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+					return (v * 2654435761u) >> (32 - HashBits);
+				};
+
+				std::vector<int64_t> head((size_t)1 << HashBits, -1);
+				size_t i = 0;
+				while (i + 3 <= size)
+				{
+					uint32_t h = hash(i);
+					int64_t candidate = head[h];
+					head[h] = (int64_t)i;
+
+					size_t length = 0;
+					if (candidate >= 0 && i - (size_t)candidate <= WindowSize)
+					{
+						const BYTE* a = data + candidate;
+						const BYTE* b = data + i;
+						size_t maxLength = std::min(MaxMatch, size - i);
+						while (length < maxLength && a[length] == b[length])
+							++length;
+					}
+
+					if (length < 3)
+					{
+						putLiteral(data[i++]);
+						continue;
+					}
+
+					int ls = tables.LengthSymbol[length];
+					putLiteral(257 + ls);
+					bits.Put((uint32_t)(length - LengthBase[ls]), LengthExtra[ls]);
+					size_t dist = i - (size_t)candidate;
+					int ds = tables.DistSymbol[dist];
+					bits.Put(tables.DistCode[ds], 5);
+					bits.Put((uint32_t)(dist - DistBase[ds]), DistExtra[ds]);
+
+					if (length <= 4)
+					{
+						for (size_t k = 1; k < length && i + k + 3 <= size; ++k)
+							head[hash(i + k)] = (int64_t)(i + k);
+					}
+					i += length;
+				}
+				while (i < size)
+					putLiteral(data[i++]);
+
+				putLiteral(256);
+				bits.Finish();
+			}
+
+			void ZlibCompress(const BYTE* data, size_t size, std::vector<BYTE>& out)
+			{
+				// 32K window deflate, fastest compression level.
+				out.push_back(0x78);
+				out.push_back(0x01);
+				Deflate(data, size, out);
+				PutU32BE(out, Adler32(data, size));
+			}
+
+			void PutPngChunk(std::vector<BYTE>& out, const char* type, const std::vector<BYTE>& data)
+			{
+				PutU32BE(out, (uint32_t)data.size());
+				size_t start = out.size();
+				out.insert(out.end(), type, type + 4);
+				out.insert(out.end(), data.begin(), data.end());
+				PutU32BE(out, Crc32(&out[start], out.size() - start, 0));
+			}
+
+			int Paeth(int a, int b, int c)
+			{
+				int p = a + b - c;
+				int pa = std::abs(p - a);
+				int pb = std::abs(p - b);
+				int pc = std::abs(p - c);
+				if (pa <= pb && pa <= pc)
+					return a;
+				return pb <= pc ? b : c;
+			}
+
+			bool EncodePng(const ImageView& image, std::vector<BYTE>& out)
+			{
+				int bpp;
+				BYTE colorType, bitDepth;
+				if (image.Format == PixelFormat::RGBA8)
+				{
+					bpp = 4;
+					colorType = 6;
+					bitDepth = 8;
+				}
+				else if (image.Format == PixelFormat::Gray16)
+				{
+					bpp = 2;
+					colorType = 0;
+					bitDepth = 16;
+				}
+				else
+					return false;
+
+				// Every row takes the filter with the smallest sum of absolute differences, the usual
+				// heuristic for photographic content.
+				size_t rowBytes = (size_t)bpp * image.Width;
+				std::vector<BYTE> filtered;
+				filtered.reserve((rowBytes + 1) * image.Height);
+				std::vector<BYTE> prev(rowBytes, 0), cur(rowBytes);
+				std::vector<BYTE> candidates[5];
+				for (auto& c : candidates)
+					c.resize(rowBytes);
+				for (UINT y = 0; y < image.Height; ++y)
+				{
+					const BYTE* src = Row(image, y);
+					if (image.Format == PixelFormat::Gray16)
+					{
+						// PNG stores 16 bit samples most significant byte first.
+						for (size_t x = 0; x < rowBytes; x += 2)
+						{
+							cur[x] = src[x + 1];
+							cur[x + 1] = src[x];
+						}
+					}
+					else
+						memcpy(cur.data(), src, rowBytes);
+
+					int best = 0;
+					uint64_t bestSum = UINT64_MAX;
+					for (int f = 0; f < 5; ++f)
+					{
+						BYTE* dst = candidates[f].data();
+						uint64_t sum = 0;
+						for (size_t x = 0; x < rowBytes; ++x)
+						{
+							int a = x >= (size_t)bpp ? cur[x - bpp] : 0;
+							int b = prev[x];
+							int c = x >= (size_t)bpp ? prev[x - bpp] : 0;
+							int predict = f == 0 ? 0 : f == 1 ? a : f == 2 ? b : f == 3 ? (a + b) / 2 : Paeth(a, b, c);
+							BYTE v = (BYTE)(cur[x] - predict);
+							dst[x] = v;
+							sum += (uint64_t)std::abs((int)(int8_t)v);
+						}
+						if (sum < bestSum)
+						{
+							bestSum = sum;
+							best = f;
+						}
+					}
+					filtered.push_back((BYTE)best);
+					filtered.insert(filtered.end(), candidates[best].begin(), candidates[best].end());
+					std::swap(prev, cur);
+				}
+
+				std::vector<BYTE> header;
+				PutU32BE(header, image.Width);
+				PutU32BE(header, image.Height);
+				header.push_back(bitDepth);
+				header.push_back(colorType);
+				header.push_back(0);
+				header.push_back(0);
+				header.push_back(0);
+				std::vector<BYTE> compressed;
+				compressed.reserve(filtered.size() / 2);
+				ZlibCompress(filtered.data(), filtered.size(), compressed);
+
+				const BYTE signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+				out.insert(out.end(), signature, signature + 8);
+				PutPngChunk(out, "IHDR", header);
+				PutPngChunk(out, "IDAT", compressed);
+				PutPngChunk(out, "IEND", std::vector<BYTE>());
+				return true;
+			}
+
+			// The Quite OK Image format, see qoiformat.org. Four channels, sRGB.
+			bool EncodeQoi(const ImageView& image, std::vector<BYTE>& out)
+			{
+				if (image.Format != PixelFormat::RGBA8)
+					return false;
+
+				PutString(out, "qoif");
+				PutU32BE(out, image.Width);
+				PutU32BE(out, image.Height);
+				out.push_back(4);
+				out.push_back(0);
+
+				BYTE index[64][4] = {};
+				BYTE prev[4] = { 0, 0, 0, 255 };
+				int run = 0;
+				size_t pixelCount = (size_t)image.Width * image.Height;
+				size_t pixel = 0;
+				for (UINT y = 0; y < image.Height; ++y)
+				{
+					const BYTE* src = Row(image, y);
+					for (UINT x = 0; x < image.Width; ++x, src += 4)
+					{
+						++pixel;
+						if (memcmp(src, prev, 4) == 0)
+						{
+							++run;
+							if (run == 62 || pixel == pixelCount)
+							{
+								out.push_back((BYTE)(0xc0 | (run - 1)));
+								run = 0;
+							}
+							continue;
+						}
+						if (run > 0)
+						{
+							out.push_back((BYTE)(0xc0 | (run - 1)));
+							run = 0;
+						}
+
+						int slot = (src[0] * 3 + src[1] * 5 + src[2] * 7 + src[3] * 11) % 64;
+						if (memcmp(index[slot], src, 4) == 0)
+							out.push_back((BYTE)slot);
+						else
+						{
+							memcpy(index[slot], src, 4);
+							if (src[3] == prev[3])
+							{
+								int vr = (int8_t)(src[0] - prev[0]);
+								int vg = (int8_t)(src[1] - prev[1]);
+								int vb = (int8_t)(src[2] - prev[2]);
+								int vgr = vr - vg;
+								int vgb = vb - vg;
+								if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1)
+									out.push_back((BYTE)(0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2)));
+								else if (vgr >= -8 && vgr <= 7 && vg >= -32 && vg <= 31 && vgb >= -8 && vgb <= 7)
+								{
+									out.push_back((BYTE)(0x80 | (vg + 32)));
+									out.push_back((BYTE)(((vgr + 8) << 4) | (vgb + 8)));
+								}
+								else
+								{
+									out.push_back(0xfe);
+									out.insert(out.end(), src, src + 3);
+								}
+							}
+							else
+							{
+								out.push_back(0xff);
+								out.insert(out.end(), src, src + 4);
+							}
+						}
+						memcpy(prev, src, 4);
+					}
+				}
+
+				const BYTE padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+				out.insert(out.end(), padding, padding + 8);
+				return true;
+			}
+
+			bool EncodeBmp(const ImageView& image, std::vector<BYTE>& out)
+			{
+				if (image.Format != PixelFormat::RGBA8)
+					return false;
+
+				// 32 bit BGRA rows stored bottom up behind a BITMAPINFOHEADER.
+				uint32_t rowBytes = 4 * image.Width;
+				uint32_t imageBytes = rowBytes * image.Height;
+				out.push_back('B');
+				out.push_back('M');
+				PutU32LE(out, 54 + imageBytes);
+				PutU32LE(out, 0);
+				PutU32LE(out, 54);
+				PutU32LE(out, 40);
+				PutU32LE(out, image.Width);
+				PutU32LE(out, image.Height);
+				PutU16LE(out, 1);
+				PutU16LE(out, 32);
+				PutU32LE(out, 0);
+				PutU32LE(out, imageBytes);
+				PutU32LE(out, 2835);
+				PutU32LE(out, 2835);
+				PutU32LE(out, 0);
+				PutU32LE(out, 0);
+
+				size_t offset = out.size();
+				out.resize(offset + imageBytes);
+				for (UINT y = 0; y < image.Height; ++y)
+					SwizzleRedBlue(Row(image, image.Height - 1 - y), &out[offset + (size_t)y * rowBytes], image.Width);
+				return true;
+			}
+
+			bool EncodePpm(const ImageView& image, std::vector<BYTE>& out)
+			{
+				if (image.Format == PixelFormat::GrayFloat)
+					return false;
+
+				bool gray = image.Format == PixelFormat::Gray16;
+				PutString(out, StringPrintf("%s\n%u %u\n%d\n", gray ? "P5" : "P6", image.Width, image.Height, gray ? 65535 : 255));
+				size_t offset = out.size();
+				out.resize(offset + (size_t)(gray ? 2 : 3) * image.Width * image.Height);
+				BYTE* dst = &out[offset];
+				for (UINT y = 0; y < image.Height; ++y)
+				{
+					const BYTE* src = Row(image, y);
+					for (UINT x = 0; x < image.Width; ++x)
+					{
+						// 16 bit samples are stored most significant byte first.
+						if (gray)
+						{
+							*dst++ = src[2 * x + 1];
+							*dst++ = src[2 * x];
+						}
+						else
+						{
+							*dst++ = src[4 * x];
+							*dst++ = src[4 * x + 1];
+							*dst++ = src[4 * x + 2];
+						}
+					}
+				}
+				return true;
+			}
+
+			bool EncodePfm(const ImageView& image, std::vector<BYTE>& out)
+			{
+				if (image.Format == PixelFormat::Gray16)
+					return false;
+
+				// A negative scale marks little endian floats, rows are stored bottom up.
+				bool gray = image.Format == PixelFormat::GrayFloat;
+				PutString(out, StringPrintf("%s\n%u %u\n-1.0\n", gray ? "Pf" : "PF", image.Width, image.Height));
+				int channels = gray ? 1 : 3;
+				size_t offset = out.size();
+				out.resize(offset + sizeof(float) * channels * image.Width * image.Height);
+				float* dst = reinterpret_cast<float*>(&out[offset]);
+				for (UINT y = 0; y < image.Height; ++y)
+				{
+					const BYTE* src = Row(image, image.Height - 1 - y);
+					if (gray)
+					{
+						memcpy(dst, src, sizeof(float) * image.Width);
+						dst += image.Width;
+						continue;
+					}
+					for (UINT x = 0; x < image.Width; ++x)
+					{
+						*dst++ = src[4 * x] / 255.0f;
+						*dst++ = src[4 * x + 1] / 255.0f;
+						*dst++ = src[4 * x + 2] / 255.0f;
+					}
+				}
+				return true;
+			}
+		}	// namespace
+
+		ImageView MakeImageView(const RetrieveImageData& image)
+		{
+			ImageView view;
+			view.Data = image.Data.data();
+			view.Width = image.Width;
+			view.Height = image.Height;
+			view.Pitch = image.Pitch;
+			view.Format = PixelFormat::RGBA8;
+			return view;
+		}
+
+		ImageView MakeImageView(const std::vector<float>& image, UINT width, UINT height)
+		{
+			ImageView view;
+			view.Data = image.data();
+			view.Width = width;
+			view.Height = height;
+			view.Pitch = width * sizeof(float);
+			view.Format = PixelFormat::GrayFloat;
+			return view;
+		}
+
+		ImageFileFormat GetImageFileFormat(const std::string& file)
+		{
+			size_t dot = file.find_last_of('.');
+			if (dot == std::string::npos)
+				return ImageFileFormat::Unknown;
+			std::string ext = file.substr(dot + 1);
+			for (auto& c : ext)
+				c = (char)std::tolower((unsigned char)c);
+
+			if (ext == "bmp")
+				return ImageFileFormat::BMP;
+			if (ext == "ppm" || ext == "pgm")
+				return ImageFileFormat::PPM;
+			if (ext == "pfm")
+				return ImageFileFormat::PFM;
+			if (ext == "png")
+				return ImageFileFormat::PNG;
+			if (ext == "qoi")
+				return ImageFileFormat::QOI;
+			return ImageFileFormat::Unknown;
+		}
+
+		void SwizzleRedBlue(const BYTE* src, BYTE* dst, size_t pixelCount)
+		{
+			size_t i = 0;
+#if HANDWORK_IMAGE_SSE
+			const __m128i keep = _mm_set1_epi32(0xff00ff00);
+			const __m128i low = _mm_set1_epi32(0x000000ff);
+			for (; i + 4 <= pixelCount; i += 4)
+			{
+				__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i));
+				__m128i red = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+				__m128i blue = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+				__m128i result = _mm_or_si128(_mm_and_si128(p, keep), _mm_or_si128(red, blue));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), result);
+			}
+#endif
+			for (; i < pixelCount; ++i)
+			{
+				BYTE r = src[4 * i];
+				BYTE b = src[4 * i + 2];
+				dst[4 * i] = b;
+				dst[4 * i + 1] = src[4 * i + 1];
+				dst[4 * i + 2] = r;
+				dst[4 * i + 3] = src[4 * i + 3];
+			}
+		}
+
+		bool EncodeImage(const ImageView& image, ImageFileFormat format, std::vector<BYTE>& out)
+		{
+			switch (format)
+			{
+			case ImageFileFormat::BMP: return EncodeBmp(image, out);
+			case ImageFileFormat::PPM: return EncodePpm(image, out);
+			case ImageFileFormat::PFM: return EncodePfm(image, out);
+			case ImageFileFormat::PNG: return EncodePng(image, out);
+			case ImageFileFormat::QOI: return EncodeQoi(image, out);
+			default: return false;
+			}
+		}
+
+		bool WriteImage(const std::string& file, const ImageView& image)
+		{
+			std::vector<BYTE> encoded;
+			if (!EncodeImage(image, GetImageFileFormat(file), encoded))
+			{
+				LOG(ERROR) << StringPrintf("Cannot encode the image \"%s\" in this format.", file.c_str());
+				return false;
+			}
+
+			FILE* fp = fopen(file.c_str(), "wb");
+			if (!fp)
+			{
+				LOG(ERROR) << StringPrintf("Cannot open \"%s\" for writing.", file.c_str());
+				return false;
+			}
+			bool ok = fwrite(encoded.data(), 1, encoded.size(), fp) == encoded.size();
+			fclose(fp);
+			if (!ok)
+				LOG(ERROR) << StringPrintf("Failed to write \"%s\".", file.c_str());
+			return ok;
+		}
+
+		ImageWriter::ImageWriter(size_t maxQueued) :
+			mMaxQueued(std::max(maxQueued, (size_t)1)),
+			mFailed(0)
+		{
+			mThread = std::thread(&ImageWriter::Run, this);
+		}
+
+		ImageWriter::~ImageWriter()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mExit = true;
+			}
+			mQueueChanged.notify_all();
+			mThread.join();
+		}
+
+		void ImageWriter::Write(const std::string& file, RetrieveImageData&& image)
+		{
+			Job job;
+			job.File = file;
+			job.View = MakeImageView(image);
+			job.Pixels = std::move(image.Data);
+			Enqueue(std::move(job));
+		}
+
+		void ImageWriter::Write(const std::string& file, const ImageView& image)
+		{
+			// Pack the rows, the caller may reuse its memory right away.
+			UINT rowBytes = image.Width * (image.Format == PixelFormat::RGBA8 || image.Format == PixelFormat::GrayFloat ? 4 : 2);
+			Job job;
+			job.File = file;
+			job.View = image;
+			job.View.Pitch = rowBytes;
+			job.Pixels.resize((size_t)rowBytes * image.Height);
+			for (UINT y = 0; y < image.Height; ++y)
+				memcpy(&job.Pixels[(size_t)y * rowBytes], Row(image, y), rowBytes);
+			Enqueue(std::move(job));
+		}
+
+		void ImageWriter::Flush()
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mQueueChanged.wait(lock, [this] { return mQueue.empty() && !mBusy; });
+		}
+
+		void ImageWriter::Enqueue(Job&& job)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mQueueChanged.wait(lock, [this] { return mQueue.size() < mMaxQueued; });
+				mQueue.push_back(std::move(job));
+			}
+			mQueueChanged.notify_all();
+		}
+
+		void ImageWriter::Run()
+		{
+			for (;;)
+			{
+				Job job;
+				{
+					std::unique_lock<std::mutex> lock(mMutex);
+					mQueueChanged.wait(lock, [this] { return mExit || !mQueue.empty(); });
+					// Leave only once the queue is drained.
+					if (mQueue.empty())
+						return;
+					job = std::move(mQueue.front());
+					mQueue.pop_front();
+					mBusy = true;
+				}
+				mQueueChanged.notify_all();
+
+				job.View.Data = job.Pixels.data();
+				if (!WriteImage(job.File, job.View))
+					++mFailed;
+
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mBusy = false;
+				}
+				mQueueChanged.notify_all();
+			}
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
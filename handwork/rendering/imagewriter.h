@@ -0,0 +1,102 @@
+// Portable image encoders and a background writer for render target and depth read backs.
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include "renderbackend.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Files are uncompressed BMP, PPM and PFM, deflate compressed PNG or QOI.
+		enum class ImageFileFormat
+		{
+			BMP,
+			PPM,
+			PFM,
+			PNG,
+			QOI,
+			Unknown
+		};
+
+		// Pixel layouts of read backs: color targets, 16 bit and float single channel images.
+		enum class PixelFormat
+		{
+			RGBA8,
+			Gray16,
+			GrayFloat
+		};
+
+		// Rows of an image in memory, Pitch bytes apart.
+		struct ImageView
+		{
+			const void* Data = nullptr;
+			UINT Width = 0;
+			UINT Height = 0;
+			UINT Pitch = 0;
+			PixelFormat Format = PixelFormat::RGBA8;
+		};
+
+		ImageView MakeImageView(const RetrieveImageData& image);
+		ImageView MakeImageView(const std::vector<float>& image, UINT width, UINT height);
+		// Format from the file extension, case insensitive.
+		ImageFileFormat GetImageFileFormat(const std::string& file);
+
+		// Swap red and blue of four channel 8 bit pixels, which converts RGBA to BGRA and back. Source and
+		// destination may be the same.
+		void SwizzleRedBlue(const BYTE* src, BYTE* dst, size_t pixelCount);
+
+		// Return false if the file format cannot hold the pixel format. BMP, PNG and QOI keep alpha, PPM
+		// drops it. PFM takes floats and stores color scaled to [0, 1]. PNG and PPM store Gray16 as 16
+		// bit gray, the other formats reject it.
+		bool EncodeImage(const ImageView& image, ImageFileFormat format, std::vector<BYTE>& out);
+		bool WriteImage(const std::string& file, const ImageView& image);
+
+		// Encode and write images on a background thread, so encoding overlaps with rendering. Write
+		// blocks while maxQueued images are waiting, which bounds the memory a fast producer can take.
+		class ImageWriter
+		{
+		public:
+			ImageWriter(size_t maxQueued = 8);
+			ImageWriter(const ImageWriter& rhs) = delete;
+			ImageWriter& operator=(const ImageWriter& rhs) = delete;
+			// Writes the images still queued.
+			~ImageWriter();
+
+			// Take over the pixels of a read back.
+			void Write(const std::string& file, RetrieveImageData&& image);
+			// Copy the pixels of any image.
+			void Write(const std::string& file, const ImageView& image);
+			// Block until every queued image is written.
+			void Flush();
+			// Number of images that failed to encode or write.
+			size_t GetFailedCount() const { return mFailed; }
+
+		private:
+			struct Job
+			{
+				std::string File;
+				std::vector<BYTE> Pixels;
+				ImageView View;
+			};
+
+			void Enqueue(Job&& job);
+			void Run();
+
+			size_t mMaxQueued;
+			std::deque<Job> mQueue;
+			bool mBusy = false;
+			bool mExit = false;
+			std::atomic<size_t> mFailed;
+			std::mutex mMutex;
+			std::condition_variable mQueueChanged;
+			std::thread mThread;
+		};
+
+	}	// namespace rendering
+}	// namespace handwork
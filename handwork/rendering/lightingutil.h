@@ -0,0 +1,120 @@
+// C++ port of the directional light part of lightingutil.hlsl for the CPU rasterizer.
+
+#pragma once
+
+#include "bridgestructs.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Keep in sync with shaders/lightingutil.hlsl, the function names and formulas match one to one.
+		namespace lighting
+		{
+			inline Vector3f Modulate(const Vector3f& a, const Vector3f& b)
+			{
+				return Vector3f(a.x * b.x, a.y * b.y, a.z * b.z);
+			}
+
+			inline float Saturate(float v)
+			{
+				return Clamp(v, 0.0f, 1.0f);
+			}
+
+			// Schlick gives an approximation to Fresnel reflectance (see pg. 233 "Real-Time Rendering 3rd Ed.").
+			inline Vector3f SchlickFresnel(const Vector3f& R0, const Vector3f& normal, const Vector3f& lightVec)
+			{
+				float cosIncidentAngle = Saturate(Dot(normal, lightVec));
+				float f0 = 1.0f - cosIncidentAngle;
+				return R0 + (Vector3f(1.0f, 1.0f, 1.0f) - R0) * (f0 * f0 * f0 * f0 * f0);
+			}
+
+			// Add two fresnel factor to build a more accurate diffue model.
+			inline float DisneyDiffuse(const Vector3f& lightVec, const Vector3f& normal, const Vector3f& toEye, float roughness)
+			{
+				float oneMinusCosL = 1.0f - std::abs(Dot(normal, lightVec));
+				float oneMinusCosLSqr = oneMinusCosL * oneMinusCosL;
+				float oneMinusCosV = 1.0f - std::abs(Dot(normal, toEye));
+				float oneMinusCosVSqr = oneMinusCosV * oneMinusCosV;
+
+				float IDotH = Dot(lightVec, Normalize(toEye + lightVec));
+				float F_D90 = 0.5f + 2.0f * IDotH * IDotH * roughness;
+
+				return (1.0f + (F_D90 - 1.0f) * oneMinusCosLSqr * oneMinusCosLSqr * oneMinusCosL)
+					* (1.0f + (F_D90 - 1.0f) * oneMinusCosVSqr * oneMinusCosVSqr * oneMinusCosV);
+			}
+
+			// Calculate the microsurface distribution based on GGX.
+			inline float GGX_D(const Vector3f& halfVec, const Vector3f& normal, float roughness)
+			{
+				float cosTheta = std::max(Dot(halfVec, normal), 0.0f);
+				float cosTheta2 = cosTheta * cosTheta;
+				if (cosTheta2 < 0.00001f)
+					return 0.0f;
+
+				float tanTheta2 = (1.0f - cosTheta2) / cosTheta2;
+				float root = roughness / (cosTheta2 * (roughness * roughness + tanTheta2));
+				return InvPi * root * root;
+			}
+
+			// Smith G1 item for micosurface occlusion.
+			inline float Smith_G1(const Vector3f& vec, const Vector3f& halfVec, const Vector3f& normal, float roughness)
+			{
+				float cosTheta = Dot(vec, normal);
+				if (cosTheta > 0.9999f)
+					return 1.0f;
+				if (Dot(vec, halfVec) * cosTheta <= 0.00001f)
+					return 0.0f;
+
+				float tanTheta = std::abs(std::sqrt(1.0f - cosTheta * cosTheta) / cosTheta);
+				float root = roughness * tanTheta;
+				return 2.0f / (1.0f + std::sqrt(1.0f + root * root));
+			}
+
+			// Smith G item for microsurface occlusion.
+			inline float Smith_G(const Vector3f& toEye, const Vector3f& lightVec, const Vector3f& halfVec, const Vector3f& normal, float roughness)
+			{
+				return Smith_G1(toEye, halfVec, normal, roughness) * Smith_G1(lightVec, halfVec, normal, roughness);
+			}
+
+			// Use Cook Torrance model to calculate light.
+			inline Vector3f CookTorrance(const Vector3f& lightStrength, const Vector3f& lightVec, const Vector3f& normal,
+				const Vector3f& toEye, const MaterialData& mat)
+			{
+				Vector3f diffuse = mat.Albedo * (1.0f - mat.Metalness);
+				Vector3f specular = Lerp(mat.Metalness, Vector3f(0.04f, 0.04f, 0.04f), mat.Albedo);
+
+				Vector3f halfVec = Normalize(toEye + lightVec);
+				float roughness = mat.Roughness;
+				float D = GGX_D(halfVec, normal, roughness);
+				float G = Smith_G(toEye, lightVec, halfVec, normal, roughness);
+				Vector3f F = SchlickFresnel(specular, halfVec, lightVec);
+
+				Vector3f specAlbedo = F * (D * G);
+				float cos = std::max(Dot(lightVec, normal), 0.0f) * std::max(Dot(toEye, normal), 0.0f);
+				if (cos <= 0.0f)
+					specAlbedo = Vector3f(0.0f, 0.0f, 0.0f);
+				else
+					specAlbedo = specAlbedo / cos * Pi / 4.0f;
+
+				float disney = DisneyDiffuse(lightVec, normal, toEye, roughness);
+
+				return Modulate(diffuse * disney + specAlbedo, lightStrength);
+			}
+
+			// Evaluates the lighting equation for directional lights.
+			inline Vector3f ComputeDirectionalLight(const Light& L, const MaterialData& mat, const Vector3f& normal, const Vector3f& toEye)
+			{
+				// The light vector aims opposite the direction the light rays travel.
+				Vector3f lightVec = Normalize(-L.Direction);
+
+				// Scale light down by Lambert's cosine law.
+				float ndotl = std::max(Dot(lightVec, normal), 0.0f);
+				Vector3f lightStrength = L.Strength * ndotl;
+
+				return CookTorrance(lightStrength, lightVec, normal, toEye, mat);
+			}
+		}	// namespace lighting
+
+	}	// namespace rendering
+}	// namespace handwork
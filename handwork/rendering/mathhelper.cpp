@@ -1,6 +1,6 @@
 // Helper math class.
 
-#include "MathHelper.h"
+#include "mathhelper.h"
 #include <float.h>
 #include <cmath>
 
@@ -2,8 +2,15 @@
 
 #pragma once
 
-#include <Windows.h>
 #include <cstdint>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+// Windows integer types used by the structures shared with the GPU.
+typedef int32_t INT;
+typedef uint32_t UINT;
+typedef uint8_t BYTE;
+#endif
 #include "../utility/utility.h"
 #include "../utility/geometry.h"
 #include "../utility/transform.h"
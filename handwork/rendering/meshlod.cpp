@@ -0,0 +1,109 @@
+#include "meshlod.h"
+#include "../utility/stringprint.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		int BuildSubmeshLods(const std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+			std::unordered_map<std::string, SubmeshGeometry>& drawArgs, const SimplifyOptions& options)
+		{
+			// Go by name, so the index buffer comes out the same every time.
+			std::vector<std::string> names;
+			for (auto& e : drawArgs)
+			{
+				if (e.second.Lods.empty())
+					names.push_back(e.first);
+			}
+			std::sort(names.begin(), names.end());
+
+			SimplifyOptions levelOptions = options;
+			levelOptions.MaxLevels = std::min(levelOptions.MaxLevels, MaxLodLevels - 1);
+			std::vector<SimplifiedLevel> levels;
+			int levelCount = 0;
+			for (const std::string& name : names)
+			{
+				SubmeshGeometry& submesh = drawArgs[name];
+				CHECK(submesh.BaseVertexLocation >= 0 && submesh.BaseVertexLocation + submesh.VertexCount <= vertices.size());
+				CHECK(submesh.StartIndexLocation + submesh.IndexCount <= indices.size());
+				if (submesh.VertexCount == 0)
+					continue;
+				// Copy the indices, indices grows while the levels are appended.
+				std::vector<std::uint32_t> source(indices.begin() + submesh.StartIndexLocation,
+					indices.begin() + submesh.StartIndexLocation + submesh.IndexCount);
+				if (!SimplifyLevels(&vertices[submesh.BaseVertexLocation].Pos, sizeof(Vertex), submesh.VertexCount,
+					source.data(), source.size(), levelOptions, levels))
+				{
+					LOG(ERROR) << StringPrintf("Submesh \"%s\" is not an oriented manifold, it gets no levels of detail.", name.c_str());
+					continue;
+				}
+
+				SubmeshGeometry levelSubmesh = submesh;
+				for (size_t i = 0; i < levels.size(); ++i)
+				{
+					SubmeshLod lod;
+					lod.IndexCount = (UINT)levels[i].Indices.size();
+					lod.StartIndexLocation = (UINT)indices.size();
+					lod.Error = levels[i].Error;
+					indices.insert(indices.end(), levels[i].Indices.begin(), levels[i].Indices.end());
+					submesh.Lods.push_back(lod);
+
+					levelSubmesh.IndexCount = lod.IndexCount;
+					levelSubmesh.StartIndexLocation = lod.StartIndexLocation;
+					drawArgs[StringPrintf("%s_lod%d", name.c_str(), (int)i + 1)] = levelSubmesh;
+				}
+				levelCount += (int)levels.size();
+			}
+			return levelCount;
+		}
+
+		SphereBounds ComputeSphereBounds(const Vertex* vertices, UINT count)
+		{
+			// Center of the box, tight enough for selecting levels.
+			SphereBounds sphere;
+			if (count == 0)
+				return sphere;
+			Bounds3f bounds;
+			for (UINT i = 0; i < count; ++i)
+				bounds = Union(bounds, vertices[i].Pos);
+			sphere.Center = bounds.Center();
+			float radiusSquared = 0.0f;
+			for (UINT i = 0; i < count; ++i)
+				radiusSquared = std::max(radiusSquared, DistanceSquared(sphere.Center, vertices[i].Pos));
+			sphere.Radius = std::sqrt(radiusSquared);
+			return sphere;
+		}
+
+		float LodScale(float fovY, float renderHeight, float pixelError)
+		{
+			if (pixelError <= 0.0f)
+				return 0.0f;
+			return renderHeight / (2.0f * std::tan(0.5f * Radians(fovY))) / pixelError;
+		}
+
+		int SelectLod(const SubmeshGeometry& submesh, const Matrix4x4& world, const Vector3f& eye, float lodScale, float nearZ)
+		{
+			if (submesh.Lods.empty() || lodScale <= 0.0f)
+				return 0;
+
+			// Largest scale of the world axes bounds how much the error grows.
+			float scaleSquared = 0.0f;
+			for (int j = 0; j < 3; ++j)
+				scaleSquared = std::max(scaleSquared, world.m[0][j] * world.m[0][j] + world.m[1][j] * world.m[1][j] + world.m[2][j] * world.m[2][j]);
+			float scale = std::sqrt(scaleSquared);
+			const Vector3f& c = submesh.Sphere.Center;
+			Vector3f center(world.m[0][0] * c.x + world.m[0][1] * c.y + world.m[0][2] * c.z + world.m[0][3],
+				world.m[1][0] * c.x + world.m[1][1] * c.y + world.m[1][2] * c.z + world.m[1][3],
+				world.m[2][0] * c.x + world.m[2][1] * c.y + world.m[2][2] * c.z + world.m[2][3]);
+			float distance = std::max(Distance(center, eye) - submesh.Sphere.Radius * scale, nearZ);
+
+			// Errors grow with the levels, so stop at the first that projects too large.
+			float errorLimit = distance / (scale * lodScale);
+			int lod = 0;
+			while (lod < (int)submesh.Lods.size() && lod < MaxLodLevels - 1 && submesh.Lods[lod].Error <= errorLimit)
+				++lod;
+			return lod;
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,42 @@
+// Build the levels of detail of submeshes and select them by projected error, shared by the D3D12
+// and the headless renderer.
+
+#pragma once
+
+#include "scenetypes.h"
+#include "../mesh/simplify.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Levels a renderer tells apart, the full submesh and at most MaxLodLevels - 1 coarser ones.
+		const int MaxLodLevels = 8;
+
+		// Simplify the triangle list submeshes of drawArgs, append their levels to indices and fill the
+		// Lods of the submeshes. Every level is also added as a submesh named "<name>_lod<level>" so it can
+		// be drawn on its own. Call it before adding the geometry. Submeshes that are not oriented
+		// manifolds keep no levels and are logged. Return the number of levels added.
+		int BuildSubmeshLods(const std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+			std::unordered_map<std::string, SubmeshGeometry>& drawArgs, const SimplifyOptions& options = SimplifyOptions());
+
+		SphereBounds ComputeSphereBounds(const Vertex* vertices, UINT count);
+
+		// Pixels an error of one unit at distance one covers, divided by the error in pixels a level may
+		// show. fovY is in degrees like the one of Camera. A pixel error of 0 or less turns the selection off.
+		float LodScale(float fovY, float renderHeight, float pixelError);
+
+		// Coarsest level whose error projects to at most the allowed pixels from the nearest point of the
+		// bounding sphere of the submesh placed by world, 0 for the full submesh. Distances are clamped to
+		// nearZ, so the camera inside the sphere always gets the full submesh.
+		int SelectLod(const SubmeshGeometry& submesh, const Matrix4x4& world, const Vector3f& eye, float lodScale, float nearZ);
+
+		// Index range of a level selected by SelectLod.
+		inline void GetLodRange(const SubmeshGeometry& submesh, int lod, UINT* indexCount, UINT* startIndexLocation)
+		{
+			*indexCount = lod > 0 ? submesh.Lods[lod - 1].IndexCount : submesh.IndexCount;
+			*startIndexLocation = lod > 0 ? submesh.Lods[lod - 1].StartIndexLocation : submesh.StartIndexLocation;
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,292 @@
+// Asynchronous read back of GPU textures through a ring of read back buffers.
+
+#include "readbackqueue.h"
+#include "deviceresources.h"
+#include "../utility/stringprint.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		using Microsoft::WRL::ComPtr;
+
+		ReadBackQueue::ReadBackQueue(DeviceResources* deviceResources) :
+			mDeviceResources(deviceResources)
+		{
+			ThrowIfFailed(mDeviceResources->GetD3DDevice()->CreateCommandAllocator(
+				D3D12_COMMAND_LIST_TYPE_DIRECT,
+				IID_PPV_ARGS(mCmdListAlloc.GetAddressOf())));
+			ThrowIfFailed(mDeviceResources->GetD3DDevice()->CreateCommandList(
+				0,
+				D3D12_COMMAND_LIST_TYPE_DIRECT,
+				mCmdListAlloc.Get(),
+				nullptr,
+				IID_PPV_ARGS(mCommandList.GetAddressOf())));
+			mCommandList->Close();
+		}
+
+		ReadBackQueue::~ReadBackQueue()
+		{
+			for (auto& buffer : mBuffers)
+			{
+				if (buffer->Mapped)
+					buffer->Resource->Unmap(0, &CD3DX12_RANGE(0, 0));
+			}
+		}
+
+		void ReadBackQueue::Reserve(int count, ID3D12Resource* texture)
+		{
+			D3D12_RESOURCE_DESC desc = texture->GetDesc();
+			UINT64 size = 0;
+			mDeviceResources->GetD3DDevice()->GetCopyableFootprints(&desc, 0, 1, 0, nullptr, nullptr, nullptr, &size);
+
+			int ready = 0;
+			for (auto buffer : mFreeBuffers)
+			{
+				if (ready < count && buffer->Size < size && IsComplete(buffer))
+					CreateResource(buffer, size);
+				if (buffer->Size >= size)
+					++ready;
+			}
+			for (; ready < count; ++ready)
+			{
+				std::unique_ptr<ReadBackBuffer> buffer = std::make_unique<ReadBackBuffer>();
+				CreateResource(buffer.get(), size);
+				mFreeBuffers.push_back(buffer.get());
+				mBuffers.push_back(std::move(buffer));
+			}
+		}
+
+		ReadBackTicket ReadBackQueue::Request(ID3D12Resource* source, ReadBackCallback callback, D3D12_RESOURCE_STATES sourceState)
+		{
+			D3D12_RESOURCE_DESC desc = source->GetDesc();
+			UINT64 size = 0;
+			mDeviceResources->GetD3DDevice()->GetCopyableFootprints(&desc, 0, 1, 0, nullptr, nullptr, nullptr, &size);
+			ReadBackBuffer* buffer = AcquireBuffer(size);
+
+			// The buffer is complete, so the GPU is done with the commands of its allocator.
+			ThrowIfFailed(buffer->CmdListAlloc->Reset());
+			ThrowIfFailed(mCommandList->Reset(buffer->CmdListAlloc.Get(), nullptr));
+			ReadBackTicket ticket = RecordCopy(mCommandList.Get(), buffer, source, sourceState, callback);
+			ThrowIfFailed(mCommandList->Close());
+			ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+			mDeviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+			mDeviceResources->Signal();
+			return ticket;
+		}
+
+		ReadBackTicket ReadBackQueue::Record(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* source, ReadBackCallback callback,
+			D3D12_RESOURCE_STATES sourceState)
+		{
+			D3D12_RESOURCE_DESC desc = source->GetDesc();
+			UINT64 size = 0;
+			mDeviceResources->GetD3DDevice()->GetCopyableFootprints(&desc, 0, 1, 0, nullptr, nullptr, nullptr, &size);
+			return RecordCopy(cmdList, AcquireBuffer(size), source, sourceState, callback);
+		}
+
+		bool ReadBackQueue::IsReady(ReadBackTicket ticket) const
+		{
+			PendingRead* request = mRequests.Get(HandleCast<PendingRead>(ticket));
+			return request && IsComplete(request->Buffer);
+		}
+
+		void ReadBackQueue::Wait(ReadBackTicket ticket)
+		{
+			PendingRead* request = mRequests.Get(HandleCast<PendingRead>(ticket));
+			if (!request)
+				return;
+			ReadBackBuffer* buffer = request->Buffer;
+			// A recorded copy without a fence yet, the caller has executed its list by now.
+			if (!buffer->Signaled)
+				mDeviceResources->Signal();
+			mDeviceResources->WaitForFence(buffer->Fence);
+		}
+
+		bool ReadBackQueue::Map(ReadBackTicket ticket, ReadBackData& data)
+		{
+			PendingRead* request = Finished(ticket);
+			if (!request)
+				return false;
+			data = request->Layout;
+			return true;
+		}
+
+		bool ReadBackQueue::Copy(ReadBackTicket ticket, RetrieveImageData& image)
+		{
+			PendingRead* request = Finished(ticket);
+			if (!request)
+				return false;
+			const ReadBackData& layout = request->Layout;
+			image.Width = layout.Width;
+			image.Height = layout.Height;
+			image.Pitch = layout.Pitch;
+			image.Data.resize((size_t)layout.Pitch * layout.Height);
+			memcpy(image.Data.data(), layout.Data, image.Data.size());
+			return true;
+		}
+
+		bool ReadBackQueue::Copy(ReadBackTicket ticket, void* dest, UINT destPitch)
+		{
+			PendingRead* request = Finished(ticket);
+			if (!request)
+				return false;
+			const ReadBackData& layout = request->Layout;
+			BYTE* destRow = static_cast<BYTE*>(dest);
+			UINT rowBytes = std::min(layout.RowBytes, destPitch);
+			for (UINT y = 0; y < layout.Height; ++y, destRow += destPitch)
+				memcpy(destRow, layout.Data + (size_t)y * layout.Pitch, rowBytes);
+			return true;
+		}
+
+		void ReadBackQueue::Release(ReadBackTicket ticket)
+		{
+			std::unique_ptr<PendingRead> request = mRequests.Remove(HandleCast<PendingRead>(ticket));
+			if (!request)
+				return;
+			// Released copies still in flight stay out of use until their fence completes.
+			ReadBackBuffer* buffer = request->Buffer;
+			if (buffer->Mapped)
+			{
+				buffer->Resource->Unmap(0, &CD3DX12_RANGE(0, 0));
+				buffer->Mapped = nullptr;
+			}
+			mFreeBuffers.push_back(buffer);
+		}
+
+		void ReadBackQueue::Poll()
+		{
+			for (size_t i = 0; i < mRequests.SlotCount(); ++i)
+			{
+				PendingRead* request = mRequests.At(i);
+				if (!request || !request->Callback)
+					continue;
+				ReadBackTicket ticket = HandleCast<ReadBackRequest>(mRequests.HandleAt(i));
+				if (!Finished(ticket))
+					continue;
+				ReadBackCallback callback = std::move(request->Callback);
+				callback(ticket, request->Layout);
+				Release(ticket);
+			}
+		}
+
+		void ReadBackQueue::OnSignal(UINT64 fence)
+		{
+			for (auto buffer : mUnsignaled)
+			{
+				buffer->Fence = fence;
+				buffer->Signaled = true;
+			}
+			mUnsignaled.clear();
+		}
+
+		bool ReadBackQueue::IsComplete(const ReadBackBuffer* buffer) const
+		{
+			return buffer->Signaled && mDeviceResources->GetFence()->GetCompletedValue() >= buffer->Fence;
+		}
+
+		ReadBackQueue::ReadBackBuffer* ReadBackQueue::AcquireBuffer(UINT64 size)
+		{
+			// Prefer a completed buffer that is large enough, then any completed one to grow.
+			int fit = -1;
+			for (int i = 0; i < (int)mFreeBuffers.size(); ++i)
+			{
+				if (!IsComplete(mFreeBuffers[i]))
+					continue;
+				if (fit < 0 || (mFreeBuffers[fit]->Size < size && mFreeBuffers[i]->Size > mFreeBuffers[fit]->Size))
+					fit = i;
+				if (mFreeBuffers[fit]->Size >= size)
+					break;
+			}
+
+			ReadBackBuffer* buffer;
+			if (fit >= 0)
+			{
+				buffer = mFreeBuffers[fit];
+				mFreeBuffers.erase(mFreeBuffers.begin() + fit);
+			}
+			else
+			{
+				std::unique_ptr<ReadBackBuffer> created = std::make_unique<ReadBackBuffer>();
+				buffer = created.get();
+				mBuffers.push_back(std::move(created));
+				LOG(INFO) << StringPrintf("Read back ring grows to %d buffers.", (int)mBuffers.size());
+			}
+			if (buffer->Size < size)
+				CreateResource(buffer, size);
+			return buffer;
+		}
+
+		void ReadBackQueue::CreateResource(ReadBackBuffer* buffer, UINT64 size)
+		{
+			ID3D12Device* device = mDeviceResources->GetD3DDevice();
+			if (!buffer->CmdListAlloc)
+			{
+				ThrowIfFailed(device->CreateCommandAllocator(
+					D3D12_COMMAND_LIST_TYPE_DIRECT,
+					IID_PPV_ARGS(buffer->CmdListAlloc.GetAddressOf())));
+			}
+
+			ThrowIfFailed(device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+				D3D12_HEAP_FLAG_NONE,
+				&CD3DX12_RESOURCE_DESC::Buffer(size),
+				D3D12_RESOURCE_STATE_COPY_DEST,
+				nullptr,
+				IID_PPV_ARGS(buffer->Resource.ReleaseAndGetAddressOf())));
+			buffer->Size = size;
+		}
+
+		ReadBackTicket ReadBackQueue::RecordCopy(ID3D12GraphicsCommandList* cmdList, ReadBackBuffer* buffer, ID3D12Resource* source,
+			D3D12_RESOURCE_STATES sourceState, ReadBackCallback callback)
+		{
+			// Get the copy target location, rows are aligned to 256 bytes.
+			D3D12_RESOURCE_DESC desc = source->GetDesc();
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+			UINT rowCount = 0;
+			UINT64 rowBytes = 0;
+			mDeviceResources->GetD3DDevice()->GetCopyableFootprints(&desc, 0, 1, 0, &footprint, &rowCount, &rowBytes, nullptr);
+
+			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(source,
+				sourceState, D3D12_RESOURCE_STATE_COPY_SOURCE));
+			CD3DX12_TEXTURE_COPY_LOCATION copyDest(buffer->Resource.Get(), footprint);
+			CD3DX12_TEXTURE_COPY_LOCATION copySrc(source, 0);
+			cmdList->CopyTextureRegion(&copyDest, 0, 0, 0, &copySrc, nullptr);
+			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(source,
+				D3D12_RESOURCE_STATE_COPY_SOURCE, sourceState));
+
+			buffer->Fence = 0;
+			buffer->Signaled = false;
+			mUnsignaled.push_back(buffer);
+
+			std::unique_ptr<PendingRead> request = std::make_unique<PendingRead>();
+			request->Buffer = buffer;
+			request->Layout.Width = footprint.Footprint.Width;
+			request->Layout.Height = footprint.Footprint.Height;
+			request->Layout.Pitch = footprint.Footprint.RowPitch;
+			request->Layout.RowBytes = (UINT)rowBytes;
+			request->Layout.Format = footprint.Footprint.Format;
+			request->Callback = std::move(callback);
+			return HandleCast<ReadBackRequest>(mRequests.Add(std::move(request)));
+		}
+
+		ReadBackQueue::PendingRead* ReadBackQueue::Finished(ReadBackTicket ticket)
+		{
+			PendingRead* request = mRequests.Get(HandleCast<PendingRead>(ticket));
+			if (!request)
+				return nullptr;
+			ReadBackBuffer* buffer = request->Buffer;
+			if (!IsComplete(buffer))
+				return nullptr;
+
+			// Map once on first access, the mapping lives until the ticket is released.
+			if (!buffer->Mapped)
+			{
+				UINT64 readBytes = (UINT64)request->Layout.Pitch * request->Layout.Height;
+				ThrowIfFailed(buffer->Resource->Map(0, &CD3DX12_RANGE(0, (SIZE_T)readBytes), reinterpret_cast<void**>(&buffer->Mapped)));
+			}
+			request->Layout.Data = buffer->Mapped;
+			return request;
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
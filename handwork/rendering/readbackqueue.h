@@ -0,0 +1,118 @@
+// Asynchronous read back of GPU textures through a ring of read back buffers.
+
+#pragma once
+
+#include <functional>
+#include "d3dUtil.h"
+#include "renderbackend.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		class DeviceResources;
+
+		// Layout of a finished read back. Data points into the mapped read back buffer and stays valid
+		// until the ticket is released, rows are Pitch bytes apart and RowBytes of them are used.
+		struct ReadBackData
+		{
+			const BYTE* Data = nullptr;
+			UINT Width = 0;
+			UINT Height = 0;
+			UINT Pitch = 0;
+			UINT RowBytes = 0;
+			DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+		};
+
+		// Tickets refer to requests kept privately by the queue.
+		struct ReadBackRequest;
+		typedef Handle<ReadBackRequest> ReadBackTicket;
+		// Called by Poll on the polling thread, the ticket is released after the callback returns.
+		typedef std::function<void(ReadBackTicket, const ReadBackData&)> ReadBackCallback;
+
+		// A request copies a texture into a free read back buffer and completes with the first fence
+		// DeviceResources signals after the copy was submitted. Finished requests are read through their
+		// ticket without waiting, or handed to their callback by Poll. Buffers return to the ring on
+		// Release and the ring grows when every buffer is held by a request or still in flight.
+		class ReadBackQueue
+		{
+		public:
+			static const int InitialBufferCount = 3;
+
+			ReadBackQueue(DeviceResources* deviceResources);
+			ReadBackQueue(const ReadBackQueue& rhs) = delete;
+			ReadBackQueue& operator=(const ReadBackQueue& rhs) = delete;
+			~ReadBackQueue();
+
+			// Keep at least count free buffers large enough for the top mip of the texture.
+			void Reserve(int count, ID3D12Resource* texture);
+
+			// Copy the top mip of a texture on a command list of the queue and submit it. The source is
+			// returned to its state after the copy, for depth stencil formats the depth plane is copied.
+			ReadBackTicket Request(ID3D12Resource* source, ReadBackCallback callback = nullptr,
+				D3D12_RESOURCE_STATES sourceState = D3D12_RESOURCE_STATE_PRESENT);
+			// Record the copy into a command list of the caller. The request completes with the next
+			// fence signaled after the caller executed the list.
+			ReadBackTicket Record(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* source, ReadBackCallback callback = nullptr,
+				D3D12_RESOURCE_STATES sourceState = D3D12_RESOURCE_STATE_PRESENT);
+
+			// False for requests that are still on the GPU and for stale tickets.
+			bool IsReady(ReadBackTicket ticket) const;
+			void Wait(ReadBackTicket ticket);
+			// Zero copy access to a finished request, returns false if it is not ready.
+			bool Map(ReadBackTicket ticket, ReadBackData& data);
+			// Copy a finished request to an image or to caller memory with rows destPitch bytes apart,
+			// return false if it is not ready.
+			bool Copy(ReadBackTicket ticket, RetrieveImageData& image);
+			bool Copy(ReadBackTicket ticket, void* dest, UINT destPitch);
+			void Release(ReadBackTicket ticket);
+
+			// Hand the finished requests with callbacks to them.
+			void Poll();
+			// DeviceResources reports every fence it signals.
+			void OnSignal(UINT64 fence);
+
+			size_t GetPendingCount() const { return mRequests.Size(); }
+			size_t GetBufferCount() const { return mBuffers.size(); }
+
+		private:
+			struct ReadBackBuffer
+			{
+				Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+				Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+				UINT64 Size = 0;
+				// Fence of the last copy into the buffer, 0 while the copy is not signaled yet.
+				UINT64 Fence = 0;
+				bool Signaled = true;
+				BYTE* Mapped = nullptr;
+			};
+
+			struct PendingRead
+			{
+				ReadBackBuffer* Buffer;
+				ReadBackData Layout;
+				ReadBackCallback Callback;
+			};
+
+			bool IsComplete(const ReadBackBuffer* buffer) const;
+			ReadBackBuffer* AcquireBuffer(UINT64 size);
+			void CreateResource(ReadBackBuffer* buffer, UINT64 size);
+			ReadBackTicket RecordCopy(ID3D12GraphicsCommandList* cmdList, ReadBackBuffer* buffer, ID3D12Resource* source,
+				D3D12_RESOURCE_STATES sourceState, ReadBackCallback callback);
+			// The request of a ticket if its copy is complete, mapped on first access.
+			PendingRead* Finished(ReadBackTicket ticket);
+
+			DeviceResources* mDeviceResources;
+			// List for the copies of Request, it is reset with the allocator of the buffer copied to.
+			Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCmdListAlloc;
+			Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
+
+			std::vector<std::unique_ptr<ReadBackBuffer>> mBuffers;
+			std::vector<ReadBackBuffer*> mFreeBuffers;
+			// Buffers with copies that wait for the next signaled fence.
+			std::vector<ReadBackBuffer*> mUnsignaled;
+			HandlePool<PendingRead> mRequests;
+		};
+
+	}	// namespace rendering
+}	// namespace handwork
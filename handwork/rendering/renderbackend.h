@@ -0,0 +1,97 @@
+// Platform independent interface for the device work of a renderer: buffers, draws, fences and read back.
+
+#pragma once
+
+#include "scenetypes.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		class RetrieveImageData
+		{
+		public:
+			UINT Width;
+			UINT Height;
+			UINT Pitch;
+			std::vector<BYTE> Data;
+		};
+
+		// Throughput of a batch of views rendered by RenderViews. Wait is the time the CPU blocked on
+		// the read back of finished views.
+		struct ViewBatchStats
+		{
+			UINT Views = 0;
+			float TotalMs = 0.0f;
+			float WaitMs = 0.0f;
+			float ViewsPerSecond = 0.0f;
+		};
+
+		struct BackendBuffer;
+		typedef Handle<BackendBuffer> BufferHandle;
+
+		// Element layout of a buffer. Vertex buffers hold Vertex, index buffers 32 bit indices, instance
+		// buffers InstanceData and material buffers MaterialData.
+		enum class BufferType
+		{
+			Vertex,
+			Index,
+			Instance,
+			Material
+		};
+
+		// State shared by all draws of a frame.
+		struct FrameSetup
+		{
+			PassConstants Pass;
+			BufferHandle Materials;
+			// Only write depth, the color target keeps its clear color.
+			bool DepthOnly = false;
+			Vector4f ClearColor = Vector4f(0.0f, 0.0f, 0.0f, 1.0f);
+		};
+
+		// Indexed triangle list draw of InstanceCount instances, read from the instance buffer starting
+		// at FirstInstance. Non-instanced items are drawn as a single instance.
+		struct DrawCommand
+		{
+			BufferHandle VertexBuffer;
+			BufferHandle IndexBuffer;
+			BufferHandle InstanceBuffer;
+			UINT IndexCount = 0;
+			UINT StartIndexLocation = 0;
+			INT BaseVertexLocation = 0;
+			UINT FirstInstance = 0;
+			UINT InstanceCount = 1;
+		};
+
+		// The device side of a renderer. A frame is recorded with BeginFrame and Draw, and executed by
+		// Submit, which returns the fence value signaled once the frame is done. Buffers must not be
+		// updated while a submitted frame using them is still running.
+		class RenderBackend
+		{
+		public:
+			virtual ~RenderBackend() {}
+
+			// Color and depth targets are recreated on resize.
+			virtual void Resize(int width, int height) = 0;
+			virtual Vector2i GetRenderTargetSize() const = 0;
+
+			virtual BufferHandle CreateBuffer(BufferType type, size_t byteSize, const void* initData) = 0;
+			virtual void UpdateBuffer(BufferHandle buffer, size_t byteOffset, size_t byteSize, const void* data) = 0;
+			virtual void DestroyBuffer(BufferHandle buffer) = 0;
+
+			virtual void BeginFrame(const FrameSetup& setup) = 0;
+			virtual void Draw(const DrawCommand& draw) = 0;
+			virtual uint64_t Submit() = 0;
+			virtual uint64_t GetCompletedFence() const = 0;
+			// Block until the fence value is reached, 0 never blocks.
+			virtual void WaitForFence(uint64_t fence) = 0;
+
+			// Read back the targets of the last completed frame. Color is RGBA8, depth is the post
+			// projection depth in [0, 1] with 1 for pixels nothing was drawn to.
+			virtual void ReadbackColor(RetrieveImageData& image) = 0;
+			virtual void ReadbackDepth(std::vector<float>& depth) = 0;
+		};
+
+	}	// namespace rendering
+}	// namespace handwork
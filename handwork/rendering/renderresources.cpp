@@ -2,6 +2,9 @@
 
 #include "renderresources.h"
 #include "geogenerator.h"
+#include "depthutil.h"
+#include "../utility/shadowfit.h"
+#include "../utility/parallel.h"
 
 namespace handwork
 {
@@ -11,17 +14,40 @@ namespace handwork
 		using namespace DirectX;
 		using namespace DirectX::PackedVector;
 
+		namespace
+		{
+			// Command lists the passes are recorded into at most, and the draws below which a job does
+			// not pay for its own command list.
+			const int MaxRecordJobs = 16;
+			const uint32_t MinRecordJobDraws = 64;
+
+			D3D12_RESOURCE_STATES ToResourceState(GraphResourceState state)
+			{
+				switch (state)
+				{
+				case GraphResourceState::RenderTarget: return D3D12_RESOURCE_STATE_RENDER_TARGET;
+				case GraphResourceState::DepthWrite: return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+				case GraphResourceState::DepthRead: return D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+				case GraphResourceState::ShaderRead: return D3D12_RESOURCE_STATE_GENERIC_READ;
+				case GraphResourceState::CopySource: return D3D12_RESOURCE_STATE_COPY_SOURCE;
+				case GraphResourceState::CopyDest: return D3D12_RESOURCE_STATE_COPY_DEST;
+				case GraphResourceState::Present: return D3D12_RESOURCE_STATE_PRESENT;
+				default: return D3D12_RESOURCE_STATE_COMMON;
+				}
+			}
+		}	// namespace
+
 		RenderResources::RenderResources(const std::shared_ptr<DeviceResources>& deviceResource, const std::shared_ptr<Camera> camera,
-			const std::shared_ptr<GameTimer> timer, bool continousMode, bool depthOnlyMode) :
+			const std::shared_ptr<GameTimer> timer, bool continousMode, bool depthOnlyMode, int shadowCascades) :
 			mDeviceResources(deviceResource),
 			mCamera(camera),
 			mGameTimer(timer),
-			mCurrentMatCBIndex(-1),
-			mCurrentObjCBIndex(-1),
-			mCurrentInstCBIndex(0),
+			mCurrentGeoIndex(0),
 			mContinousMode(continousMode),
 			mDepthOnlyMode(depthOnlyMode)
 		{
+			mCascadeCount = Clamp(shadowCascades, 1, MaxCascades);
+
 			mAmbientLight = { 0.4f, 0.4f, 0.4f, 1.0f };
 			mDirectLights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
 			mDirectLights[0].Strength = { 0.4f, 0.4f, 0.5f };
@@ -49,7 +75,7 @@ namespace handwork
 
 			mShadowMap.reset();
 			mSsao.reset();
-			mShadowMap = std::make_unique<ShadowMap>(device, 2048, 2048);
+			mShadowMap = std::make_unique<ShadowMap>(device, mShadowTileSize, mShadowTileSize, mCascadeCount);
 			mSsao = std::make_unique<Ssao>(device, commandList, renderSize.x, renderSize.y);
 
 			BuildRootSignature();
@@ -96,6 +122,7 @@ namespace handwork
 			auto commandList = mDeviceResources->GetCommandList();
 			auto commandQueue = mDeviceResources->GetCommandQueue();
 
+			BuildSceneBVH();
 			BuildFrameResources();
 
 			// Execute the initialization commands.
@@ -112,14 +139,24 @@ namespace handwork
 			mFrameResources.clear();
 			mCurrFrameResource = nullptr;
 			mCurrFrameResourceIndex = 0;
+			mRecordJobs.clear();
+			mRecordLists.clear();
 			mRootSignature.Reset();
 			mSsaoRootSignature.Reset();
-			mGeometries.clear();
-			mMaterials.clear();
+			mGeometries.Clear();
+			mMaterials.Clear();
+			mGeometryNames.Clear();
 			mShaders.clear();
 			mPSOs.clear();
 			mSrvDescriptorHeap.Reset();
-			mAllRitems.clear();
+			mAllRitems.Clear();
+			mRenderItemNames.Clear();
+			mBatchIndices.clear();
+			mObjectSlots.Clear();
+			mInstanceRanges.Reset(0);
+			mObjectCapacity = 0;
+			mInstanceCapacity = 0;
+			mMaterialCapacity = 0;
 
 			for (int i = 0; i < (int)RenderLayer::Count; ++i)
 			{
@@ -132,6 +169,12 @@ namespace handwork
 		void RenderResources::Update()
 		{
 			Vector2i renderSize = mDeviceResources->GetRenderTargetSize();
+			mStats = RenderStats();
+			GameTimer stageTimer;
+			stageTimer.Reset();
+
+			// Make room for items and materials added since the last frame.
+			GrowFrameResources();
 
 			// Cycle through the circular frame resource array.
 			mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -139,98 +182,172 @@ namespace handwork
 
 			// Has the GPU finished processing the commands of the current frame resource?
 			// If not, wait until the GPU has completed commands up to this fence point.
-			if (mCurrFrameResource->Fence != 0 && mDeviceResources->GetFence()->GetCompletedValue() < mCurrFrameResource->Fence)
-			{
-				HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-				ThrowIfFailed(mDeviceResources->GetFence()->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-				WaitForSingleObject(eventHandle, INFINITE);
-				CloseHandle(eventHandle);
-			}
+			mDeviceResources->WaitForFence(mCurrFrameResource->Fence);
+			stageTimer.Tick();
+			mStats.WaitMs = 1000.0f * stageTimer.DeltaTime();
+
+			// Hand finished asynchronous read backs to their callbacks.
+			mDeviceResources->GetReadBackQueue()->Poll();
+
+			// Items were added, removed or resized, rebuild before their bounds are refreshed.
+			if (mSceneBVHRebuild)
+				BuildSceneBVH();
 
 			// Update obj constant buffer and instance data.
+			// Every item owns its constant buffer slot, instance range and scene BVH primitives, so chunks
+			// of items are written in parallel without locking. Mapped upload memory is write combined,
+			// the writes go through streaming stores and each chunk fences its own stores.
 			auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 			auto currInstCB = mCurrFrameResource->InstanceBuffer.get();
-			for (auto& e : mAllRitems)
+			std::atomic<UINT64> constantBytes(0);
+			std::atomic<UINT64> instanceBytes(0);
+			std::atomic<bool> boundsChanged(false);
+			ParallelForRange([&](int64_t begin, int64_t end)
 			{
-				// Only update the cbuffer data if the constants have changed.  
-				// This needs to be tracked per frame resource.
-				if (e->NumFramesDirty <= 0)
-					continue;
-
-				if (e->Instances.size() == 0)
+				UINT64 chunkConstantBytes = 0;
+				UINT64 chunkInstanceBytes = 0;
+				bool chunkBoundsChanged = false;
+				for (int64_t i = begin; i < end; ++i)
 				{
-					// No instancing.
-					ObjectConstants objConstants;
-					objConstants.World = e->World;
-					objConstants.MaterialIndex = e->Mat->MatCBIndex;
-					currObjectCB->CopyData(e->ObjCBIndex, objConstants);
-				}
-				else
-				{
-					// Instancing.
-					currInstCB->CopyContinuousData(e->InstCBIndex, (int)e->Instances.size(), &(e->Instances[0]));
-				}
+					RenderItem* e = mAllRitems.At(i);
+					// Only update the cbuffer data if the constants have changed.  
+					// This needs to be tracked per frame resource.
+					if (!e || e->NumFramesDirty <= 0)
+						continue;
 
-				// Next FrameResource need to be updated too.
-				e->NumFramesDirty--;
-			}
+					if (e->Instances.size() == 0)
+					{
+						// No instancing.
+						ObjectConstants objConstants;
+						objConstants.World = e->World;
+						objConstants.MaterialIndex = e->Mat->MatCBIndex;
+						currObjectCB->StreamData(e->ObjCBIndex, objConstants);
+						chunkConstantBytes += sizeof(ObjectConstants);
+					}
+					else
+					{
+						// Instancing, copy the ranges changed since this frame resource was last written.
+						DirtyRanges& dirty = e->DirtyInstances[mCurrFrameResourceIndex];
+						dirty.Coalesce(4);
+						for (size_t r = 0; r < dirty.Size(); ++r)
+						{
+							UINT count = dirty[r].End - dirty[r].Begin;
+							currInstCB->StreamContinuousData(e->InstCBIndex + dirty[r].Begin, count, &e->Instances[dirty[r].Begin]);
+							chunkInstanceBytes += count * sizeof(InstanceData);
+						}
+						dirty.Clear();
+					}
+					// Bounds are shared by all frame resources, refresh them once per change.
+					if (e->NumFramesDirty == gNumFrameResources)
+						chunkBoundsChanged |= UpdateRenderItemBounds(e);
+
+					// Next FrameResource need to be updated too.
+					e->NumFramesDirty--;
+				}
+				d3dUtil::StreamFence();
+				constantBytes += chunkConstantBytes;
+				instanceBytes += chunkInstanceBytes;
+				if (chunkBoundsChanged)
+					boundsChanged = true;
+			}, (int64_t)mAllRitems.SlotCount(), 1024);
+			if (boundsChanged)
+				mSceneBVHDirty = true;
+			stageTimer.Tick();
+			mStats.ItemUpdateMs = 1000.0f * stageTimer.DeltaTime();
 
 			// Update material constant buffer.
 			auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
-			for (auto& e : mMaterials)
+			ParallelForRange([&](int64_t begin, int64_t end)
 			{
-				// Only update the cbuffer data if the constants have changed.  If the cbuffer
-				// data changes, it needs to be updated for each FrameResource.
-				Material* mat = e.second.get();
-				if (mat->NumFramesDirty > 0)
+				UINT64 chunkConstantBytes = 0;
+				for (int64_t i = begin; i < end; ++i)
 				{
-					MaterialData matData;
-					matData.Albedo = mat->Albedo;
-					matData.Roughness = mat->Roughness;
-					matData.Metalness = mat->Metalness;
+					// Only update the cbuffer data if the constants have changed.  If the cbuffer
+					// data changes, it needs to be updated for each FrameResource.
+					Material* mat = mMaterials.At(i);
+					if (mat && mat->NumFramesDirty > 0)
+					{
+						MaterialData matData;
+						matData.Albedo = mat->Albedo;
+						matData.Roughness = mat->Roughness;
+						matData.Metalness = mat->Metalness;
 
-					currMaterialBuffer->CopyData(mat->MatCBIndex, matData);
+						currMaterialBuffer->CopyData(mat->MatCBIndex, matData);
+						chunkConstantBytes += sizeof(MaterialData);
 
-					// Next FrameResource need to be updated too.
-					mat->NumFramesDirty--;
+						// Next FrameResource need to be updated too.
+						mat->NumFramesDirty--;
+					}
 				}
-			}
+				constantBytes += chunkConstantBytes;
+			}, (int64_t)mMaterials.SlotCount(), 1024);
+			mStats.ConstantUploadBytes += constantBytes;
+			mStats.InstanceUploadBytes += instanceBytes;
+			stageTimer.Tick();
+			mStats.MaterialUpdateMs = 1000.0f * stageTimer.DeltaTime();
 
 			// Update shadow transform.
-			// Only the first "main" light casts a shadow.
+			// Only the first "main" light casts a shadow, through one cascade per tile of the shadow map.
+			Bounds3f sceneBounds = mSceneBVH.Empty() ? mSceneBounds : mSceneBVH.WorldBound();
 			Vector3f lightDir = mDirectLights[0].Direction;
 			Vector3f targetPos = Vector3f(mSceneSphereBounds.Center.x, mSceneSphereBounds.Center.y, mSceneSphereBounds.Center.z);
 			Vector3f lightPos = targetPos - 2.0f* mSceneSphereBounds.Radius * lightDir;
 			Vector3f lightUp = Vector3f(0.0f, 1.0f, 0.0f);
 			Matrix4x4 lightView = d3dUtil::CameraLookAt(lightPos, targetPos, lightUp);
+			Matrix4x4 invLightView = Inverse(lightView);
 			mLightPosW = lightPos;
-
-			// Transform bounding sphere to light space.
-			Vector3f sphereCenterLS = Transform(lightView, Matrix4x4())(targetPos, VectorType::Point);
-
-			// Ortho frustum in light space encloses scene.
-			float l = sphereCenterLS.x - mSceneSphereBounds.Radius * 1.5f;
-			float b = sphereCenterLS.y - mSceneSphereBounds.Radius * 1.5f;
-			float n = sphereCenterLS.z - mSceneSphereBounds.Radius * 1.5f;
-			float r = sphereCenterLS.x + mSceneSphereBounds.Radius * 1.5f;
-			float t = sphereCenterLS.y + mSceneSphereBounds.Radius * 1.5f;
-			float f = sphereCenterLS.z + mSceneSphereBounds.Radius * 1.5f;
-
-			mLightNearZ = n;
-			mLightFarZ = f;
-			Matrix4x4 lightProj = OrthographicOffCenter(l, r, b, t, n, f).GetMatrix();
-
-			// Transform NDC space [-1,+1]^2 to texture space [0,1]^2
-			Matrix4x4 T(
-				0.5f, 0.0f, 0.0f, 0.5f,
-				0.0f, -0.5f, 0.0f, 0.5f,
-				0.0f, 0.0f, 1.0f, 0.0f,
-				0.0f, 0.0f, 0.0f, 1.0f);
-
-			Matrix4x4 S = Matrix4x4::Mul(Matrix4x4::Mul(T, lightProj), lightView);
 			mLightView = lightView;
-			mLightProj = lightProj;
-			mShadowTransform = S;
+
+			// Split the part of the camera frustum in front of the farthest scene point.
+			Matrix4x4 cameraView = mCamera->GetView();
+			float cameraNearZ = mCamera->GetNearZ();
+			float cameraFarZ = mCamera->GetFarZ();
+			float shadowFarZ = cameraFarZ;
+			if (!sceneBounds.IsEmpty())
+				shadowFarZ = Clamp(TransformBounds(cameraView, sceneBounds).pMax.z, cameraNearZ + 0.01f, cameraFarZ);
+			float splits[MaxCascades];
+			ComputeCascadeSplits(cameraNearZ, shadowFarZ, mCascadeCount, mCascadeSplitLambda, splits);
+
+			Vector3f cameraCorners[8];
+			FrustumCorners(Inverse(Matrix4x4::Mul(mCamera->GetProj(), cameraView)), cameraCorners);
+			UINT w = mShadowMap->Width();
+			UINT h = mShadowMap->Height();
+			float tileScale = 1.0f / mCascadeCount;
+			for (int i = 0; i < mCascadeCount; ++i)
+			{
+				Vector3f slice[8];
+				FrustumSliceCorners(cameraCorners, cameraNearZ, cameraFarZ, i == 0 ? cameraNearZ : splits[i - 1], splits[i], slice);
+				Bounds3f lightBounds = FitCascadeBounds(lightView, slice, sceneBounds, (int)w);
+				// Keep the projection invertible for flat scenes.
+				lightBounds.pMax.z = std::max(lightBounds.pMax.z, lightBounds.pMin.z + 0.001f);
+				Matrix4x4 lightProj = OrthographicOffCenter(lightBounds.pMin.x, lightBounds.pMax.x,
+					lightBounds.pMin.y, lightBounds.pMax.y, lightBounds.pMin.z, lightBounds.pMax.z).GetMatrix();
+
+				// Transform NDC space [-1,+1]^2 to texture space of the cascade tile.
+				Matrix4x4 T(
+					0.5f * tileScale, 0.0f, 0.0f, (0.5f + i) * tileScale,
+					0.0f, -0.5f, 0.0f, 0.5f,
+					0.0f, 0.0f, 1.0f, 0.0f,
+					0.0f, 0.0f, 0.0f, 1.0f);
+				mMainPassCB.CascadeTransforms[i] = Matrix4x4::Mul(Matrix4x4::Mul(T, lightProj), lightView);
+				mMainPassCB.CascadeSplits[i] = splits[i];
+
+				Matrix4x4 lightViewProj = Matrix4x4::Mul(lightProj, lightView);
+				PassConstants& shadowPassCB = mShadowPassCB[i];
+				shadowPassCB.View = lightView;
+				shadowPassCB.InvView = invLightView;
+				shadowPassCB.Proj = lightProj;
+				shadowPassCB.InvProj = Inverse(lightProj);
+				shadowPassCB.ViewProj = lightViewProj;
+				shadowPassCB.InvViewProj = Inverse(lightViewProj);
+				shadowPassCB.EyePosW = mLightPosW;
+				shadowPassCB.RenderTargetSize = Vector2f((float)w, (float)h);
+				shadowPassCB.InvRenderTargetSize = Vector2f(1.0f / w, 1.0f / h);
+				shadowPassCB.NearZ = lightBounds.pMin.z;
+				shadowPassCB.FarZ = lightBounds.pMax.z;
+			}
+			mMainPassCB.CascadeCount = (UINT)mCascadeCount;
+			mShadowTransform = mMainPassCB.CascadeTransforms[0];
 
 			// Update main pass constant buffer.
 			Matrix4x4 view = mCamera->GetView();
@@ -240,7 +357,7 @@ namespace handwork
 			Matrix4x4 invProj = Inverse(proj);
 			Matrix4x4 invViewProj = Inverse(viewProj);
 			// Transform NDC space [-1,+1]^2 to texture space [0,1]^2
-			T = Matrix4x4(
+			Matrix4x4 T(
 				0.5f, 0.0f, 0.0f, 0.5f,
 				0.0f, -0.5f, 0.0f, 0.5f,
 				0.0f, 0.0f, 1.0f, 0.0f,
@@ -271,29 +388,22 @@ namespace handwork
 			auto currPassCB = mCurrFrameResource->PassCB.get();
 			currPassCB->CopyData(0, mMainPassCB);
 
-			// Update shadow pass constant buffer.
-			view = mLightView;
-			proj = mLightProj;
-			viewProj = Matrix4x4::Mul(proj, view);
-			invView = Inverse(view);
-			invProj = Inverse(proj);
-			invViewProj = Inverse(viewProj);
-			UINT w = mShadowMap->Width();
-			UINT h = mShadowMap->Height();
-			mShadowPassCB.View = view;
-			mShadowPassCB.InvView = invView;
-			mShadowPassCB.Proj = proj;
-			mShadowPassCB.InvProj = invProj;
-			mShadowPassCB.ViewProj = viewProj;
-			mShadowPassCB.InvViewProj = invViewProj;
-			mShadowPassCB.EyePosW = mLightPosW;
-			mShadowPassCB.RenderTargetSize = Vector2f((float)w, (float)h);
-			mShadowPassCB.InvRenderTargetSize = Vector2f(1.0f / w, 1.0f / h);
-			mShadowPassCB.NearZ = mLightNearZ;
-			mShadowPassCB.FarZ = mLightFarZ;
-
-			currPassCB = mCurrFrameResource->PassCB.get();
-			currPassCB->CopyData(1, mShadowPassCB);
+			// Update shadow pass constant buffers, one per cascade.
+			for (int i = 0; i < mCascadeCount; ++i)
+				currPassCB->CopyData(1 + i, mShadowPassCB[i]);
+			mStats.ConstantUploadBytes += (1 + mCascadeCount) * sizeof(PassConstants);
+
+			stageTimer.Tick();
+			mStats.PassUpdateMs = 1000.0f * stageTimer.DeltaTime();
+
+			// Cull against the camera and every cascade, and pack the visible instances.
+			mLodScale = LodScale(mCamera->GetFovY(), (float)renderSize.y, mLodPixelError);
+			SelectLods();
+			CullRenderItems(CullView::Camera, mMainPassCB.ViewProj);
+			for (int i = 0; i < mCascadeCount; ++i)
+				CullRenderItems((CullView)((int)CullView::Shadow + i), mShadowPassCB[i].ViewProj);
+			stageTimer.Tick();
+			mStats.CullMs = 1000.0f * stageTimer.DeltaTime();
 
 			// Update ssao constant buffer.
 			SsaoConstants ssaoCB;
@@ -326,6 +436,7 @@ namespace handwork
 
 			auto currSsaoCB = mCurrFrameResource->SsaoCB.get();
 			currSsaoCB->CopyData(0, ssaoCB);
+			mStats.ConstantUploadBytes += sizeof(SsaoConstants);
 		}
 
 		void RenderResources::Render()
@@ -338,115 +449,60 @@ namespace handwork
 			ThrowIfFailed(cmdListAlloc->Reset());
 			// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 			// Reusing the command list reuses memory.
+			GameTimer stageTimer;
+			stageTimer.Reset();
 			ThrowIfFailed(commandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
-
-			ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-			commandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-			ID3D12Resource* matBuffer;
-			ID3D12Resource* instBuffer;
-			if(!mDepthOnlyMode)
-			{
-				// Set base root signature.
-				commandList->SetGraphicsRootSignature(mRootSignature.Get());
-				// Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
-				// set as a root descriptor.
-				matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
-				commandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
-				instBuffer = mCurrFrameResource->InstanceBuffer->Resource();
-				commandList->SetGraphicsRootShaderResourceView(3, instBuffer->GetGPUVirtualAddress());
-				// Bind null SRV for shadow map pass.
-				commandList->SetGraphicsRootDescriptorTable(4, mNullSrv);
-
-				//
-				// Shadow map pass.
-				//
-
-				DrawSceneToShadowMap();
-
-				//
-				// Normal/depth pass.
-				//
-
-				DrawNormalsAndDepth();
-
-				//
-				// Compute SSAO.
-				// 
-
-				commandList->SetGraphicsRootSignature(mSsaoRootSignature.Get());
-				mSsao->ComputeSsao(commandList, mCurrFrameResource, 3);
-			}
-
-			//
-			// Main rendering pass.
-			//
-
-			// Rebind state whenever graphics root signature changes.
-			// Bind all the materials used in this scene. For structured buffers, we can bypass the heap and 
-			// set as a root descriptor.
-			commandList->SetGraphicsRootSignature(mRootSignature.Get());
-			matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
-			commandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
-			instBuffer = mCurrFrameResource->InstanceBuffer->Resource();
-			commandList->SetGraphicsRootShaderResourceView(3, instBuffer->GetGPUVirtualAddress());
-			auto passCB = mCurrFrameResource->PassCB->Resource();
-			commandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
-			if(mDepthOnlyMode)
-			{
-				// Bind null SRV for shadow map pass.
-				commandList->SetGraphicsRootDescriptorTable(4, mNullSrv);
-			}
-			else
+			mAutoInstanceCount = 0;
+
+			// Resolve the draws of the passes the frame needs, with the transitions derived by the graph.
+			BuildRenderGraph();
+			mRecordPasses.clear();
+			mPassDraws.clear();
+			mGraphBarriers.clear();
+			mPendingBarrierCount = 0;
+			mRenderGraph.Execute([this](const GraphBarrier* barriers, uint32_t count)
 			{
-				CD3DX12_GPU_DESCRIPTOR_HANDLE shadowMapDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-				shadowMapDescriptor.Offset(mShadowMapHeapIndex, mDeviceResources->GetCbvSrvUavSize());
-				commandList->SetGraphicsRootDescriptorTable(4, shadowMapDescriptor);
-			}
-
-			mDeviceResources->PreparePresent(mDepthOnlyMode);
-
-			if(mDepthOnlyMode)
-			{
-				if (mRitemLayer[(int)RenderLayer::Opaque].size() != 0)
-				{
-					commandList->SetPipelineState(mPSOs["depth_opaque"].Get());
-					DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::Opaque]);
-				}
-				if (mRitemLayer[(int)RenderLayer::OpaqueInst].size() != 0)
+				mPendingFirstBarrier = mGraphBarriers.size();
+				mPendingBarrierCount = count;
+				for (uint32_t i = 0; i < count; ++i)
 				{
-					commandList->SetPipelineState(mPSOs["depthInst_opaque"].Get());
-					DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::OpaqueInst]);
+					mGraphBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(mGraphResources[barriers[i].Resource],
+						ToResourceState(barriers[i].Before), ToResourceState(barriers[i].After)));
 				}
-			}
-			else
+				mStats.GraphBarriers += count;
+			});
+
+			// Record the jobs in parallel, the shadow, normal/depth and main passes end up in jobs of their
+			// own once they have enough draws, and large passes are split across several jobs.
+			mRecordPartition.Reset(JobPartition::Capacity(mPassDraws.size(), (uint32_t)mRecordJobs.size(), MinRecordJobDraws));
+			for (const auto& pass : mRecordPasses)
+				mRecordPartition.AddGroup(pass.DrawCount);
+			uint32_t jobCount = mRecordPartition.GetJobCount();
+			CHECK(jobCount <= mRecordJobs.size());
+			ParallelFor([this](int64_t j)
 			{
-				if (mRitemLayer[(int)RenderLayer::Opaque].size() != 0)
-				{
-					commandList->SetPipelineState(mPSOs["opaque"].Get());
-					DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::Opaque]);
-				}
-				if (mRitemLayer[(int)RenderLayer::OpaqueInst].size() != 0)
-				{
-					commandList->SetPipelineState(mPSOs["opaqueInst"].Get());
-					DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::OpaqueInst]);
-				}
-				if (mRitemLayer[(int)RenderLayer::WireFrame].size() != 0)
-				{
-					commandList->SetPipelineState(mPSOs["opaque_wireframe"].Get());
-					DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::WireFrame]);
-				}
-				if (mRitemLayer[(int)RenderLayer::WireFrameInst].size() != 0)
-				{
-					commandList->SetPipelineState(mPSOs["opaqueInst_wireframe"].Get());
-					DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::WireFrameInst]);
-				}
-				if (mRitemLayer[(int)RenderLayer::Debug].size() != 0)
-				{
-					commandList->SetPipelineState(mPSOs["debug"].Get());
-					DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::Debug]);
-				}
+				RecordJobCommands((uint32_t)j);
+			}, (int64_t)jobCount, 1);
+
+			mRecordLists.clear();
+			for (uint32_t j = 0; j < jobCount; ++j)
+			{
+				const RecordJob& job = mRecordJobs[j];
+				mStats.DrawCalls += job.DrawCalls;
+				mStats.PipelineBinds += job.PipelineBinds;
+				mStats.GeometryBinds += job.GeometryBinds;
+				mStats.SkippedGeometryBinds += job.SkippedGeometryBinds;
+				mRecordLists.push_back(job.CommandList.Get());
 			}
+			mStats.RecordJobs = jobCount;
+
+			// The queue runs the jobs in order and ahead of the command list of the device, which returns
+			// the resources to their states between frames and presents or reads back the frame.
+			mDeviceResources->GetCommandQueue()->ExecuteCommandLists(jobCount, mRecordLists.data());
+			if (mPendingBarrierCount > 0)
+				commandList->ResourceBarrier(mPendingBarrierCount, &mGraphBarriers[mPendingFirstBarrier]);
+			stageTimer.Tick();
+			mStats.RecordMs = 1000.0f * stageTimer.DeltaTime();
 
 			if (mContinousMode)
 				mDeviceResources->Present(mCurrFrameResource->Fence);
@@ -478,6 +534,10 @@ namespace handwork
 					commandList->ResourceBarrier(1, &barrier);
 				}
 
+				// Batched views copy the result out in the same command list.
+				if (mBatchViews)
+					mViewReadBack = mDeviceResources->GetReadBackQueue()->Record(commandList, mDeviceResources->CurrentBackBuffer());
+
 				// Done recording commands.
 				ThrowIfFailed(commandList->Close());
 				// Add the command list to the queue for execution.
@@ -485,11 +545,77 @@ namespace handwork
 				mDeviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
 				mDeviceResources->ManualSwapBackBuffers();
-				mCurrFrameResource->Fence++;
 
-				// Wait to finish.
-				mDeviceResources->FlushCommandQueue();
+				// Wait to finish. Batched views only wait when the frame resource or the read back buffer
+				// comes around again.
+				mCurrFrameResource->Fence = mDeviceResources->Signal();
+				if (!mBatchViews)
+					mDeviceResources->WaitForFence(mCurrFrameResource->Fence);
+			}
+		}
+
+		ViewBatchStats RenderResources::RenderViews(const std::vector<Camera>& cameras, std::vector<RetrieveImageData>& images)
+		{
+			ViewBatchStats stats;
+			if (mContinousMode)
+			{
+				LOG(ERROR) << "Batched views need the discrete mode.";
+				return stats;
+			}
+
+			GameTimer batchTimer;
+			batchTimer.Reset();
+			GameTimer waitTimer;
+			images.resize(cameras.size());
+			Camera savedCamera = *mCamera;
+
+			// View i - 1 is read back after view i is submitted, so the ring holds two views at most.
+			ReadBackQueue* readBackQueue = mDeviceResources->GetReadBackQueue();
+			std::vector<ReadBackTicket> tickets(cameras.size());
+			auto readBack = [&](size_t view)
+			{
+				waitTimer.Reset();
+				readBackQueue->Wait(tickets[view]);
+				waitTimer.Tick();
+				stats.WaitMs += 1000.0f * waitTimer.DeltaTime();
+				readBackQueue->Copy(tickets[view], images[view]);
+				readBackQueue->Release(tickets[view]);
+			};
+
+			for (size_t i = 0; i < cameras.size(); ++i)
+			{
+				*mCamera = cameras[i];
+				mCamera->UpdateViewMatrix();
+
+				// Update waits for the frame resource, and with it the command allocator, of an older view.
+				Update();
+				mBatchViews = true;
+				Render();
+				mBatchViews = false;
+				tickets[i] = mViewReadBack;
+
+				if (i > 0)
+					readBack(i - 1);
 			}
+			if (!cameras.empty())
+				readBack(cameras.size() - 1);
+
+			*mCamera = savedCamera;
+
+			batchTimer.Tick();
+			stats.Views = (UINT)cameras.size();
+			stats.TotalMs = 1000.0f * batchTimer.DeltaTime();
+			if (stats.TotalMs > 0.0f)
+				stats.ViewsPerSecond = 1000.0f * stats.Views / stats.TotalMs;
+			LOG(INFO) << StringPrintf("Rendered %u views in %.1f ms, %.1f views/s, %.1f ms waiting for read back.",
+				stats.Views, stats.TotalMs, stats.ViewsPerSecond, stats.WaitMs);
+			return stats;
+		}
+
+		void RenderResources::RetrieveLinearDepthBuffer(std::vector<float>& depth)
+		{
+			mDeviceResources->RetrieveDepthBuffer(depth);
+			depth::LinearizeDepth(depth.data(), depth.data(), depth.size(), mCamera->GetNearZ(), mCamera->GetFarZ());
 		}
 
 		void RenderResources::SetLights(Light* lights)
@@ -499,30 +625,12 @@ namespace handwork
 			mDirectLights[2] = lights[2];
 		}
 
-		void RenderResources::AddMaterial(const Material& mat)
+		MaterialHandle RenderResources::AddMaterial(const Material& mat)
 		{
-			auto matPtr = std::make_unique<Material>();
-			matPtr->Name = mat.Name;
-			matPtr->Albedo = mat.Albedo;
-			matPtr->Roughness = mat.Roughness;
-			matPtr->Metalness = mat.Metalness;
-
-			if (mMaterials.find(matPtr->Name) != mMaterials.end())
-			{
-				// Replace existing material.
-				matPtr->MatCBIndex = mMaterials[matPtr->Name]->MatCBIndex;
-				mMaterials.erase(matPtr->Name);
-				mMaterials[matPtr->Name] = std::move(matPtr);
-			}
-			else
-			{
-				// Add new material.
-				matPtr->MatCBIndex = ++mCurrentMatCBIndex;
-				mMaterials[matPtr->Name] = std::move(matPtr);
-			}
+			return mMaterials.Add(mat, gNumFrameResources);
 		}
 
-		void RenderResources::AddGeometryData(
+		GeometryHandle RenderResources::AddGeometryData(
 			const std::vector<Vertex>& vertices,
 			const std::vector<std::uint32_t>& indices,
 			const std::unordered_map<std::string, SubmeshGeometry>& drawArgs,
@@ -544,6 +652,7 @@ namespace handwork
 
 			auto geo = std::make_unique<MeshGeometry>();
 			geo->Name = name;
+			geo->GeoIndex = mCurrentGeoIndex++;
 
 			ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 			CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
@@ -570,140 +679,246 @@ namespace handwork
 			geo->IndexFormat = useIndices16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
 			geo->IndexBufferByteSize = ibByteSize;
 
-			// Calculate submesh bounds.
 			geo->DrawArgs = drawArgs;
-			for (auto& e : geo->DrawArgs)
-			{
-				BoundingBox::CreateFromPoints(e.second.BoxBounds, e.second.VertexCount, reinterpret_cast<const XMFLOAT3*>(&vertices[e.second.BaseVertexLocation].Pos), sizeof(Vertex));
-				BoundingSphere::CreateFromPoints(e.second.SphereBounds, e.second.VertexCount, reinterpret_cast<const XMFLOAT3*>(&vertices[e.second.BaseVertexLocation].Pos), sizeof(Vertex));
-			}
+			ComputeSubmeshBounds(vertices, geo->DrawArgs);
 
-			if (mGeometries.find(geo->Name) != mGeometries.end())
-				mGeometries.erase(geo->Name);
-			mGeometries[geo->Name] = std::move(geo);
+			// A geometry added under an existing name takes over the name. Items added before keep
+			// drawing the old one, it lives until the resources are released.
+			GeometryHandle handle = mGeometries.Add(std::move(geo));
+			mGeometryNames.Add(name, handle);
+			return handle;
 		}
 
-		void RenderResources::AddRenderItem(const std::vector<RenderItemData>& renderItems, const RenderLayer layer)
+		std::vector<RenderItemHandle> RenderResources::AddRenderItem(const std::vector<RenderItemData>& renderItems, const RenderLayer layer)
 		{
-			BoundingBox tempBox;
-			BoundingSphere tempSphere;
-			XMFLOAT4X4 tempCache;
+			std::vector<RenderItemHandle> handles;
+			handles.reserve(renderItems.size());
 			for (auto& e : renderItems)
 			{
+				MeshGeometry* geo = mGeometries.Get(e.Geo);
+				Material* mat = nullptr;
+				SubmeshGeometry* subMesh = ResolveRenderItem(e, geo ? &geo->DrawArgs : nullptr, mMaterials, &mat);
+				if (!subMesh)
+				{
+					handles.push_back(RenderItemHandle());
+					continue;
+				}
+
 				auto item = std::make_unique<RenderItem>();
 				item->Name = e.Name;
-				item->Geo = mGeometries[e.GeoName].get();
-				item->SubMesh = &(item->Geo->DrawArgs[e.DrawArgName]);
-				item->PrimitiveType = e.PrimitiveType;
+				item->Geo = geo;
+				item->SubMesh = subMesh;
+				item->PrimitiveType = (D3D12_PRIMITIVE_TOPOLOGY)e.PrimitiveType;
 				item->IndexCount = item->SubMesh->IndexCount;
 				item->StartIndexLocation = item->SubMesh->StartIndexLocation;
 				item->BaseVertexLocation = item->SubMesh->BaseVertexLocation;
+				auto batchKey = std::make_pair((const SubmeshGeometry*)item->SubMesh, item->PrimitiveType);
+				auto batch = mBatchIndices.find(batchKey);
+				if (batch == mBatchIndices.end())
+					batch = mBatchIndices.insert(std::make_pair(batchKey, (UINT)mBatchIndices.size())).first;
+				item->BatchIndex = batch->second;
 				if (e.Instances.size() == 0)
 				{
 					// No instancing.
 					item->World = e.World;
-					item->ObjCBIndex = ++mCurrentObjCBIndex;
-					item->Mat = mMaterials[e.MatName].get();
+					item->ObjCBIndex = mObjectSlots.Allocate();
+					item->Mat = mat;
 				}
 				else
 				{
 					// Instancing.
-					int numInst = (int)e.Instances.size();
-					item->Instances.resize(numInst);
-					for (int i = 0; i < numInst; ++i)
-					{
-						item->Instances[i].World = e.Instances[i].World;
-						item->Instances[i].MaterialIndex = mMaterials[e.Instances[i].MatName]->MatCBIndex;
-					}
-					item->InstCBIndex = mCurrentInstCBIndex;
-					mCurrentInstCBIndex += numInst;
+					mMaterials.ResolveInstances(e.Instances, item->Instances, e.Name);
+					item->InstCBIndex = AllocateInstanceRange((UINT)item->Instances.size());
+					MarkInstancesDirty(item.get(), 0, (UINT)item->Instances.size());
 				}
 
+				if (UpdateRenderItemBounds(item.get()))
+					mSceneBVHDirty = true;
+
 				// Update scene bounds.
 				if (layer != RenderLayer::Debug && layer != RenderLayer::Count)
 				{
-					if (item->Instances.size() == 0)
-					{
-						// No instancing.
-						tempCache = d3dUtil::ConvertToXMFLOAT4x4(item->World);
-						const XMMATRIX transform = XMLoadFloat4x4(&tempCache);
-						BoundingBox box = item->SubMesh->BoxBounds;
-						box.Transform(tempBox, transform);
-						BoundingSphere sphere = item->SubMesh->SphereBounds;
-						sphere.Transform(tempSphere, transform);
-
-						if (mSceneSphereBounds.Radius <= 0.0f)
-						{
-							mSceneBoxBounds = tempBox;
-							mSceneSphereBounds = tempSphere;
-						}
-						else
-						{
-							BoundingBox::CreateMerged(mSceneBoxBounds, mSceneBoxBounds, tempBox);
-							BoundingSphere::CreateMerged(mSceneSphereBounds, mSceneSphereBounds, tempSphere);
-						}
-					}
-					else
-					{
-						// Instancing.
-						for (auto& inst : item->Instances)
-						{
-							tempCache = d3dUtil::ConvertToXMFLOAT4x4(inst.World);
-							const XMMATRIX transform = XMLoadFloat4x4(&tempCache);
-							BoundingBox box = item->SubMesh->BoxBounds;
-							box.Transform(tempBox, transform);
-							BoundingSphere sphere = item->SubMesh->SphereBounds;
-							sphere.Transform(tempSphere, transform);
-
-							if (mSceneSphereBounds.Radius <= 0.0f)
-							{
-								mSceneBoxBounds = tempBox;
-								mSceneSphereBounds = tempSphere;
-							}
-							else
-							{
-								BoundingBox::CreateMerged(mSceneBoxBounds, mSceneBoxBounds, tempBox);
-								BoundingSphere::CreateMerged(mSceneSphereBounds, mSceneSphereBounds, tempSphere);
-							}
-						}
-					}
+					mSceneBounds = Union(mSceneBounds, item->Bounds);
+					Vector3f center = mSceneBounds.Center();
+					Vector3f extent = mSceneBounds.Extent();
+					mSceneBoxBounds.Center = XMFLOAT3(center.x, center.y, center.z);
+					mSceneBoxBounds.Extents = XMFLOAT3(extent.x, extent.y, extent.z);
+					mSceneSphereBounds.Center = mSceneBoxBounds.Center;
+					mSceneSphereBounds.Radius = extent.Length();
+					mSceneBVHRebuild = true;
 				}
 
+				item->LayerIndex = (int)layer;
+				item->LayerPosition = (int)mRitemLayer[(int)layer].size();
 				mRitemLayer[(int)layer].push_back(item.get());
-				mAllRitems.push_back(std::move(item));
+				RenderItemHandle handle = mAllRitems.Add(std::move(item));
+				mRenderItemNames.Add(e.Name, handle);
+				handles.push_back(handle);
 			}
+			return handles;
 		}
 
-		Material* RenderResources::GetMaterial(const std::string& name)
+		bool RenderResources::RemoveRenderItem(RenderItemHandle handle)
 		{
-			if (name.empty())
-				return nullptr;
-			if (mMaterials.find(name) != mMaterials.end())
-				return mMaterials[name].get();
+			RenderItem* item = mAllRitems.Get(handle);
+			if (!item)
+				return false;
+
+			DetachFromSceneBVH(item);
+			if (item->Instances.size() == 0)
+				mObjectSlots.Free(item->ObjCBIndex);
 			else
-				return nullptr;
+				mInstanceRanges.Free(item->InstCBIndex, (UINT)item->Instances.size());
+
+			// Draw order comes from the sort keys, so the last item of the layer can take the place.
+			auto& layerItems = mRitemLayer[item->LayerIndex];
+			RenderItem* last = layerItems.back();
+			layerItems[item->LayerPosition] = last;
+			last->LayerPosition = item->LayerPosition;
+			layerItems.pop_back();
+
+			mRenderItemNames.Remove(item->Name, handle);
+			mAllRitems.Remove(handle);
+			return true;
 		}
 
-		MeshGeometry* RenderResources::GetMeshGeometry(const std::string& name)
+		bool RenderResources::UpdateRenderItemWorld(RenderItemHandle handle, const Matrix4x4& world)
 		{
-			if (name.empty())
-				return nullptr;
-			if (mGeometries.find(name) != mGeometries.end())
-				return mGeometries[name].get();
-			else
-				return nullptr;
+			RenderItem* item = mAllRitems.Get(handle);
+			if (!item || item->Instances.size() != 0)
+				return false;
+
+			item->World = world;
+			item->NumFramesDirty = gNumFrameResources;
+			return true;
 		}
 
-		RenderItem* RenderResources::GetRenderItem(const std::string& name, const RenderLayer layer)
+		bool RenderResources::UpdateInstances(RenderItemHandle handle, const std::vector<Instance>& instances)
 		{
-			if (name.empty())
-				return nullptr;
-			for (auto& item : mRitemLayer[(int)layer])
+			RenderItem* item = mAllRitems.Get(handle);
+			if (!item || item->Instances.size() == 0 || instances.size() == 0)
+				return false;
+
+			UINT oldCount = (UINT)item->Instances.size();
+			UINT newCount = (UINT)instances.size();
+			mMaterials.ResolveInstances(instances, mResolvedInstances, item->Name);
+
+			if (newCount != oldCount)
+			{
+				// The item needs a new range and new primitives in the scene BVH.
+				DetachFromSceneBVH(item);
+				mInstanceRanges.Free(item->InstCBIndex, oldCount);
+				item->InstCBIndex = -1;
+				item->Instances.swap(mResolvedInstances);
+				item->InstCBIndex = AllocateInstanceRange(newCount);
+				for (int i = 0; i < gNumFrameResources; ++i)
+					item->DirtyInstances[i].Clear();
+				MarkInstancesDirty(item, 0, newCount);
+				return true;
+			}
+
+			// Same count, only upload the instances that changed.
+			for (UINT i = 0; i < newCount; ++i)
 			{
-				if (item->Name == name)
-					return item;
+				if (memcmp(&item->Instances[i], &mResolvedInstances[i], sizeof(InstanceData)) != 0)
+				{
+					item->Instances[i] = mResolvedInstances[i];
+					MarkInstancesDirty(item, i, i + 1);
+				}
+			}
+			return true;
+		}
+
+		bool RenderResources::UpdateInstanceRange(RenderItemHandle handle, UINT first, const std::vector<Instance>& instances)
+		{
+			RenderItem* item = mAllRitems.Get(handle);
+			if (!item || first + instances.size() > item->Instances.size())
+				return false;
+
+			mMaterials.ResolveInstances(instances, mResolvedInstances, item->Name);
+			std::copy(mResolvedInstances.begin(), mResolvedInstances.end(), item->Instances.begin() + first);
+			MarkInstancesDirty(item, first, first + (UINT)instances.size());
+			return true;
+		}
+
+		void RenderResources::MarkInstancesDirty(RenderItem* item, UINT begin, UINT end)
+		{
+			if (begin >= end)
+				return;
+			for (int i = 0; i < gNumFrameResources; ++i)
+				item->DirtyInstances[i].Add(begin, end);
+			item->NumFramesDirty = gNumFrameResources;
+		}
+
+		UINT RenderResources::AllocateInstanceRange(UINT count)
+		{
+			uint32_t offset;
+			if (mInstanceRanges.Allocate(count, &offset))
+				return offset;
+
+			// Compact when a good part of the buffer is lost to fragmentation and grow otherwise.
+			// Growing within the capacity of the frame resources is free.
+			UINT freeCount = mInstanceRanges.Capacity() - mInstanceRanges.Used();
+			if (freeCount >= count && freeCount >= mInstanceRanges.Capacity() / 4)
+			{
+				CompactInstanceRanges();
+				if (mInstanceRanges.Allocate(count, &offset))
+					return offset;
 			}
-			return nullptr;
+			mInstanceRanges.Grow(std::max(mInstanceRanges.Capacity() + count, mInstanceCapacity));
+			bool allocated = mInstanceRanges.Allocate(count, &offset);
+			CHECK(allocated);
+			return offset;
+		}
+
+		void RenderResources::CompactInstanceRanges()
+		{
+			// Every frame resource copy of a moved range has to be written again.
+			mInstanceRanges.Reset(mInstanceRanges.Capacity());
+			for (size_t i = 0; i < mAllRitems.SlotCount(); ++i)
+			{
+				RenderItem* item = mAllRitems.At(i);
+				if (!item || item->Instances.size() == 0 || item->InstCBIndex == (UINT)-1)
+					continue;
+				uint32_t offset;
+				bool allocated = mInstanceRanges.Allocate((UINT)item->Instances.size(), &offset);
+				CHECK(allocated);
+				if (offset != item->InstCBIndex)
+				{
+					item->InstCBIndex = offset;
+					MarkInstancesDirty(item, 0, (UINT)item->Instances.size());
+				}
+			}
+		}
+
+		Material* RenderResources::GetMaterial(MaterialHandle handle) const
+		{
+			return mMaterials.Get(handle);
+		}
+
+		MeshGeometry* RenderResources::GetMeshGeometry(GeometryHandle handle) const
+		{
+			return mGeometries.Get(handle);
+		}
+
+		RenderItem* RenderResources::GetRenderItem(RenderItemHandle handle) const
+		{
+			return mAllRitems.Get(handle);
+		}
+
+		MaterialHandle RenderResources::FindMaterial(const std::string& name) const
+		{
+			return mMaterials.Find(name);
+		}
+
+		GeometryHandle RenderResources::FindMeshGeometry(const std::string& name) const
+		{
+			return mGeometryNames.Find(name);
+		}
+
+		RenderItemHandle RenderResources::FindRenderItem(const std::string& name) const
+		{
+			return mRenderItemNames.Find(name);
 		}
 
 		void RenderResources::BuildRootSignature()
@@ -881,6 +1096,9 @@ namespace handwork
 			mShaders["opaquePS"] = d3dUtil::CompileShader(L"shaders\\default.hlsl", nullptr, "PS", "ps_5_1");
 			mShaders["standardInstVS"] = d3dUtil::CompileShader(L"shaders\\default.hlsl", nullptr, "VSInst", "vs_5_1");
 			mShaders["opaqueInstPS"] = d3dUtil::CompileShader(L"shaders\\default.hlsl", nullptr, "PSInst", "ps_5_1");
+			const D3D_SHADER_MACRO wireframeDefines[] = { { "WIREFRAME", "1" }, { nullptr, nullptr } };
+			mShaders["wireframePS"] = d3dUtil::CompileShader(L"shaders\\default.hlsl", wireframeDefines, "PS", "ps_5_1");
+			mShaders["wireframeInstPS"] = d3dUtil::CompileShader(L"shaders\\default.hlsl", wireframeDefines, "PSInst", "ps_5_1");
 
 			mShaders["shadowVS"] = d3dUtil::CompileShader(L"shaders\\shadows.hlsl", nullptr, "VS", "vs_5_1");
 			mShaders["shadowOpaquePS"] = d3dUtil::CompileShader(L"shaders\\shadows.hlsl", nullptr, "PS", "ps_5_1");
@@ -960,15 +1178,24 @@ namespace handwork
 				opaquePsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
 			}
 			ThrowIfFailed(device->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
-			opaquePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-			ThrowIfFailed(device->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
+
+			// Wireframes are not drawn by the normal/depth pass, so they test against its depth instead
+			// of matching it, and they do not sample the shadow and ambient maps.
+			D3D12_GRAPHICS_PIPELINE_STATE_DESC wireframePsoDesc = opaquePsoDesc;
+			wireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+			wireframePsoDesc.DepthStencilState = basePsoDesc.DepthStencilState;
+			wireframePsoDesc.PS =
+			{
+				reinterpret_cast<BYTE*>(mShaders["wireframePS"]->GetBufferPointer()),
+				mShaders["wireframePS"]->GetBufferSize()
+			};
+			ThrowIfFailed(device->CreateGraphicsPipelineState(&wireframePsoDesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
 
 			//
 			// PSO for opaque instance objects.
 			//
 
 			D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueInstPsoDesc = opaquePsoDesc;
-			opaqueInstPsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
 			opaqueInstPsoDesc.VS =
 			{
 				reinterpret_cast<BYTE*>(mShaders["standardInstVS"]->GetBufferPointer()),
@@ -980,8 +1207,15 @@ namespace handwork
 				mShaders["opaqueInstPS"]->GetBufferSize()
 			};
 			ThrowIfFailed(device->CreateGraphicsPipelineState(&opaqueInstPsoDesc, IID_PPV_ARGS(&mPSOs["opaqueInst"])));
-			opaqueInstPsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-			ThrowIfFailed(device->CreateGraphicsPipelineState(&opaqueInstPsoDesc, IID_PPV_ARGS(&mPSOs["opaqueInst_wireframe"])));
+			D3D12_GRAPHICS_PIPELINE_STATE_DESC wireframeInstPsoDesc = opaqueInstPsoDesc;
+			wireframeInstPsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+			wireframeInstPsoDesc.DepthStencilState = basePsoDesc.DepthStencilState;
+			wireframeInstPsoDesc.PS =
+			{
+				reinterpret_cast<BYTE*>(mShaders["wireframeInstPS"]->GetBufferPointer()),
+				mShaders["wireframeInstPS"]->GetBufferSize()
+			};
+			ThrowIfFailed(device->CreateGraphicsPipelineState(&wireframeInstPsoDesc, IID_PPV_ARGS(&mPSOs["opaqueInst_wireframe"])));
 
 			//
 			// PSO for depth opaque objects.
@@ -1018,6 +1252,22 @@ namespace handwork
 			};
 			ThrowIfFailed(device->CreateGraphicsPipelineState(&depthInstPsoDesc, IID_PPV_ARGS(&mPSOs["depthInst_opaque"])));
 
+			//
+			// PSOs for the single sample depth of MSAA depth only frames, there is no render target.
+			//
+
+			D3D12_GRAPHICS_PIPELINE_STATE_DESC depthPrepassPsoDesc = depthPsoDesc;
+			depthPrepassPsoDesc.PS = { nullptr, 0 };
+			depthPrepassPsoDesc.NumRenderTargets = 0;
+			depthPrepassPsoDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+			depthPrepassPsoDesc.RasterizerState.MultisampleEnable = false;
+			depthPrepassPsoDesc.SampleDesc.Count = 1;
+			depthPrepassPsoDesc.SampleDesc.Quality = 0;
+			ThrowIfFailed(device->CreateGraphicsPipelineState(&depthPrepassPsoDesc, IID_PPV_ARGS(&mPSOs["depthPrepass"])));
+
+			depthPrepassPsoDesc.VS = depthInstPsoDesc.VS;
+			ThrowIfFailed(device->CreateGraphicsPipelineState(&depthPrepassPsoDesc, IID_PPV_ARGS(&mPSOs["depthPrepassInst"])));
+
 
 			//
 			// PSO for shadow map pass.
@@ -1158,14 +1408,310 @@ namespace handwork
 
 		void RenderResources::BuildFrameResources()
 		{
+			// Frames in flight may still read the old buffers.
+			if (!mFrameResources.empty())
+			{
+				mDeviceResources->FlushCommandQueue();
+				mFrameResources.clear();
+				mCurrFrameResource = nullptr;
+			}
+
+			mObjectCapacity = std::max(mObjectCapacity, mObjectSlots.Capacity());
+			mInstanceCapacity = std::max(mInstanceCapacity, mInstanceRanges.Capacity());
+			mMaterialCapacity = std::max(mMaterialCapacity, mMaterials.Count());
+
+			// The instance buffer holds all instances first, followed by the same layout for the
+			// instances that passed the culling of each view. The automatic instancing batches come last,
+			// room for every non-instanced item in the main, normal and shadow cascade passes.
+			mAutoInstanceStart = (1 + (int)CullView::Shadow + mCascadeCount) * mInstanceCapacity;
+			mAutoInstanceCapacity = (2 + mCascadeCount) * mObjectCapacity;
+			// One recording job per worker thread.
+			auto device = mDeviceResources->GetD3DDevice();
+			bool createJobs = mRecordJobs.empty();
+			if (createJobs)
+				mRecordJobs.resize(std::min(MaxThreadIndex(), MaxRecordJobs));
 			for (int i = 0; i < gNumFrameResources; ++i)
 			{
-				mFrameResources.push_back(std::make_unique<FrameResource>(mDeviceResources->GetD3DDevice(),
-					2, mCurrentObjCBIndex + 1, mCurrentMatCBIndex + 1, mCurrentInstCBIndex));
+				mFrameResources.push_back(std::make_unique<FrameResource>(device,
+					1 + mCascadeCount, mObjectCapacity, mMaterialCapacity,
+					mAutoInstanceStart + mAutoInstanceCapacity, (UINT)mRecordJobs.size()));
+			}
+			if (createJobs)
+			{
+				for (size_t j = 0; j < mRecordJobs.size(); ++j)
+				{
+					auto& cmdList = mRecordJobs[j].CommandList;
+					ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+						mFrameResources[0]->RecordCmdListAllocs[j].Get(), nullptr, IID_PPV_ARGS(cmdList.GetAddressOf())));
+					// The jobs reset the command lists before recording, so they start closed.
+					ThrowIfFailed(cmdList->Close());
+				}
+			}
+
+			// New buffers start empty.
+			for (size_t i = 0; i < mAllRitems.SlotCount(); ++i)
+			{
+				RenderItem* item = mAllRitems.At(i);
+				if (!item)
+					continue;
+				item->NumFramesDirty = gNumFrameResources;
+				MarkInstancesDirty(item, 0, (UINT)item->Instances.size());
+			}
+			for (size_t i = 0; i < mMaterials.SlotCount(); ++i)
+			{
+				if (mMaterials.At(i))
+					mMaterials.At(i)->NumFramesDirty = gNumFrameResources;
+			}
+		}
+
+		void RenderResources::GrowFrameResources()
+		{
+			UINT objectCount = mObjectSlots.Capacity();
+			UINT instanceCount = mInstanceRanges.Capacity();
+			UINT materialCount = mMaterials.Count();
+			if (objectCount <= mObjectCapacity && instanceCount <= mInstanceCapacity && materialCount <= mMaterialCapacity)
+				return;
+
+			if (objectCount > mObjectCapacity)
+				mObjectCapacity = std::max(objectCount, 2 * mObjectCapacity);
+			if (instanceCount > mInstanceCapacity)
+				mInstanceCapacity = std::max(instanceCount, 2 * mInstanceCapacity);
+			if (materialCount > mMaterialCapacity)
+				mMaterialCapacity = std::max(materialCount, 2 * mMaterialCapacity);
+			BuildFrameResources();
+			mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
+
+			LOG(INFO) << StringPrintf("Grow frame resources to %u objects, %u instances and %u materials.",
+				mObjectCapacity, mInstanceCapacity, mMaterialCapacity);
+		}
+
+		void RenderResources::BuildSceneBVH()
+		{
+			GameTimer timer;
+			timer.Reset();
+
+			// Debug items are already in clip space, they are neither culled nor picked.
+			mScenePrimItems.clear();
+			mScenePrimInstances.clear();
+			for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+			{
+				if (layer == (int)RenderLayer::Debug)
+					continue;
+				for (auto& item : mRitemLayer[layer])
+				{
+					item->BVHPrimOffset = (int)mScenePrimItems.size();
+					if (item->Instances.size() == 0)
+					{
+						mScenePrimItems.push_back(item);
+						mScenePrimInstances.push_back(-1);
+					}
+					else
+					{
+						for (int i = 0; i < (int)item->Instances.size(); ++i)
+						{
+							mScenePrimItems.push_back(item);
+							mScenePrimInstances.push_back(i);
+						}
+					}
+				}
+			}
+
+			mScenePrimBounds.resize(mScenePrimItems.size());
+			for (size_t i = 0; i < mAllRitems.SlotCount(); ++i)
+			{
+				if (mAllRitems.At(i))
+					UpdateRenderItemBounds(mAllRitems.At(i));
+			}
+			mSceneBVH.Build(mScenePrimBounds);
+			mSceneBVHDirty = false;
+			mSceneBVHRebuild = false;
+
+			timer.Stop();
+			LOG(INFO) << StringPrintf("Build scene BVH over %d primitives, %d nodes, depth %d, %f seconds.",
+				mSceneBVH.PrimitiveCount(), mSceneBVH.NodeCount(), mSceneBVH.MaxDepth(), timer.TotalTime());
+		}
+
+		void RenderResources::DetachFromSceneBVH(RenderItem* item)
+		{
+			if (item->BVHPrimOffset < 0)
+				return;
+			int primCount = item->Instances.size() == 0 ? 1 : (int)item->Instances.size();
+			for (int i = 0; i < primCount; ++i)
+				mScenePrimItems[item->BVHPrimOffset + i] = nullptr;
+			item->BVHPrimOffset = -1;
+			mSceneBVHRebuild = true;
+		}
+
+		bool RenderResources::UpdateRenderItemBounds(RenderItem* item)
+		{
+			const Bounds3f& local = item->SubMesh->Bounds;
+
+			if (item->Instances.size() == 0)
+			{
+				// No instancing.
+				item->Bounds = TransformBounds(item->World, local);
+				if (item->BVHPrimOffset >= 0)
+					mScenePrimBounds[item->BVHPrimOffset] = item->Bounds;
+			}
+			else
+			{
+				// Instancing, the item bounds enclose all instances.
+				Bounds3f bounds;
+				for (size_t i = 0; i < item->Instances.size(); ++i)
+				{
+					Bounds3f instBounds = TransformBounds(item->Instances[i].World, local);
+					if (item->BVHPrimOffset >= 0)
+						mScenePrimBounds[item->BVHPrimOffset + i] = instBounds;
+					bounds = Union(bounds, instBounds);
+				}
+				item->Bounds = bounds;
+			}
+			return item->BVHPrimOffset >= 0;
+		}
+
+		void RenderResources::SelectLods()
+		{
+			Vector3f eye = mMainPassCB.EyePosW;
+			float nearZ = mCamera->GetNearZ();
+			for (size_t i = 0; i < mAllRitems.SlotCount(); ++i)
+			{
+				RenderItem* e = mAllRitems.At(i);
+				if (!e)
+					continue;
+				if (e->SubMesh->Lods.empty() || mLodScale <= 0.0f)
+				{
+					e->Lod = 0;
+					e->InstanceLods.clear();
+					continue;
+				}
+				if (e->Instances.size() == 0)
+				{
+					e->Lod = SelectLod(*e->SubMesh, e->World, eye, mLodScale, nearZ);
+					continue;
+				}
+				e->InstanceLods.resize(e->Instances.size());
+				for (size_t j = 0; j < e->Instances.size(); ++j)
+					e->InstanceLods[j] = (uint8_t)SelectLod(*e->SubMesh, e->Instances[j].World, eye, mLodScale, nearZ);
 			}
 		}
 
-		void RenderResources::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+		void RenderResources::CullRenderItems(CullView view, const Matrix4x4& viewProj)
+		{
+			if (mSceneBVHDirty)
+			{
+				mSceneBVH.Refit(mScenePrimBounds);
+				mSceneBVHDirty = false;
+			}
+
+			int v = (int)view;
+			for (size_t i = 0; i < mAllRitems.SlotCount(); ++i)
+			{
+				RenderItem* e = mAllRitems.At(i);
+				if (!e || e->BVHPrimOffset < 0)
+					continue;
+				e->Visible[v] = false;
+				e->VisibleInstances[v].clear();
+				std::fill(e->VisibleLodCounts[v], e->VisibleLodCounts[v] + MaxLodLevels, 0);
+			}
+
+			Frustum frustum = ExtractFrustum(viewProj);
+			mVisiblePrims.clear();
+			mSceneBVH.QueryFrustum(frustum, mVisiblePrims);
+			for (int prim : mVisiblePrims)
+			{
+				int instance = mScenePrimInstances[prim];
+				if (instance < 0)
+					mScenePrimItems[prim]->Visible[v] = true;
+				else
+					mScenePrimItems[prim]->VisibleInstances[v].push_back(instance);
+			}
+
+			// Pack the visible instances into the region of this view.
+			auto currInstCB = mCurrFrameResource->InstanceBuffer.get();
+			UINT regionStart = (1 + v) * mInstanceCapacity;
+			for (size_t i = 0; i < mAllRitems.SlotCount(); ++i)
+			{
+				RenderItem* e = mAllRitems.At(i);
+				if (!e || e->BVHPrimOffset < 0 || e->Instances.size() == 0)
+					continue;
+				std::vector<int>& visible = e->VisibleInstances[v];
+				int numVisible = (int)visible.size();
+				e->VisibleInstanceCount[v] = (UINT)numVisible;
+				if (numVisible == 0)
+					continue;
+
+				// Keep the original instance order within each level of detail, the tree reports them in
+				// traversal order.
+				if (e->InstanceLods.size() == e->Instances.size())
+				{
+					const std::vector<uint8_t>& lods = e->InstanceLods;
+					std::sort(visible.begin(), visible.end(), [&lods](int a, int b)
+					{
+						return lods[a] < lods[b] || (lods[a] == lods[b] && a < b);
+					});
+					for (int j = 0; j < numVisible; ++j)
+						++e->VisibleLodCounts[v][lods[visible[j]]];
+				}
+				else
+				{
+					std::sort(visible.begin(), visible.end());
+					e->VisibleLodCounts[v][0] = (UINT)numVisible;
+				}
+				mVisibleInstanceData.resize(numVisible);
+				for (int j = 0; j < numVisible; ++j)
+					mVisibleInstanceData[j] = e->Instances[visible[j]];
+				currInstCB->CopyContinuousData(regionStart + e->InstCBIndex, numVisible, mVisibleInstanceData.data());
+				mStats.VisibleInstanceUploadBytes += numVisible * sizeof(InstanceData);
+			}
+		}
+
+		RenderItem* RenderResources::Pick(int x, int y, int* instance) const
+		{
+			if (instance)
+				*instance = -1;
+			if (mSceneBVH.Empty())
+				return nullptr;
+
+			// Unproject the pixel onto the near and far planes.
+			Vector2i renderSize = mDeviceResources->GetRenderTargetSize();
+			float ndcX = 2.0f * (x + 0.5f) / renderSize.x - 1.0f;
+			float ndcY = 1.0f - 2.0f * (y + 0.5f) / renderSize.y;
+			Transform invViewProj(mMainPassCB.InvViewProj, mMainPassCB.ViewProj);
+			Vector3f nearPos = invViewProj(Vector3f(ndcX, ndcY, 0.0f), VectorType::Point);
+			Vector3f farPos = invViewProj(Vector3f(ndcX, ndcY, 1.0f), VectorType::Point);
+
+			// Primitives of items removed since the last rebuild have no item.
+			int prim = mSceneBVH.IntersectRay(nearPos, farPos - nearPos, 1.0f);
+			if (prim < 0 || !mScenePrimItems[prim])
+				return nullptr;
+			if (instance)
+				*instance = mScenePrimInstances[prim];
+			return mScenePrimItems[prim];
+		}
+
+		void RenderResources::QueryRenderItems(const Bounds3f& bounds, std::vector<std::pair<RenderItem*, int>>& result) const
+		{
+			std::vector<int> prims;
+			mSceneBVH.QueryBounds(bounds, prims);
+			for (int prim : prims)
+			{
+				if (mScenePrimItems[prim])
+					result.push_back(std::make_pair(mScenePrimItems[prim], mScenePrimInstances[prim]));
+			}
+		}
+
+		void RenderResources::BeginRecordPass(std::function<void(ID3D12GraphicsCommandList*, bool)> setup)
+		{
+			RecordPass pass;
+			pass.Setup = std::move(setup);
+			pass.FirstDraw = mPassDraws.size();
+			pass.FirstBarrier = mPendingFirstBarrier;
+			pass.BarrierCount = mPendingBarrierCount;
+			mRecordPasses.push_back(std::move(pass));
+			mPendingBarrierCount = 0;
+		}
+
+		void RenderResources::AddPassDraws(const LayerPass* layers, int layerCount, CullView view, const PassConstants& pass)
 		{
 			UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 			UINT instElementSize = sizeof(InstanceData);
@@ -1176,107 +1722,471 @@ namespace handwork
 			D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress();
 			D3D12_GPU_VIRTUAL_ADDRESS instBufferAddress = instanceBuffer->GetGPUVirtualAddress();
 
-			// For each render item...
-			for (size_t i = 0; i < ritems.size(); ++i)
+			// Build the keys of the visible items. The layer field keeps the order the layers are given in,
+			// each layer owns one pipeline state of the pass.
+			mDrawList.Clear();
+			mDrawItems.clear();
+			for (int l = 0; l < layerCount; ++l)
+			{
+				for (auto ri : mRitemLayer[(int)layers[l].Layer])
+				{
+					bool culled = view != CullView::None && ri->BVHPrimOffset >= 0;
+					if (culled && (ri->Instances.size() == 0 ? !ri->Visible[(int)view] : ri->VisibleInstanceCount[(int)view] == 0))
+						continue;
+
+					float depth = 0.0f;
+					if (!ri->Bounds.IsEmpty())
+					{
+						Vector3f c = ri->Bounds.Center();
+						depth = pass.View.m[2][0] * c.x + pass.View.m[2][1] * c.y + pass.View.m[2][2] * c.z + pass.View.m[2][3];
+					}
+					// Materials are read per draw from the material buffer and never bound, so the material
+					// field groups the items of a batch and level of detail instead.
+					UINT batch = ri->BatchIndex * MaxLodLevels + (UINT)ri->Lod;
+					mDrawList.Add(DrawKey::Make(l, l, ri->Geo->GeoIndex, batch, DrawKey::DepthBucket(depth, pass.NearZ, pass.FarZ)),
+						(uint32_t)mDrawItems.size());
+					mDrawItems.push_back(ri);
+				}
+			}
+			mDrawList.Sort();
+
+			ID3D12PipelineState* layerPSOs[(int)RenderLayer::Count];
+			ID3D12PipelineState* layerInstPSOs[(int)RenderLayer::Count];
+			for (int l = 0; l < layerCount && l < (int)RenderLayer::Count; ++l)
 			{
-				auto ri = ritems[i];
+				layerPSOs[l] = mPSOs[layers[l].PSO].Get();
+				layerInstPSOs[l] = layers[l].InstPSO ? mPSOs[layers[l].InstPSO].Get() : nullptr;
+			}
 
-				cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-				cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-				cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			auto currInstCB = mCurrFrameResource->InstanceBuffer.get();
+			size_t drawCount = mDrawList.Size();
+			for (size_t i = 0; i < drawCount;)
+			{
+				auto ri = mDrawItems[mDrawList.Payload(i)];
+				bool culled = view != CullView::None && ri->BVHPrimOffset >= 0;
+				int slot = (int)DrawKey::Pipeline(mDrawList.Key(i));
 
-				if (ri->Instances.size() == 0)
+				// Sorting keeps the items of a batch next to each other, extend the batch over them.
+				size_t batchEnd = i + 1;
+				if (mAutoInstancing && ri->Instances.size() == 0 && layerInstPSOs[slot])
+				{
+					while (batchEnd < drawCount)
+					{
+						auto next = mDrawItems[mDrawList.Payload(batchEnd)];
+						if ((int)DrawKey::Pipeline(mDrawList.Key(batchEnd)) != slot || next->Instances.size() != 0 ||
+							next->SubMesh != ri->SubMesh || next->PrimitiveType != ri->PrimitiveType || next->Lod != ri->Lod)
+							break;
+						++batchEnd;
+					}
+				}
+				UINT batchCount = (UINT)(batchEnd - i);
+				if (batchCount > 1 && mAutoInstanceCount + batchCount > mAutoInstanceCapacity)
+				{
+					// Out of room this frame, draw the rest one by one.
+					batchEnd = i + 1;
+					batchCount = 1;
+				}
+
+				PassDraw draw;
+				draw.PSO = batchCount > 1 ? layerInstPSOs[slot] : layerPSOs[slot];
+				draw.Geo = ri->Geo;
+				draw.Topology = ri->PrimitiveType;
+				draw.IndexCount = ri->IndexCount;
+				draw.StartIndexLocation = ri->StartIndexLocation;
+				draw.BaseVertexLocation = ri->BaseVertexLocation;
+				if (ri->Instances.size() == 0 && ri->Lod > 0)
+				{
+					GetLodRange(*ri->SubMesh, ri->Lod, &draw.IndexCount, &draw.StartIndexLocation);
+					++mStats.LodDraws;
+					mStats.LodTrianglesSaved += (UINT64)(ri->IndexCount - draw.IndexCount) / 3 * batchCount;
+				}
+				if (batchCount > 1)
+				{
+					// Automatic instancing, write the worlds of the batch as instances.
+					mBatchInstanceData.resize(batchCount);
+					for (UINT j = 0; j < batchCount; ++j)
+					{
+						auto item = mDrawItems[mDrawList.Payload(i + j)];
+						mBatchInstanceData[j].World = item->World;
+						mBatchInstanceData[j].MaterialIndex = item->Mat->MatCBIndex;
+					}
+					UINT instStart = mAutoInstanceStart + mAutoInstanceCount;
+					currInstCB->CopyContinuousData(instStart, batchCount, mBatchInstanceData.data());
+					mStats.VisibleInstanceUploadBytes += batchCount * sizeof(InstanceData);
+					mAutoInstanceCount += batchCount;
+
+					draw.ObjectCB = objCBAddress;
+					draw.Instances = instBufferAddress + instStart * instElementSize;
+					draw.InstanceCount = batchCount;
+					++mStats.AutoInstancedDraws;
+					mStats.DrawCallsSaved += batchCount - 1;
+				}
+				else if (ri->Instances.size() == 0)
 				{
 					// No instancing.
-					cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress + ri->ObjCBIndex * objCBByteSize);
-					cmdList->SetGraphicsRootShaderResourceView(3, instBufferAddress);
-					cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+					draw.ObjectCB = objCBAddress + ri->ObjCBIndex * objCBByteSize;
+					draw.Instances = instBufferAddress;
+					draw.InstanceCount = 1;
+				}
+				else if (culled)
+				{
+					// Instancing, one draw per level of detail of the packed instances.
+					UINT instStart = (1 + (int)view) * mInstanceCapacity + ri->InstCBIndex;
+					draw.ObjectCB = objCBAddress;
+					for (int lod = 0; lod < MaxLodLevels; ++lod)
+					{
+						UINT count = ri->VisibleLodCounts[(int)view][lod];
+						if (count == 0)
+							continue;
+						draw.Instances = instBufferAddress + instStart * instElementSize;
+						draw.InstanceCount = count;
+						draw.IndexCount = ri->IndexCount;
+						draw.StartIndexLocation = ri->StartIndexLocation;
+						if (lod > 0)
+						{
+							GetLodRange(*ri->SubMesh, lod, &draw.IndexCount, &draw.StartIndexLocation);
+							++mStats.LodDraws;
+							mStats.LodTrianglesSaved += (UINT64)(ri->IndexCount - draw.IndexCount) / 3 * count;
+						}
+						mPassDraws.push_back(draw);
+						instStart += count;
+					}
+					i = batchEnd;
+					continue;
 				}
 				else
 				{
-					// Instancing.
-					cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
-					cmdList->SetGraphicsRootShaderResourceView(3, instBufferAddress + ri->InstCBIndex * instElementSize);
-					cmdList->DrawIndexedInstanced(ri->IndexCount, (UINT)ri->Instances.size(), ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+					// Instancing without culling, the instances are in their original order.
+					draw.ObjectCB = objCBAddress;
+					draw.Instances = instBufferAddress + ri->InstCBIndex * instElementSize;
+					draw.InstanceCount = (UINT)ri->Instances.size();
 				}
+				mPassDraws.push_back(draw);
+				i = batchEnd;
 			}
+			RecordPass& recordPass = mRecordPasses.back();
+			recordPass.DrawCount = (UINT)(mPassDraws.size() - recordPass.FirstDraw);
 		}
 
-		void RenderResources::DrawSceneToShadowMap()
+		void RenderResources::BindRootState(ID3D12GraphicsCommandList* cmdList)
 		{
-			auto commandList = mDeviceResources->GetCommandList();
+			cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+			// Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
+			// set as a root descriptor.
+			auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
+			cmdList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+			auto instBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+			cmdList->SetGraphicsRootShaderResourceView(3, instBuffer->GetGPUVirtualAddress());
+			cmdList->SetGraphicsRootDescriptorTable(4, mNullSrv);
+		}
 
-			// Bind the pass constant buffer for the shadow map pass.
-			UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
-			auto passCB = mCurrFrameResource->PassCB->Resource();
-			D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + 1 * passCBByteSize;
-			commandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
-
-			commandList->RSSetViewports(1, &mShadowMap->Viewport());
-			commandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
-			// Change to DEPTH_WRITE.
-			commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-				D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
-			// Clear the back buffer and depth buffer.
-			commandList->ClearDepthStencilView(mShadowMap->Dsv(),
-				D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-			// Specify the buffers we are going to render to.
-			commandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
-
-			if (mRitemLayer[(int)RenderLayer::Opaque].size() != 0)
-			{
-				commandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
-				DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::Opaque]);
-			}
-			if (mRitemLayer[(int)RenderLayer::OpaqueInst].size() != 0)
+		void RenderResources::RecordJobCommands(uint32_t jobIndex)
+		{
+			RecordJob& job = mRecordJobs[jobIndex];
+			auto cmdList = job.CommandList.Get();
+			auto cmdListAlloc = mCurrFrameResource->RecordCmdListAllocs[jobIndex].Get();
+			ThrowIfFailed(cmdListAlloc->Reset());
+			ThrowIfFailed(cmdList->Reset(cmdListAlloc, nullptr));
+			job.DrawCalls = 0;
+			job.PipelineBinds = 0;
+			job.GeometryBinds = 0;
+			job.SkippedGeometryBinds = 0;
+
+			ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+			cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+			const JobSegment* segments = mRecordPartition.GetSegments(jobIndex);
+			for (uint32_t s = 0; s < mRecordPartition.GetSegmentCount(jobIndex); ++s)
 			{
-				commandList->SetPipelineState(mPSOs["shadowInst_opaque"].Get());
-				DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::OpaqueInst]);
-			}
+				const JobSegment& segment = segments[s];
+				const RecordPass& pass = mRecordPasses[segment.Group];
+				bool first = segment.First == 0;
+				if (first && pass.BarrierCount > 0)
+					cmdList->ResourceBarrier(pass.BarrierCount, &mGraphBarriers[pass.FirstBarrier]);
+				pass.Setup(cmdList, first);
+
+				// Every segment starts with unknown state, setup may have changed it.
+				ID3D12PipelineState* currPSO = nullptr;
+				MeshGeometry* currGeo = nullptr;
+				D3D12_PRIMITIVE_TOPOLOGY currTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+				const PassDraw* draws = &mPassDraws[pass.FirstDraw + segment.First];
+				for (UINT i = 0; i < segment.Count; ++i)
+				{
+					const PassDraw& draw = draws[i];
+					if (draw.PSO != currPSO)
+					{
+						cmdList->SetPipelineState(draw.PSO);
+						currPSO = draw.PSO;
+						++job.PipelineBinds;
+					}
+					if (draw.Geo != currGeo)
+					{
+						cmdList->IASetVertexBuffers(0, 1, &draw.Geo->VertexBufferView());
+						cmdList->IASetIndexBuffer(&draw.Geo->IndexBufferView());
+						currGeo = draw.Geo;
+						++job.GeometryBinds;
+					}
+					else
+						++job.SkippedGeometryBinds;
+					if (draw.Topology != currTopology)
+					{
+						cmdList->IASetPrimitiveTopology(draw.Topology);
+						currTopology = draw.Topology;
+					}
 
-			// Change back to GENERIC_READ so we can read the texture in a shader.
-			commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-				D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
+					cmdList->SetGraphicsRootConstantBufferView(0, draw.ObjectCB);
+					cmdList->SetGraphicsRootShaderResourceView(3, draw.Instances);
+					cmdList->DrawIndexedInstanced(draw.IndexCount, draw.InstanceCount, draw.StartIndexLocation, draw.BaseVertexLocation, 0);
+					++job.DrawCalls;
+				}
+			}
+			ThrowIfFailed(cmdList->Close());
 		}
 
-		void RenderResources::DrawNormalsAndDepth()
+		void RenderResources::BuildRenderGraph()
 		{
-			auto commandList = mDeviceResources->GetCommandList();
+			bool msaa = mDeviceResources->GetMsaaQuality() > 0;
+			// Only the opaque layers sample the shadow and ambient maps, wireframes are drawn without them.
+			bool lit = !mDepthOnlyMode && (!mRitemLayer[(int)RenderLayer::Opaque].empty() ||
+				!mRitemLayer[(int)RenderLayer::OpaqueInst].empty());
+			// Without MSAA the opaque layers test for equal depth against the normal/depth pass.
+			bool loadDepth = lit && !msaa;
+
+			RenderGraph& graph = mRenderGraph;
+			graph.Reset();
+			uint32_t shadowMap = graph.ImportResource("shadowMap", GraphResourceState::ShaderRead);
+			uint32_t normalMap = graph.ImportResource("normalMap", GraphResourceState::ShaderRead);
+			// The single sample depth buffer can be read back after any frame.
+			uint32_t depth = graph.ImportResource("depth", GraphResourceState::DepthWrite, true);
+			// The transitions of the swap chain and MSAA targets stay with the device resources.
+			uint32_t target = graph.ImportResource("renderTarget", GraphResourceState::RenderTarget, true);
+
+			uint32_t shadowPass = graph.AddPass("shadow", [this] { DrawSceneToShadowMap(); });
+			graph.Write(shadowPass, shadowMap, GraphResourceState::DepthWrite, true);
+
+			uint32_t normalPass = graph.AddPass("normalDepth", [this] { DrawNormalsAndDepth(); });
+			graph.Write(normalPass, normalMap, GraphResourceState::RenderTarget, true);
+			graph.Write(normalPass, depth, GraphResourceState::DepthWrite, true);
+
+			// Every ssao step writes a new transient, aliasing folds them into the ping-pong between the
+			// two ambient maps of Ssao.
+			TransientDesc ambientDesc;
+			ambientDesc.Width = mSsao->SsaoMapWidth();
+			ambientDesc.Height = mSsao->SsaoMapHeight();
+			ambientDesc.Format = (uint32_t)Ssao::AmbientMapFormat;
+			ambientDesc.State = GraphResourceState::ShaderRead;
+			std::vector<uint32_t> ambientMaps;
+			ambientMaps.push_back(graph.CreateTransient("ambientMap", ambientDesc));
+			uint32_t ssaoPass = graph.AddPass("ssao", [this, ambient = ambientMaps.back()]
+			{
+				BeginRecordPass([this, ambient](ID3D12GraphicsCommandList* cmdList, bool)
+				{
+					cmdList->SetGraphicsRootSignature(mSsaoRootSignature.Get());
+					mSsao->ComputeAmbient(cmdList, mCurrFrameResource, mGraphAmbientMaps[ambient]);
+				});
+			});
+			graph.Read(ssaoPass, normalMap, GraphResourceState::ShaderRead);
+			graph.Read(ssaoPass, depth, GraphResourceState::DepthRead);
+			graph.Write(ssaoPass, ambientMaps.back(), GraphResourceState::RenderTarget, true);
+			for (int i = 0; i < 2 * mSsaoBlurCount; ++i)
+			{
+				bool horzBlur = i % 2 == 0;
+				uint32_t source = ambientMaps.back();
+				uint32_t blurred = graph.CreateTransient("ambientMap", ambientDesc);
+				ambientMaps.push_back(blurred);
+				uint32_t blurPass = graph.AddPass(horzBlur ? "ssaoBlurH" : "ssaoBlurV", [this, horzBlur, source, blurred]
+				{
+					BeginRecordPass([this, horzBlur, source, blurred](ID3D12GraphicsCommandList* cmdList, bool)
+					{
+						cmdList->SetGraphicsRootSignature(mSsaoRootSignature.Get());
+						mSsao->BlurAmbientMap(cmdList, mCurrFrameResource, horzBlur,
+							mGraphAmbientMaps[source], mGraphAmbientMaps[blurred]);
+					});
+				});
+				graph.Read(blurPass, normalMap, GraphResourceState::ShaderRead);
+				graph.Read(blurPass, depth, GraphResourceState::DepthRead);
+				graph.Read(blurPass, source, GraphResourceState::ShaderRead);
+				graph.Write(blurPass, blurred, GraphResourceState::RenderTarget, true);
+			}
+
+			// The MSAA depth buffer cannot be read back, so MSAA depth only frames also draw the single
+			// sample depth buffer. Without MSAA the main pass writes to it.
+			if (mDepthOnlyMode && msaa)
+			{
+				uint32_t prepass = graph.AddPass("depthPrepass", [this]
+				{
+					BeginRecordPass([this](ID3D12GraphicsCommandList* cmdList, bool first)
+					{
+						BindRootState(cmdList);
+						auto passCB = mCurrFrameResource->PassCB->Resource();
+						cmdList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+						cmdList->RSSetViewports(1, &mDeviceResources->GetScreenViewport());
+						cmdList->RSSetScissorRects(1, &mDeviceResources->GetScissorRect());
+						if (first)
+							cmdList->ClearDepthStencilView(mDeviceResources->Dsv(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+						cmdList->OMSetRenderTargets(0, nullptr, false, &mDeviceResources->Dsv());
+					});
+					const LayerPass layers[] = {
+						{ RenderLayer::Opaque, "depthPrepass", "depthPrepassInst" },
+						{ RenderLayer::OpaqueInst, "depthPrepassInst", nullptr } };
+					AddPassDraws(layers, _countof(layers), CullView::Camera, mMainPassCB);
+				});
+				graph.Write(prepass, depth, GraphResourceState::DepthWrite, true);
+			}
 
-			// Bind the constant buffer for this pass.
-			auto passCB = mCurrFrameResource->PassCB->Resource();
-			commandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+			uint32_t mainPass = graph.AddPass("main", [this, lit, loadDepth] { DrawMainPass(lit, !loadDepth); });
+			graph.Write(mainPass, target, GraphResourceState::RenderTarget, true);
+			if (!msaa)
+			{
+				if (loadDepth)
+					graph.Read(mainPass, depth, GraphResourceState::DepthWrite);
+				graph.Write(mainPass, depth, GraphResourceState::DepthWrite, !loadDepth);
+			}
+			if (lit)
+			{
+				graph.Read(mainPass, shadowMap, GraphResourceState::ShaderRead);
+				graph.Read(mainPass, ambientMaps.back(), GraphResourceState::ShaderRead);
+			}
 
-			auto normalMap = mSsao->NormalMap();
-			auto normalMapRtv = mSsao->NormalMapRtv();
+			CHECK(graph.Compile());
+			mStats.GraphPasses = graph.GetActivePassCount();
+			mStats.CulledGraphPasses = graph.GetCulledPassCount();
+
+			mGraphResources.assign(graph.GetPhysicalResourceCount(), nullptr);
+			mGraphResources[graph.GetPhysicalResource(shadowMap)] = mShadowMap->Resource();
+			mGraphResources[graph.GetPhysicalResource(normalMap)] = mSsao->NormalMap();
+			mGraphResources[graph.GetPhysicalResource(depth)] = mDeviceResources->DepthStencilBuffer();
+			mGraphResources[graph.GetPhysicalResource(target)] = msaa ?
+				mDeviceResources->CurrentOffScreenBuffer() : mDeviceResources->CurrentBackBuffer();
+
+			// Hand out the ambient maps in the order the physical resources come alive. The chain ends on
+			// the first one, which is the map the main pass samples.
+			mGraphAmbientMaps.assign(ambientMaps.back() + 1, -1);
+			std::vector<int> physicalMaps(graph.GetPhysicalResourceCount(), -1);
+			int mapCount = 0;
+			for (uint32_t ambient : ambientMaps)
+			{
+				uint32_t physical = graph.GetPhysicalResource(ambient);
+				if (physical == RenderGraph::Invalid)
+					continue;
+				if (physicalMaps[physical] < 0)
+				{
+					CHECK(mapCount < Ssao::AmbientMapCount);
+					physicalMaps[physical] = mapCount++;
+					mGraphResources[physical] = mSsao->AmbientMap(physicalMaps[physical]);
+				}
+				mGraphAmbientMaps[ambient] = physicalMaps[physical];
+			}
+			CHECK(!lit || mGraphAmbientMaps[ambientMaps.back()] == 0);
+		}
 
-			commandList->RSSetViewports(1, &mDeviceResources->GetScreenViewport());
-			commandList->RSSetScissorRects(1, &mDeviceResources->GetScissorRect());
-			// Change to RENDER_TARGET.
-			commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap,
-				D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
+		void RenderResources::DrawMainPass(bool lit, bool clearDepth)
+		{
+			BeginRecordPass([this, lit, clearDepth](ID3D12GraphicsCommandList* cmdList, bool first)
+			{
+				BindRootState(cmdList);
+				auto passCB = mCurrFrameResource->PassCB->Resource();
+				cmdList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+				// Unlit passes keep the null SRV, the shadow and ambient maps may not have been drawn this frame.
+				if (lit)
+				{
+					CD3DX12_GPU_DESCRIPTOR_HANDLE shadowMapDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+					shadowMapDescriptor.Offset(mShadowMapHeapIndex, mDeviceResources->GetCbvSrvUavSize());
+					cmdList->SetGraphicsRootDescriptorTable(4, shadowMapDescriptor);
+				}
 
-			// Clear the screen normal map and depth buffer.
-			float clearValue[] = { 0.0f, 0.0f, 1.0f, 0.0f };
-			commandList->ClearRenderTargetView(normalMapRtv, clearValue, 0, nullptr);
-			commandList->ClearDepthStencilView(mDeviceResources->Dsv(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-			// Specify the buffers we are going to render to.
-			commandList->OMSetRenderTargets(1, &normalMapRtv, true, &mDeviceResources->Dsv());
+				// Only the job starting the pass transitions and clears the render target.
+				if (first)
+					mDeviceResources->PreparePresent(clearDepth, cmdList);
+				else
+					mDeviceResources->BindRenderTargets(cmdList);
+			});
 
-			if (mRitemLayer[(int)RenderLayer::Opaque].size() != 0)
+			if(mDepthOnlyMode)
 			{
-				commandList->SetPipelineState(mPSOs["drawNormals"].Get());
-				DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::Opaque]);
+				const LayerPass layers[] = {
+					{ RenderLayer::Opaque, "depth_opaque", "depthInst_opaque" },
+					{ RenderLayer::OpaqueInst, "depthInst_opaque", nullptr } };
+				AddPassDraws(layers, _countof(layers), CullView::Camera, mMainPassCB);
 			}
-			if (mRitemLayer[(int)RenderLayer::OpaqueInst].size() != 0)
+			else
+			{
+				const LayerPass layers[] = {
+					{ RenderLayer::Opaque, "opaque", "opaqueInst" },
+					{ RenderLayer::OpaqueInst, "opaqueInst", nullptr },
+					{ RenderLayer::WireFrame, "opaque_wireframe", "opaqueInst_wireframe" },
+					{ RenderLayer::WireFrameInst, "opaqueInst_wireframe", nullptr } };
+				AddPassDraws(layers, _countof(layers), CullView::Camera, mMainPassCB);
+				// Debug geometry is given in clip space and never culled.
+				const LayerPass debugLayers[] = { { RenderLayer::Debug, "debug", nullptr } };
+				AddPassDraws(debugLayers, _countof(debugLayers), CullView::None, mMainPassCB);
+			}
+		}
+
+		void RenderResources::DrawSceneToShadowMap()
+		{
+			UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+
+			// Every cascade is a record pass of its own that renders to its tile of the shadow map.
+			for (int i = 0; i < mCascadeCount; ++i)
 			{
-				commandList->SetPipelineState(mPSOs["drawNormalsInst"].Get());
-				DrawRenderItems(commandList, mRitemLayer[(int)RenderLayer::OpaqueInst]);
+				BeginRecordPass([this, i, passCBByteSize](ID3D12GraphicsCommandList* cmdList, bool first)
+				{
+					BindRootState(cmdList);
+					// Clear all cascade tiles at once.
+					if (first && i == 0)
+					{
+						cmdList->ClearDepthStencilView(mShadowMap->Dsv(),
+							D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+					}
+					// Specify the buffers we are going to render to.
+					cmdList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+
+					// Bind the pass constant buffer of the cascade and render to its tile.
+					auto passCB = mCurrFrameResource->PassCB->Resource();
+					D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + (1 + i) * passCBByteSize;
+					cmdList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+					D3D12_VIEWPORT viewport = mShadowMap->TileViewport(i);
+					D3D12_RECT scissorRect = mShadowMap->TileScissorRect(i);
+					cmdList->RSSetViewports(1, &viewport);
+					cmdList->RSSetScissorRects(1, &scissorRect);
+				});
+
+				const LayerPass layers[] = {
+					{ RenderLayer::Opaque, "shadow_opaque", "shadowInst_opaque" },
+					{ RenderLayer::OpaqueInst, "shadowInst_opaque", nullptr } };
+				AddPassDraws(layers, _countof(layers), (CullView)((int)CullView::Shadow + i), mShadowPassCB[i]);
 			}
+		}
 
-			// Change back to GENERIC_READ so we can read the texture in a shader.
-			commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap,
-				D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
+		void RenderResources::DrawNormalsAndDepth()
+		{
+			BeginRecordPass([this](ID3D12GraphicsCommandList* cmdList, bool first)
+			{
+				BindRootState(cmdList);
+				// Bind the constant buffer for this pass.
+				auto passCB = mCurrFrameResource->PassCB->Resource();
+				cmdList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+
+				auto normalMapRtv = mSsao->NormalMapRtv();
+
+				cmdList->RSSetViewports(1, &mDeviceResources->GetScreenViewport());
+				cmdList->RSSetScissorRects(1, &mDeviceResources->GetScissorRect());
+				// Clear the screen normal map and depth buffer.
+				if (first)
+				{
+					float clearValue[] = { 0.0f, 0.0f, 1.0f, 0.0f };
+					cmdList->ClearRenderTargetView(normalMapRtv, clearValue, 0, nullptr);
+					cmdList->ClearDepthStencilView(mDeviceResources->Dsv(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+				}
+				// Specify the buffers we are going to render to.
+				cmdList->OMSetRenderTargets(1, &normalMapRtv, true, &mDeviceResources->Dsv());
+			});
+
+			const LayerPass layers[] = {
+				{ RenderLayer::Opaque, "drawNormals", "drawNormalsInst" },
+				{ RenderLayer::OpaqueInst, "drawNormalsInst", nullptr } };
+			AddPassDraws(layers, _countof(layers), CullView::Camera, mMainPassCB);
 		}
 
 		CD3DX12_CPU_DESCRIPTOR_HANDLE RenderResources::GetCpuSrv(int index) const
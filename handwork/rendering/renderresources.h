@@ -3,26 +3,67 @@
 #pragma once
 
 #include "d3dutil.h"
+#include "scenetables.h"
 #include "frameresource.h"
 #include "ssao.h"
 #include "shadowmap.h"
 #include "deviceresources.h"
 #include "camera.h"
 #include "gametimer.h"
+#include "../utility/drawlist.h"
+#include "../utility/slotallocator.h"
+#include "../utility/rendergraph.h"
+#include "../utility/jobpartition.h"
 
 namespace handwork
 {
 	namespace rendering
 	{
-		// Divide render items by pixel shader.
-		enum class RenderLayer : int
+		// A layer drawn in a pass and the pipeline state used for it. InstPSO is the instanced variant
+		// used to batch non-instanced items, or nullptr to draw them one by one.
+		struct LayerPass
 		{
-			Opaque = 0,
-			WireFrame,
-			OpaqueInst,
-			WireFrameInst,
-			Debug,
-			Count
+			RenderLayer Layer;
+			const char* PSO;
+			const char* InstPSO;
+		};
+
+		// Draw submission counters, reset at the start of each frame.
+		struct RenderStats
+		{
+			UINT DrawCalls = 0;
+			UINT PipelineBinds = 0;
+			UINT GeometryBinds = 0;
+			// Geometry binds avoided by drawing sorted lists.
+			UINT SkippedGeometryBinds = 0;
+			// Instanced draws built from non-instanced items and the draw calls they replaced.
+			UINT AutoInstancedDraws = 0;
+			UINT DrawCallsSaved = 0;
+			// Bytes written to the upload buffers. Constants cover the object, material, pass and ssao
+			// buffers. Instances are the dirty ranges of the items, visible instances the per view
+			// packing and automatic instancing batches.
+			UINT64 ConstantUploadBytes = 0;
+			UINT64 InstanceUploadBytes = 0;
+			UINT64 VisibleInstanceUploadBytes = 0;
+			// CPU milliseconds spent in the stages of the frame. Wait covers blocking on the frame resource
+			// fence, items and materials the buffer fills, pass the shadow and pass constants, cull the
+			// view culling and instance packing, record resolving the draws and the parallel command list
+			// recording of Render.
+			float WaitMs = 0.0f;
+			float ItemUpdateMs = 0.0f;
+			float MaterialUpdateMs = 0.0f;
+			float PassUpdateMs = 0.0f;
+			float CullMs = 0.0f;
+			float RecordMs = 0.0f;
+			// Render graph passes recorded and culled, and the transitions derived for them.
+			UINT GraphPasses = 0;
+			UINT CulledGraphPasses = 0;
+			UINT GraphBarriers = 0;
+			// Command lists the passes were recorded into in parallel.
+			UINT RecordJobs = 0;
+			// Draws of coarser levels of detail and the triangles they left out.
+			UINT LodDraws = 0;
+			UINT64 LodTrianglesSaved = 0;
 		};
 
 		// The main render class for GPU draw logic. It support both continuous mode and discrete model.
@@ -33,7 +74,7 @@ namespace handwork
 		{
 		public:
 			RenderResources(const std::shared_ptr<DeviceResources>& deviceResource, const std::shared_ptr<Camera> camera,
-				const std::shared_ptr<GameTimer> timer, bool continousMode = true, bool depthOnlyMode = false);
+				const std::shared_ptr<GameTimer> timer, bool continousMode = true, bool depthOnlyMode = false, int shadowCascades = 3);
 			void CreateDeviceDependentResources();
 			void CreateWindowSizeDependentResources();
 			void ReleaseDeviceDependentResources();
@@ -41,15 +82,50 @@ namespace handwork
 			void FinishAddData();
 			void Update();
 			void Render();
+			// Discrete mode only. Render the scene from every camera and read the render targets back into
+			// images. Rendering of a view overlaps the read back of the previous one, views cycle through
+			// the frame resources and the read back queue of the device. The shared camera is restored.
+			ViewBatchStats RenderViews(const std::vector<Camera>& cameras, std::vector<RetrieveImageData>& images);
+			// View space depth of the last frame from the near and far planes of the camera. The depth of
+			// MSAA frames is the one of the pixel centers.
+			void RetrieveLinearDepthBuffer(std::vector<float>& depth);
 			void SetLights(Light* lights);
 
-			void AddMaterial(const Material& mat);
-			void AddGeometryData(const std::vector<Vertex>& vertices, const std::vector<std::uint32_t>& indices,
+			// Adding a material under an existing name updates that material and returns its handle.
+			MaterialHandle AddMaterial(const Material& mat);
+			GeometryHandle AddGeometryData(const std::vector<Vertex>& vertices, const std::vector<std::uint32_t>& indices,
 				const std::unordered_map<std::string, SubmeshGeometry>& drawArgs, const std::string& name);
-			void AddRenderItem(const std::vector<RenderItemData>& renderItems, const RenderLayer layer);
-			Material* GetMaterial(const std::string& name);
-			MeshGeometry* GetMeshGeometry(const std::string& name);
-			RenderItem* GetRenderItem(const std::string& name, const RenderLayer layer);
+			// Return one handle per item, invalid for items whose geometry, draw arg or material is unknown.
+			std::vector<RenderItemHandle> AddRenderItem(const std::vector<RenderItemData>& renderItems, const RenderLayer layer);
+			// Items can be added, removed and updated between frames. Buffer slots of removed items are
+			// reused, the frame resources grow when the items outgrow them. These return false for
+			// stale handles and for updates that do not match the kind of item.
+			bool RemoveRenderItem(RenderItemHandle handle);
+			bool UpdateRenderItemWorld(RenderItemHandle handle, const Matrix4x4& world);
+			// Replace the instances of an instanced item, the instance count may change. Only instances
+			// that differ from the current ones are uploaded again.
+			bool UpdateInstances(RenderItemHandle handle, const std::vector<Instance>& instances);
+			// Overwrite the instances starting at first, the range must lie within the item.
+			bool UpdateInstanceRange(RenderItemHandle handle, UINT first, const std::vector<Instance>& instances);
+			// Lookups return nullptr for invalid or stale handles.
+			Material* GetMaterial(MaterialHandle handle) const;
+			MeshGeometry* GetMeshGeometry(GeometryHandle handle) const;
+			RenderItem* GetRenderItem(RenderItemHandle handle) const;
+			// Name lookups for convenience, they return an invalid handle for unknown names.
+			MaterialHandle FindMaterial(const std::string& name) const;
+			GeometryHandle FindMeshGeometry(const std::string& name) const;
+			RenderItemHandle FindRenderItem(const std::string& name) const;
+			// Find the render item whose bounds are hit first by the ray through a pixel of the render
+			// target. instance receives the instance index, or -1 for non-instanced items.
+			RenderItem* Pick(int x, int y, int* instance = nullptr) const;
+			// Append the items and instances with bounds overlapping the query box.
+			void QueryRenderItems(const Bounds3f& bounds, std::vector<std::pair<RenderItem*, int>>& result) const;
+			// Counters of the last rendered frame.
+			const RenderStats& GetRenderStats() const { return mStats; }
+			// Merge visible non-instanced items sharing a submesh into instanced draws, on by default.
+			void SetAutoInstancing(bool enable) { mAutoInstancing = enable; }
+			// Error in pixels the levels of detail of submeshes may show, 0 draws the full submeshes.
+			void SetLodPixelError(float pixels) { mLodPixelError = pixels; }
 
 		private:
 			void BuildRootSignature();
@@ -58,9 +134,40 @@ namespace handwork
 			void BuildShadersAndInputLayout();
 			void BuildPSOs();
 			void BuildFrameResources();
-			void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+			// Rebuild the frame resources with room for all slots in use, capacities at least double.
+			void GrowFrameResources();
+			UINT AllocateInstanceRange(UINT count);
+			// Pack the instance ranges of all items to the front of the instance buffer.
+			void CompactInstanceRanges();
+			// Queue instances [begin, end) of an item for upload to every frame resource.
+			void MarkInstancesDirty(RenderItem* item, UINT begin, UINT end);
+			void BuildSceneBVH();
+			// Take the primitives of an item out of the scene BVH until the next rebuild.
+			void DetachFromSceneBVH(RenderItem* item);
+			// Refresh the item bounds and its scene BVH primitive bounds. Return true when primitive bounds
+			// were written and the BVH needs a refit. Items touch disjoint primitives, so different items
+			// can be updated in parallel.
+			bool UpdateRenderItemBounds(RenderItem* item);
+			// Select the levels of detail of the items and instances for the camera.
+			void SelectLods();
+			void CullRenderItems(CullView view, const Matrix4x4& viewProj);
+			// Start a record pass, it takes the graph transitions handed over since the last one.
+			void BeginRecordPass(std::function<void(ID3D12GraphicsCommandList*, bool)> setup);
+			// Sort the items of the layers that passed the culling of the view, or all of them for CullView::None,
+			// and append their draws to the current record pass. Depth buckets are taken from the pass.
+			void AddPassDraws(const LayerPass* layers, int layerCount, CullView view, const PassConstants& pass);
+			// Root signature and buffers of the scene passes, with the null SRV for the shadow and ambient maps.
+			void BindRootState(ID3D12GraphicsCommandList* cmdList);
+			// Record the segments of a job into its command list. State is only bound when it changes.
+			void RecordJobCommands(uint32_t job);
+			// Declare the passes of the frame and the resources they use, and compile the graph.
+			void BuildRenderGraph();
+			// The draw functions add the record passes of the graph passes, the jobs write their commands.
 			void DrawSceneToShadowMap();
 			void DrawNormalsAndDepth();
+			// Lit passes sample the shadow and ambient maps. Without clearDepth the pass keeps the depth of
+			// the normal/depth pass.
+			void DrawMainPass(bool lit, bool clearDepth);
 
 			CD3DX12_CPU_DESCRIPTOR_HANDLE GetCpuSrv(int index) const;
 			CD3DX12_GPU_DESCRIPTOR_HANDLE GetGpuSrv(int index) const;
@@ -80,9 +187,10 @@ namespace handwork
 			Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 			Microsoft::WRL::ComPtr<ID3D12RootSignature> mSsaoRootSignature = nullptr;
 
-			// Render resources.
-			std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-			std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
+			// Render resources, the name indices only serve the Find lookups.
+			HandlePool<MeshGeometry> mGeometries;
+			MaterialTable mMaterials;
+			NameTable<MeshGeometry> mGeometryNames;
 			std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>> mShaders;
 			std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D12PipelineState>> mPSOs;
 
@@ -90,7 +198,8 @@ namespace handwork
 			std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
 			// List of all the render items.
-			std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+			HandlePool<RenderItem> mAllRitems;
+			NameTable<RenderItem> mRenderItemNames;
 			// Render items divided by PSO.
 			std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
@@ -103,30 +212,134 @@ namespace handwork
 			CD3DX12_GPU_DESCRIPTOR_HANDLE mNullSrv;
 
 			PassConstants mMainPassCB;  // index 0 of pass cbuffer.
-			PassConstants mShadowPassCB;// index 1 of pass cbuffer.
+			PassConstants mShadowPassCB[MaxCascades];// index 1 + cascade of pass cbuffer.
 
 			// Shadow and ssao helpers.
 			std::unique_ptr<ShadowMap> mShadowMap;
 			std::unique_ptr<Ssao> mSsao;
+			int mSsaoBlurCount = 3;
+
+			// Passes of the current frame. The graph is declared again every frame, the D3D12 resources
+			// stand for its physical resources and the ambient map indices for its ambient map transients.
+			RenderGraph mRenderGraph;
+			std::vector<ID3D12Resource*> mGraphResources;
+			std::vector<int> mGraphAmbientMaps;
+			std::vector<D3D12_RESOURCE_BARRIER> mGraphBarriers;
 			DirectX::BoundingSphere mSceneSphereBounds;
 			DirectX::BoundingBox mSceneBoxBounds;
+			Bounds3f mSceneBounds;
+
+			// Hierarchy over all non-instanced items and instances outside the debug layer. Primitive i
+			// belongs to mScenePrimItems[i] and instance mScenePrimInstances[i], or -1 if not instanced.
+			BVH mSceneBVH;
+			std::vector<Bounds3f> mScenePrimBounds;
+			std::vector<RenderItem*> mScenePrimItems;
+			std::vector<int> mScenePrimInstances;
+			bool mSceneBVHDirty = false;
+			// Items were added or removed, or changed their instance count since the last build.
+			bool mSceneBVHRebuild = false;
+
+			// Sorted draws of the current pass, payloads index mDrawItems.
+			DrawList mDrawList;
+			std::vector<RenderItem*> mDrawItems;
+			RenderStats mStats;
+
+			// A draw call resolved on the render thread, the recording jobs only write it.
+			struct PassDraw
+			{
+				ID3D12PipelineState* PSO;
+				MeshGeometry* Geo;
+				D3D12_PRIMITIVE_TOPOLOGY Topology;
+				D3D12_GPU_VIRTUAL_ADDRESS ObjectCB;
+				D3D12_GPU_VIRTUAL_ADDRESS Instances;
+				UINT IndexCount;
+				UINT InstanceCount;
+				UINT StartIndexLocation;
+				INT BaseVertexLocation;
+			};
+
+			// A pass as the recording jobs see it. Setup binds the state and targets of the pass on a
+			// command list, first is set for the job that starts the pass and clears its targets. The
+			// draws are a range of mPassDraws, the transitions before the pass a range of mGraphBarriers.
+			struct RecordPass
+			{
+				std::function<void(ID3D12GraphicsCommandList*, bool)> Setup;
+				size_t FirstDraw = 0;
+				UINT DrawCount = 0;
+				size_t FirstBarrier = 0;
+				UINT BarrierCount = 0;
+			};
 
-			// Light for shadow map.
-			float mLightNearZ = 0.0f;
-			float mLightFarZ = 0.0f;
+			// Command list of a recording job and the counters of its last recording.
+			struct RecordJob
+			{
+				Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList;
+				UINT DrawCalls = 0;
+				UINT PipelineBinds = 0;
+				UINT GeometryBinds = 0;
+				UINT SkippedGeometryBinds = 0;
+			};
+
+			// Parallel recording. The record passes of a frame are cut into jobs of similar draw counts,
+			// each job records into its own command list with the allocator of the frame resource, and
+			// the lists are submitted in the order of the passes. Transitions not taken by a pass yet wait
+			// in the pending range of mGraphBarriers.
+			std::vector<RecordPass> mRecordPasses;
+			std::vector<PassDraw> mPassDraws;
+			std::vector<RecordJob> mRecordJobs;
+			std::vector<ID3D12CommandList*> mRecordLists;
+			JobPartition mRecordPartition;
+			size_t mPendingFirstBarrier = 0;
+			UINT mPendingBarrierCount = 0;
+
+			// Automatic instancing. The batches of a frame are written one after another behind the culled
+			// instance regions, mAutoInstanceCount of the mAutoInstanceCapacity elements are used so far.
+			bool mAutoInstancing = true;
+			float mLodPixelError = 1.0f;
+			float mLodScale = 0.0f;
+			std::map<std::pair<const SubmeshGeometry*, D3D12_PRIMITIVE_TOPOLOGY>, UINT> mBatchIndices;
+			std::vector<InstanceData> mBatchInstanceData;
+			UINT mAutoInstanceStart = 0;
+			UINT mAutoInstanceCapacity = 0;
+			UINT mAutoInstanceCount = 0;
+
+			// Scratch space for resolving instance updates.
+			std::vector<InstanceData> mResolvedInstances;
+
+			// Scratch space for culling and packing the visible instance data before upload.
+			std::vector<int> mVisiblePrims;
+			std::vector<InstanceData> mVisibleInstanceData;
+
+			// Light for shadow map, the shadow transform is the one of the first cascade.
 			Vector3f mLightPosW;
 			Matrix4x4 mLightView;
-			Matrix4x4 mLightProj;
 			Matrix4x4 mShadowTransform;
 
+			// Shadow cascades, each one renders to its own tile of the shadow map. The split lambda
+			// blends uniform (0) and logarithmic (1) cascade distances.
+			int mCascadeCount = 3;
+			float mCascadeSplitLambda = 0.75f;
+			UINT mShadowTileSize = 1024;
+
 			// Current light
 			Light mDirectLights[3];
 			Vector4f mAmbientLight;
 
-			// Manage new material and geometry.
-			int mCurrentMatCBIndex;
-			int mCurrentObjCBIndex;
-			int mCurrentInstCBIndex;
+			// Manage new geometry.
+			UINT mCurrentGeoIndex;
+
+			// Object constant buffer slots and instance buffer ranges of the render items. The frame
+			// resources hold the capacities below, which grow when the allocators outgrow them.
+			SlotAllocator mObjectSlots;
+			RangeAllocator mInstanceRanges;
+			UINT mObjectCapacity = 0;
+			UINT mInstanceCapacity = 0;
+			UINT mMaterialCapacity = 0;
+
+			// While batching views the discrete Render records the read back of the view into mViewReadBack
+			// instead of flushing the queue.
+			bool mBatchViews = false;
+			ReadBackTicket mViewReadBack;
 
 			// Mode control.
 			bool mContinousMode;
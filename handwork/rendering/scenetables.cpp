@@ -0,0 +1,90 @@
+#include "scenetables.h"
+#include "meshlod.h"
+#include "../utility/stringprint.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		MaterialHandle MaterialTable::Add(const Material& mat, int dirtyFrames)
+		{
+			MaterialHandle found = mat.Name.empty() ? MaterialHandle() : mNames.Find(mat.Name);
+			if (Material* existing = mMaterials.Get(found))
+			{
+				existing->Albedo = mat.Albedo;
+				existing->Roughness = mat.Roughness;
+				existing->Metalness = mat.Metalness;
+				existing->NumFramesDirty = dirtyFrames;
+				return found;
+			}
+
+			auto matPtr = std::make_unique<Material>();
+			matPtr->Name = mat.Name;
+			matPtr->Albedo = mat.Albedo;
+			matPtr->Roughness = mat.Roughness;
+			matPtr->Metalness = mat.Metalness;
+			matPtr->MatCBIndex = (int)Count();
+			matPtr->NumFramesDirty = dirtyFrames;
+			MaterialHandle handle = mMaterials.Add(std::move(matPtr));
+			mNames.Add(mat.Name, handle);
+			return handle;
+		}
+
+		void MaterialTable::Clear()
+		{
+			mMaterials.Clear();
+			mNames.Clear();
+		}
+
+		int MaterialTable::ResolveInstances(const std::vector<Instance>& instances, std::vector<InstanceData>& data,
+			const std::string& itemName) const
+		{
+			int unknownMats = 0;
+			data.resize(instances.size());
+			for (size_t i = 0; i < instances.size(); ++i)
+			{
+				Material* mat = mMaterials.Get(instances[i].Mat);
+				data[i].World = instances[i].World;
+				data[i].MaterialIndex = mat ? mat->MatCBIndex : 0;
+				if (!mat)
+					++unknownMats;
+			}
+			if (unknownMats > 0)
+				LOG(ERROR) << StringPrintf("Render item \"%s\" has %d instances with unknown materials, using the first material.",
+					itemName.c_str(), unknownMats);
+			return unknownMats;
+		}
+
+		void ComputeSubmeshBounds(const std::vector<Vertex>& vertices, std::unordered_map<std::string, SubmeshGeometry>& drawArgs)
+		{
+			for (auto& e : drawArgs)
+			{
+				Bounds3f bounds;
+				for (UINT i = 0; i < e.second.VertexCount; ++i)
+					bounds = Union(bounds, vertices[e.second.BaseVertexLocation + i].Pos);
+				e.second.Bounds = bounds;
+				e.second.Sphere = ComputeSphereBounds(vertices.data() + e.second.BaseVertexLocation, e.second.VertexCount);
+			}
+		}
+
+		SubmeshGeometry* ResolveRenderItem(const RenderItemData& data, std::unordered_map<std::string, SubmeshGeometry>* drawArgs,
+			const MaterialTable& materials, Material** mat)
+		{
+			auto drawArg = drawArgs ? drawArgs->find(data.DrawArgName) : std::unordered_map<std::string, SubmeshGeometry>::iterator();
+			if (!drawArgs || drawArg == drawArgs->end())
+			{
+				LOG(ERROR) << StringPrintf("Render item \"%s\" refers to an unknown geometry or draw arg \"%s\".",
+					data.Name.c_str(), data.DrawArgName.c_str());
+				return nullptr;
+			}
+			*mat = data.Instances.size() == 0 ? materials.Get(data.Mat) : nullptr;
+			if (data.Instances.size() == 0 && !*mat)
+			{
+				LOG(ERROR) << StringPrintf("Render item \"%s\" refers to an unknown material.", data.Name.c_str());
+				return nullptr;
+			}
+			return &drawArg->second;
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
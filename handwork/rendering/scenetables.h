@@ -0,0 +1,81 @@
+// Scene bookkeeping shared by the D3D12 and the headless renderer: names, materials and the checks of
+// added render items.
+
+#pragma once
+
+#include "scenetypes.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Names of the objects a renderer owns. An object added under an existing name takes over the
+		// name, objects without a name are not listed.
+		template <typename T>
+		class NameTable
+		{
+		public:
+			void Add(const std::string& name, Handle<T> handle)
+			{
+				if (!name.empty())
+					mNames[name] = handle;
+			}
+
+			// Forget the name only if it still refers to handle.
+			void Remove(const std::string& name, Handle<T> handle)
+			{
+				auto found = mNames.find(name);
+				if (found != mNames.end() && found->second == handle)
+					mNames.erase(found);
+			}
+
+			Handle<T> Find(const std::string& name) const
+			{
+				auto found = mNames.find(name);
+				return found != mNames.end() ? found->second : Handle<T>();
+			}
+
+			void Clear() { mNames.clear(); }
+
+		private:
+			std::unordered_map<std::string, Handle<T>> mNames;
+		};
+
+		// Materials of a renderer. Materials are never removed, so every new one takes the next element
+		// of the material buffer.
+		class MaterialTable
+		{
+		public:
+			// Add a material, or replace the one of the same name in place so the items using it see the
+			// change. Either way it is marked dirty for dirtyFrames frames.
+			MaterialHandle Add(const Material& mat, int dirtyFrames);
+			Material* Get(MaterialHandle handle) const { return mMaterials.Get(handle); }
+			MaterialHandle Find(const std::string& name) const { return mNames.Find(name); }
+			void Clear();
+
+			// Elements of the material buffer in use.
+			UINT Count() const { return (UINT)mMaterials.Size(); }
+			size_t SlotCount() const { return mMaterials.SlotCount(); }
+			Material* At(size_t index) const { return mMaterials.At(index); }
+
+			// Copy instance descriptions, instances with unknown materials use the first one. Log them
+			// under itemName and return their number.
+			int ResolveInstances(const std::vector<Instance>& instances, std::vector<InstanceData>& data,
+				const std::string& itemName) const;
+
+		private:
+			HandlePool<Material> mMaterials;
+			NameTable<Material> mNames;
+		};
+
+		// Bounds and bounding spheres of the submeshes of a geometry.
+		void ComputeSubmeshBounds(const std::vector<Vertex>& vertices, std::unordered_map<std::string, SubmeshGeometry>& drawArgs);
+
+		// Submesh an added render item draws and, if it is not instanced, its material. drawArgs are the
+		// ones of the geometry of the item, nullptr if the geometry is unknown. Log and return nullptr if
+		// the item refers to an unknown geometry, draw arg or material.
+		SubmeshGeometry* ResolveRenderItem(const RenderItemData& data, std::unordered_map<std::string, SubmeshGeometry>* drawArgs,
+			const MaterialTable& materials, Material** mat);
+
+	}	// namespace rendering
+}	// namespace handwork
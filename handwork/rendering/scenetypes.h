@@ -0,0 +1,117 @@
+// Provide the scene description shared by the D3D12 renderer and the headless CPU renderer.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "mathhelper.h"
+#include "bridgestructs.h"
+#include "../utility/bounds.h"
+#include "../utility/handle.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		const int gNumFrameResources = 3;
+
+		// D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, the only topology the CPU backend draws.
+		const UINT gTriangleListTopology = 4;
+
+		// Divide render items by pixel shader.
+		enum class RenderLayer : int
+		{
+			Opaque = 0,
+			WireFrame,
+			OpaqueInst,
+			WireFrameInst,
+			Debug,
+			Count
+		};
+
+		// Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
+		// geometries are stored in one vertex and index buffer.  It provides the offsets
+		// and data needed to draw a subset of geometry stores in the vertex and index
+		// buffers so that we can implement the technique described by Figure 6.3.
+		struct SphereBounds
+		{
+			Vector3f Center;
+			float Radius = 0.0f;
+		};
+
+		// Coarser level of detail of a submesh, a range of the same index buffer that indexes the same
+		// vertices. Error is the local space distance the level deviates from the full submesh.
+		struct SubmeshLod
+		{
+			UINT IndexCount = 0;
+			UINT StartIndexLocation = 0;
+			float Error = 0.0f;
+		};
+
+		struct SubmeshGeometry
+		{
+			UINT IndexCount = 0;
+			UINT VertexCount = 0;
+			UINT StartIndexLocation = 0;
+			INT BaseVertexLocation = 0;
+
+			// Local space bounds of the vertices of this submesh, computed when the geometry is added.
+			Bounds3f Bounds;
+			SphereBounds Sphere;
+
+			// Levels of detail after the full submesh, from fine to coarse. See BuildSubmeshLods.
+			std::vector<SubmeshLod> Lods;
+		};
+
+		// Simple struct to represent a material for our demos.  A production 3D engine
+		// would likely create a class hierarchy of Materials.
+		struct Material
+		{
+			// Unique material name for lookup.
+			std::string Name;
+
+			// Index into constant buffer corresponding to this material.
+			int MatCBIndex = -1;
+
+			// Dirty flag indicating the material has changed and we need to update the constant buffer.
+			// Because we have a material constant buffer for each FrameResource, we have to apply the
+			// update to each FrameResource.  Thus, when we modify a material we should set
+			// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
+			int NumFramesDirty = gNumFrameResources;
+
+			// Material constant buffer data used for shading.
+			Vector3f Albedo = { 1.0f, 1.0f, 1.0f };	//Fresnel/Diffuse
+			float Roughness = 0.5f;
+			float Metalness = 0.5f;
+		};
+
+		// Geometry and items are owned by the renderer, their layout depends on the backend.
+		struct MeshGeometry;
+		struct RenderItem;
+
+		typedef Handle<Material> MaterialHandle;
+		typedef Handle<MeshGeometry> GeometryHandle;
+		typedef Handle<RenderItem> RenderItemHandle;
+
+		// Simple struct to represent a instance specific data.
+		struct Instance
+		{
+			Matrix4x4 World;
+			MaterialHandle Mat;
+		};
+
+		struct RenderItemData
+		{
+			std::string Name;
+			Matrix4x4 World;
+			MaterialHandle Mat;
+			GeometryHandle Geo;
+			std::string DrawArgName;
+			// A D3D_PRIMITIVE_TOPOLOGY value.
+			UINT PrimitiveType = gTriangleListTopology;
+			std::vector<Instance> Instances;
+		};
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -6,15 +6,16 @@ namespace handwork
 {
 	namespace rendering
 	{
-		ShadowMap::ShadowMap(ID3D12Device* device, UINT width, UINT height)
+		ShadowMap::ShadowMap(ID3D12Device* device, UINT width, UINT height, UINT tileCount)
 		{
 			md3dDevice = device;
 
 			mWidth = width;
 			mHeight = height;
+			mTileCount = std::max(tileCount, (UINT)1);
 
-			mViewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
-			mScissorRect = { 0, 0, (int)width, (int)height };
+			mViewport = { 0.0f, 0.0f, (float)(width * mTileCount), (float)height, 0.0f, 1.0f };
+			mScissorRect = { 0, 0, (int)(width * mTileCount), (int)height };
 
 			BuildResource();
 		}
@@ -29,6 +30,11 @@ namespace handwork
 			return mHeight;
 		}
 
+		UINT ShadowMap::TileCount()const
+		{
+			return mTileCount;
+		}
+
 		ID3D12Resource* ShadowMap::Resource()
 		{
 			return mShadowMap.Get();
@@ -54,6 +60,18 @@ namespace handwork
 			return mScissorRect;
 		}
 
+		D3D12_VIEWPORT ShadowMap::TileViewport(UINT tile)const
+		{
+			DCHECK_LT(tile, mTileCount);
+			return { (float)(tile * mWidth), 0.0f, (float)mWidth, (float)mHeight, 0.0f, 1.0f };
+		}
+
+		D3D12_RECT ShadowMap::TileScissorRect(UINT tile)const
+		{
+			DCHECK_LT(tile, mTileCount);
+			return { (int)(tile * mWidth), 0, (int)((tile + 1) * mWidth), (int)mHeight };
+		}
+
 		void ShadowMap::BuildDescriptors(CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 			CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
 			CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv)
@@ -73,6 +91,8 @@ namespace handwork
 			{
 				mWidth = newWidth;
 				mHeight = newHeight;
+				mViewport = { 0.0f, 0.0f, (float)(mWidth * mTileCount), (float)mHeight, 0.0f, 1.0f };
+				mScissorRect = { 0, 0, (int)(mWidth * mTileCount), (int)mHeight };
 
 				BuildResource();
 
@@ -115,7 +135,7 @@ namespace handwork
 			ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
 			texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
 			texDesc.Alignment = 0;
-			texDesc.Width = mWidth;
+			texDesc.Width = mWidth * mTileCount;
 			texDesc.Height = mHeight;
 			texDesc.DepthOrArraySize = 1;
 			texDesc.MipLevels = 1;
@@ -8,22 +8,27 @@ namespace handwork
 {
 	namespace rendering
 	{
+		// The map can be an atlas of tiles placed side by side, one per shadow cascade. Width and
+		// height are the size of one tile.
 		class ShadowMap
 		{
 		public:
-			ShadowMap(ID3D12Device* device, UINT width, UINT height);
+			ShadowMap(ID3D12Device* device, UINT width, UINT height, UINT tileCount = 1);
 			ShadowMap(const ShadowMap& rhs) = delete;
 			ShadowMap& operator=(const ShadowMap& rhs) = delete;
 			~ShadowMap() = default;
 
 			UINT Width() const;
 			UINT Height() const;
+			UINT TileCount() const;
 			ID3D12Resource* Resource();
 			CD3DX12_GPU_DESCRIPTOR_HANDLE Srv() const;
 			CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv() const;
 
 			D3D12_VIEWPORT Viewport()const;
 			D3D12_RECT ScissorRect()const;
+			D3D12_VIEWPORT TileViewport(UINT tile)const;
+			D3D12_RECT TileScissorRect(UINT tile)const;
 
 			void BuildDescriptors(
 				CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
@@ -44,6 +49,7 @@ namespace handwork
 
 			UINT mWidth = 0;
 			UINT mHeight = 0;
+			UINT mTileCount = 1;
 			DXGI_FORMAT mFormat = DXGI_FORMAT_R24G8_TYPELESS;
 
 			CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
@@ -78,9 +78,9 @@ namespace handwork
 			return mNormalMap.Get();
 		}
 
-		ID3D12Resource* Ssao::AmbientMap()
+		ID3D12Resource* Ssao::AmbientMap(int index)
 		{
-			return mAmbientMap0.Get();
+			return index == 0 ? mAmbientMap0.Get() : mAmbientMap1.Get();
 		}
 
 		CD3DX12_CPU_DESCRIPTOR_HANDLE Ssao::NormalMapRtv()const
@@ -188,25 +188,17 @@ namespace handwork
 			}
 		}
 
-		void Ssao::ComputeSsao(
-			ID3D12GraphicsCommandList* cmdList,
-			FrameResource* currFrame,
-			int blurCount)
+		void Ssao::ComputeAmbient(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, int target)
 		{
 			cmdList->RSSetViewports(1, &mViewport);
 			cmdList->RSSetScissorRects(1, &mScissorRect);
 
-			// We compute the initial SSAO to AmbientMap0.
-
-			// Change to RENDER_TARGET.
-			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mAmbientMap0.Get(),
-				D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
+			CD3DX12_CPU_DESCRIPTOR_HANDLE targetRtv = target == 0 ? mhAmbientMap0CpuRtv : mhAmbientMap1CpuRtv;
 			float clearValue[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-			cmdList->ClearRenderTargetView(mhAmbientMap0CpuRtv, clearValue, 0, nullptr);
+			cmdList->ClearRenderTargetView(targetRtv, clearValue, 0, nullptr);
 
 			// Specify the buffers we are going to render to.
-			cmdList->OMSetRenderTargets(1, &mhAmbientMap0CpuRtv, true, nullptr);
+			cmdList->OMSetRenderTargets(1, &targetRtv, true, nullptr);
 
 			// Bind the constant buffer for this pass.
 			auto ssaoCBAddress = currFrame->SsaoCB->Resource()->GetGPUVirtualAddress();
@@ -226,62 +218,27 @@ namespace handwork
 			cmdList->IASetIndexBuffer(nullptr);
 			cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 			cmdList->DrawInstanced(6, 1, 0, 0);
-
-			// Change back to GENERIC_READ so we can read the texture in a shader.
-			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mAmbientMap0.Get(),
-				D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
-
-			BlurAmbientMap(cmdList, currFrame, blurCount);
 		}
 
-		void Ssao::BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, int blurCount)
+		void Ssao::BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, bool horzBlur,
+			int source, int target)
 		{
+			cmdList->RSSetViewports(1, &mViewport);
+			cmdList->RSSetScissorRects(1, &mScissorRect);
 			cmdList->SetPipelineState(mBlurPso);
 
 			auto ssaoCBAddress = currFrame->SsaoCB->Resource()->GetGPUVirtualAddress();
 			cmdList->SetGraphicsRootConstantBufferView(0, ssaoCBAddress);
+			cmdList->SetGraphicsRoot32BitConstant(1, horzBlur ? 1 : 0, 0);
 
-			for (int i = 0; i < blurCount; ++i)
-			{
-				BlurAmbientMap(cmdList, true);
-				BlurAmbientMap(cmdList, false);
-			}
-		}
-
-		void Ssao::BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, bool horzBlur)
-		{
-			ID3D12Resource* output = nullptr;
-			CD3DX12_GPU_DESCRIPTOR_HANDLE inputSrv;
-			CD3DX12_CPU_DESCRIPTOR_HANDLE outputRtv;
-
-			// Ping-pong the two ambient map textures as we apply
-			// horizontal and vertical blur passes.
-			if (horzBlur == true)
-			{
-				output = mAmbientMap1.Get();
-				inputSrv = mhAmbientMap0GpuSrv;
-				outputRtv = mhAmbientMap1CpuRtv;
-				cmdList->SetGraphicsRoot32BitConstant(1, 1, 0);
-			}
-			else
-			{
-				output = mAmbientMap0.Get();
-				inputSrv = mhAmbientMap1GpuSrv;
-				outputRtv = mhAmbientMap0CpuRtv;
-				cmdList->SetGraphicsRoot32BitConstant(1, 0, 0);
-			}
-
-			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(output,
-				D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
+			CD3DX12_GPU_DESCRIPTOR_HANDLE inputSrv = source == 0 ? mhAmbientMap0GpuSrv : mhAmbientMap1GpuSrv;
+			CD3DX12_CPU_DESCRIPTOR_HANDLE outputRtv = target == 0 ? mhAmbientMap0CpuRtv : mhAmbientMap1CpuRtv;
 
 			float clearValue[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 			cmdList->ClearRenderTargetView(outputRtv, clearValue, 0, nullptr);
 
 			cmdList->OMSetRenderTargets(1, &outputRtv, true, nullptr);
 
-			// Normal/depth map still bound.
-
-
 			// Bind the normal and depth maps.
 			cmdList->SetGraphicsRootDescriptorTable(2, mhNormalMapGpuSrv);
 
@@ -293,9 +250,6 @@ namespace handwork
 			cmdList->IASetIndexBuffer(nullptr);
 			cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 			cmdList->DrawInstanced(6, 1, 0, 0);
-
-			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(output,
-				D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
 		}
 
 		void Ssao::BuildResources()
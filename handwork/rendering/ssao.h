@@ -22,6 +22,7 @@ namespace handwork
 			static const DXGI_FORMAT NormalMapFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
 
 			static const int MaxBlurRadius = 5;
+			static const int AmbientMapCount = 2;
 
 			UINT SsaoMapWidth()const;
 			UINT SsaoMapHeight()const;
@@ -30,7 +31,8 @@ namespace handwork
 			std::vector<float> CalcGaussWeights(float sigma);
 
 			ID3D12Resource* NormalMap();
-			ID3D12Resource* AmbientMap();
+			// The ambient maps rest in GENERIC_READ. Map 0 is the one the main pass samples.
+			ID3D12Resource* AmbientMap(int index = 0);
 
 			CD3DX12_CPU_DESCRIPTOR_HANDLE NormalMapRtv()const;
 			CD3DX12_GPU_DESCRIPTOR_HANDLE NormalMapSrv()const;
@@ -54,26 +56,22 @@ namespace handwork
 			void OnResize(UINT newWidth, UINT newHeight);
 
 			///<summary>
-			/// Changes the render target to the Ambient render target and draws a fullscreen
-			/// quad to kick off the pixel shader to compute the AmbientMap.  We still keep the
-			/// main depth buffer binded to the pipeline, but depth buffer read/writes
-			/// are disabled, as we do not need the depth buffer computing the Ambient map.
+			/// Changes the render target to an ambient map and draws a fullscreen quad to kick off the
+			/// pixel shader to compute the ambient access. The target has to be in the RENDER_TARGET
+			/// state, the normal and depth maps readable by the pixel shader.
 			///</summary>
-			void ComputeSsao(
-				ID3D12GraphicsCommandList* cmdList,
-				FrameResource* currFrame,
-				int blurCount);
+			void ComputeAmbient(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, int target);
 
-
-		private:
 			///<summary>
-			/// Blurs the ambient map to smooth out the noise caused by only taking a
+			/// Blurs one ambient map into the other to smooth out the noise caused by only taking a
 			/// few random samples per pixel.  We use an edge preserving blur so that 
 			/// we do not blur across discontinuities--we want edges to remain edges.
+			/// The source has to be readable by the pixel shader, the target a render target.
 			///</summary>
-			void BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, int blurCount);
-			void BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, bool horzBlur);
+			void BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, bool horzBlur,
+				int source, int target);
 
+		private:
 			void BuildResources();
 			void BuildRandomVectorTexture(ID3D12GraphicsCommandList* cmdList);
 
@@ -0,0 +1,552 @@
+#include "tilerasterizer.h"
+#include "lightingutil.h"
+#include "../utility/parallel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HANDWORK_RASTER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace handwork
+{
+	namespace rendering
+	{
+		static const uint32_t InvalidId = 0xffffffff;
+		static const int TriangleIdBits = 16;
+		static const int SubpixelBits = 4;
+		static const int64_t SubpixelScale = 1 << SubpixelBits;
+
+		// Column vector convention, the same the matrices are uploaded with to the GPU.
+		static inline Vector4f TransformPoint(const Matrix4x4& m, const Vector3f& p)
+		{
+			return Vector4f(
+				m.m[0][0] * p.x + m.m[0][1] * p.y + m.m[0][2] * p.z + m.m[0][3],
+				m.m[1][0] * p.x + m.m[1][1] * p.y + m.m[1][2] * p.z + m.m[1][3],
+				m.m[2][0] * p.x + m.m[2][1] * p.y + m.m[2][2] * p.z + m.m[2][3],
+				m.m[3][0] * p.x + m.m[3][1] * p.y + m.m[3][2] * p.z + m.m[3][3]);
+		}
+
+		static inline Vector3f TransformVector(const Matrix4x4& m, const Vector3f& v)
+		{
+			return Vector3f(
+				m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z,
+				m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z,
+				m.m[2][0] * v.x + m.m[2][1] * v.y + m.m[2][2] * v.z);
+		}
+
+		static inline uint32_t PackColor(const Vector3f& c)
+		{
+			uint32_t r = (uint32_t)(Clamp(c.x, 0.0f, 1.0f) * 255.0f + 0.5f);
+			uint32_t g = (uint32_t)(Clamp(c.y, 0.0f, 1.0f) * 255.0f + 0.5f);
+			uint32_t b = (uint32_t)(Clamp(c.z, 0.0f, 1.0f) * 255.0f + 0.5f);
+			return r | (g << 8) | (b << 16) | (255u << 24);
+		}
+
+		// Farthest depth of a block of the depth target.
+		static inline float BlockMaxDepth(const float* depth, int stride)
+		{
+#if HANDWORK_RASTER_SSE
+			__m128 m = _mm_setzero_ps();
+			for (int r = 0; r < TileRasterizer::BlockSize; ++r, depth += stride)
+				for (int c = 0; c < TileRasterizer::BlockSize; c += 4)
+					m = _mm_max_ps(m, _mm_loadu_ps(depth + c));
+			m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+			m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_cvtss_f32(m);
+#else
+			float m = 0.0f;
+			for (int r = 0; r < TileRasterizer::BlockSize; ++r, depth += stride)
+				for (int c = 0; c < TileRasterizer::BlockSize; ++c)
+					m = std::max(m, depth[c]);
+			return m;
+#endif
+		}
+
+		void TileRasterizer::Resize(int width, int height)
+		{
+			CHECK(width > 0 && height > 0 && width <= MaxTargetSize && height <= MaxTargetSize);
+			mWidth = width;
+			mHeight = height;
+			mTilesX = (width + TileSize - 1) / TileSize;
+			mTilesY = (height + TileSize - 1) / TileSize;
+			mStride = mTilesX * TileSize;
+			mBlocksX = mStride / BlockSize;
+			size_t pixels = (size_t)mStride * mTilesY * TileSize;
+			mColor.assign(pixels, 0xff000000);
+			mDepth.assign(pixels, 1.0f);
+			mBlockMaxDepth.assign(pixels / (BlockSize * BlockSize), 1.0f);
+		}
+
+		void TileRasterizer::Render(const FrameSetup& setup, const std::vector<RasterDraw>& draws,
+			const MaterialData* materials, size_t materialCount)
+		{
+			mSetup = setup;
+			mMaterials = materials;
+			mMaterialCount = materials ? materialCount : 0;
+
+			BuildJobs(draws);
+			ParallelFor([&](int64_t j)
+			{
+				SetupJob((uint32_t)j, draws);
+			}, (int64_t)mJobCount, 1);
+
+			bool shade = !mSetup.DepthOnly;
+			if (shade && (int)mTileIds.size() < MaxThreadIndex())
+			{
+				mTileIds.resize(MaxThreadIndex());
+				for (auto& ids : mTileIds)
+					ids.resize(TileSize * TileSize);
+			}
+			ParallelFor([&](int64_t t)
+			{
+				uint32_t* ids = shade ? mTileIds[ThreadIndex].data() : nullptr;
+				RasterizeTile((int)t, ids);
+				if (shade)
+					ShadeTile((int)t, ids);
+			}, (int64_t)mTilesX * mTilesY, 1);
+		}
+
+		void TileRasterizer::ReadbackColor(RetrieveImageData& image) const
+		{
+			image.Width = (UINT)mWidth;
+			image.Height = (UINT)mHeight;
+			image.Pitch = (UINT)mWidth * 4;
+			image.Data.resize((size_t)image.Pitch * mHeight);
+			for (int y = 0; y < mHeight; ++y)
+				memcpy(&image.Data[(size_t)y * image.Pitch], &mColor[(size_t)y * mStride], image.Pitch);
+		}
+
+		void TileRasterizer::ReadbackDepth(std::vector<float>& depth) const
+		{
+			depth.resize((size_t)mWidth * mHeight);
+			for (int y = 0; y < mHeight; ++y)
+				memcpy(&depth[(size_t)y * mWidth], &mDepth[(size_t)y * mStride], mWidth * sizeof(float));
+		}
+
+		void TileRasterizer::BuildJobs(const std::vector<RasterDraw>& draws)
+		{
+			// Cut the instances of all draws into jobs of similar size, small instances share a job.
+			mPartition.Reset(JobTriangles);
+			mInstances.clear();
+			for (UINT d = 0; d < (UINT)draws.size(); ++d)
+			{
+				UINT triangleCount = draws[d].IndexCount / 3;
+				if (triangleCount == 0)
+					continue;
+				for (UINT k = 0; k < draws[d].InstanceCount; ++k)
+				{
+					mPartition.AddGroup(triangleCount);
+					mInstances.push_back({ d, k });
+				}
+			}
+			mJobCount = mPartition.GetJobCount();
+			if (mJobs.size() < mJobCount)
+				mJobs.resize(mJobCount);
+		}
+
+		void TileRasterizer::SetupJob(uint32_t jobIndex, const std::vector<RasterDraw>& draws)
+		{
+			Job& job = mJobs[jobIndex];
+			job.Triangles.clear();
+			job.ShadeData.clear();
+			job.Bins.resize((size_t)mTilesX * mTilesY);
+			for (auto& bin : job.Bins)
+				bin.clear();
+
+			bool shade = !mSetup.DepthOnly;
+			const JobSegment* segments = mPartition.GetSegments(jobIndex);
+			for (uint32_t s = 0; s < mPartition.GetSegmentCount(jobIndex); ++s)
+			{
+				const JobSegment& segment = segments[s];
+				const RasterDraw& draw = draws[mInstances[segment.Group].Draw];
+				const InstanceData& inst = draw.Instances[mInstances[segment.Group].Instance];
+				Matrix4x4 worldViewProj = Matrix4x4::Mul(mSetup.Pass.ViewProj, inst.World);
+				UINT materialIndex = inst.MaterialIndex < mMaterialCount ? inst.MaterialIndex : InvalidId;
+
+				const uint32_t* indices = draw.Indices + (size_t)segment.First * 3;
+				for (UINT t = 0; t < segment.Count; ++t, indices += 3)
+				{
+					ClipVertex v[3];
+					bool valid = true;
+					for (int c = 0; c < 3; ++c)
+					{
+						size_t vi = (size_t)((int64_t)indices[c] + draw.BaseVertexLocation);
+						if (vi >= draw.VertexCount)
+						{
+							valid = false;
+							break;
+						}
+						const Vertex& vertex = draw.Vertices[vi];
+						v[c].Pos = TransformPoint(worldViewProj, vertex.Pos);
+						if (shade)
+						{
+							Vector4f posW = TransformPoint(inst.World, vertex.Pos);
+							v[c].PosW = Vector3f(posW.x, posW.y, posW.z);
+							// Assumes uniform scaling, like the vertex shaders.
+							v[c].NormalW = TransformVector(inst.World, vertex.Normal);
+						}
+					}
+					if (valid)
+						ClipTriangle(job, v, materialIndex);
+				}
+			}
+		}
+
+		void TileRasterizer::ClipTriangle(Job& job, const ClipVertex* v, UINT materialIndex)
+		{
+			// Trivially reject triangles completely outside a side plane or the far plane.
+			bool outLeft = true, outRight = true, outBottom = true, outTop = true, outFar = true;
+			for (int c = 0; c < 3; ++c)
+			{
+				const Vector4f& p = v[c].Pos;
+				outLeft &= p.x < -p.w;
+				outRight &= p.x > p.w;
+				outBottom &= p.y < -p.w;
+				outTop &= p.y > p.w;
+				outFar &= p.z > p.w;
+			}
+			if (outLeft || outRight || outBottom || outTop || outFar)
+				return;
+
+			// Distances to the near plane z >= 0 and the four guard band planes, the remaining parts
+			// outside the view are rejected per tile and pixel.
+			float guardX = 1.0f + 2.0f * GuardBand / mWidth;
+			float guardY = 1.0f + 2.0f * GuardBand / mHeight;
+			auto distance = [guardX, guardY](const Vector4f& p, int plane)
+			{
+				switch (plane)
+				{
+				case 0: return p.z;
+				case 1: return guardX * p.w - p.x;
+				case 2: return guardX * p.w + p.x;
+				case 3: return guardY * p.w - p.y;
+				default: return guardY * p.w + p.y;
+				}
+			};
+			int clipMask = 0;
+			for (int plane = 0; plane < 5; ++plane)
+				for (int c = 0; c < 3; ++c)
+					if (distance(v[c].Pos, plane) < 0.0f)
+						clipMask |= 1 << plane;
+			if (clipMask == 0)
+			{
+				SetupTriangle(job, v[0], v[1], v[2], materialIndex);
+				return;
+			}
+
+			// Clip the polygon plane by plane, every plane adds at most one vertex.
+			ClipVertex poly[2][8];
+			int count = 3;
+			int current = 0;
+			for (int c = 0; c < 3; ++c)
+				poly[0][c] = v[c];
+			for (int plane = 0; plane < 5 && count >= 3; ++plane)
+			{
+				if (!(clipMask & (1 << plane)))
+					continue;
+				const ClipVertex* in = poly[current];
+				ClipVertex* out = poly[current ^ 1];
+				int outCount = 0;
+				for (int c = 0; c < count; ++c)
+				{
+					const ClipVertex& a = in[c];
+					const ClipVertex& b = in[(c + 1) % count];
+					float da = distance(a.Pos, plane);
+					float db = distance(b.Pos, plane);
+					if (da >= 0.0f)
+						out[outCount++] = a;
+					if ((da >= 0.0f) != (db >= 0.0f))
+					{
+						float t = da / (da - db);
+						ClipVertex& p = out[outCount++];
+						p.Pos = Vector4f(Lerp(t, a.Pos.x, b.Pos.x), Lerp(t, a.Pos.y, b.Pos.y),
+							Lerp(t, a.Pos.z, b.Pos.z), Lerp(t, a.Pos.w, b.Pos.w));
+						p.PosW = a.PosW + (b.PosW - a.PosW) * t;
+						p.NormalW = a.NormalW + (b.NormalW - a.NormalW) * t;
+					}
+				}
+				count = outCount;
+				current ^= 1;
+			}
+			for (int i = 1; i + 1 < count; ++i)
+				SetupTriangle(job, poly[current][0], poly[current][i], poly[current][i + 1], materialIndex);
+		}
+
+		void TileRasterizer::SetupTriangle(Job& job, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, UINT materialIndex)
+		{
+			const ClipVertex* v[3] = { &v0, &v1, &v2 };
+			float sz[3], invW[3];
+			int64_t X[3], Y[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				invW[c] = 1.0f / v[c]->Pos.w;
+				float sx = (v[c]->Pos.x * invW[c] * 0.5f + 0.5f) * mWidth;
+				float sy = (0.5f - v[c]->Pos.y * invW[c] * 0.5f) * mHeight;
+				X[c] = (int64_t)std::floor(sx * SubpixelScale + 0.5f);
+				Y[c] = (int64_t)std::floor(sy * SubpixelScale + 0.5f);
+				sz[c] = v[c]->Pos.z * invW[c];
+			}
+
+			// Clockwise triangles in screen space are front facing, back faces are culled.
+			int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+			if (area <= 0)
+				return;
+
+			// Pixels whose centers lie in the bounding box, small triangles often cover none.
+			const int64_t half = SubpixelScale / 2;
+			RasterTriangle tri;
+			tri.MinX = (int)std::max<int64_t>(-((half - std::min(X[0], std::min(X[1], X[2]))) >> SubpixelBits), 0);
+			tri.MaxX = (int)std::min<int64_t>((std::max(X[0], std::max(X[1], X[2])) - half) >> SubpixelBits, mWidth - 1);
+			tri.MinY = (int)std::max<int64_t>(-((half - std::min(Y[0], std::min(Y[1], Y[2]))) >> SubpixelBits), 0);
+			tri.MaxY = (int)std::min<int64_t>((std::max(Y[0], std::max(Y[1], Y[2])) - half) >> SubpixelBits, mHeight - 1);
+			if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+				return;
+
+			// Edge functions stepped per pixel and evaluated at pixel centers. Pixels exactly on an edge
+			// belong to it for top and left edges, the other edges need a positive value.
+			double invArea = 1.0 / (double)area;
+			double depth[3] = { 0.0, 0.0, 0.0 };
+			tri.TopLeft = 0;
+			for (int i = 0; i < 3; ++i)
+			{
+				int a = (i + 1) % 3;
+				int b = (i + 2) % 3;
+				int64_t ex = X[b] - X[a];
+				int64_t ey = Y[b] - Y[a];
+				bool topLeft = (ey == 0 && ex > 0) || ey < 0;
+				tri.EdgeA[i] = (int32_t)(-ey * SubpixelScale);
+				tri.EdgeB[i] = (int32_t)(ex * SubpixelScale);
+				int64_t c = ey * X[a] - ex * Y[a] + (ex - ey) * half;
+				tri.EdgeC[i] = c - (topLeft ? 0 : 1);
+				tri.TopLeft |= topLeft ? 1 << i : 0;
+				// The bias is not negligible for small triangles, keep it out of the interpolation.
+				depth[0] += sz[i] * tri.EdgeA[i] * invArea;
+				depth[1] += sz[i] * tri.EdgeB[i] * invArea;
+				depth[2] += sz[i] * c * invArea;
+			}
+			tri.InvArea = (float)invArea;
+			tri.Depth = Vector3f((float)depth[0], (float)depth[1], (float)depth[2]);
+			tri.MinDepth = std::min(sz[0], std::min(sz[1], sz[2]));
+
+			uint16_t index = (uint16_t)job.Triangles.size();
+			job.Triangles.push_back(tri);
+			if (!mSetup.DepthOnly)
+			{
+				ShadeTriangle shade;
+				for (int c = 0; c < 3; ++c)
+				{
+					shade.PosW[c] = v[c]->PosW;
+					shade.NormalW[c] = v[c]->NormalW;
+					shade.InvW[c] = invW[c];
+				}
+				shade.MaterialIndex = materialIndex;
+				job.ShadeData.push_back(shade);
+			}
+
+			// Bin into every tile the pixel bounds touch.
+			for (int ty = tri.MinY / TileSize; ty <= tri.MaxY / TileSize; ++ty)
+				for (int tx = tri.MinX / TileSize; tx <= tri.MaxX / TileSize; ++tx)
+					job.Bins[ty * mTilesX + tx].push_back(index);
+		}
+
+		void TileRasterizer::RasterizeTile(int tileIndex, uint32_t* ids)
+		{
+			int tileX = (tileIndex % mTilesX) * TileSize;
+			int tileY = (tileIndex / mTilesX) * TileSize;
+
+			// Clear the tile.
+			uint32_t clearColor = PackColor(Vector3f(mSetup.ClearColor.x, mSetup.ClearColor.y, mSetup.ClearColor.z));
+			for (int y = tileY; y < tileY + TileSize; ++y)
+			{
+				std::fill_n(&mDepth[(size_t)y * mStride + tileX], TileSize, 1.0f);
+				std::fill_n(&mColor[(size_t)y * mStride + tileX], TileSize, clearColor);
+			}
+			for (int by = tileY / BlockSize; by < (tileY + TileSize) / BlockSize; ++by)
+				std::fill_n(&mBlockMaxDepth[(size_t)by * mBlocksX + tileX / BlockSize], TileSize / BlockSize, 1.0f);
+			if (ids)
+				std::fill_n(ids, TileSize * TileSize, InvalidId);
+
+			const int extent = BlockSize - 1;
+			for (size_t j = 0; j < mJobCount; ++j)
+			{
+				const Job& job = mJobs[j];
+				for (uint16_t index : job.Bins[tileIndex])
+				{
+					const RasterTriangle& tri = job.Triangles[index];
+					uint32_t id = ((uint32_t)j << TriangleIdBits) | index;
+					int x0 = std::max(tri.MinX, tileX) & ~(BlockSize - 1);
+					int y0 = std::max(tri.MinY, tileY) & ~(BlockSize - 1);
+					int x1 = std::min(tri.MaxX, tileX + TileSize - 1);
+					int y1 = std::min(tri.MaxY, tileY + TileSize - 1);
+					for (int by = y0; by <= y1; by += BlockSize)
+					{
+						for (int bx = x0; bx <= x1; bx += BlockSize)
+						{
+							// Hierarchical depth test, depth is linear in screen space so the nearest
+							// value over the block is at one of its corners.
+							float& blockMax = mBlockMaxDepth[(size_t)(by / BlockSize) * mBlocksX + bx / BlockSize];
+							float z = tri.Depth.x * bx + tri.Depth.y * by + tri.Depth.z;
+							float zMin = z + std::min(tri.Depth.x * extent, 0.0f) + std::min(tri.Depth.y * extent, 0.0f);
+							if (std::max(zMin, tri.MinDepth) >= blockMax)
+								continue;
+
+							// Reject blocks outside an edge and skip the pixel tests of blocks inside all of
+							// them. An edge crossing the block stays within 32 bits over it.
+							int32_t edges[3];
+							bool outside = false;
+							bool covered = true;
+							for (int i = 0; i < 3 && !outside; ++i)
+							{
+								int64_t w = (int64_t)tri.EdgeA[i] * bx + (int64_t)tri.EdgeB[i] * by + tri.EdgeC[i];
+								int64_t dx = (int64_t)tri.EdgeA[i] * extent;
+								int64_t dy = (int64_t)tri.EdgeB[i] * extent;
+								outside = w + std::max<int64_t>(dx, 0) + std::max<int64_t>(dy, 0) < 0;
+								bool inside = w + std::min<int64_t>(dx, 0) + std::min<int64_t>(dy, 0) >= 0;
+								covered &= inside;
+								edges[i] = (int32_t)(inside ? std::min<int64_t>(w, 1 << 30) : w);
+							}
+							if (outside)
+								continue;
+
+							if (RasterizeBlock(tri, bx, by, covered ? nullptr : edges, id, ids, tileX, tileY))
+								blockMax = BlockMaxDepth(&mDepth[(size_t)by * mStride + bx], mStride);
+						}
+					}
+				}
+			}
+		}
+
+		bool TileRasterizer::RasterizeBlock(const RasterTriangle& tri, int bx, int by, const int32_t* edges, uint32_t id,
+			uint32_t* ids, int tileX, int tileY)
+		{
+			bool written = false;
+#if HANDWORK_RASTER_SSE
+			const __m128 zero = _mm_setzero_ps();
+			const __m128i allOnes = _mm_set1_epi32(-1);
+			const __m128 laneX = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			__m128i edgeRow[3], edgeHalf[3], edgeStepY[3];
+			if (edges)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					int32_t a = tri.EdgeA[i];
+					edgeRow[i] = _mm_add_epi32(_mm_set1_epi32(edges[i]), _mm_setr_epi32(0, a, 2 * a, 3 * a));
+					edgeHalf[i] = _mm_set1_epi32(4 * a);
+					edgeStepY[i] = _mm_set1_epi32(tri.EdgeB[i]);
+				}
+			}
+			const __m128 depthA = _mm_set1_ps(tri.Depth.x);
+			const __m128 depthB = _mm_set1_ps(tri.Depth.y);
+			const __m128 depthC = _mm_set1_ps(tri.Depth.z);
+
+			for (int y = by; y < by + BlockSize; ++y)
+			{
+				__m128 py = _mm_set1_ps((float)y);
+				for (int h = 0; h < 2; ++h)
+				{
+					int x = bx + 4 * h;
+					// Covered where none of the edge functions has the sign bit set.
+					__m128 mask = _mm_castsi128_ps(allOnes);
+					if (edges)
+					{
+						__m128i w = _mm_or_si128(_mm_or_si128(edgeRow[0], edgeRow[1]), edgeRow[2]);
+						if (h == 1)
+							w = _mm_or_si128(_mm_or_si128(_mm_add_epi32(edgeRow[0], edgeHalf[0]),
+								_mm_add_epi32(edgeRow[1], edgeHalf[1])), _mm_add_epi32(edgeRow[2], edgeHalf[2]));
+						mask = _mm_castsi128_ps(_mm_cmpgt_epi32(w, allOnes));
+					}
+					__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneX);
+					__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(depthA, px), _mm_mul_ps(depthB, py)), depthC);
+					z = _mm_max_ps(z, zero);
+					float* depth = &mDepth[(size_t)y * mStride + x];
+					__m128 old = _mm_loadu_ps(depth);
+					mask = _mm_and_ps(mask, _mm_cmplt_ps(z, old));
+					int bits = _mm_movemask_ps(mask);
+					if (bits == 0)
+						continue;
+					_mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old)));
+					written = true;
+					if (ids)
+					{
+						uint32_t* row = ids + (y - tileY) * TileSize + (x - tileX);
+						for (int lane = 0; lane < 4; ++lane)
+							if (bits & (1 << lane))
+								row[lane] = id;
+					}
+				}
+				if (edges)
+					for (int i = 0; i < 3; ++i)
+						edgeRow[i] = _mm_add_epi32(edgeRow[i], edgeStepY[i]);
+			}
+#else
+			for (int y = by; y < by + BlockSize; ++y)
+			{
+				for (int x = bx; x < bx + BlockSize; ++x)
+				{
+					bool inside = true;
+					for (int i = 0; i < 3 && edges; ++i)
+						inside &= edges[i] + tri.EdgeA[i] * (x - bx) + tri.EdgeB[i] * (y - by) >= 0;
+					float z = std::max(tri.Depth.x * x + tri.Depth.y * y + tri.Depth.z, 0.0f);
+					float& depth = mDepth[(size_t)y * mStride + x];
+					if (!inside || !(z < depth))
+						continue;
+					depth = z;
+					written = true;
+					if (ids)
+						ids[(y - tileY) * TileSize + (x - tileX)] = id;
+				}
+			}
+#endif
+			return written;
+		}
+
+		void TileRasterizer::ShadeTile(int tileIndex, const uint32_t* ids)
+		{
+			int tileX = (tileIndex % mTilesX) * TileSize;
+			int tileY = (tileIndex / mTilesX) * TileSize;
+			int width = std::min(mWidth - tileX, (int)TileSize);
+			int height = std::min(mHeight - tileY, (int)TileSize);
+			const PassConstants& pass = mSetup.Pass;
+			MaterialData defaultMat;
+
+			for (int ly = 0; ly < height; ++ly)
+			{
+				for (int lx = 0; lx < width; ++lx)
+				{
+					uint32_t id = ids[ly * TileSize + lx];
+					if (id == InvalidId)
+						continue;
+					const Job& job = mJobs[id >> TriangleIdBits];
+					uint32_t index = id & ((1u << TriangleIdBits) - 1);
+					const RasterTriangle& tri = job.Triangles[index];
+					const ShadeTriangle& shade = job.ShadeData[index];
+
+					// Perspective correct interpolation of the shading inputs.
+					int x = tileX + lx;
+					int y = tileY + ly;
+					float p[3];
+					for (int i = 0; i < 3; ++i)
+					{
+						int64_t w = (int64_t)tri.EdgeA[i] * x + (int64_t)tri.EdgeB[i] * y + tri.EdgeC[i] + (~tri.TopLeft >> i & 1);
+						p[i] = (float)w * tri.InvArea * shade.InvW[i];
+					}
+					float invSum = 1.0f / (p[0] + p[1] + p[2]);
+					Vector3f posW = (shade.PosW[0] * p[0] + shade.PosW[1] * p[1] + shade.PosW[2] * p[2]) * invSum;
+					Vector3f normalW = shade.NormalW[0] * p[0] + shade.NormalW[1] * p[1] + shade.NormalW[2] * p[2];
+
+					// Same as the opaque pixel shaders, without SSAO and shadows.
+					const MaterialData& mat = shade.MaterialIndex != InvalidId ? mMaterials[shade.MaterialIndex] : defaultMat;
+					Vector3f diffuseAlbedo = mat.Albedo * (1.0f - mat.Metalness);
+					Vector3f normal = normalW.LengthSquared() > 0.0f ? Normalize(normalW) : Vector3f(0.0f, 1.0f, 0.0f);
+					Vector3f toEye = pass.EyePosW - posW;
+					toEye = toEye.LengthSquared() > 0.0f ? Normalize(toEye) : normal;
+					Vector3f color = lighting::Modulate(Vector3f(pass.AmbientLight.x, pass.AmbientLight.y, pass.AmbientLight.z), diffuseAlbedo);
+					for (int i = 0; i < 3; ++i)
+						color += lighting::ComputeDirectionalLight(pass.Lights[i], mat, normal, toEye);
+					mColor[(size_t)(tileY + ly) * mStride + tileX + lx] = PackColor(color);
+				}
+			}
+		}
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -0,0 +1,136 @@
+// Multithreaded tile based software rasterizer behind the CPU render backend.
+
+#pragma once
+
+#include "renderbackend.h"
+#include "../utility/jobpartition.h"
+
+namespace handwork
+{
+	namespace rendering
+	{
+		// Indexed triangle list draw with its buffers resolved to system memory.
+		struct RasterDraw
+		{
+			const Vertex* Vertices = nullptr;
+			size_t VertexCount = 0;
+			// Already offset by the start index location.
+			const uint32_t* Indices = nullptr;
+			UINT IndexCount = 0;
+			INT BaseVertexLocation = 0;
+			const InstanceData* Instances = nullptr;
+			UINT InstanceCount = 0;
+		};
+
+		// A frame runs in two parallel phases. The setup phase transforms, clips and culls the triangles
+		// in jobs of at most JobTriangles input triangles and bins them into the screen tiles they touch.
+		// The raster phase walks every tile through the bins of all jobs in submission order, so the
+		// result does not depend on the thread count. 8x8 blocks are rejected against the farthest depth
+		// they hold and classified against the edges, the pixels of partially covered blocks are tested
+		// four at a time with SSE. With shading on, the tile first resolves visibility and then shades
+		// each pixel once with the Cook-Torrance model of lightingutil.hlsl.
+		class TileRasterizer
+		{
+		public:
+			static constexpr int TileSize = 64;
+			static const int BlockSize = 8;
+			static const int JobTriangles = 8192;
+			// Largest target size, and how far outside of it triangles may reach before they are clipped,
+			// in pixels. Together they keep the fixed point edge functions of a block within 32 bits.
+			static const int MaxTargetSize = 8192;
+			static const int GuardBand = 4096;
+
+			void Resize(int width, int height);
+			void Render(const FrameSetup& setup, const std::vector<RasterDraw>& draws,
+				const MaterialData* materials, size_t materialCount);
+
+			void ReadbackColor(RetrieveImageData& image) const;
+			void ReadbackDepth(std::vector<float>& depth) const;
+
+		private:
+			// Screen space triangle with vertices snapped to 1/16 pixel. Edge i is opposite vertex i and
+			// evaluates to Edge(A, B, C) = A * px + B * py + C in fixed point, which is exact, so triangles
+			// sharing an edge never leave a gap or cover a pixel twice. The fill convention bias is folded
+			// into C, a pixel is covered when all three are not negative. Depth is the plane of post
+			// projection depth at the center of pixel (x, y): Depth.x * x + Depth.y * y + Depth.z.
+			struct RasterTriangle
+			{
+				int32_t EdgeA[3];
+				int32_t EdgeB[3];
+				int64_t EdgeC[3];
+				float InvArea;
+				Vector3f Depth;
+				float MinDepth;
+				int MinX, MinY, MaxX, MaxY;
+				// Bit i is set when pixels exactly on edge i belong to the triangle, C has no bias then.
+				int TopLeft;
+			};
+
+			// Inputs of the pixel shading, only written when the frame is shaded.
+			struct ShadeTriangle
+			{
+				Vector3f PosW[3];
+				Vector3f NormalW[3];
+				float InvW[3];
+				UINT MaterialIndex;
+			};
+
+			struct ClipVertex
+			{
+				Vector4f Pos;
+				Vector3f PosW;
+				Vector3f NormalW;
+			};
+
+			// Instance of a draw, the triangles of each are a group of the job partition.
+			struct DrawInstance
+			{
+				UINT Draw;
+				UINT Instance;
+			};
+
+			struct Job
+			{
+				std::vector<RasterTriangle> Triangles;
+				std::vector<ShadeTriangle> ShadeData;
+				// Indices into Triangles for every tile.
+				std::vector<std::vector<uint16_t>> Bins;
+			};
+
+			void BuildJobs(const std::vector<RasterDraw>& draws);
+			void SetupJob(uint32_t jobIndex, const std::vector<RasterDraw>& draws);
+			// Clip against the near plane and the guard band and set up the resulting polygon.
+			void ClipTriangle(Job& job, const ClipVertex* v, UINT materialIndex);
+			void SetupTriangle(Job& job, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, UINT materialIndex);
+			void RasterizeTile(int tileIndex, uint32_t* ids);
+			// Depth test the covered pixels of a block and return whether any depth was written. Edges holds
+			// the edge functions at the first pixel of a partially covered block, nullptr if it is covered.
+			bool RasterizeBlock(const RasterTriangle& tri, int bx, int by, const int32_t* edges, uint32_t id,
+				uint32_t* ids, int tileX, int tileY);
+			void ShadeTile(int tileIndex, const uint32_t* ids);
+
+			int mWidth = 0;
+			int mHeight = 0;
+			int mTilesX = 0;
+			int mTilesY = 0;
+			// Targets are padded to whole tiles, rows are mStride pixels apart.
+			int mStride = 0;
+			int mBlocksX = 0;
+			std::vector<uint32_t> mColor;
+			std::vector<float> mDepth;
+			// Farthest depth of every 8x8 block.
+			std::vector<float> mBlockMaxDepth;
+
+			FrameSetup mSetup;
+			const MaterialData* mMaterials = nullptr;
+			size_t mMaterialCount = 0;
+			JobPartition mPartition;
+			std::vector<DrawInstance> mInstances;
+			std::vector<Job> mJobs;
+			size_t mJobCount = 0;
+			// Per thread visibility buffer of a tile, pixel ids are job index << 16 | triangle index.
+			std::vector<std::vector<uint32_t>> mTileIds;
+		};
+
+	}	// namespace rendering
+}	// namespace handwork
@@ -69,6 +69,20 @@ namespace handwork
 				memcpy(&mMappedData[startIndex*mElementByteSize], data, mElementByteSize*number);
 			}
 
+			// CopyData and CopyContinuousData through streaming stores, for buffers written once per frame.
+			// Call d3dUtil::StreamFence() on the writing thread after the last write.
+			void StreamData(int elementIndex, const T& data)
+			{
+				d3dUtil::StreamCopy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
+			}
+
+			void StreamContinuousData(int startIndex, int number, const T* data)
+			{
+				if (mIsConstantBuffer)
+					throw new std::exception("Cannot use \"StreamContinuousData\" method in \"UploadBuffer\" for constant buffer.");
+				d3dUtil::StreamCopy(&mMappedData[startIndex*mElementByteSize], data, mElementByteSize*number);
+			}
+
 		private:
 			Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
 			BYTE* mMappedData = nullptr;
@@ -72,6 +72,15 @@ cbuffer cbPass : register(b1)
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light gLights[MaxLights];
+
+    // Shadow cascades of the first light. Cascade i covers view depths up to gCascadeSplits[i]
+    // and maps world space to its tile of the shadow map atlas.
+    float4x4 gCascadeTransforms[MaxCascades];
+    float4 gCascadeSplits;
+    uint gCascadeCount;
+    uint gCascadePad0;
+    uint gCascadePad1;
+    uint gCascadePad2;
 };
 
 //---------------------------------------------------------------------------------------
@@ -92,13 +101,14 @@ float CalcShadowFactor(float4 shadowPosH)
 
     // Texel size.
     float dx = 1.0f / (float) width;
+    float dy = 1.0f / (float) height;
 
     float percentLit = 0.0f;
     const float2 offsets[9] =
     {
-        float2(-dx, -dx), float2(0.0f, -dx), float2(dx, -dx),
+        float2(-dx, -dy), float2(0.0f, -dy), float2(dx, -dy),
         float2(-dx, 0.0f), float2(0.0f, 0.0f), float2(dx, 0.0f),
-        float2(-dx, +dx), float2(0.0f, +dx), float2(dx, +dx)
+        float2(-dx, +dy), float2(0.0f, +dy), float2(dx, +dy)
     };
 
     [unroll]
@@ -111,3 +121,30 @@ float CalcShadowFactor(float4 shadowPosH)
     return percentLit / 9.0f;
 }
 
+//---------------------------------------------------------------------------------------
+// Pick the cascade covering the view depth of a world space point, and do PCF in its
+// tile of the shadow map atlas. Points beyond the last cascade are lit.
+//---------------------------------------------------------------------------------------
+float CalcCascadeShadowFactor(float3 posW)
+{
+    float depthV = mul(float4(posW, 1.0f), gView).z;
+
+    [unroll]
+    for (uint i = 0; i < MaxCascades; ++i)
+    {
+        if (i < gCascadeCount && depthV <= gCascadeSplits[i])
+        {
+            float4 shadowPosH = mul(float4(posW, 1.0f), gCascadeTransforms[i]);
+
+            // Keep the PCF taps inside the tile so they do not read the neighbour cascade.
+            uint width, height, numMips;
+            gShadowMap.GetDimensions(0, width, height, numMips);
+            float tileMin = (float) i / gCascadeCount + 1.5f / width;
+            float tileMax = (float) (i + 1) / gCascadeCount - 1.5f / width;
+            shadowPosH.x = clamp(shadowPosH.x / shadowPosH.w, tileMin, tileMax) * shadowPosH.w;
+
+            return CalcShadowFactor(shadowPosH);
+        }
+    }
+    return 1.0f;
+}
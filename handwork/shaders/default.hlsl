@@ -24,7 +24,6 @@ struct VertexIn
 struct VertexOut
 {
     float4 PosH : SV_POSITION;
-    float4 ShadowPosH : POSITION0;
     float4 SsaoPosH : POSITION1;
     float3 PosW : POSITION2;
     float3 NormalW : NORMAL;
@@ -34,7 +33,6 @@ struct VertexOut
 struct VertexInstOut
 {
     float4 PosH : SV_POSITION;
-    float4 ShadowPosH : POSITION0;
     float4 SsaoPosH : POSITION1;
     float3 PosW : POSITION2;
     float3 NormalW : NORMAL;
@@ -60,9 +58,6 @@ VertexOut VS(VertexIn vin)
 
     // Generate projective tex-coords to project SSAO map onto scene.
     vout.SsaoPosH = mul(posW, gViewProjTex);
-
-    // Generate projective tex-coords to project shadow map onto scene.
-    vout.ShadowPosH = mul(posW, gShadowTransform);
 	
     return vout;
 }
@@ -81,16 +76,23 @@ float4 PS(VertexOut pin) : SV_Target
     // Vector from point being lit to eye. 
     float3 toEyeW = normalize(gEyePosW - pin.PosW);
 
+#ifdef WIREFRAME
+    // Wireframes are neither in the normal/depth pass nor in the shadow map, they are lit without
+    // ambient occlusion and shadows, so the passes computing them can be skipped.
+    float ambientAccess = 1.0f;
+    float3 shadowFactor = float3(1.0f, 1.0f, 1.0f);
+#else
     // Finish texture projection and sample SSAO map.
     pin.SsaoPosH /= pin.SsaoPosH.w;
     float ambientAccess = gSsaoMap.Sample(gsamLinearClamp, pin.SsaoPosH.xy, 0.0f).r;
 
-    // Light terms.
-    float4 ambient = ambientAccess * gAmbientLight * diffuseAlbedo;
-
     // Only the first light casts a shadow.
     float3 shadowFactor = float3(1.0f, 1.0f, 1.0f);
-    shadowFactor[0] = CalcShadowFactor(pin.ShadowPosH);
+    shadowFactor[0] = CalcCascadeShadowFactor(pin.PosW);
+#endif
+
+    // Light terms.
+    float4 ambient = ambientAccess * gAmbientLight * diffuseAlbedo;
 
     float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
@@ -127,9 +129,6 @@ VertexInstOut VSInst(VertexIn vin, uint instanceID : SV_InstanceID)
 
     // Generate projective tex-coords to project SSAO map onto scene.
     vout.SsaoPosH = mul(posW, gViewProjTex);
-
-    // Generate projective tex-coords to project shadow map onto scene.
-    vout.ShadowPosH = mul(posW, gShadowTransform);
 	
     return vout;
 }
@@ -148,16 +147,23 @@ float4 PSInst(VertexInstOut pin) : SV_Target
     // Vector from point being lit to eye. 
     float3 toEyeW = normalize(gEyePosW - pin.PosW);
 
+#ifdef WIREFRAME
+    // Wireframes are neither in the normal/depth pass nor in the shadow map, they are lit without
+    // ambient occlusion and shadows, so the passes computing them can be skipped.
+    float ambientAccess = 1.0f;
+    float3 shadowFactor = float3(1.0f, 1.0f, 1.0f);
+#else
     // Finish texture projection and sample SSAO map.
     pin.SsaoPosH /= pin.SsaoPosH.w;
     float ambientAccess = gSsaoMap.Sample(gsamLinearClamp, pin.SsaoPosH.xy, 0.0f).r;
 
-    // Light terms.
-    float4 ambient = ambientAccess * gAmbientLight * diffuseAlbedo;
-
     // Only the first light casts a shadow.
     float3 shadowFactor = float3(1.0f, 1.0f, 1.0f);
-    shadowFactor[0] = CalcShadowFactor(pin.ShadowPosH);
+    shadowFactor[0] = CalcCascadeShadowFactor(pin.PosW);
+#endif
+
+    // Light terms.
+    float4 ambient = ambientAccess * gAmbientLight * diffuseAlbedo;
 
     float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
@@ -1,4 +1,5 @@
 #define MaxLights 16
+#define MaxCascades 4
 
 static const float PI = 3.14159265f;
 static const float INVPI = 1.0f / PI;
@@ -0,0 +1,124 @@
+// Benchmark of building and querying the BVH over a large scene of instance boxes. The query results
+// are compared to brute force tests so a wrong tree fails the run.
+// Usage: bvh_benchmark [instance count], 1000000 by default.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+#include "utility/bvh.h"
+#include "utility/stringprint.h"
+#include "testcheck.h"
+
+using namespace handwork;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Instances spread over a wide and flat area, like objects placed on terrain.
+	std::vector<Bounds3f> MakeInstances(int count)
+	{
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> size(0.1f, 2.0f);
+		std::vector<Bounds3f> bounds(count);
+		for (int i = 0; i < count; ++i)
+		{
+			Vector3f center(position(rng), 0.1f * position(rng), position(rng));
+			float r = size(rng);
+			bounds[i] = Bounds3f(center - Vector3f(r, r, r), center + Vector3f(r, r, r));
+		}
+		return bounds;
+	}
+}	// namespace
+
+int main(int argc, char* argv[])
+{
+	int count = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 1000000;
+	std::vector<Bounds3f> bounds = MakeInstances(count);
+
+	BVH bvh;
+	Clock::time_point start = Clock::now();
+	bvh.Build(bounds);
+	double buildTime = MillisecondsSince(start);
+	LOG(INFO) << StringPrintf("Built %d instances in %.1f ms, %d nodes, depth %d.",
+		count, buildTime, bvh.NodeCount(), bvh.MaxDepth());
+
+	// Camera above the middle of the scene looking along the ground.
+	Transform view = LookAt(Vector3f(0.0f, 20.0f, -50.0f), Vector3f(0.0f, 0.0f, 100.0f), Vector3f(0.0f, 1.0f, 0.0f));
+	Frustum frustum = ExtractFrustum((Perspective(60.0f, 0.5f, 300.0f, 16.0f / 9.0f) * view).GetMatrix());
+	const int repeats = 10;
+	std::vector<int> result;
+	start = Clock::now();
+	for (int k = 0; k < repeats; ++k)
+	{
+		result.clear();
+		bvh.QueryFrustum(frustum, result);
+	}
+	double frustumTime = MillisecondsSince(start) / repeats;
+	std::vector<int> expected;
+	start = Clock::now();
+	for (int i = 0; i < count; ++i)
+	{
+		if (Intersects(frustum, bounds[i]))
+			expected.push_back(i);
+	}
+	double bruteFrustumTime = MillisecondsSince(start);
+	std::sort(result.begin(), result.end());
+	EXPECT_TRUE(result == expected);
+	LOG(INFO) << StringPrintf("Frustum query: %d visible in %.2f ms, brute force %.2f ms.",
+		(int)result.size(), frustumTime, bruteFrustumTime);
+
+	Bounds3f region(Vector3f(-20.0f, -20.0f, -20.0f), Vector3f(20.0f, 20.0f, 20.0f));
+	start = Clock::now();
+	for (int k = 0; k < repeats; ++k)
+	{
+		result.clear();
+		bvh.QueryBounds(region, result);
+	}
+	double boundsTime = MillisecondsSince(start) / repeats;
+	int overlapping = 0;
+	for (int i = 0; i < count; ++i)
+		overlapping += Overlaps(bounds[i], region);
+	EXPECT_EQ((int)result.size(), overlapping);
+	LOG(INFO) << StringPrintf("Box query: %d overlapping in %.3f ms.", (int)result.size(), boundsTime);
+
+	// Rays straight down onto the scene.
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	const int rayCount = 10000;
+	int hits = 0;
+	start = Clock::now();
+	for (int k = 0; k < rayCount; ++k)
+	{
+		Vector3f origin(position(rng), 100.0f, position(rng));
+		hits += bvh.IntersectRay(origin, Vector3f(0.0f, -1.0f, 0.0f), 1000.0f) >= 0;
+	}
+	LOG(INFO) << StringPrintf("%d rays: %d hits in %.2f ms.", rayCount, hits, MillisecondsSince(start));
+
+	// Move everything up and refit.
+	for (Bounds3f& b : bounds)
+	{
+		b.pMin.y += 1.0f;
+		b.pMax.y += 1.0f;
+	}
+	start = Clock::now();
+	bvh.Refit(bounds);
+	double refitTime = MillisecondsSince(start);
+	result.clear();
+	bvh.QueryBounds(region, result);
+	overlapping = 0;
+	for (int i = 0; i < count; ++i)
+		overlapping += Overlaps(bounds[i], region);
+	EXPECT_EQ((int)result.size(), overlapping);
+	LOG(INFO) << StringPrintf("Refit in %.1f ms.", refitTime);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,136 @@
+// Tests of the frustum extraction and of the box tests, the batched one against the single box one.
+
+#include "utility/culling.h"
+#include "testcheck.h"
+#include <random>
+
+using namespace handwork;
+
+namespace
+{
+	Matrix4x4 TestViewProj()
+	{
+		Transform view = LookAt(Vector3f(3.0f, 2.0f, -8.0f), Vector3f(0.0f, 0.5f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f));
+		Transform proj = Perspective(60.0f, 0.5f, 40.0f, 1.5f);
+		return (proj * view).GetMatrix();
+	}
+
+	float PlaneDistance(const Vector4f& plane, const Vector3f& p)
+	{
+		return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+	}
+
+	// Inside test in clip space, -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+	bool InsideClip(const Matrix4x4& m, const Vector3f& p)
+	{
+		float c[4];
+		for (int i = 0; i < 4; ++i)
+			c[i] = m.m[i][0] * p.x + m.m[i][1] * p.y + m.m[i][2] * p.z + m.m[i][3];
+		return c[3] > 0.0f && std::abs(c[0]) <= c[3] && std::abs(c[1]) <= c[3] && c[2] >= 0.0f && c[2] <= c[3];
+	}
+
+	Bounds3f RandomBox(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+		std::uniform_real_distribution<float> size(0.0f, 6.0f);
+		Vector3f p(position(rng), position(rng), position(rng));
+		return Bounds3f(p, p + Vector3f(size(rng), size(rng), size(rng)));
+	}
+
+	void TestExtractFrustum(std::mt19937& rng)
+	{
+		Matrix4x4 viewProj = TestViewProj();
+		Frustum frustum = ExtractFrustum(viewProj);
+		for (int i = 0; i < Frustum::PlaneCount; ++i)
+		{
+			const Vector4f& p = frustum.Planes[i];
+			EXPECT_NEAR(p.x * p.x + p.y * p.y + p.z * p.z, 1.0f, 1e-5f);
+		}
+
+		std::uniform_real_distribution<float> position(-45.0f, 45.0f);
+		int inside = 0, mismatches = 0;
+		for (int k = 0; k < 20000; ++k)
+		{
+			Vector3f p(position(rng), position(rng), position(rng));
+			bool inPlanes = true, nearPlane = false;
+			for (int i = 0; i < Frustum::PlaneCount; ++i)
+			{
+				float d = PlaneDistance(frustum.Planes[i], p);
+				inPlanes = inPlanes && d >= 0.0f;
+				nearPlane = nearPlane || std::abs(d) < 1e-3f;
+			}
+			// Points on a plane may go either way with rounding.
+			if (nearPlane)
+				continue;
+			mismatches += inPlanes != InsideClip(viewProj, p);
+			inside += inPlanes;
+		}
+		EXPECT_EQ(mismatches, 0);
+		EXPECT_TRUE(inside > 100);
+	}
+
+	void TestIntersects(std::mt19937& rng)
+	{
+		Matrix4x4 viewProj = TestViewProj();
+		Frustum frustum = ExtractFrustum(viewProj);
+		Vector3f eye(3.0f, 2.0f, -8.0f);
+		Vector3f dir = Normalize(Vector3f(0.0f, 0.5f, 0.0f) - eye);
+
+		// A box on the view axis is visible, the same box behind the camera or past the far plane is not.
+		Vector3f half(0.5f, 0.5f, 0.5f);
+		EXPECT_TRUE(Intersects(frustum, Bounds3f(eye + dir * 10.0f - half, eye + dir * 10.0f + half)));
+		EXPECT_TRUE(!Intersects(frustum, Bounds3f(eye - dir * 10.0f - half, eye - dir * 10.0f + half)));
+		EXPECT_TRUE(!Intersects(frustum, Bounds3f(eye + dir * 45.0f - half, eye + dir * 45.0f + half)));
+		EXPECT_TRUE(!Intersects(frustum, Bounds3f()));
+
+		// Conservative, a box with any point inside the frustum is never rejected.
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		int rejectedVisible = 0;
+		for (int k = 0; k < 5000; ++k)
+		{
+			Bounds3f box = RandomBox(rng);
+			if (Intersects(frustum, box))
+				continue;
+			for (int s = 0; s < 64; ++s)
+			{
+				Vector3f t(unit(rng), unit(rng), unit(rng));
+				Vector3f p = box.pMin + Vector3f(t.x * (box.pMax.x - box.pMin.x),
+					t.y * (box.pMax.y - box.pMin.y), t.z * (box.pMax.z - box.pMin.z));
+				rejectedVisible += InsideClip(viewProj, p);
+			}
+		}
+		EXPECT_EQ(rejectedVisible, 0);
+	}
+
+	void TestCullBounds(std::mt19937& rng)
+	{
+		Frustum frustum = ExtractFrustum(TestViewProj());
+		// Counts around the batch size and one that leaves a partial last batch.
+		for (int count : { 0, 1, 7, 8, 9, 17, 1003 })
+		{
+			BoundsSoA soa;
+			soa.Resize(count);
+			std::vector<int> expected;
+			for (int i = 0; i < count; ++i)
+			{
+				Bounds3f box = RandomBox(rng);
+				soa.Set(i, box);
+				if (Intersects(frustum, box))
+					expected.push_back(i);
+			}
+			std::vector<int> visible(count);
+			int numVisible = CullBounds(frustum, soa, visible.data());
+			visible.resize(numVisible);
+			EXPECT_TRUE(visible == expected);
+		}
+	}
+}	// namespace
+
+int main()
+{
+	std::mt19937 rng(3);
+	TestExtractFrustum(rng);
+	TestIntersects(rng);
+	TestCullBounds(rng);
+	return TEST_RESULT();
+}
@@ -0,0 +1,92 @@
+// Tests of the depth read back conversions against scalar references, with sizes that are not
+// multiples of the SIMD width so the vector loops and the scalar tails both run.
+
+#include "rendering/depthutil.h"
+#include "testcheck.h"
+#include <cstring>
+#include <random>
+
+using namespace handwork;
+using namespace handwork::rendering;
+
+namespace
+{
+	void TestUnpackDepth24(std::mt19937& rng)
+	{
+		const UINT height = 3;
+		for (UINT width = 1; width <= 13; ++width)
+		{
+			// Rows padded past the texels, stencil bits set to garbage.
+			UINT pitch = width * 4 + 12;
+			std::vector<BYTE> texels((size_t)pitch * height);
+			for (BYTE& b : texels)
+				b = (BYTE)rng();
+			std::vector<float> unpacked((size_t)width * height, -1.0f);
+			depth::UnpackDepth24(texels.data(), width, height, pitch, unpacked.data());
+
+			bool matches = true;
+			for (UINT y = 0; y < height; ++y)
+			{
+				for (UINT x = 0; x < width; ++x)
+				{
+					uint32_t texel;
+					memcpy(&texel, &texels[(size_t)y * pitch + x * 4], sizeof(texel));
+					float reference = (float)(texel & 0xffffff) * (1.0f / 16777215.0f);
+					matches = matches && unpacked[(size_t)y * width + x] == reference;
+				}
+			}
+			EXPECT_TRUE(matches);
+		}
+
+		// The ends of the range map to exactly 0 and 1.
+		uint32_t ends[2] = { 0xff000000u, 0x00ffffffu };
+		float unpacked[2];
+		depth::UnpackDepth24(reinterpret_cast<const BYTE*>(ends), 2, 1, sizeof(ends), unpacked);
+		EXPECT_EQ(unpacked[0], 0.0f);
+		EXPECT_EQ(unpacked[1], 1.0f);
+	}
+
+	void TestLinearizeDepth(std::mt19937& rng)
+	{
+		const float nearZ = 0.1f, farZ = 100.0f;
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		for (size_t count : { (size_t)1, (size_t)3, (size_t)4, (size_t)7, (size_t)1003 })
+		{
+			std::vector<float> device(count);
+			for (float& d : device)
+				d = uniform(rng);
+			device[count - 1] = 1.0f;
+			std::vector<float> view(count);
+			depth::LinearizeDepth(device.data(), view.data(), count, nearZ, farZ);
+
+			bool matches = true;
+			double maxError = 0.0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				float reference = farZ * nearZ / (farZ - device[i] * (farZ - nearZ));
+				matches = matches && view[i] == reference;
+				// Toward the far plane the denominator cancels and float loses digits, the scalar
+				// comparison above covers that part.
+				double exact = (double)farZ * nearZ / (farZ - (double)device[i] * (farZ - nearZ));
+				if (exact < 0.5 * farZ)
+					maxError = std::max(maxError, std::abs(view[i] - exact) / exact);
+			}
+			EXPECT_TRUE(matches);
+			EXPECT_TRUE(maxError < 1e-5);
+			// Empty pixels end up at the far plane.
+			EXPECT_NEAR(view[count - 1], farZ, 1e-2f);
+
+			// In place gives the same result.
+			depth::LinearizeDepth(device.data(), device.data(), count, nearZ, farZ);
+			EXPECT_TRUE(device == view);
+		}
+	}
+}	// namespace
+
+int main()
+{
+	std::mt19937 rng(11);
+	TestUnpackDepth24(rng);
+	TestLinearizeDepth(rng);
+	return TEST_RESULT();
+}
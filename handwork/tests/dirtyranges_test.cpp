@@ -0,0 +1,114 @@
+// Randomized test of DirtyRanges against a bitset of the dirty elements.
+
+#include "utility/dirtyranges.h"
+#include "testcheck.h"
+#include <algorithm>
+#include <bitset>
+#include <random>
+
+using namespace handwork;
+
+namespace
+{
+	const uint32_t ElementCount = 512;
+	typedef std::bitset<ElementCount> Elements;
+
+	// Maximal runs of set elements, merged across gaps of at most maxGap clear ones.
+	std::vector<DirtyRange> ReferenceRanges(const Elements& dirty, uint32_t maxGap)
+	{
+		std::vector<DirtyRange> ranges;
+		for (uint32_t i = 0; i < ElementCount; ++i)
+		{
+			if (!dirty[i])
+				continue;
+			if (!ranges.empty() && i - ranges.back().End <= maxGap)
+				ranges.back().End = i + 1;
+			else
+				ranges.push_back({ i, i + 1 });
+		}
+		return ranges;
+	}
+
+	bool Matches(const DirtyRanges& ranges, const std::vector<DirtyRange>& reference)
+	{
+		if (ranges.Size() != reference.size())
+			return false;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			if (ranges[i].Begin != reference[i].Begin || ranges[i].End != reference[i].End)
+				return false;
+		}
+		return true;
+	}
+
+	void TestAgainstBitset(std::mt19937& rng)
+	{
+		for (int trial = 0; trial < 5000; ++trial)
+		{
+			DirtyRanges ranges;
+			Elements dirty;
+			int adds = rng() % 40;
+			// Some trials mark in increasing order like the renderer does, which takes the fast path.
+			bool increasing = trial % 4 == 0;
+			uint32_t cursor = 0;
+			for (int k = 0; k < adds; ++k)
+			{
+				uint32_t begin = increasing ? cursor + rng() % 8 : rng() % ElementCount;
+				uint32_t length = rng() % 3 == 0 ? 1 : rng() % 24;
+				begin = std::min(begin, ElementCount);
+				uint32_t end = std::min(begin + length, ElementCount);
+				cursor = end;
+				ranges.Add(begin, end);
+				for (uint32_t i = begin; i < end; ++i)
+					dirty.set(i);
+			}
+
+			// Ranges are sorted, disjoint and not adjacent, so they match the runs of the bitset.
+			EXPECT_TRUE(Matches(ranges, ReferenceRanges(dirty, 0)));
+			EXPECT_EQ(ranges.ElementCount(), (uint32_t)dirty.count());
+			EXPECT_EQ(ranges.Empty(), dirty.none());
+
+			uint32_t maxGap = rng() % 6;
+			ranges.Coalesce(maxGap);
+			EXPECT_TRUE(Matches(ranges, ReferenceRanges(dirty, maxGap)));
+
+			ranges.Clear();
+			EXPECT_TRUE(ranges.Empty());
+			if (handwork::test::Failures() > 0)
+				return;
+		}
+	}
+
+	void TestEdgeCases()
+	{
+		DirtyRanges ranges;
+		ranges.Add(5, 5);
+		ranges.Add(7, 3);
+		EXPECT_TRUE(ranges.Empty());
+
+		// Touching ranges merge, ranges one element apart do not.
+		ranges.Add(10, 20);
+		ranges.Add(20, 30);
+		ranges.Add(0, 9);
+		EXPECT_EQ(ranges.Size(), 2u);
+		EXPECT_EQ(ranges[0].End, 9u);
+		EXPECT_EQ(ranges[1].Begin, 10u);
+		EXPECT_EQ(ranges[1].End, 30u);
+
+		// A range covering several others replaces them.
+		ranges.Add(40, 50);
+		ranges.Add(60, 70);
+		ranges.Add(8, 65);
+		EXPECT_EQ(ranges.Size(), 1u);
+		EXPECT_EQ(ranges[0].Begin, 0u);
+		EXPECT_EQ(ranges[0].End, 70u);
+	}
+}	// namespace
+
+int main()
+{
+	std::mt19937 rng(7);
+	TestEdgeCases();
+	TestAgainstBitset(rng);
+	return TEST_RESULT();
+}
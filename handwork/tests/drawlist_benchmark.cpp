@@ -0,0 +1,87 @@
+// Benchmark of building draw keys and sorting a draw list, compared with std::stable_sort on the
+// same keys. The sorted lists must agree so a wrong sort fails the run.
+// Usage: drawlist_benchmark [draw count], 100000 by default.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+#include "utility/drawlist.h"
+#include "utility/stringprint.h"
+#include "testcheck.h"
+
+using namespace handwork;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// State of one draw as the renderer sees it before the key is built.
+	struct DrawState
+	{
+		uint32_t Pipeline;
+		uint32_t Geometry;
+		uint32_t Material;
+		float ViewDepth;
+	};
+}	// namespace
+
+int main(int argc, char* argv[])
+{
+	int count = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 100000;
+	const float nearZ = 0.1f, farZ = 1000.0f;
+
+	// A scene of a few pipelines and many meshes and materials, all in one layer.
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> depth(nearZ, farZ);
+	std::vector<DrawState> draws(count);
+	for (DrawState& d : draws)
+		d = { (uint32_t)(rng() % 6), (uint32_t)(rng() % 2000), (uint32_t)(rng() % 500), depth(rng) };
+
+	const int frames = 10;
+	DrawList list;
+	double buildTime = 0.0, sortTime = 0.0;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		Clock::time_point start = Clock::now();
+		list.Clear();
+		list.Reserve(count);
+		for (int i = 0; i < count; ++i)
+		{
+			const DrawState& d = draws[i];
+			list.Add(DrawKey::Make(0, d.Pipeline, d.Geometry, d.Material,
+				DrawKey::DepthBucket(d.ViewDepth, nearZ, farZ)), (uint32_t)i);
+		}
+		buildTime += MillisecondsSince(start);
+		start = Clock::now();
+		list.Sort();
+		sortTime += MillisecondsSince(start);
+	}
+
+	std::vector<std::pair<uint64_t, uint32_t>> reference(count);
+	for (int i = 0; i < count; ++i)
+	{
+		const DrawState& d = draws[i];
+		reference[i] = { DrawKey::Make(0, d.Pipeline, d.Geometry, d.Material,
+			DrawKey::DepthBucket(d.ViewDepth, nearZ, farZ)), (uint32_t)i };
+	}
+	Clock::time_point start = Clock::now();
+	std::stable_sort(reference.begin(), reference.end(),
+		[](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) { return a.first < b.first; });
+	double referenceTime = MillisecondsSince(start);
+
+	bool matches = list.Size() == reference.size();
+	for (size_t i = 0; matches && i < reference.size(); ++i)
+		matches = list.Key(i) == reference[i].first && list.Payload(i) == reference[i].second;
+	EXPECT_TRUE(matches);
+
+	LOG(INFO) << StringPrintf("%d draws: keys built in %.2f ms, radix sort %.2f ms, std::stable_sort %.2f ms.",
+		count, buildTime / frames, sortTime / frames, referenceTime);
+	return TEST_RESULT();
+}
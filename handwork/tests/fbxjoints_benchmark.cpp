@@ -0,0 +1,141 @@
+// Benchmark of the joint bookkeeping of the FBX importer on a synthetic rig: cluster name lookups
+// through the joint index map against the linear scan they replaced, and the in place compaction
+// against a copying one. Both pairs must agree so a wrong lookup or compaction fails the run.
+// Usage: fbxjoints_benchmark [joint count], 2000 by default.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+#include "mesh/skeletonjoints.h"
+#include "utility/stringprint.h"
+#include "testcheck.h"
+
+using namespace handwork;
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Lookup of the importer before the joint index map.
+	int FindJointLinear(const std::string& name, const std::vector<JointInfo>& skeletonInfo)
+	{
+		for (int i = 0; i < (int)skeletonInfo.size(); ++i)
+		{
+			if (skeletonInfo[i].Name == name)
+				return i;
+		}
+		return -1;
+	}
+
+	// Copy the kept joints to a new array, dropping invalid ones and everything below them.
+	std::vector<JointInfo> CompactJointsByCopy(const std::vector<JointInfo>& skeletonInfo, std::vector<int>& newPos)
+	{
+		std::vector<JointInfo> compacted;
+		newPos.assign(skeletonInfo.size(), -1);
+		for (int i = 0; i < (int)skeletonInfo.size(); ++i)
+		{
+			JointInfo joint = skeletonInfo[i];
+			if (!joint.Valid || (joint.Parent >= 0 && newPos[joint.Parent] < 0))
+				continue;
+			if (joint.Parent >= 0)
+				joint.Parent = newPos[joint.Parent];
+			newPos[i] = (int)compacted.size();
+			compacted.push_back(joint);
+		}
+		return compacted;
+	}
+
+	// Joints in depth first order like the importer reads them. Each joint hangs below a recent
+	// one, which gives chains of limbs and fingers.
+	std::vector<JointInfo> MakeRig(int count, std::mt19937& rng)
+	{
+		std::vector<JointInfo> skeletonInfo(count);
+		for (int i = 0; i < count; ++i)
+		{
+			skeletonInfo[i].Name = StringPrintf("rig:joint_%d", i);
+			skeletonInfo[i].Parent = i == 0 ? -1 : std::max(0, i - 1 - (int)(rng() % 8));
+		}
+		return skeletonInfo;
+	}
+}	// namespace
+
+int main(int argc, char* argv[])
+{
+	int jointCount = argc > 1 ? std::max(std::atoi(argv[1]), 2) : 2000;
+	std::mt19937 rng(9);
+	std::vector<JointInfo> skeletonInfo = MakeRig(jointCount, rng);
+
+	// Several skinned meshes, each with clusters on the root and most other joints plus a name
+	// the skeleton does not have.
+	const int meshCount = 8;
+	std::vector<std::string> clusterNames;
+	size_t firstMeshClusters = 0;
+	for (int m = 0; m < meshCount; ++m)
+	{
+		for (int i = 0; i < jointCount; ++i)
+		{
+			if (i == 0 || rng() % 64 != 0)
+				clusterNames.push_back(skeletonInfo[i].Name);
+		}
+		clusterNames.push_back(StringPrintf("rig:helper_%d", m));
+		if (m == 0)
+			firstMeshClusters = clusterNames.size();
+	}
+
+	Clock::time_point start = Clock::now();
+	JointIndexMap jointIndices;
+	BuildJointIndexMap(skeletonInfo, jointIndices);
+	std::vector<int> mapped(clusterNames.size());
+	for (size_t i = 0; i < clusterNames.size(); ++i)
+		mapped[i] = FindJoint(clusterNames[i], jointIndices);
+	double mapTime = MillisecondsSince(start);
+
+	start = Clock::now();
+	std::vector<int> scanned(clusterNames.size());
+	for (size_t i = 0; i < clusterNames.size(); ++i)
+		scanned[i] = FindJointLinear(clusterNames[i], skeletonInfo);
+	double scanTime = MillisecondsSince(start);
+	EXPECT_TRUE(mapped == scanned);
+	LOG(INFO) << StringPrintf("%d joints, %d cluster lookups: joint index map %.2f ms, linear scan %.2f ms.",
+		jointCount, (int)clusterNames.size(), mapTime, scanTime);
+
+	// Validate the joints bound by the first mesh only. The others stay invalid and drop their
+	// subtrees.
+	for (size_t i = 0; i < firstMeshClusters; ++i)
+	{
+		if (mapped[i] >= 0)
+			skeletonInfo[mapped[i]].Valid = true;
+	}
+
+	std::vector<int> referencePos;
+	start = Clock::now();
+	std::vector<JointInfo> reference = CompactJointsByCopy(skeletonInfo, referencePos);
+	double copyTime = MillisecondsSince(start);
+
+	std::vector<int> newPos;
+	start = Clock::now();
+	int validCount = CompactJoints(skeletonInfo, newPos);
+	double compactTime = MillisecondsSince(start);
+
+	EXPECT_EQ(validCount, (int)reference.size());
+	EXPECT_TRUE(newPos == referencePos);
+	bool matches = (int)skeletonInfo.size() == validCount;
+	for (int i = 0; matches && i < validCount; ++i)
+	{
+		matches = skeletonInfo[i].Name == reference[i].Name && skeletonInfo[i].Parent == reference[i].Parent &&
+			skeletonInfo[i].Valid;
+	}
+	EXPECT_TRUE(matches);
+	EXPECT_TRUE(validCount > 0 && validCount < jointCount);
+	LOG(INFO) << StringPrintf("Compacted to %d joints: in place %.3f ms, copying %.3f ms.",
+		validCount, compactTime, copyTime);
+
+	return TEST_RESULT();
+}
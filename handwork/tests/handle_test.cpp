@@ -0,0 +1,73 @@
+// Tests of the generation checks of HandlePool, across Remove and Clear.
+
+#include "utility/handle.h"
+#include "testcheck.h"
+
+using namespace handwork;
+
+namespace
+{
+	struct Item
+	{
+		explicit Item(int value) : Value(value) {}
+		int Value;
+	};
+
+	void TestAddRemove()
+	{
+		HandlePool<Item> pool;
+		Handle<Item> a = pool.Add(std::unique_ptr<Item>(new Item(1)));
+		Handle<Item> b = pool.Add(std::unique_ptr<Item>(new Item(2)));
+		EXPECT_EQ(pool.Size(), 2u);
+		EXPECT_EQ(pool.Get(a)->Value, 1);
+		EXPECT_EQ(pool.Get(b)->Value, 2);
+		EXPECT_TRUE(pool.Get(Handle<Item>()) == nullptr);
+
+		std::unique_ptr<Item> removed = pool.Remove(a);
+		EXPECT_EQ(removed->Value, 1);
+		EXPECT_TRUE(pool.Get(a) == nullptr);
+		EXPECT_TRUE(pool.Remove(a) == nullptr);
+
+		// The freed slot is reused under a new generation.
+		Handle<Item> c = pool.Add(std::unique_ptr<Item>(new Item(3)));
+		EXPECT_EQ(c.Index, a.Index);
+		EXPECT_TRUE(c != a);
+		EXPECT_TRUE(pool.Get(a) == nullptr);
+		EXPECT_EQ(pool.Get(c)->Value, 3);
+	}
+
+	void TestClear()
+	{
+		HandlePool<Item> pool;
+		std::vector<Handle<Item>> before;
+		for (int i = 0; i < 4; ++i)
+			before.push_back(pool.Add(std::unique_ptr<Item>(new Item(i))));
+		pool.Remove(before[2]);
+
+		// Like a device loss, everything is released and the scene is added again.
+		pool.Clear();
+		EXPECT_EQ(pool.Size(), 0u);
+		for (const Handle<Item>& h : before)
+			EXPECT_TRUE(pool.Get(h) == nullptr);
+
+		std::vector<Handle<Item>> after;
+		for (int i = 0; i < 4; ++i)
+			after.push_back(pool.Add(std::unique_ptr<Item>(new Item(10 + i))));
+		EXPECT_EQ(pool.Size(), 4u);
+		EXPECT_EQ(pool.SlotCount(), 4u);
+		for (int i = 0; i < 4; ++i)
+		{
+			// Slots are filled from the front again, but old handles do not reach the new objects.
+			EXPECT_EQ(after[i].Index, (uint32_t)i);
+			EXPECT_TRUE(pool.Get(before[i]) == nullptr);
+			EXPECT_EQ(pool.Get(after[i])->Value, 10 + i);
+		}
+	}
+}	// namespace
+
+int main()
+{
+	TestAddRemove();
+	TestClear();
+	return TEST_RESULT();
+}
@@ -0,0 +1,262 @@
+// Tests of the render graph compiler: culling, transient aliasing, dependencies and barriers.
+
+#include "utility/rendergraph.h"
+#include "testcheck.h"
+#include <algorithm>
+
+using namespace handwork;
+
+typedef GraphResourceState State;
+
+namespace
+{
+	std::vector<uint32_t> Sorted(std::vector<uint32_t> values)
+	{
+		std::sort(values.begin(), values.end());
+		return values;
+	}
+
+	bool HasBarrier(const std::vector<GraphBarrier>& barriers, uint32_t resource, State before, State after)
+	{
+		for (const GraphBarrier& b : barriers)
+		{
+			if (b.Resource == resource && b.Before == before && b.After == after)
+				return true;
+		}
+		return false;
+	}
+
+	// The frame of the D3D12 renderer: shadow map, normal and depth, SSAO with three blur rounds
+	// ping-ponging between equal ambient maps, then the main pass.
+	struct Frame
+	{
+		RenderGraph Graph;
+		uint32_t ShadowMap, NormalMap, Depth, Target;
+		uint32_t Ambient[7];
+		uint32_t ShadowPass, NormalDepthPass, SsaoPass, MainPass;
+		uint32_t BlurPasses[6];
+
+		explicit Frame(bool lit)
+		{
+			ShadowMap = Graph.ImportResource("shadowMap", State::ShaderRead);
+			NormalMap = Graph.ImportResource("normalMap", State::ShaderRead);
+			Depth = Graph.ImportResource("depth", State::DepthWrite, true);
+			Target = Graph.ImportResource("target", State::RenderTarget, true);
+
+			ShadowPass = Graph.AddPass("shadow", nullptr);
+			Graph.Write(ShadowPass, ShadowMap, State::DepthWrite, true);
+			NormalDepthPass = Graph.AddPass("normalDepth", nullptr);
+			Graph.Write(NormalDepthPass, NormalMap, State::RenderTarget, true);
+			Graph.Write(NormalDepthPass, Depth, State::DepthWrite, true);
+
+			TransientDesc desc;
+			desc.Width = 640;
+			desc.Height = 360;
+			desc.Format = 56;
+			desc.State = State::ShaderRead;
+			Ambient[0] = Graph.CreateTransient("ambient0", desc);
+			SsaoPass = Graph.AddPass("ssao", nullptr);
+			Graph.Read(SsaoPass, NormalMap, State::ShaderRead);
+			Graph.Read(SsaoPass, Depth, State::DepthRead);
+			Graph.Write(SsaoPass, Ambient[0], State::RenderTarget, true);
+			for (int i = 0; i < 6; ++i)
+			{
+				Ambient[i + 1] = Graph.CreateTransient("ambient" + std::to_string(i + 1), desc);
+				BlurPasses[i] = Graph.AddPass(i % 2 == 0 ? "blurH" : "blurV", nullptr);
+				Graph.Read(BlurPasses[i], NormalMap, State::ShaderRead);
+				Graph.Read(BlurPasses[i], Depth, State::DepthRead);
+				Graph.Read(BlurPasses[i], Ambient[i], State::ShaderRead);
+				Graph.Write(BlurPasses[i], Ambient[i + 1], State::RenderTarget, true);
+			}
+
+			// The lit main pass keeps the depth of the normal pass, the unlit one clears it.
+			MainPass = Graph.AddPass("main", nullptr);
+			Graph.Write(MainPass, Target, State::RenderTarget, true);
+			if (lit)
+			{
+				Graph.Read(MainPass, Depth, State::DepthWrite);
+				Graph.Write(MainPass, Depth, State::DepthWrite);
+				Graph.Read(MainPass, ShadowMap, State::ShaderRead);
+				Graph.Read(MainPass, Ambient[6], State::ShaderRead);
+			}
+			else
+			{
+				Graph.Write(MainPass, Depth, State::DepthWrite, true);
+			}
+		}
+	};
+
+	void TestCullOnClear()
+	{
+		// A clear ends the contents written before, so a pass whose only output is cleared later is
+		// culled, while a later write that loads the contents keeps it.
+		for (bool clear : { true, false })
+		{
+			RenderGraph graph;
+			uint32_t target = graph.ImportResource("target", State::RenderTarget, true);
+			uint32_t first = graph.AddPass("first", nullptr);
+			graph.Write(first, target, State::RenderTarget, true);
+			uint32_t second = graph.AddPass("second", nullptr);
+			graph.Write(second, target, State::RenderTarget, clear);
+			EXPECT_TRUE(graph.Compile());
+			EXPECT_EQ(graph.IsPassActive(first), !clear);
+			EXPECT_TRUE(graph.IsPassActive(second));
+			EXPECT_EQ(graph.GetCulledPassCount(), clear ? 1u : 0u);
+		}
+
+		// Writes to resources that are not outputs and never read are culled, unless the pass has side
+		// effects.
+		RenderGraph graph;
+		uint32_t scratch = graph.ImportResource("scratch", State::Common);
+		uint32_t unused = graph.AddPass("unused", nullptr);
+		graph.Write(unused, scratch, State::CopyDest, true);
+		uint32_t sideEffect = graph.AddPass("sideEffect", nullptr, true);
+		graph.Write(sideEffect, scratch, State::CopyDest, true);
+		EXPECT_TRUE(graph.Compile());
+		EXPECT_TRUE(!graph.IsPassActive(unused));
+		EXPECT_TRUE(graph.IsPassActive(sideEffect));
+
+		// Without shadows and SSAO only the main pass is left, it clears both outputs.
+		Frame unlit(false);
+		EXPECT_TRUE(unlit.Graph.Compile());
+		EXPECT_EQ(unlit.Graph.GetActivePassCount(), 1u);
+		EXPECT_TRUE(unlit.Graph.IsPassActive(unlit.MainPass));
+		EXPECT_TRUE(!unlit.Graph.IsPassActive(unlit.NormalDepthPass));
+		for (uint32_t ambient : unlit.Ambient)
+			EXPECT_EQ(unlit.Graph.GetPhysicalResource(ambient), RenderGraph::Invalid);
+	}
+
+	void TestAmbientAliasing()
+	{
+		Frame frame(true);
+		RenderGraph& graph = frame.Graph;
+		EXPECT_TRUE(graph.Compile());
+		EXPECT_EQ(graph.GetCulledPassCount(), 0u);
+
+		// The ping-pong of seven ambient maps fits into two physical maps besides the four imports.
+		EXPECT_EQ(graph.GetPhysicalResourceCount(), 6u);
+		uint32_t even = graph.GetPhysicalResource(frame.Ambient[0]);
+		uint32_t odd = graph.GetPhysicalResource(frame.Ambient[1]);
+		EXPECT_TRUE(even != odd);
+		EXPECT_TRUE(even >= 4 && odd >= 4);
+		for (int i = 0; i < 7; ++i)
+			EXPECT_EQ(graph.GetPhysicalResource(frame.Ambient[i]), i % 2 == 0 ? even : odd);
+		EXPECT_EQ(graph.GetPhysicalResource(frame.Depth), frame.Depth);
+
+		// Different descriptions never alias.
+		RenderGraph mixed;
+		TransientDesc a, b;
+		a.Width = b.Width = 64;
+		a.Height = b.Height = 64;
+		a.Format = 1;
+		b.Format = 2;
+		uint32_t target = mixed.ImportResource("target", State::RenderTarget, true);
+		uint32_t ta = mixed.CreateTransient("a", a);
+		uint32_t tb = mixed.CreateTransient("b", b);
+		uint32_t pa = mixed.AddPass("a", nullptr);
+		mixed.Write(pa, ta, State::RenderTarget, true);
+		uint32_t pb = mixed.AddPass("b", nullptr);
+		mixed.Read(pb, ta, State::ShaderRead);
+		mixed.Write(pb, tb, State::RenderTarget, true);
+		uint32_t pc = mixed.AddPass("c", nullptr);
+		mixed.Read(pc, tb, State::ShaderRead);
+		mixed.Write(pc, target, State::RenderTarget, true);
+		EXPECT_TRUE(mixed.Compile());
+		EXPECT_TRUE(mixed.GetPhysicalResource(ta) != mixed.GetPhysicalResource(tb));
+	}
+
+	void TestDependenciesAndBarriers()
+	{
+		Frame frame(true);
+		RenderGraph& graph = frame.Graph;
+		EXPECT_TRUE(graph.Compile());
+		uint32_t even = graph.GetPhysicalResource(frame.Ambient[0]);
+		uint32_t odd = graph.GetPhysicalResource(frame.Ambient[1]);
+
+		std::vector<uint32_t> order = graph.GetExecutionOrder();
+		EXPECT_EQ(order.size(), 10u);
+		EXPECT_EQ(order.front(), frame.ShadowPass);
+		EXPECT_EQ(order.back(), frame.MainPass);
+
+		// Readers wait for the writers of what they read, writers also for the earlier readers and
+		// writers of the physical resources they write.
+		EXPECT_TRUE(graph.GetDependencies(frame.ShadowPass).empty());
+		EXPECT_TRUE(graph.GetDependencies(frame.NormalDepthPass).empty());
+		EXPECT_TRUE(Sorted(graph.GetDependencies(frame.SsaoPass)) == std::vector<uint32_t>({ frame.NormalDepthPass }));
+		EXPECT_TRUE(Sorted(graph.GetDependencies(frame.BlurPasses[0])) ==
+			std::vector<uint32_t>({ frame.NormalDepthPass, frame.SsaoPass }));
+		EXPECT_TRUE(Sorted(graph.GetDependencies(frame.BlurPasses[2])) ==
+			std::vector<uint32_t>({ frame.NormalDepthPass, frame.BlurPasses[0], frame.BlurPasses[1] }));
+		// The main pass writes the depth the SSAO passes read.
+		std::vector<uint32_t> mainDependencies = { frame.ShadowPass, frame.NormalDepthPass, frame.SsaoPass };
+		mainDependencies.insert(mainDependencies.end(), frame.BlurPasses, frame.BlurPasses + 6);
+		EXPECT_TRUE(Sorted(graph.GetDependencies(frame.MainPass)) == Sorted(mainDependencies));
+
+		const std::vector<GraphBarrier>& shadow = graph.GetBarriers(frame.ShadowPass);
+		EXPECT_EQ(shadow.size(), 1u);
+		EXPECT_TRUE(HasBarrier(shadow, frame.ShadowMap, State::ShaderRead, State::DepthWrite));
+
+		const std::vector<GraphBarrier>& normalDepth = graph.GetBarriers(frame.NormalDepthPass);
+		EXPECT_EQ(normalDepth.size(), 1u);
+		EXPECT_TRUE(HasBarrier(normalDepth, frame.NormalMap, State::ShaderRead, State::RenderTarget));
+
+		const std::vector<GraphBarrier>& ssao = graph.GetBarriers(frame.SsaoPass);
+		EXPECT_EQ(ssao.size(), 3u);
+		EXPECT_TRUE(HasBarrier(ssao, frame.NormalMap, State::RenderTarget, State::ShaderRead));
+		EXPECT_TRUE(HasBarrier(ssao, frame.Depth, State::DepthWrite, State::DepthRead));
+		EXPECT_TRUE(HasBarrier(ssao, even, State::ShaderRead, State::RenderTarget));
+
+		for (int i = 0; i < 6; ++i)
+		{
+			uint32_t read = i % 2 == 0 ? even : odd;
+			uint32_t written = i % 2 == 0 ? odd : even;
+			const std::vector<GraphBarrier>& blur = graph.GetBarriers(frame.BlurPasses[i]);
+			EXPECT_EQ(blur.size(), 2u);
+			EXPECT_TRUE(HasBarrier(blur, read, State::RenderTarget, State::ShaderRead));
+			EXPECT_TRUE(HasBarrier(blur, written, State::ShaderRead, State::RenderTarget));
+		}
+
+		const std::vector<GraphBarrier>& main = graph.GetBarriers(frame.MainPass);
+		EXPECT_EQ(main.size(), 3u);
+		EXPECT_TRUE(HasBarrier(main, frame.Depth, State::DepthRead, State::DepthWrite));
+		EXPECT_TRUE(HasBarrier(main, frame.ShadowMap, State::DepthWrite, State::ShaderRead));
+		EXPECT_TRUE(HasBarrier(main, even, State::RenderTarget, State::ShaderRead));
+
+		// Everything ends in its resting state, the last blur left the odd map readable.
+		EXPECT_TRUE(graph.GetFinalBarriers().empty());
+
+		// Execute hands the barriers of each pass over before running it.
+		RenderGraph small;
+		std::vector<std::string> log;
+		uint32_t target = small.ImportResource("target", State::Present, true);
+		uint32_t pass = small.AddPass("draw", [&log]() { log.push_back("draw"); });
+		small.Write(pass, target, State::RenderTarget, true);
+		EXPECT_TRUE(small.Compile());
+		small.Execute([&log](const GraphBarrier* barriers, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; ++i)
+				log.push_back(barriers[i].After == State::RenderTarget ? "toTarget" : "toPresent");
+		});
+		EXPECT_TRUE(log == std::vector<std::string>({ "toTarget", "draw", "toPresent" }));
+	}
+
+	void TestInvalidDeclarations()
+	{
+		RenderGraph graph;
+		uint32_t transient = graph.CreateTransient("transient", TransientDesc());
+		uint32_t output = graph.ImportResource("output", State::Common, true);
+		uint32_t pass = graph.AddPass("pass", nullptr);
+		graph.Read(pass, transient, State::ShaderRead);
+		graph.Write(pass, output, State::RenderTarget);
+		EXPECT_TRUE(!graph.Compile());
+	}
+}	// namespace
+
+int main()
+{
+	TestCullOnClear();
+	TestAmbientAliasing();
+	TestDependenciesAndBarriers();
+	TestInvalidDeclarations();
+	return TEST_RESULT();
+}
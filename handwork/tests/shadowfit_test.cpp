@@ -0,0 +1,99 @@
+// Tests of the cascade split distances and of the texel snapping of the cascade bounds.
+
+#include "utility/shadowfit.h"
+#include "testcheck.h"
+#include <cmath>
+
+using namespace handwork;
+
+namespace
+{
+	void TestUniformSplits()
+	{
+		const int count = 4;
+		float splits[count];
+		ComputeCascadeSplits(1.0f, 1000.0f, count, 0.0f, splits);
+		for (int i = 0; i < count; ++i)
+			EXPECT_NEAR(splits[i], 1.0f + 999.0f * (i + 1) / count, 1e-3f);
+	}
+
+	void TestLogarithmicSplits()
+	{
+		const int count = 4;
+		float splits[count];
+		ComputeCascadeSplits(1.0f, 1000.0f, count, 1.0f, splits);
+		// Each cascade covers the same depth ratio.
+		float ratio = std::pow(1000.0f, 1.0f / count);
+		float previous = 1.0f;
+		for (int i = 0; i < count; ++i)
+		{
+			EXPECT_NEAR(splits[i] / previous, ratio, 1e-4f);
+			previous = splits[i];
+		}
+		EXPECT_EQ(splits[count - 1], 1000.0f);
+
+		// A single cascade covers the whole range for any lambda.
+		ComputeCascadeSplits(0.5f, 80.0f, 1, 0.5f, splits);
+		EXPECT_EQ(splits[0], 80.0f);
+	}
+
+	void TestCascadeSnapping()
+	{
+		const float nearZ = 1.0f, farZ = 100.0f;
+		const int resolution = 1024;
+		Matrix4x4 proj(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, farZ / (farZ - nearZ), -farZ * nearZ / (farZ - nearZ), 0, 0, 1, 0);
+		Vector3f corners[8];
+		FrustumCorners(Inverse(proj), corners);
+		Vector3f slice[8];
+		FrustumSliceCorners(corners, nearZ, farZ, 10.0f, 20.0f, slice);
+
+		// Light looking down -y at a scene below the camera.
+		Matrix4x4 lightView(1, 0, 0, 0, 0, 0, 1, 0, 0, -1, 0, 50, 0, 0, 0, 1);
+		Bounds3f scene(Vector3f(-100, 0, -100), Vector3f(100, 20, 100));
+		Bounds3f reference = FitCascadeBounds(lightView, slice, scene, resolution);
+		float width = reference.pMax.x - reference.pMin.x;
+		float texel = width / resolution;
+		EXPECT_NEAR(reference.pMax.y - reference.pMin.y, width, 1e-4f);
+
+		Transform toLight(lightView, Matrix4x4());
+		for (float dx : { 0.001f, 0.013f, 0.37f, 5.123f })
+		{
+			Vector3f moved[8];
+			for (int i = 0; i < 8; ++i)
+				moved[i] = slice[i] + Vector3f(dx, 0.5f * dx, 0.0f);
+			Bounds3f bounds = FitCascadeBounds(lightView, moved, scene, resolution);
+
+			// The size does not change and the origin only moves by whole texels.
+			EXPECT_NEAR(bounds.pMax.x - bounds.pMin.x, width, 1e-4f);
+			EXPECT_NEAR(bounds.pMax.y - bounds.pMin.y, width, 1e-4f);
+			float shiftX = (bounds.pMin.x - reference.pMin.x) / texel;
+			float shiftY = (bounds.pMin.y - reference.pMin.y) / texel;
+			EXPECT_NEAR(shiftX, std::round(shiftX), 1e-2f);
+			EXPECT_NEAR(shiftY, std::round(shiftY), 1e-2f);
+
+			// The snapped box still covers the slice in x and y, depth is clamped to the scene.
+			for (int i = 0; i < 8; ++i)
+			{
+				Vector3f p = toLight(moved[i], VectorType::Point);
+				EXPECT_TRUE(p.x >= bounds.pMin.x && p.x <= bounds.pMax.x);
+				EXPECT_TRUE(p.y >= bounds.pMin.y && p.y <= bounds.pMax.y);
+			}
+		}
+
+		// A movement well below a texel keeps the bounds as they are.
+		Vector3f nudged[8];
+		for (int i = 0; i < 8; ++i)
+			nudged[i] = slice[i] + Vector3f(0.0f, 0.0f, 1e-4f);
+		Bounds3f still = FitCascadeBounds(lightView, nudged, scene, resolution);
+		EXPECT_NEAR(still.pMin.x, reference.pMin.x, 1e-4f);
+		EXPECT_NEAR(still.pMin.y, reference.pMin.y, 1e-4f);
+	}
+}	// namespace
+
+int main()
+{
+	TestUniformSplits();
+	TestLogarithmicSplits();
+	TestCascadeSnapping();
+	return TEST_RESULT();
+}
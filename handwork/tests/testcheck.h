@@ -0,0 +1,35 @@
+// Minimal checks for the host tests. A failed check is reported and the test goes on, TEST_RESULT
+// returns the exit code of the test.
+
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+namespace handwork
+{
+	namespace test
+	{
+		inline int& Failures()
+		{
+			static int failures = 0;
+			return failures;
+		}
+
+		inline bool Report(bool passed, const char* expression, const char* file, int line)
+		{
+			if (!passed)
+			{
+				std::cerr << file << ':' << line << ": check failed: " << expression << '\n';
+				++Failures();
+			}
+			return passed;
+		}
+	}	// namespace test
+}	// namespace handwork
+
+#define EXPECT_TRUE(condition) handwork::test::Report((condition), #condition, __FILE__, __LINE__)
+#define EXPECT_EQ(a, b) handwork::test::Report((a) == (b), #a " == " #b, __FILE__, __LINE__)
+#define EXPECT_NEAR(a, b, tolerance) \
+	handwork::test::Report(std::abs((a) - (b)) <= (tolerance), #a " near " #b, __FILE__, __LINE__)
+#define TEST_RESULT() (handwork::test::Failures() == 0 ? 0 : 1)
@@ -0,0 +1,159 @@
+// Provide axis aligned bounding box support.
+
+#pragma once
+
+#include "utility.h"
+#include "geometry.h"
+#include "transform.h"
+
+namespace handwork
+{
+	// Bounds3 Declarations
+	template <typename T>
+	class Bounds3
+	{
+	public:
+		// Bounds3 Public Methods
+		// The default bounds are empty, so that any union with them gives the other operand.
+		Bounds3()
+		{
+			T minNum = std::numeric_limits<T>::lowest();
+			T maxNum = std::numeric_limits<T>::max();
+			pMin = Vector3<T>(maxNum, maxNum, maxNum);
+			pMax = Vector3<T>(minNum, minNum, minNum);
+		}
+		explicit Bounds3(const Vector3<T> &p) : pMin(p), pMax(p) {}
+		Bounds3(const Vector3<T> &p1, const Vector3<T> &p2)
+			: pMin(std::min(p1.x, p2.x), std::min(p1.y, p2.y), std::min(p1.z, p2.z)),
+			pMax(std::max(p1.x, p2.x), std::max(p1.y, p2.y), std::max(p1.z, p2.z)) {}
+
+		const Vector3<T> &operator[](int i) const
+		{
+			DCHECK(i == 0 || i == 1);
+			return (i == 0) ? pMin : pMax;
+		}
+		Vector3<T> &operator[](int i)
+		{
+			DCHECK(i == 0 || i == 1);
+			return (i == 0) ? pMin : pMax;
+		}
+		bool operator==(const Bounds3<T> &b) const { return b.pMin == pMin && b.pMax == pMax; }
+		bool operator!=(const Bounds3<T> &b) const { return b.pMin != pMin || b.pMax != pMax; }
+
+		bool IsEmpty() const { return pMin.x > pMax.x || pMin.y > pMax.y || pMin.z > pMax.z; }
+		Vector3<T> Diagonal() const { return pMax - pMin; }
+		Vector3<T> Center() const { return (pMin + pMax) * 0.5f; }
+		// Half of the diagonal.
+		Vector3<T> Extent() const { return (pMax - pMin) * 0.5f; }
+		T SurfaceArea() const
+		{
+			Vector3<T> d = Diagonal();
+			return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
+		}
+		T Volume() const
+		{
+			Vector3<T> d = Diagonal();
+			return d.x * d.y * d.z;
+		}
+		int MaximumExtent() const
+		{
+			Vector3<T> d = Diagonal();
+			if (d.x > d.y && d.x > d.z)
+				return 0;
+			else if (d.y > d.z)
+				return 1;
+			else
+				return 2;
+		}
+		// Position of p relative to the corners, pMin is 0 and pMax is 1.
+		Vector3<T> Offset(const Vector3<T> &p) const
+		{
+			Vector3<T> o = p - pMin;
+			if (pMax.x > pMin.x) o.x /= pMax.x - pMin.x;
+			if (pMax.y > pMin.y) o.y /= pMax.y - pMin.y;
+			if (pMax.z > pMin.z) o.z /= pMax.z - pMin.z;
+			return o;
+		}
+
+		friend std::ostream &operator<<(std::ostream &os, const Bounds3<T> &b)
+		{
+			os << "[ " << b.pMin << " - " << b.pMax << " ]";
+			return os;
+		}
+
+		// Bounds3 Public Data
+		Vector3<T> pMin, pMax;
+	};
+
+	typedef Bounds3<float> Bounds3f;
+	typedef Bounds3<int> Bounds3i;
+
+	// Bounds3 Inline Functions
+	template <typename T>
+	Bounds3<T> Union(const Bounds3<T> &b, const Vector3<T> &p)
+	{
+		Bounds3<T> ret;
+		ret.pMin = Min(b.pMin, p);
+		ret.pMax = Max(b.pMax, p);
+		return ret;
+	}
+
+	template <typename T>
+	Bounds3<T> Union(const Bounds3<T> &b1, const Bounds3<T> &b2)
+	{
+		Bounds3<T> ret;
+		ret.pMin = Min(b1.pMin, b2.pMin);
+		ret.pMax = Max(b1.pMax, b2.pMax);
+		return ret;
+	}
+
+	template <typename T>
+	Bounds3<T> Intersect(const Bounds3<T> &b1, const Bounds3<T> &b2)
+	{
+		Bounds3<T> ret;
+		ret.pMin = Max(b1.pMin, b2.pMin);
+		ret.pMax = Min(b1.pMax, b2.pMax);
+		return ret;
+	}
+
+	template <typename T>
+	bool Overlaps(const Bounds3<T> &b1, const Bounds3<T> &b2)
+	{
+		bool x = (b1.pMax.x >= b2.pMin.x) && (b1.pMin.x <= b2.pMax.x);
+		bool y = (b1.pMax.y >= b2.pMin.y) && (b1.pMin.y <= b2.pMax.y);
+		bool z = (b1.pMax.z >= b2.pMin.z) && (b1.pMin.z <= b2.pMax.z);
+		return (x && y && z);
+	}
+
+	template <typename T>
+	bool Inside(const Vector3<T> &p, const Bounds3<T> &b)
+	{
+		return (p.x >= b.pMin.x && p.x <= b.pMax.x && p.y >= b.pMin.y &&
+			p.y <= b.pMax.y && p.z >= b.pMin.z && p.z <= b.pMax.z);
+	}
+
+	// Bounds of an affine transformed box, using the column vector convention of Matrix4x4.
+	// Each output axis takes the smaller and larger contribution of every input axis (Arvo).
+	inline Bounds3f TransformBounds(const Matrix4x4 &m, const Bounds3f &b)
+	{
+		if (b.IsEmpty())
+			return b;
+		Bounds3f ret;
+		for (int i = 0; i < 3; ++i)
+		{
+			float lo = m.m[i][3];
+			float hi = m.m[i][3];
+			for (int j = 0; j < 3; ++j)
+			{
+				float e = m.m[i][j] * b.pMin[j];
+				float f = m.m[i][j] * b.pMax[j];
+				lo += std::min(e, f);
+				hi += std::max(e, f);
+			}
+			ret.pMin[i] = lo;
+			ret.pMax[i] = hi;
+		}
+		return ret;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,371 @@
+#include "bvh.h"
+
+namespace handwork
+{
+	// Number of centroid bins evaluated per split.
+	static const int BVHBucketCount = 12;
+	// Cost of visiting an interior node relative to testing one primitive.
+	static const float BVHTraversalCost = 0.125f;
+	static const int BVHMaxStackDepth = 64;
+
+	enum class FrustumOverlap { Outside, Intersect, Inside };
+
+	static FrustumOverlap ClassifyBounds(const Frustum& frustum, const Bounds3f& b)
+	{
+		Vector3f c = b.Center();
+		Vector3f e = b.Extent();
+		FrustumOverlap ret = FrustumOverlap::Inside;
+		for (int i = 0; i < Frustum::PlaneCount; ++i)
+		{
+			const Vector4f& p = frustum.Planes[i];
+			float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+			float r = std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z;
+			if (d + r < 0.0f)
+				return FrustumOverlap::Outside;
+			if (d - r < 0.0f)
+				ret = FrustumOverlap::Intersect;
+		}
+		return ret;
+	}
+
+	// Slab test, returns the entry distance clamped to 0 or a negative value on a miss.
+	static inline float IntersectRayBounds(const Bounds3f& b, const Vector3f& origin, const Vector3f& invDir,
+		const int dirIsNeg[3], float tMax)
+	{
+		float tMin = (b[dirIsNeg[0]].x - origin.x) * invDir.x;
+		float tFar = (b[1 - dirIsNeg[0]].x - origin.x) * invDir.x;
+		float tyMin = (b[dirIsNeg[1]].y - origin.y) * invDir.y;
+		float tyMax = (b[1 - dirIsNeg[1]].y - origin.y) * invDir.y;
+		if (tMin > tyMax || tyMin > tFar)
+			return -1.0f;
+		if (tyMin > tMin) tMin = tyMin;
+		if (tyMax < tFar) tFar = tyMax;
+		float tzMin = (b[dirIsNeg[2]].z - origin.z) * invDir.z;
+		float tzMax = (b[1 - dirIsNeg[2]].z - origin.z) * invDir.z;
+		if (tMin > tzMax || tzMin > tFar)
+			return -1.0f;
+		if (tzMin > tMin) tMin = tzMin;
+		if (tzMax < tFar) tFar = tzMax;
+		if (tFar < 0.0f || tMin > tMax)
+			return -1.0f;
+		return std::max(tMin, 0.0f);
+	}
+
+	// Primitive record used during the build. Partitioning moves whole records so each split
+	// reads contiguous memory instead of chasing primitive ids.
+	struct BVHPrimitiveInfo
+	{
+		Bounds3f Bounds;
+		Vector3f Centroid;
+		int Id;
+	};
+
+	void BVH::Build(const std::vector<Bounds3f>& bounds, int maxPrimsInNode)
+	{
+		Clear();
+		if (bounds.empty())
+			return;
+
+		int count = (int)bounds.size();
+		mPrimBounds = bounds;
+		std::vector<BVHPrimitiveInfo> primInfo(count);
+		for (int i = 0; i < count; ++i)
+		{
+			primInfo[i].Bounds = bounds[i];
+			primInfo[i].Centroid = bounds[i].Center();
+			primInfo[i].Id = i;
+		}
+
+		// A balanced tree has about 2 * count / maxPrimsInNode nodes.
+		maxPrimsInNode = std::max(maxPrimsInNode, 1);
+		mNodes.reserve(2 * count / maxPrimsInNode + 1);
+		BuildRecursive(primInfo.data(), 0, count, maxPrimsInNode, 0);
+
+		mPrimIndices.resize(count);
+		for (int i = 0; i < count; ++i)
+			mPrimIndices[i] = primInfo[i].Id;
+	}
+
+	int BVH::BuildRecursive(BVHPrimitiveInfo* primInfo, int start, int end, int maxPrimsInNode, int depth)
+	{
+		int nodeIndex = (int)mNodes.size();
+		mNodes.push_back(BVHNode());
+		mMaxDepth = std::max(mMaxDepth, depth);
+
+		Bounds3f bounds;
+		Bounds3f centroidBounds;
+		for (int i = start; i < end; ++i)
+		{
+			bounds = Union(bounds, primInfo[i].Bounds);
+			centroidBounds = Union(centroidBounds, primInfo[i].Centroid);
+		}
+
+		BVHNode& node = mNodes[nodeIndex];
+		node.Bounds = bounds;
+		node.PrimitivesOffset = start;
+		node.PrimitiveCount = end - start;
+		node.SecondChildOffset = -1;
+		node.Axis = 0;
+
+		// The depth limit keeps traversal within the fixed size stacks.
+		int count = end - start;
+		if (count == 1 || depth >= BVHMaxStackDepth - 1)
+			return nodeIndex;
+
+		int dim = centroidBounds.MaximumExtent();
+		int mid = (start + end) / 2;
+		if (centroidBounds.pMax[dim] <= centroidBounds.pMin[dim])
+		{
+			// All centroids coincide, no split helps. Keep leaves small by splitting the range in half.
+			if (count <= maxPrimsInNode)
+				return nodeIndex;
+		}
+		else
+		{
+			// Bin the centroids along the widest axis.
+			int bucketCount[BVHBucketCount] = {};
+			Bounds3f bucketBounds[BVHBucketCount];
+			float cMin = centroidBounds.pMin[dim];
+			float scale = BVHBucketCount / (centroidBounds.pMax[dim] - cMin);
+			auto bucketOf = [&](const BVHPrimitiveInfo& info)
+			{
+				return std::min((int)((info.Centroid[dim] - cMin) * scale), BVHBucketCount - 1);
+			};
+			for (int i = start; i < end; ++i)
+			{
+				int b = bucketOf(primInfo[i]);
+				bucketCount[b]++;
+				bucketBounds[b] = Union(bucketBounds[b], primInfo[i].Bounds);
+			}
+
+			// Sweep from both sides to get the surface area heuristic cost of every bucket boundary.
+			float belowArea[BVHBucketCount - 1];
+			int belowCount[BVHBucketCount - 1];
+			Bounds3f acc;
+			int accCount = 0;
+			for (int i = 0; i < BVHBucketCount - 1; ++i)
+			{
+				acc = Union(acc, bucketBounds[i]);
+				accCount += bucketCount[i];
+				belowArea[i] = acc.IsEmpty() ? 0.0f : acc.SurfaceArea();
+				belowCount[i] = accCount;
+			}
+			float cost[BVHBucketCount - 1];
+			acc = Bounds3f();
+			accCount = 0;
+			for (int i = BVHBucketCount - 1; i > 0; --i)
+			{
+				acc = Union(acc, bucketBounds[i]);
+				accCount += bucketCount[i];
+				float aboveArea = acc.IsEmpty() ? 0.0f : acc.SurfaceArea();
+				cost[i - 1] = belowCount[i - 1] * belowArea[i - 1] + accCount * aboveArea;
+			}
+
+			int minBucket = 0;
+			for (int i = 1; i < BVHBucketCount - 1; ++i)
+			{
+				if (cost[i] < cost[minBucket])
+					minBucket = i;
+			}
+			float area = bounds.IsEmpty() ? 0.0f : bounds.SurfaceArea();
+			float minCost = area > 0.0f ? BVHTraversalCost + cost[minBucket] / area : (float)count;
+			float leafCost = (float)count;
+
+			if (count <= maxPrimsInNode && minCost >= leafCost)
+				return nodeIndex;
+
+			BVHPrimitiveInfo* pmid = std::partition(primInfo + start, primInfo + end,
+				[&](const BVHPrimitiveInfo& info) { return bucketOf(info) <= minBucket; });
+			mid = (int)(pmid - primInfo);
+			// Rounding can leave one side empty, fall back to an equal count split.
+			if (mid == start || mid == end)
+			{
+				mid = (start + end) / 2;
+				std::nth_element(primInfo + start, primInfo + mid, primInfo + end,
+					[&](const BVHPrimitiveInfo& a, const BVHPrimitiveInfo& b) { return a.Centroid[dim] < b.Centroid[dim]; });
+			}
+		}
+
+		BuildRecursive(primInfo, start, mid, maxPrimsInNode, depth + 1);
+		int second = BuildRecursive(primInfo, mid, end, maxPrimsInNode, depth + 1);
+		mNodes[nodeIndex].SecondChildOffset = second;
+		mNodes[nodeIndex].Axis = dim;
+		return nodeIndex;
+	}
+
+	void BVH::Refit(const std::vector<Bounds3f>& bounds)
+	{
+		CHECK_EQ(bounds.size(), mPrimBounds.size());
+		mPrimBounds = bounds;
+
+		// Children are stored after their parent, so a reverse sweep visits them first.
+		for (int i = (int)mNodes.size() - 1; i >= 0; --i)
+		{
+			BVHNode& node = mNodes[i];
+			if (node.SecondChildOffset < 0)
+			{
+				Bounds3f b;
+				for (int j = 0; j < node.PrimitiveCount; ++j)
+					b = Union(b, mPrimBounds[mPrimIndices[node.PrimitivesOffset + j]]);
+				node.Bounds = b;
+			}
+			else
+			{
+				node.Bounds = Union(mNodes[i + 1].Bounds, mNodes[node.SecondChildOffset].Bounds);
+			}
+		}
+	}
+
+	void BVH::Clear()
+	{
+		mNodes.clear();
+		mPrimIndices.clear();
+		mPrimBounds.clear();
+		mMaxDepth = 0;
+	}
+
+	void BVH::AddSubtree(int nodeIndex, std::vector<int>& result) const
+	{
+		const BVHNode& node = mNodes[nodeIndex];
+		for (int i = 0; i < node.PrimitiveCount; ++i)
+		{
+			int prim = mPrimIndices[node.PrimitivesOffset + i];
+			if (!mPrimBounds[prim].IsEmpty())
+				result.push_back(prim);
+		}
+	}
+
+	void BVH::QueryFrustum(const Frustum& frustum, std::vector<int>& result) const
+	{
+		if (mNodes.empty())
+			return;
+
+		int toVisit[BVHMaxStackDepth];
+		int toVisitOffset = 0;
+		int current = 0;
+		while (true)
+		{
+			const BVHNode& node = mNodes[current];
+			FrustumOverlap overlap = ClassifyBounds(frustum, node.Bounds);
+			if (overlap == FrustumOverlap::Inside)
+			{
+				// The whole subtree is visible, its primitives are one contiguous range.
+				AddSubtree(current, result);
+			}
+			else if (overlap == FrustumOverlap::Intersect)
+			{
+				if (node.SecondChildOffset < 0)
+				{
+					for (int i = 0; i < node.PrimitiveCount; ++i)
+					{
+						int prim = mPrimIndices[node.PrimitivesOffset + i];
+						if (Intersects(frustum, mPrimBounds[prim]))
+							result.push_back(prim);
+					}
+				}
+				else
+				{
+					toVisit[toVisitOffset++] = node.SecondChildOffset;
+					current = current + 1;
+					continue;
+				}
+			}
+			if (toVisitOffset == 0)
+				break;
+			current = toVisit[--toVisitOffset];
+		}
+	}
+
+	void BVH::QueryBounds(const Bounds3f& query, std::vector<int>& result) const
+	{
+		if (mNodes.empty() || query.IsEmpty())
+			return;
+
+		int toVisit[BVHMaxStackDepth];
+		int toVisitOffset = 0;
+		int current = 0;
+		while (true)
+		{
+			const BVHNode& node = mNodes[current];
+			if (Overlaps(node.Bounds, query))
+			{
+				if (node.SecondChildOffset < 0)
+				{
+					for (int i = 0; i < node.PrimitiveCount; ++i)
+					{
+						int prim = mPrimIndices[node.PrimitivesOffset + i];
+						if (Overlaps(mPrimBounds[prim], query))
+							result.push_back(prim);
+					}
+				}
+				else
+				{
+					toVisit[toVisitOffset++] = node.SecondChildOffset;
+					current = current + 1;
+					continue;
+				}
+			}
+			if (toVisitOffset == 0)
+				break;
+			current = toVisit[--toVisitOffset];
+		}
+	}
+
+	int BVH::IntersectRay(const Vector3f& origin, const Vector3f& dir, float tMax, float* tHit) const
+	{
+		if (mNodes.empty())
+			return -1;
+
+		Vector3f invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+		int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+		int hit = -1;
+		float tClosest = tMax;
+
+		int toVisit[BVHMaxStackDepth];
+		int toVisitOffset = 0;
+		int current = 0;
+		while (true)
+		{
+			const BVHNode& node = mNodes[current];
+			if (IntersectRayBounds(node.Bounds, origin, invDir, dirIsNeg, tClosest) >= 0.0f)
+			{
+				if (node.SecondChildOffset < 0)
+				{
+					for (int i = 0; i < node.PrimitiveCount; ++i)
+					{
+						int prim = mPrimIndices[node.PrimitivesOffset + i];
+						float t = IntersectRayBounds(mPrimBounds[prim], origin, invDir, dirIsNeg, tClosest);
+						if (t >= 0.0f && (hit < 0 || t < tClosest))
+						{
+							hit = prim;
+							tClosest = t;
+						}
+					}
+				}
+				else
+				{
+					// Visit the child on the near side of the split first.
+					if (dirIsNeg[node.Axis])
+					{
+						toVisit[toVisitOffset++] = current + 1;
+						current = node.SecondChildOffset;
+					}
+					else
+					{
+						toVisit[toVisitOffset++] = node.SecondChildOffset;
+						current = current + 1;
+					}
+					continue;
+				}
+			}
+			if (toVisitOffset == 0)
+				break;
+			current = toVisit[--toVisitOffset];
+		}
+
+		if (hit >= 0 && tHit)
+			*tHit = tClosest;
+		return hit;
+	}
+
+}	// namespace handwork
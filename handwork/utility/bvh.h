@@ -0,0 +1,62 @@
+// Provide a bounding volume hierarchy over axis aligned boxes for scene queries.
+
+#pragma once
+
+#include "utility.h"
+#include "geometry.h"
+#include "bounds.h"
+#include "culling.h"
+
+namespace handwork
+{
+	// Node of the flattened tree in depth first order, the first child of an interior node
+	// directly follows it. Every node covers a contiguous range of the primitive index array.
+	struct BVHNode
+	{
+		Bounds3f Bounds;
+		int PrimitivesOffset;
+		int PrimitiveCount;
+		int SecondChildOffset;	// -1 for leaves.
+		int Axis;				// Split axis of interior nodes.
+	};
+
+	struct BVHPrimitiveInfo;
+
+	// The tree stores primitive ids only, the id of a primitive is its index in the bounds array
+	// passed to Build and Refit.
+	class BVH
+	{
+	public:
+		BVH() {}
+
+		// Binned surface area heuristic build. Empty bounds are allowed and never reported.
+		void Build(const std::vector<Bounds3f>& bounds, int maxPrimsInNode = 4);
+		// Recompute node bounds for moved primitives, the tree topology is kept. The array must
+		// have the same size as the one given to Build.
+		void Refit(const std::vector<Bounds3f>& bounds);
+		void Clear();
+
+		// Append the ids of primitives overlapping the query to result.
+		void QueryFrustum(const Frustum& frustum, std::vector<int>& result) const;
+		void QueryBounds(const Bounds3f& query, std::vector<int>& result) const;
+		// Find the primitive whose box is entered first by the ray origin + t * dir, t in [0, tMax].
+		// Returns -1 when nothing is hit.
+		int IntersectRay(const Vector3f& origin, const Vector3f& dir, float tMax, float* tHit = nullptr) const;
+
+		bool Empty() const { return mNodes.empty(); }
+		Bounds3f WorldBound() const { return mNodes.empty() ? Bounds3f() : mNodes[0].Bounds; }
+		int NodeCount() const { return (int)mNodes.size(); }
+		int PrimitiveCount() const { return (int)mPrimBounds.size(); }
+		int MaxDepth() const { return mMaxDepth; }
+
+	private:
+		int BuildRecursive(BVHPrimitiveInfo* primInfo, int start, int end, int maxPrimsInNode, int depth);
+		void AddSubtree(int nodeIndex, std::vector<int>& result) const;
+
+		std::vector<BVHNode> mNodes;
+		std::vector<int> mPrimIndices;
+		std::vector<Bounds3f> mPrimBounds;
+		int mMaxDepth = 0;
+	};
+
+}	// namespace handwork
@@ -0,0 +1,132 @@
+#include "culling.h"
+
+namespace handwork
+{
+	// Boxes tested together per plane, wide enough for 8 float lanes.
+	static const int CullBatchSize = 8;
+
+	// Plane from row a of the matrix plus sign times row b, normalized so that plane
+	// distances are in world units.
+	static Vector4f CombineRows(const Matrix4x4& m, int a, float sign, int b)
+	{
+		float x = m.m[a][0] + sign * m.m[b][0];
+		float y = m.m[a][1] + sign * m.m[b][1];
+		float z = m.m[a][2] + sign * m.m[b][2];
+		float w = m.m[a][3] + sign * m.m[b][3];
+		float len = std::sqrt(x * x + y * y + z * z);
+		if (len > 0.0f)
+		{
+			float invLen = 1.0f / len;
+			x *= invLen; y *= invLen; z *= invLen; w *= invLen;
+		}
+		return Vector4f(x, y, z, w);
+	}
+
+	Frustum ExtractFrustum(const Matrix4x4& viewProj)
+	{
+		// Clip = M * p, so each clip coordinate is the dot product of a matrix row with p.
+		// Visible points satisfy -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+		Frustum frustum;
+		frustum.Planes[Frustum::Left] = CombineRows(viewProj, 3, 1.0f, 0);
+		frustum.Planes[Frustum::Right] = CombineRows(viewProj, 3, -1.0f, 0);
+		frustum.Planes[Frustum::Bottom] = CombineRows(viewProj, 3, 1.0f, 1);
+		frustum.Planes[Frustum::Top] = CombineRows(viewProj, 3, -1.0f, 1);
+		frustum.Planes[Frustum::Near] = CombineRows(viewProj, 2, 0.0f, 2);
+		frustum.Planes[Frustum::Far] = CombineRows(viewProj, 3, -1.0f, 2);
+		return frustum;
+	}
+
+	bool Intersects(const Frustum& frustum, const Bounds3f& bounds)
+	{
+		if (bounds.IsEmpty())
+			return false;
+		Vector3f c = bounds.Center();
+		Vector3f e = bounds.Extent();
+		for (int i = 0; i < Frustum::PlaneCount; ++i)
+		{
+			const Vector4f& p = frustum.Planes[i];
+			// Distance of the box corner farthest along the plane normal.
+			float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w +
+				std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z;
+			if (d < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	void BoundsSoA::Resize(size_t count)
+	{
+		CenterX.resize(count);
+		CenterY.resize(count);
+		CenterZ.resize(count);
+		ExtentX.resize(count);
+		ExtentY.resize(count);
+		ExtentZ.resize(count);
+	}
+
+	void BoundsSoA::Set(size_t i, const Bounds3f& bounds)
+	{
+		DCHECK_LT(i, Size());
+		Vector3f c = bounds.Center();
+		Vector3f e = bounds.Extent();
+		CenterX[i] = c.x;
+		CenterY[i] = c.y;
+		CenterZ[i] = c.z;
+		ExtentX[i] = e.x;
+		ExtentY[i] = e.y;
+		ExtentZ[i] = e.z;
+	}
+
+	int CullBounds(const Frustum& frustum, const BoundsSoA& bounds, int* visible)
+	{
+		const int count = (int)bounds.Size();
+		const float* cx = bounds.CenterX.data();
+		const float* cy = bounds.CenterY.data();
+		const float* cz = bounds.CenterZ.data();
+		const float* ex = bounds.ExtentX.data();
+		const float* ey = bounds.ExtentY.data();
+		const float* ez = bounds.ExtentZ.data();
+
+		int numVisible = 0;
+		for (int start = 0; start < count; start += CullBatchSize)
+		{
+			const int n = std::min(CullBatchSize, count - start);
+			// Keep the per lane results in fixed size arrays, the inner loops have a constant
+			// trip count and no branches so they map onto SIMD lanes.
+			float cxb[CullBatchSize], cyb[CullBatchSize], czb[CullBatchSize];
+			float exb[CullBatchSize], eyb[CullBatchSize], ezb[CullBatchSize];
+			for (int j = 0; j < CullBatchSize; ++j)
+			{
+				// Pad the tail of the last batch with copies of its first box, their results are never
+				// read because only the first n lanes are compacted.
+				int k = start + (j < n ? j : 0);
+				cxb[j] = cx[k]; cyb[j] = cy[k]; czb[j] = cz[k];
+				exb[j] = ex[k]; eyb[j] = ey[k]; ezb[j] = ez[k];
+			}
+
+			int inside[CullBatchSize];
+			for (int j = 0; j < CullBatchSize; ++j)
+				inside[j] = 1;
+			for (int i = 0; i < Frustum::PlaneCount; ++i)
+			{
+				const Vector4f& p = frustum.Planes[i];
+				const float ax = std::abs(p.x), ay = std::abs(p.y), az = std::abs(p.z);
+				for (int j = 0; j < CullBatchSize; ++j)
+				{
+					float d = p.x * cxb[j] + p.y * cyb[j] + p.z * czb[j] + p.w +
+						ax * exb[j] + ay * eyb[j] + az * ezb[j];
+					inside[j] &= (d >= 0.0f) ? 1 : 0;
+				}
+			}
+
+			for (int j = 0; j < n; ++j)
+			{
+				// Branch free compaction, always write and only advance on visible boxes.
+				visible[numVisible] = start + j;
+				numVisible += inside[j];
+			}
+		}
+		return numVisible;
+	}
+
+}	// namespace handwork
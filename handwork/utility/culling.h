@@ -0,0 +1,45 @@
+// Provide CPU side view frustum culling of axis aligned bounding boxes.
+
+#pragma once
+
+#include "utility.h"
+#include "geometry.h"
+#include "transform.h"
+#include "bounds.h"
+
+namespace handwork
+{
+	// Six planes (a, b, c, d) with normals pointing inside, a point p is inside when
+	// a*p.x + b*p.y + c*p.z + d >= 0 for every plane.
+	struct Frustum
+	{
+		enum { Left = 0, Right, Bottom, Top, Near, Far, PlaneCount };
+
+		Vector4f Planes[PlaneCount];
+	};
+
+	// Extract the frustum from a view projection matrix in the column vector convention of
+	// Matrix4x4, with the D3D clip space depth range [0, w]. The planes are in the space the
+	// matrix transforms from, so pass view * proj to get world space planes.
+	Frustum ExtractFrustum(const Matrix4x4& viewProj);
+
+	// Conservative test, boxes near frustum corners may be reported visible.
+	bool Intersects(const Frustum& frustum, const Bounds3f& bounds);
+
+	// Boxes stored as center and half extent in structure of arrays layout, so the batched test
+	// below runs over contiguous floats and can be vectorized by the compiler.
+	struct BoundsSoA
+	{
+		std::vector<float> CenterX, CenterY, CenterZ;
+		std::vector<float> ExtentX, ExtentY, ExtentZ;
+
+		void Resize(size_t count);
+		void Set(size_t i, const Bounds3f& bounds);
+		size_t Size() const { return CenterX.size(); }
+	};
+
+	// Test all boxes against the frustum and write the indices of the visible ones to visible,
+	// which must hold bounds.Size() entries. Returns the number of visible boxes.
+	int CullBounds(const Frustum& frustum, const BoundsSoA& bounds, int* visible);
+
+}	// namespace handwork
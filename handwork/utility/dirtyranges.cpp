@@ -0,0 +1,63 @@
+#include "dirtyranges.h"
+
+namespace handwork
+{
+	void DirtyRanges::Add(uint32_t begin, uint32_t end)
+	{
+		if (begin >= end)
+			return;
+
+		// Ranges are mostly marked in increasing order, extend or append at the back then.
+		if (mRanges.empty() || begin > mRanges.back().End)
+		{
+			mRanges.push_back({ begin, end });
+			return;
+		}
+		if (begin >= mRanges.back().Begin)
+		{
+			mRanges.back().End = std::max(mRanges.back().End, end);
+			return;
+		}
+
+		// First range that ends at or after begin, it is the first one to touch the new range.
+		auto first = std::lower_bound(mRanges.begin(), mRanges.end(), begin,
+			[](const DirtyRange& r, uint32_t value) { return r.End < value; });
+		// Ranges starting at or before end touch it too.
+		auto last = first;
+		while (last != mRanges.end() && last->Begin <= end)
+			++last;
+
+		if (first == last)
+		{
+			mRanges.insert(first, { begin, end });
+			return;
+		}
+		first->Begin = std::min(first->Begin, begin);
+		first->End = std::max((last - 1)->End, end);
+		mRanges.erase(first + 1, last);
+	}
+
+	void DirtyRanges::Coalesce(uint32_t maxGap)
+	{
+		if (mRanges.size() < 2)
+			return;
+		size_t out = 0;
+		for (size_t i = 1; i < mRanges.size(); ++i)
+		{
+			if (mRanges[i].Begin - mRanges[out].End <= maxGap)
+				mRanges[out].End = mRanges[i].End;
+			else
+				mRanges[++out] = mRanges[i];
+		}
+		mRanges.resize(out + 1);
+	}
+
+	uint32_t DirtyRanges::ElementCount() const
+	{
+		uint32_t count = 0;
+		for (auto& r : mRanges)
+			count += r.End - r.Begin;
+		return count;
+	}
+
+}	// namespace handwork
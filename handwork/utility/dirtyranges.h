@@ -0,0 +1,37 @@
+// Provide tracking of modified element ranges for partial buffer uploads.
+
+#pragma once
+
+#include "utility.h"
+
+namespace handwork
+{
+	// Half open element interval [Begin, End).
+	struct DirtyRange
+	{
+		uint32_t Begin;
+		uint32_t End;
+	};
+
+	// Sorted set of disjoint, non adjacent ranges. Overlapping and touching ranges are merged when
+	// added, so copying the set moves every modified element exactly once.
+	class DirtyRanges
+	{
+	public:
+		void Add(uint32_t begin, uint32_t end);
+		// Merge ranges separated by at most maxGap clean elements, trading some redundant copying
+		// for fewer copy calls.
+		void Coalesce(uint32_t maxGap);
+		void Clear() { mRanges.clear(); }
+
+		bool Empty() const { return mRanges.empty(); }
+		size_t Size() const { return mRanges.size(); }
+		const DirtyRange& operator[](size_t i) const { return mRanges[i]; }
+		// Total number of elements covered.
+		uint32_t ElementCount() const;
+
+	private:
+		std::vector<DirtyRange> mRanges;
+	};
+
+}	// namespace handwork
@@ -0,0 +1,98 @@
+#include "drawlist.h"
+
+namespace handwork
+{
+	uint32_t DrawKey::DepthBucket(float depth, float nearZ, float farZ)
+	{
+		const uint32_t maxBucket = (uint32_t)Mask(DepthBits);
+		if (!(farZ > nearZ))
+			return 0;
+		float t = Clamp((depth - nearZ) / (farZ - nearZ), 0.0f, 1.0f);
+		return std::min((uint32_t)(t * maxBucket), maxBucket);
+	}
+
+	void DrawList::Clear()
+	{
+		mKeys.clear();
+		mPayloads.clear();
+	}
+
+	void DrawList::Reserve(size_t count)
+	{
+		mKeys.reserve(count);
+		mPayloads.reserve(count);
+	}
+
+	void DrawList::Add(uint64_t key, uint32_t payload)
+	{
+		mKeys.push_back(key);
+		mPayloads.push_back(payload);
+	}
+
+	void DrawList::Sort()
+	{
+		const size_t count = mKeys.size();
+		if (count < 2)
+			return;
+
+		// Small lists are faster with a comparison sort.
+		if (count < 64)
+		{
+			for (size_t i = 1; i < count; ++i)
+			{
+				uint64_t key = mKeys[i];
+				uint32_t payload = mPayloads[i];
+				size_t j = i;
+				for (; j > 0 && mKeys[j - 1] > key; --j)
+				{
+					mKeys[j] = mKeys[j - 1];
+					mPayloads[j] = mPayloads[j - 1];
+				}
+				mKeys[j] = key;
+				mPayloads[j] = payload;
+			}
+			return;
+		}
+
+		// Histogram all digits in one read of the keys. 11 bit digits take 6 passes for 64 bits
+		// and the histograms still fit in the L1 cache.
+		const int radixBits = 11;
+		const int bucketCount = 1 << radixBits;
+		const int passCount = (64 + radixBits - 1) / radixBits;
+		mHistograms.assign(passCount * bucketCount, 0);
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint64_t key = mKeys[i];
+			for (int pass = 0; pass < passCount; ++pass)
+				mHistograms[pass * bucketCount + ((key >> (pass * radixBits)) & (bucketCount - 1))]++;
+		}
+
+		mTempKeys.resize(count);
+		mTempPayloads.resize(count);
+		for (int pass = 0; pass < passCount; ++pass)
+		{
+			uint32_t* histogram = &mHistograms[pass * bucketCount];
+			int shift = pass * radixBits;
+			// All keys share this digit, the pass would not move anything.
+			if (histogram[(mKeys[0] >> shift) & (bucketCount - 1)] == count)
+				continue;
+
+			uint32_t offset = 0;
+			for (int b = 0; b < bucketCount; ++b)
+			{
+				uint32_t n = histogram[b];
+				histogram[b] = offset;
+				offset += n;
+			}
+			for (size_t i = 0; i < count; ++i)
+			{
+				size_t dst = histogram[(mKeys[i] >> shift) & (bucketCount - 1)]++;
+				mTempKeys[dst] = mKeys[i];
+				mTempPayloads[dst] = mPayloads[i];
+			}
+			mKeys.swap(mTempKeys);
+			mPayloads.swap(mTempPayloads);
+		}
+	}
+
+}	// namespace handwork
@@ -0,0 +1,71 @@
+// Provide sortable draw lists keyed by packed 64 bit state keys.
+
+#pragma once
+
+#include "utility.h"
+
+namespace handwork
+{
+	// Layout of a draw sort key from the most significant bits down. Draws sorted by key are
+	// grouped by layer, then pipeline state, geometry and material, and go front to back last.
+	struct DrawKey
+	{
+		static const int LayerBits = 4;
+		static const int PipelineBits = 8;
+		static const int GeometryBits = 16;
+		static const int MaterialBits = 16;
+		static const int DepthBits = 20;
+
+		static const int DepthShift = 0;
+		static const int MaterialShift = DepthShift + DepthBits;
+		static const int GeometryShift = MaterialShift + MaterialBits;
+		static const int PipelineShift = GeometryShift + GeometryBits;
+		static const int LayerShift = PipelineShift + PipelineBits;
+
+		// Fields wider than their bits are truncated, which only costs some sorting quality.
+		static uint64_t Make(uint32_t layer, uint32_t pipeline, uint32_t geometry, uint32_t material, uint32_t depth)
+		{
+			return (Field(layer, LayerBits) << LayerShift) | (Field(pipeline, PipelineBits) << PipelineShift) |
+				(Field(geometry, GeometryBits) << GeometryShift) | (Field(material, MaterialBits) << MaterialShift) |
+				(Field(depth, DepthBits) << DepthShift);
+		}
+
+		static uint32_t Layer(uint64_t key) { return (uint32_t)((key >> LayerShift) & Mask(LayerBits)); }
+		static uint32_t Pipeline(uint64_t key) { return (uint32_t)((key >> PipelineShift) & Mask(PipelineBits)); }
+		static uint32_t Geometry(uint64_t key) { return (uint32_t)((key >> GeometryShift) & Mask(GeometryBits)); }
+		static uint32_t Material(uint64_t key) { return (uint32_t)((key >> MaterialShift) & Mask(MaterialBits)); }
+		static uint32_t Depth(uint64_t key) { return (uint32_t)((key >> DepthShift) & Mask(DepthBits)); }
+
+		// Quantize a view depth in [nearZ, farZ] to the depth field, out of range depths are clamped.
+		static uint32_t DepthBucket(float depth, float nearZ, float farZ);
+
+	private:
+		static uint64_t Mask(int bits) { return ((uint64_t)1 << bits) - 1; }
+		static uint64_t Field(uint32_t value, int bits) { return (uint64_t)value & Mask(bits); }
+	};
+
+	// Draws of one pass as key and payload pairs, the payload is an index chosen by the caller.
+	class DrawList
+	{
+	public:
+		void Clear();
+		void Reserve(size_t count);
+		void Add(uint64_t key, uint32_t payload);
+		// Stable radix sort by key. Digits where all keys agree are skipped, so the constant layer
+		// and pipeline bits of a pass cost nothing.
+		void Sort();
+
+		size_t Size() const { return mKeys.size(); }
+		bool Empty() const { return mKeys.empty(); }
+		uint64_t Key(size_t i) const { return mKeys[i]; }
+		uint32_t Payload(size_t i) const { return mPayloads[i]; }
+
+	private:
+		std::vector<uint64_t> mKeys;
+		std::vector<uint32_t> mPayloads;
+		std::vector<uint64_t> mTempKeys;
+		std::vector<uint32_t> mTempPayloads;
+		std::vector<uint32_t> mHistograms;
+	};
+
+}	// namespace handwork
@@ -458,13 +458,13 @@ namespace handwork
 	template <typename T>
 	Vector3<T> Floor(const Vector3<T> &p) 
 	{
-		return Point3<T>(std::floor(p.x), std::floor(p.y), std::floor(p.z));
+		return Vector3<T>(std::floor(p.x), std::floor(p.y), std::floor(p.z));
 	}
 
 	template <typename T>
 	Vector3<T> Ceil(const Vector3<T> &p) 
 	{
-		return Point3<T>(std::ceil(p.x), std::ceil(p.y), std::ceil(p.z));
+		return Vector3<T>(std::ceil(p.x), std::ceil(p.y), std::ceil(p.z));
 	}
 
 	template <typename T>
@@ -476,13 +476,13 @@ namespace handwork
 	template <typename T>
 	Vector2<T> Floor(const Vector2<T> &p) 
 	{
-		return Point2<T>(std::floor(p.x), std::floor(p.y));
+		return Vector2<T>(std::floor(p.x), std::floor(p.y));
 	}
 
 	template <typename T>
 	Vector2<T> Ceil(const Vector2<T> &p) 
 	{
-		return Point2<T>(std::ceil(p.x), std::ceil(p.y));
+		return Vector2<T>(std::ceil(p.x), std::ceil(p.y));
 	}
 
 	template <typename T>
@@ -0,0 +1,131 @@
+// Provide typed, generation checked handles to objects owned by a slot pool.
+
+#pragma once
+
+#include "utility.h"
+
+namespace handwork
+{
+	// Reference to a slot of a HandlePool. The slot generation changes whenever its object is removed,
+	// so a handle to a removed object fails the lookup instead of reaching the next object in the slot.
+	template <typename T>
+	struct Handle
+	{
+		static const uint32_t InvalidIndex = 0xffffffff;
+
+		uint32_t Index = InvalidIndex;
+		uint32_t Generation = 0;
+
+		bool IsValid() const { return Index != InvalidIndex; }
+		bool operator==(const Handle<T>& h) const { return Index == h.Index && Generation == h.Generation; }
+		bool operator!=(const Handle<T>& h) const { return Index != h.Index || Generation != h.Generation; }
+	};
+
+	// Reinterpret a handle as one of a pool of another type. Owners that keep their objects under a
+	// private type use this to hand out handles of the public type.
+	template <typename U, typename T>
+	inline Handle<U> HandleCast(Handle<T> handle)
+	{
+		Handle<U> result;
+		result.Index = handle.Index;
+		result.Generation = handle.Generation;
+		return result;
+	}
+
+	// Own objects in slots addressed by handles. Lookups are an index and a generation compare,
+	// slots freed by Remove are reused by later adds.
+	template <typename T>
+	class HandlePool
+	{
+	public:
+		Handle<T> Add(std::unique_ptr<T> object)
+		{
+			uint32_t index;
+			if (!mFreeSlots.empty())
+			{
+				index = mFreeSlots.back();
+				mFreeSlots.pop_back();
+			}
+			else
+			{
+				index = (uint32_t)mSlots.size();
+				mSlots.emplace_back();
+			}
+			mSlots[index].Object = std::move(object);
+			++mCount;
+
+			Handle<T> handle;
+			handle.Index = index;
+			handle.Generation = mSlots[index].Generation;
+			return handle;
+		}
+
+		// Return nullptr for invalid handles and handles to removed objects.
+		T* Get(Handle<T> handle) const
+		{
+			if (handle.Index >= mSlots.size())
+				return nullptr;
+			const Slot& slot = mSlots[handle.Index];
+			return slot.Generation == handle.Generation ? slot.Object.get() : nullptr;
+		}
+
+		// Release the slot and hand the object back, the caller decides when it is destroyed.
+		std::unique_ptr<T> Remove(Handle<T> handle)
+		{
+			if (Get(handle) == nullptr)
+				return nullptr;
+			Slot& slot = mSlots[handle.Index];
+			++slot.Generation;
+			mFreeSlots.push_back(handle.Index);
+			--mCount;
+			return std::move(slot.Object);
+		}
+
+		// Destroy all objects. The slots and their generations are kept, so handles taken before
+		// the clear never resolve to objects added after it.
+		void Clear()
+		{
+			mFreeSlots.clear();
+			// Free in reverse so that later adds fill the slots from the front again.
+			for (size_t i = mSlots.size(); i-- > 0;)
+			{
+				Slot& slot = mSlots[i];
+				if (slot.Object)
+				{
+					slot.Object.reset();
+					++slot.Generation;
+				}
+				mFreeSlots.push_back((uint32_t)i);
+			}
+			mCount = 0;
+		}
+
+		// Number of live objects.
+		size_t Size() const { return mCount; }
+		// Slots can be iterated in [0, SlotCount()), free slots hold no object.
+		size_t SlotCount() const { return mSlots.size(); }
+		T* At(size_t index) const { return mSlots[index].Object.get(); }
+		Handle<T> HandleAt(size_t index) const
+		{
+			Handle<T> handle;
+			if (mSlots[index].Object)
+			{
+				handle.Index = (uint32_t)index;
+				handle.Generation = mSlots[index].Generation;
+			}
+			return handle;
+		}
+
+	private:
+		struct Slot
+		{
+			std::unique_ptr<T> Object;
+			uint32_t Generation = 0;
+		};
+
+		std::vector<Slot> mSlots;
+		std::vector<uint32_t> mFreeSlots;
+		size_t mCount = 0;
+	};
+
+}	// namespace handwork
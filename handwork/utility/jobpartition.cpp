@@ -0,0 +1,50 @@
+#include "jobpartition.h"
+
+namespace handwork
+{
+	uint32_t JobPartition::Capacity(uint64_t totalItems, uint32_t jobCount, uint32_t minItems)
+	{
+		uint64_t capacity = (totalItems + std::max(jobCount, 1u) - 1) / std::max(jobCount, 1u);
+		return (uint32_t)std::min<uint64_t>(std::max<uint64_t>(capacity, std::max(minItems, 1u)), UINT32_MAX);
+	}
+
+	void JobPartition::Reset(uint32_t capacity)
+	{
+		mCapacity = std::max(capacity, 1u);
+		mGroupCount = 0;
+		mRoom = 0;
+		mSegments.clear();
+		mJobs.clear();
+	}
+
+	uint32_t JobPartition::AddGroup(uint32_t itemCount)
+	{
+		uint32_t group = mGroupCount++;
+		if (itemCount == 0)
+			AddSegment(group, 0, 0);
+		for (uint32_t first = 0; first < itemCount;)
+		{
+			uint32_t room = mJobs.empty() || mRoom == 0 ? mCapacity : mRoom;
+			uint32_t count = std::min(room, itemCount - first);
+			AddSegment(group, first, count);
+			first += count;
+		}
+		return group;
+	}
+
+	void JobPartition::AddSegment(uint32_t group, uint32_t first, uint32_t count)
+	{
+		// A full job only takes more empty segments.
+		if (mJobs.empty() || (count > 0 && mRoom == 0))
+		{
+			mJobs.push_back({ mSegments.size(), 0, 0 });
+			mRoom = mCapacity;
+		}
+		mSegments.push_back({ group, first, count });
+		Job& job = mJobs.back();
+		++job.SegmentCount;
+		job.ItemCount += count;
+		mRoom -= count;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,56 @@
+// Cut ordered work into jobs that run in parallel and are consumed in order.
+
+#pragma once
+
+#include "utility.h"
+
+namespace handwork
+{
+	// The run of items of one group that belongs to a job.
+	struct JobSegment
+	{
+		uint32_t Group;
+		uint32_t First;
+		uint32_t Count;
+	};
+
+	// Groups of items, like the draws of render passes or the triangles of meshes, are added in the
+	// order their results are consumed and cut into jobs of at most capacity items. A job goes on where
+	// the one before it ended, so small groups share a job and large ones are split across several,
+	// and consuming the jobs one after another keeps the order of the work. Empty groups still get a
+	// segment, for passes that do their work without items.
+	class JobPartition
+	{
+	public:
+		// Capacity that cuts totalItems into about jobCount jobs of at least minItems.
+		static uint32_t Capacity(uint64_t totalItems, uint32_t jobCount, uint32_t minItems);
+
+		void Reset(uint32_t capacity);
+		// Return the index of the group.
+		uint32_t AddGroup(uint32_t itemCount);
+
+		uint32_t GetGroupCount() const { return mGroupCount; }
+		uint32_t GetJobCount() const { return (uint32_t)mJobs.size(); }
+		const JobSegment* GetSegments(uint32_t job) const { return mSegments.data() + mJobs[job].FirstSegment; }
+		uint32_t GetSegmentCount(uint32_t job) const { return mJobs[job].SegmentCount; }
+		uint32_t GetItemCount(uint32_t job) const { return mJobs[job].ItemCount; }
+
+	private:
+		struct Job
+		{
+			size_t FirstSegment;
+			uint32_t SegmentCount;
+			uint32_t ItemCount;
+		};
+
+		void AddSegment(uint32_t group, uint32_t first, uint32_t count);
+
+		uint32_t mCapacity = 1;
+		uint32_t mGroupCount = 0;
+		// Items the last job can still take.
+		uint32_t mRoom = 0;
+		std::vector<JobSegment> mSegments;
+		std::vector<Job> mJobs;
+	};
+
+}	// namespace handwork
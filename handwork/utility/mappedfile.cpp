@@ -0,0 +1,121 @@
+// Read only memory mapped file.
+
+#include "mappedfile.h"
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace handwork
+{
+#ifdef _WIN32
+	bool MappedFile::Open(const char* filename)
+	{
+		Close();
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			Error("Can not open file %s", filename);
+			return false;
+		}
+		mFile = file;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			Error("Can not get size of file %s", filename);
+			Close();
+			return false;
+		}
+		mSize = (size_t)size.QuadPart;
+		if (mSize == 0)
+			return true;
+
+		mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mMapping)
+		{
+			Error("Can not map file %s", filename);
+			Close();
+			return false;
+		}
+		mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		if (!mData)
+		{
+			Error("Can not map view of file %s", filename);
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (mData)
+			UnmapViewOfFile(mData);
+		if (mMapping)
+			CloseHandle(mMapping);
+		if (mFile)
+			CloseHandle(mFile);
+		mData = nullptr;
+		mMapping = nullptr;
+		mFile = nullptr;
+		mSize = 0;
+	}
+#else
+	bool MappedFile::Open(const char* filename)
+	{
+		Close();
+		mFile = open(filename, O_RDONLY);
+		if (mFile < 0)
+		{
+			Error("Can not open file %s", filename);
+			return false;
+		}
+
+		struct stat info;
+		if (fstat(mFile, &info) != 0)
+		{
+			Error("Can not get size of file %s", filename);
+			Close();
+			return false;
+		}
+		mSize = (size_t)info.st_size;
+		if (mSize == 0)
+			return true;
+
+		void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+		if (data == MAP_FAILED)
+		{
+			Error("Can not map file %s", filename);
+			Close();
+			return false;
+		}
+		madvise(data, mSize, MADV_SEQUENTIAL);
+		mData = (const char*)data;
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (mData)
+			munmap((void*)mData, mSize);
+		if (mFile >= 0)
+			close(mFile);
+		mData = nullptr;
+		mFile = -1;
+		mSize = 0;
+	}
+#endif
+
+}	// namespace handwork
@@ -0,0 +1,35 @@
+// Read only memory mapped file.
+
+#pragma once
+
+#include "utility.h"
+
+namespace handwork
+{
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile() { Close(); }
+
+		// Map the whole file. An empty file is mapped successfully with a null data pointer.
+		bool Open(const char* filename);
+		void Close();
+
+		const char* Data() const { return mData; }
+		size_t Size() const { return mSize; }
+
+	private:
+		const char* mData = nullptr;
+		size_t mSize = 0;
+#ifdef _WIN32
+		void* mFile = nullptr;
+		void* mMapping = nullptr;
+#else
+		int mFile = -1;
+#endif
+	};
+
+}	// namespace handwork
@@ -0,0 +1,212 @@
+// Provide simple parallel loop support based on a shared worker thread pool.
+
+#include "parallel.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+
+namespace handwork
+{
+	// Parallel Local Definitions
+	static std::vector<std::thread> threads;
+	static bool shutdownThreads = false;
+	class ParallelForLoop;
+	static ParallelForLoop *workList = nullptr;
+	static std::mutex workListMutex;
+	static std::condition_variable workListCondition;
+	static std::mutex initMutex;
+
+	HANDWORK_THREAD_LOCAL int ThreadIndex;
+
+	class ParallelForLoop
+	{
+	public:
+		// ParallelForLoop Public Methods
+		ParallelForLoop(std::function<void(int64_t, int64_t)> func, int64_t maxIndex, int chunkSize)
+			: func(std::move(func)), maxIndex(maxIndex), chunkSize(chunkSize) {}
+
+		bool Finished() const { return nextIndex >= maxIndex && activeWorkers == 0; }
+
+		// ParallelForLoop Private Data
+		std::function<void(int64_t, int64_t)> func;
+		const int64_t maxIndex;
+		const int chunkSize;
+		int64_t nextIndex = 0;
+		int activeWorkers = 0;
+		ParallelForLoop *next = nullptr;
+	};
+
+	// Grab the next chunk of the head loop and run it. The lock is held on entry and exit.
+	static void RunChunk(std::unique_lock<std::mutex> &lock)
+	{
+		ParallelForLoop &loop = *workList;
+		int64_t indexStart = loop.nextIndex;
+		int64_t indexEnd = std::min(indexStart + loop.chunkSize, loop.maxIndex);
+
+		// Update loop to reflect iterations this thread will run
+		loop.nextIndex = indexEnd;
+		if (loop.nextIndex == loop.maxIndex) workList = loop.next;
+		loop.activeWorkers++;
+
+		lock.unlock();
+		loop.func(indexStart, indexEnd);
+		lock.lock();
+
+		// Update loop to reflect completion of iterations
+		loop.activeWorkers--;
+		if (loop.Finished()) workListCondition.notify_all();
+	}
+
+	static void WorkerThreadFunc(int tIndex)
+	{
+		ThreadIndex = tIndex;
+		std::unique_lock<std::mutex> lock(workListMutex);
+		while (!shutdownThreads)
+		{
+			if (!workList)
+				workListCondition.wait(lock);
+			else
+				RunChunk(lock);
+		}
+	}
+
+	static void RunLoop(std::function<void(int64_t, int64_t)> func, int64_t count, int chunkSize)
+	{
+		if (count <= 0)
+			return;
+		chunkSize = std::max(chunkSize, 1);
+		ParallelInit();
+
+		// Run iterations immediately if not using threads or if _count_ is small
+		if (threads.empty() || count < chunkSize)
+		{
+			func(0, count);
+			return;
+		}
+
+		// Create and enqueue _ParallelForLoop_ for this loop
+		ParallelForLoop loop(std::move(func), count, chunkSize);
+		std::unique_lock<std::mutex> lock(workListMutex);
+		loop.next = workList;
+		workList = &loop;
+		workListCondition.notify_all();
+
+		// Help out with parallel loop iterations in the current thread
+		while (!loop.Finished())
+		{
+			if (workList == &loop)
+				RunChunk(lock);
+			else
+				workListCondition.wait(lock);
+		}
+	}
+
+	void ParallelFor(std::function<void(int64_t)> func, int64_t count, int chunkSize)
+	{
+		RunLoop([&func](int64_t begin, int64_t end)
+		{
+			for (int64_t i = begin; i < end; ++i)
+				func(i);
+		}, count, chunkSize);
+	}
+
+	void ParallelForRange(std::function<void(int64_t, int64_t)> func, int64_t count, int chunkSize)
+	{
+		RunLoop(std::move(func), count, chunkSize);
+	}
+
+	void ParallelPrefixSum(int* values, int64_t count, int chunkSize)
+	{
+		int64_t blockCount = (count + chunkSize - 1) / chunkSize;
+		if (blockCount <= 1)
+		{
+			for (int64_t i = 1; i < count; ++i)
+				values[i] += values[i - 1];
+			return;
+		}
+
+		// Scan every block on its own, then the block totals, then add them to the blocks after.
+		std::vector<int> blockSums(blockCount);
+		RunLoop([values, count, chunkSize, &blockSums](int64_t begin, int64_t end)
+		{
+			for (int64_t b = begin; b < end; ++b)
+			{
+				int* block = values + b * chunkSize;
+				int64_t size = std::min((int64_t)chunkSize, count - b * chunkSize);
+				for (int64_t i = 1; i < size; ++i)
+					block[i] += block[i - 1];
+				blockSums[b] = block[size - 1];
+			}
+		}, blockCount, 1);
+		for (int64_t b = 1; b < blockCount; ++b)
+			blockSums[b] += blockSums[b - 1];
+		RunLoop([values, count, chunkSize, &blockSums](int64_t begin, int64_t end)
+		{
+			for (int64_t b = std::max(begin, (int64_t)1); b < end; ++b)
+			{
+				int* block = values + b * chunkSize;
+				int64_t size = std::min((int64_t)chunkSize, count - b * chunkSize);
+				for (int64_t i = 0; i < size; ++i)
+					block[i] += blockSums[b - 1];
+			}
+		}, blockCount, 1);
+	}
+
+	void ParallelFor2D(std::function<void(Vector2i)> func, const Vector2i& count)
+	{
+		int64_t total = (int64_t)count.x * count.y;
+		RunLoop([&func, &count](int64_t begin, int64_t end)
+		{
+			for (int64_t i = begin; i < end; ++i)
+				func(Vector2i((int)(i % count.x), (int)(i / count.x)));
+		}, total, 1);
+	}
+
+	int MaxThreadIndex()
+	{
+		ParallelInit();
+		return 1 + (int)threads.size();
+	}
+
+	int NumSystemCores()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	void ParallelInit()
+	{
+		std::lock_guard<std::mutex> lock(initMutex);
+		if (!threads.empty() || NumSystemCores() == 1)
+			return;
+		shutdownThreads = false;
+		ThreadIndex = 0;
+		int nThreads = NumSystemCores();
+		for (int i = 0; i < nThreads - 1; ++i)
+			threads.push_back(std::thread(WorkerThreadFunc, i + 1));
+
+		// Joinable threads must not outlive the pool, make sure they are joined on exit.
+		static bool registered = false;
+		if (!registered)
+		{
+			std::atexit(ParallelCleanup);
+			registered = true;
+		}
+	}
+
+	void ParallelCleanup()
+	{
+		std::lock_guard<std::mutex> initLock(initMutex);
+		if (threads.empty())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(workListMutex);
+			shutdownThreads = true;
+			workListCondition.notify_all();
+		}
+		for (std::thread &thread : threads) thread.join();
+		threads.erase(threads.begin(), threads.end());
+		shutdownThreads = false;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,37 @@
+// Provide simple parallel loop support based on a shared worker thread pool.
+
+#pragma once
+
+#include "utility.h"
+#include "geometry.h"
+#include <atomic>
+#include <functional>
+
+namespace handwork
+{
+	// Index of the current thread. Main thread is 0, worker threads are [1, MaxThreadIndex()).
+	extern HANDWORK_THREAD_LOCAL int ThreadIndex;
+
+	// Run func(i) for i in [0, count). Iterations are handed out to the workers in chunks of
+	// chunkSize, the calling thread takes part in the work and returns after all are done.
+	void ParallelFor(std::function<void(int64_t)> func, int64_t count, int chunkSize = 1);
+
+	// Run func(begin, end) over disjoint sub ranges covering [0, count). Prefer this one for
+	// cheap loop bodies, the function call overhead is paid once per chunk instead of per item.
+	void ParallelForRange(std::function<void(int64_t, int64_t)> func, int64_t count, int chunkSize);
+
+	// Replace values[i] with values[0] + ... + values[i] for i in [0, count). Blocks of chunkSize values
+	// are summed in parallel, then offset by the sums of the blocks before them.
+	void ParallelPrefixSum(int* values, int64_t count, int chunkSize);
+
+	// Run func(x, y) over a 2D grid of [0, count.x) * [0, count.y), one item per call.
+	void ParallelFor2D(std::function<void(Vector2i)> func, const Vector2i& count);
+
+	int MaxThreadIndex();
+	int NumSystemCores();
+
+	// The thread pool is created on first use. Call cleanup before exiting to join the workers.
+	void ParallelInit();
+	void ParallelCleanup();
+
+}	// namespace handwork
@@ -0,0 +1,276 @@
+#include "rendergraph.h"
+#include "stringprint.h"
+
+namespace handwork
+{
+	void RenderGraph::Reset()
+	{
+		mPasses.clear();
+		mResources.clear();
+		mPhysical.clear();
+		mOrder.clear();
+		mFinalBarriers.clear();
+	}
+
+	uint32_t RenderGraph::ImportResource(const std::string& name, GraphResourceState state, bool output)
+	{
+		Resource resource;
+		resource.Name = name;
+		resource.Output = output;
+		resource.State = state;
+		mResources.push_back(resource);
+		return (uint32_t)mResources.size() - 1;
+	}
+
+	uint32_t RenderGraph::CreateTransient(const std::string& name, const TransientDesc& desc)
+	{
+		Resource resource;
+		resource.Name = name;
+		resource.Transient = true;
+		resource.Desc = desc;
+		resource.State = desc.State;
+		mResources.push_back(resource);
+		return (uint32_t)mResources.size() - 1;
+	}
+
+	uint32_t RenderGraph::AddPass(const std::string& name, ExecuteFunction execute, bool sideEffect)
+	{
+		mPasses.emplace_back();
+		Pass& pass = mPasses.back();
+		pass.Name = name;
+		pass.Execute = std::move(execute);
+		pass.SideEffect = sideEffect;
+		return (uint32_t)mPasses.size() - 1;
+	}
+
+	void RenderGraph::Read(uint32_t pass, uint32_t resource, GraphResourceState state)
+	{
+		CHECK_LT(resource, mResources.size());
+		mPasses[pass].Accesses.push_back({ resource, state, false, false });
+	}
+
+	void RenderGraph::Write(uint32_t pass, uint32_t resource, GraphResourceState state, bool clear)
+	{
+		CHECK_LT(resource, mResources.size());
+		mPasses[pass].Accesses.push_back({ resource, state, true, clear });
+	}
+
+	bool RenderGraph::Compile()
+	{
+		mPhysical.clear();
+		mOrder.clear();
+		mFinalBarriers.clear();
+		for (auto& pass : mPasses)
+		{
+			pass.Active = false;
+			pass.Dependencies.clear();
+			pass.Barriers.clear();
+		}
+		for (auto& resource : mResources)
+		{
+			resource.Physical = Invalid;
+			resource.FirstUse = Invalid;
+			resource.LastUse = 0;
+		}
+
+		CullPasses();
+		for (uint32_t i = 0; i < (uint32_t)mPasses.size(); ++i)
+		{
+			if (!mPasses[i].Active)
+				continue;
+			uint32_t position = (uint32_t)mOrder.size();
+			mOrder.push_back(i);
+			for (const auto& access : mPasses[i].Accesses)
+			{
+				Resource& resource = mResources[access.Resource];
+				resource.FirstUse = std::min(resource.FirstUse, position);
+				resource.LastUse = std::max(resource.LastUse, position);
+			}
+		}
+
+		AssignPhysicalResources();
+		return BuildBarriersAndDependencies();
+	}
+
+	void RenderGraph::Execute(const BarrierFunction& barrier) const
+	{
+		for (uint32_t i : mOrder)
+		{
+			const Pass& pass = mPasses[i];
+			if (!pass.Barriers.empty())
+				barrier(pass.Barriers.data(), (uint32_t)pass.Barriers.size());
+			if (pass.Execute)
+				pass.Execute();
+		}
+		if (!mFinalBarriers.empty())
+			barrier(mFinalBarriers.data(), (uint32_t)mFinalBarriers.size());
+	}
+
+	void RenderGraph::CullPasses()
+	{
+		// Walk back from the outputs. A pass is needed if it writes contents a later needed pass reads,
+		// a clearing write hides the contents of the passes before it.
+		std::vector<char> needed(mResources.size());
+		for (size_t i = 0; i < mResources.size(); ++i)
+			needed[i] = mResources[i].Output;
+
+		for (size_t i = mPasses.size(); i-- > 0;)
+		{
+			Pass& pass = mPasses[i];
+			bool active = pass.SideEffect;
+			for (const auto& access : pass.Accesses)
+				active = active || (access.Write && needed[access.Resource]);
+			pass.Active = active;
+			if (!active)
+				continue;
+
+			for (const auto& access : pass.Accesses)
+			{
+				if (access.Write && access.Clear)
+					needed[access.Resource] = false;
+			}
+			for (const auto& access : pass.Accesses)
+			{
+				if (!access.Write)
+					needed[access.Resource] = true;
+			}
+		}
+	}
+
+	void RenderGraph::AssignPhysicalResources()
+	{
+		for (auto& resource : mResources)
+		{
+			if (resource.Transient)
+				continue;
+			PhysicalResource physical;
+			physical.State = resource.State;
+			resource.Physical = (uint32_t)mPhysical.size();
+			mPhysical.push_back(physical);
+		}
+
+		// Greedy first fit in the order the transients come alive. A physical resource is free again
+		// after the last pass using its current transient.
+		std::vector<uint32_t> transients;
+		for (uint32_t i = 0; i < (uint32_t)mResources.size(); ++i)
+		{
+			if (mResources[i].Transient && mResources[i].FirstUse != Invalid)
+				transients.push_back(i);
+		}
+		std::stable_sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b)
+		{
+			return mResources[a].FirstUse < mResources[b].FirstUse;
+		});
+
+		for (uint32_t i : transients)
+		{
+			Resource& resource = mResources[i];
+			for (uint32_t j = 0; j < (uint32_t)mPhysical.size(); ++j)
+			{
+				PhysicalResource& physical = mPhysical[j];
+				if (physical.Transient && physical.Desc == resource.Desc && physical.LastUse < resource.FirstUse)
+				{
+					resource.Physical = j;
+					break;
+				}
+			}
+			if (resource.Physical == Invalid)
+			{
+				PhysicalResource physical;
+				physical.Transient = true;
+				physical.Desc = resource.Desc;
+				physical.State = resource.Desc.State;
+				resource.Physical = (uint32_t)mPhysical.size();
+				mPhysical.push_back(physical);
+			}
+			mPhysical[resource.Physical].LastUse = resource.LastUse;
+		}
+	}
+
+	bool RenderGraph::BuildBarriersAndDependencies()
+	{
+		bool valid = true;
+		std::vector<GraphResourceState> states(mPhysical.size());
+		for (size_t i = 0; i < mPhysical.size(); ++i)
+			states[i] = mPhysical[i].State;
+		// Last pass writing each physical resource and the passes reading it since.
+		std::vector<uint32_t> lastWriters(mPhysical.size(), Invalid);
+		std::vector<std::vector<uint32_t>> readers(mPhysical.size());
+		std::vector<char> written(mResources.size());
+
+		for (uint32_t p : mOrder)
+		{
+			Pass& pass = mPasses[p];
+			auto addDependency = [&](uint32_t other)
+			{
+				if (other != Invalid && other != p &&
+					std::find(pass.Dependencies.begin(), pass.Dependencies.end(), other) == pass.Dependencies.end())
+					pass.Dependencies.push_back(other);
+			};
+
+			for (const auto& access : pass.Accesses)
+			{
+				const Resource& resource = mResources[access.Resource];
+				uint32_t physical = resource.Physical;
+				if (!access.Write && resource.Transient && !written[access.Resource])
+				{
+					LOG(ERROR) << StringPrintf("Pass \"%s\" reads the transient \"%s\" before it is written.",
+						pass.Name.c_str(), resource.Name.c_str());
+					valid = false;
+				}
+				if (access.Write)
+					written[access.Resource] = true;
+
+				if (states[physical] != access.State)
+				{
+					// A pass sees a resource in one state only.
+					bool transitioned = std::any_of(pass.Barriers.begin(), pass.Barriers.end(),
+						[physical](const GraphBarrier& b) { return b.Resource == physical; });
+					if (transitioned)
+					{
+						LOG(ERROR) << StringPrintf("Pass \"%s\" uses \"%s\" in more than one state.",
+							pass.Name.c_str(), resource.Name.c_str());
+						valid = false;
+					}
+					else
+					{
+						pass.Barriers.push_back({ physical, states[physical], access.State });
+						states[physical] = access.State;
+					}
+				}
+
+				addDependency(lastWriters[physical]);
+				if (access.Write)
+				{
+					for (uint32_t reader : readers[physical])
+						addDependency(reader);
+				}
+			}
+
+			for (const auto& access : pass.Accesses)
+			{
+				uint32_t physical = mResources[access.Resource].Physical;
+				if (access.Write)
+				{
+					lastWriters[physical] = p;
+					readers[physical].clear();
+				}
+			}
+			for (const auto& access : pass.Accesses)
+			{
+				uint32_t physical = mResources[access.Resource].Physical;
+				if (!access.Write && lastWriters[physical] != p)
+					readers[physical].push_back(p);
+			}
+			std::sort(pass.Dependencies.begin(), pass.Dependencies.end());
+		}
+
+		for (uint32_t i = 0; i < (uint32_t)mPhysical.size(); ++i)
+		{
+			if (states[i] != mPhysical[i].State)
+				mFinalBarriers.push_back({ i, states[i], mPhysical[i].State });
+		}
+		return valid;
+	}
+
+}	// namespace handwork
@@ -0,0 +1,151 @@
+// Provide a render graph that orders, culls and synchronizes the passes of a frame.
+
+#pragma once
+
+#include "utility.h"
+#include <functional>
+
+namespace handwork
+{
+	// Backend neutral resource states, a renderer maps them to its own states.
+	enum class GraphResourceState
+	{
+		Common,
+		RenderTarget,
+		DepthWrite,
+		// Depth test and shader reads at the same time.
+		DepthRead,
+		ShaderRead,
+		CopySource,
+		CopyDest,
+		Present
+	};
+
+	// Transient resources only live within a frame. Transients with equal descriptions and disjoint
+	// lifetimes share one physical resource, State is the one the physical resource rests in between
+	// frames. Format is the backend format value.
+	struct TransientDesc
+	{
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		uint32_t Format = 0;
+		GraphResourceState State = GraphResourceState::Common;
+
+		bool operator==(const TransientDesc& rhs) const
+		{
+			return Width == rhs.Width && Height == rhs.Height && Format == rhs.Format && State == rhs.State;
+		}
+	};
+
+	// State transition of a physical resource.
+	struct GraphBarrier
+	{
+		uint32_t Resource;
+		GraphResourceState Before;
+		GraphResourceState After;
+	};
+
+	// Passes are declared in execution order together with the resources they read and write. Compile
+	// culls the passes none of whose writes reach an output, assigns physical resources to transients
+	// and derives the dependencies and state transitions of the remaining passes. Resources and passes
+	// are indices in the order they were added, the graph is meant to be reset and declared each frame.
+	class RenderGraph
+	{
+	public:
+		typedef std::function<void()> ExecuteFunction;
+		typedef std::function<void(const GraphBarrier* barriers, uint32_t count)> BarrierFunction;
+
+		static const uint32_t Invalid = UINT32_MAX;
+
+		// Forget all passes and resources.
+		void Reset();
+
+		// A resource owned by the renderer, in state at the start and at the end of the frame. Passes
+		// writing outputs are never culled.
+		uint32_t ImportResource(const std::string& name, GraphResourceState state, bool output = false);
+		uint32_t CreateTransient(const std::string& name, const TransientDesc& desc);
+
+		// Passes with side effects are never culled.
+		uint32_t AddPass(const std::string& name, ExecuteFunction execute, bool sideEffect = false);
+		void Read(uint32_t pass, uint32_t resource, GraphResourceState state);
+		// Writes that clear the resource do not depend on its earlier contents, so they end the
+		// lifetime of the contents written before.
+		void Write(uint32_t pass, uint32_t resource, GraphResourceState state, bool clear = false);
+
+		// Return false if the declarations are inconsistent, the reasons are logged.
+		bool Compile();
+		// Run the active passes in order, the transitions of a pass are handed to barrier before it.
+		void Execute(const BarrierFunction& barrier) const;
+
+		// Results of Compile.
+		bool IsPassActive(uint32_t pass) const { return mPasses[pass].Active; }
+		uint32_t GetActivePassCount() const { return (uint32_t)mOrder.size(); }
+		uint32_t GetCulledPassCount() const { return (uint32_t)(mPasses.size() - mOrder.size()); }
+		// Active passes in execution order.
+		const std::vector<uint32_t>& GetExecutionOrder() const { return mOrder; }
+		// Earlier active passes that must finish before the pass runs: the writers of what it reads,
+		// and the writers and readers of the physical resources it writes.
+		const std::vector<uint32_t>& GetDependencies(uint32_t pass) const { return mPasses[pass].Dependencies; }
+		// Physical resource of a resource, Invalid for transients no active pass uses. Imported resources
+		// keep their own physical resource.
+		uint32_t GetPhysicalResource(uint32_t resource) const { return mResources[resource].Physical; }
+		uint32_t GetPhysicalResourceCount() const { return (uint32_t)mPhysical.size(); }
+		// Transitions before the pass and the ones returning resources to their state after the frame.
+		const std::vector<GraphBarrier>& GetBarriers(uint32_t pass) const { return mPasses[pass].Barriers; }
+		const std::vector<GraphBarrier>& GetFinalBarriers() const { return mFinalBarriers; }
+		const std::string& GetPassName(uint32_t pass) const { return mPasses[pass].Name; }
+		const std::string& GetResourceName(uint32_t resource) const { return mResources[resource].Name; }
+
+	private:
+		struct Access
+		{
+			uint32_t Resource;
+			GraphResourceState State;
+			bool Write;
+			bool Clear;
+		};
+
+		struct Pass
+		{
+			std::string Name;
+			ExecuteFunction Execute;
+			bool SideEffect = false;
+			bool Active = false;
+			std::vector<Access> Accesses;
+			std::vector<uint32_t> Dependencies;
+			std::vector<GraphBarrier> Barriers;
+		};
+
+		struct Resource
+		{
+			std::string Name;
+			bool Transient = false;
+			bool Output = false;
+			TransientDesc Desc;
+			GraphResourceState State = GraphResourceState::Common;
+			uint32_t Physical = Invalid;
+			// First and last position in the execution order of active passes using it.
+			uint32_t FirstUse = Invalid;
+			uint32_t LastUse = 0;
+		};
+
+		struct PhysicalResource
+		{
+			bool Transient = false;
+			TransientDesc Desc;
+			GraphResourceState State = GraphResourceState::Common;
+			uint32_t LastUse = 0;
+		};
+
+		void CullPasses();
+		void AssignPhysicalResources();
+		bool BuildBarriersAndDependencies();
+
+		std::vector<Pass> mPasses;
+		std::vector<Resource> mResources;
+		std::vector<PhysicalResource> mPhysical;
+		std::vector<uint32_t> mOrder;
+		std::vector<GraphBarrier> mFinalBarriers;
+	};
+
+}	// namespace handwork
@@ -0,0 +1,108 @@
+#include "shadowfit.h"
+
+namespace handwork
+{
+	void FrustumCorners(const Matrix4x4& invViewProj, Vector3f corners[8])
+	{
+		Transform t(invViewProj, Matrix4x4());
+		int index = 0;
+		for (int z = 0; z < 2; ++z)
+		{
+			for (int y = 0; y < 2; ++y)
+			{
+				for (int x = 0; x < 2; ++x)
+				{
+					Vector3f ndc(x ? 1.0f : -1.0f, y ? 1.0f : -1.0f, (float)z);
+					corners[index++] = t(ndc, VectorType::Point);
+				}
+			}
+		}
+	}
+
+	Bounds3f LightSpaceBounds(const Matrix4x4& lightView, const Vector3f* points, int count)
+	{
+		Transform t(lightView, Matrix4x4());
+		Bounds3f bounds;
+		for (int i = 0; i < count; ++i)
+			bounds = Union(bounds, t(points[i], VectorType::Point));
+		return bounds;
+	}
+
+	Bounds3f FitShadowBounds(const Matrix4x4& lightView, const Vector3f cameraCorners[8], const Bounds3f& sceneBounds)
+	{
+		Bounds3f sceneLS = TransformBounds(lightView, sceneBounds);
+		Bounds3f receivers = Intersect(LightSpaceBounds(lightView, cameraCorners, 8), sceneLS);
+		if (receivers.IsEmpty())
+			return sceneLS;
+
+		// Anything in the column between the light and the receivers may cast onto them.
+		receivers.pMin.z = sceneLS.pMin.z;
+		return receivers;
+	}
+
+	void ComputeCascadeSplits(float nearZ, float farZ, int cascadeCount, float lambda, float* splits)
+	{
+		CHECK_GT(cascadeCount, 0);
+		CHECK_GT(nearZ, 0.0f);
+		float ratio = farZ / nearZ;
+		float range = farZ - nearZ;
+		for (int i = 1; i < cascadeCount; ++i)
+		{
+			float p = (float)i / cascadeCount;
+			float logSplit = nearZ * std::pow(ratio, p);
+			float uniformSplit = nearZ + range * p;
+			splits[i - 1] = Lerp(lambda, uniformSplit, logSplit);
+		}
+		splits[cascadeCount - 1] = farZ;
+	}
+
+	void FrustumSliceCorners(const Vector3f corners[8], float nearZ, float farZ,
+		float sliceNear, float sliceFar, Vector3f slice[8])
+	{
+		// Near and far corners with the same index lie on one ray from the eye, and view depth
+		// changes linearly along it.
+		float tNear = (sliceNear - nearZ) / (farZ - nearZ);
+		float tFar = (sliceFar - nearZ) / (farZ - nearZ);
+		for (int i = 0; i < 4; ++i)
+		{
+			Vector3f ray = corners[i + 4] - corners[i];
+			slice[i] = corners[i] + ray * tNear;
+			slice[i + 4] = corners[i] + ray * tFar;
+		}
+	}
+
+	Bounds3f FitCascadeBounds(const Matrix4x4& lightView, const Vector3f slice[8], const Bounds3f& sceneBounds,
+		int resolution)
+	{
+		CHECK_GT(resolution, 0);
+		Vector3f center(0.0f, 0.0f, 0.0f);
+		for (int i = 0; i < 8; ++i)
+			center += slice[i];
+		center = center / 8.0f;
+		float radius = 0.0f;
+		for (int i = 0; i < 8; ++i)
+			radius = std::max(radius, Distance(center, slice[i]));
+		// Round up so that float noise in the corners does not change the projection size.
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		Vector3f centerLS = Transform(lightView, Matrix4x4())(center, VectorType::Point);
+		float texelSize = 2.0f * radius / resolution;
+		Bounds3f bounds;
+		bounds.pMin.x = std::floor((centerLS.x - radius) / texelSize) * texelSize;
+		bounds.pMin.y = std::floor((centerLS.y - radius) / texelSize) * texelSize;
+		bounds.pMax.x = bounds.pMin.x + 2.0f * radius;
+		bounds.pMax.y = bounds.pMin.y + 2.0f * radius;
+		bounds.pMin.z = centerLS.z - radius;
+		bounds.pMax.z = centerLS.z + radius;
+
+		// Anything between the light and the slice may cast onto it.
+		if (!sceneBounds.IsEmpty())
+		{
+			Bounds3f sceneLS = TransformBounds(lightView, sceneBounds);
+			bounds.pMin.z = std::min(bounds.pMin.z, sceneLS.pMin.z);
+			bounds.pMax.z = std::max(bounds.pMin.z, std::min(bounds.pMax.z, sceneLS.pMax.z));
+		}
+		return bounds;
+	}
+
+}	// namespace handwork
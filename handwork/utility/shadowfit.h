@@ -0,0 +1,41 @@
+// Provide CPU side fitting of directional light shadow volumes.
+
+#pragma once
+
+#include "utility.h"
+#include "geometry.h"
+#include "transform.h"
+#include "bounds.h"
+
+namespace handwork
+{
+	// World space corners of the clip volume [-1, 1]^2 * [0, 1] for the inverse of a view
+	// projection matrix. Corners 0-3 are on the near plane and 4-7 on the far plane.
+	void FrustumCorners(const Matrix4x4& invViewProj, Vector3f corners[8]);
+
+	// Light space bounds of a set of world space points.
+	Bounds3f LightSpaceBounds(const Matrix4x4& lightView, const Vector3f* points, int count);
+
+	// Light space box for the orthographic shadow projection of a directional light looking down +z.
+	// The receivers are the part of the scene inside the camera volume given by its corners, x and y
+	// fit them tightly. Casters between the receivers and the light are kept by extending the near
+	// side to the scene bounds. Falls back to the whole scene when the camera sees none of it.
+	Bounds3f FitShadowBounds(const Matrix4x4& lightView, const Vector3f cameraCorners[8], const Bounds3f& sceneBounds);
+
+	// Far distance of each cascade along the view direction, the last one equals farZ. lambda
+	// blends the logarithmic split (1) with the uniform split (0), the practical split scheme.
+	void ComputeCascadeSplits(float nearZ, float farZ, int cascadeCount, float lambda, float* splits);
+
+	// Corners of the part of a frustum between view depths sliceNear and sliceFar. corners come from
+	// FrustumCorners of the frustum with view depths nearZ and farZ, the same ordering is kept.
+	void FrustumSliceCorners(const Vector3f corners[8], float nearZ, float farZ,
+		float sliceNear, float sliceFar, Vector3f slice[8]);
+
+	// Light space box for the orthographic projection of one cascade. x and y cover the bounding
+	// sphere of the slice, so the size does not change when the camera rotates, and the origin is
+	// snapped to whole texels of a resolution sized map, so the shadow does not shimmer when the
+	// camera moves. The near side extends to the scene bounds to keep casters toward the light.
+	Bounds3f FitCascadeBounds(const Matrix4x4& lightView, const Vector3f slice[8], const Bounds3f& sceneBounds,
+		int resolution);
+
+}	// namespace handwork
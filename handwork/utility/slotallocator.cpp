@@ -0,0 +1,107 @@
+#include "slotallocator.h"
+#include <iterator>
+
+namespace handwork
+{
+	uint32_t SlotAllocator::Allocate()
+	{
+		if (mFreeSlots.empty())
+			return mCapacity++;
+		uint32_t slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		return slot;
+	}
+
+	void SlotAllocator::Free(uint32_t slot)
+	{
+		DCHECK_LT(slot, mCapacity);
+		mFreeSlots.push_back(slot);
+	}
+
+	void SlotAllocator::Clear()
+	{
+		mFreeSlots.clear();
+		mCapacity = 0;
+	}
+
+	bool RangeAllocator::Allocate(uint32_t count, uint32_t* offset)
+	{
+		if (count == 0)
+		{
+			*offset = 0;
+			return true;
+		}
+		for (auto it = mFreeRanges.begin(); it != mFreeRanges.end(); ++it)
+		{
+			if (it->second < count)
+				continue;
+			*offset = it->first;
+			uint32_t remain = it->second - count;
+			mFreeRanges.erase(it);
+			if (remain > 0)
+				mFreeRanges[*offset + count] = remain;
+			mUsed += count;
+			return true;
+		}
+		return false;
+	}
+
+	void RangeAllocator::Free(uint32_t offset, uint32_t count)
+	{
+		if (count == 0)
+			return;
+		DCHECK_LE(offset + count, mCapacity);
+		DCHECK_GE(mUsed, count);
+		mUsed -= count;
+
+		// Merge with the free ranges right after and right before.
+		auto next = mFreeRanges.lower_bound(offset);
+		DCHECK(next == mFreeRanges.end() || next->first >= offset + count);
+		if (next != mFreeRanges.end() && next->first == offset + count)
+		{
+			count += next->second;
+			next = mFreeRanges.erase(next);
+		}
+		if (next != mFreeRanges.begin())
+		{
+			auto prev = std::prev(next);
+			DCHECK_LE(prev->first + prev->second, offset);
+			if (prev->first + prev->second == offset)
+			{
+				prev->second += count;
+				return;
+			}
+		}
+		mFreeRanges[offset] = count;
+	}
+
+	void RangeAllocator::Grow(uint32_t capacity)
+	{
+		if (capacity <= mCapacity)
+			return;
+		uint32_t added = capacity - mCapacity;
+		uint32_t offset = mCapacity;
+		mCapacity = capacity;
+		// Free() takes the range back from the used count, so count it as used first.
+		mUsed += added;
+		Free(offset, added);
+	}
+
+	void RangeAllocator::Reset(uint32_t capacity)
+	{
+		mFreeRanges.clear();
+		mCapacity = capacity;
+		mUsed = 0;
+		if (capacity > 0)
+			mFreeRanges[0] = capacity;
+	}
+
+	uint32_t RangeAllocator::LargestFreeRange() const
+	{
+		uint32_t largest = 0;
+		for (auto& e : mFreeRanges)
+			largest = std::max(largest, e.second);
+		return largest;
+	}
+
+}	// namespace handwork
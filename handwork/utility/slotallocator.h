@@ -0,0 +1,55 @@
+// Provide index allocators for slots and ranges of fixed size buffer elements.
+
+#pragma once
+
+#include "utility.h"
+#include <map>
+
+namespace handwork
+{
+	// Hand out single element indices. Freed indices are reused before the high water mark grows,
+	// so the buffer behind the slots only has to hold Capacity() elements.
+	class SlotAllocator
+	{
+	public:
+		uint32_t Allocate();
+		void Free(uint32_t slot);
+		void Clear();
+
+		// One past the highest slot handed out so far.
+		uint32_t Capacity() const { return mCapacity; }
+		uint32_t Used() const { return mCapacity - (uint32_t)mFreeSlots.size(); }
+
+	private:
+		std::vector<uint32_t> mFreeSlots;
+		uint32_t mCapacity = 0;
+	};
+
+	// Hand out contiguous ranges of [0, Capacity()). Free ranges are kept sorted and merged with
+	// their neighbours. Allocation is first fit and fails when no free range is large enough,
+	// the owner then either grows the capacity or compacts the live ranges and resets.
+	class RangeAllocator
+	{
+	public:
+		explicit RangeAllocator(uint32_t capacity = 0) { Reset(capacity); }
+
+		bool Allocate(uint32_t count, uint32_t* offset);
+		void Free(uint32_t offset, uint32_t count);
+		// Append [Capacity(), capacity) to the free ranges.
+		void Grow(uint32_t capacity);
+		// Free everything, the caller allocates the live ranges again to compact them.
+		void Reset(uint32_t capacity);
+
+		uint32_t Capacity() const { return mCapacity; }
+		uint32_t Used() const { return mUsed; }
+		uint32_t FreeRangeCount() const { return (uint32_t)mFreeRanges.size(); }
+		uint32_t LargestFreeRange() const;
+
+	private:
+		// Offset to element count of each free range.
+		std::map<uint32_t, uint32_t> mFreeRanges;
+		uint32_t mCapacity = 0;
+		uint32_t mUsed = 0;
+	};
+
+}	// namespace handwork
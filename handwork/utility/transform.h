@@ -136,6 +136,9 @@ namespace handwork
 
 		template <typename T>
 		inline Vector3<T> operator()(const Vector3<T> &v, VectorType type = VectorType::Vector) const;
+		// Transform a contiguous array in place. The matrix is only loaded once for the whole batch.
+		template <typename T>
+		inline void TransformArray(Vector3<T> *v, int count, VectorType type = VectorType::Vector) const;
 		Transform operator*(const Transform &t2) const;
 		bool SwapsHandedness() const;
 		
@@ -201,4 +204,33 @@ namespace handwork
 		}
 	}
 
+	template <typename T>
+	inline void Transform::TransformArray(Vector3<T> *v, int count, VectorType type) const
+	{
+		// Normals use the transposed inverse matrix, others use the matrix itself.
+		float a[3][4];
+		for (int i = 0; i < 3; ++i)
+			for (int j = 0; j < 4; ++j)
+				a[i][j] = (type == VectorType::Normal) ? mInv.m[j][i] : m.m[i][j];
+		if (type != VectorType::Point)
+			a[0][3] = a[1][3] = a[2][3] = 0;
+
+		bool affine = (type != VectorType::Point) || (m.m[3][0] == 0 && m.m[3][1] == 0 && m.m[3][2] == 0 && m.m[3][3] == 1);
+		if (affine)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				T x = v[i].x, y = v[i].y, z = v[i].z;
+				v[i].x = a[0][0] * x + a[0][1] * y + a[0][2] * z + a[0][3];
+				v[i].y = a[1][0] * x + a[1][1] * y + a[1][2] * z + a[1][3];
+				v[i].z = a[2][0] * x + a[2][1] * y + a[2][2] * z + a[2][3];
+			}
+		}
+		else
+		{
+			for (int i = 0; i < count; ++i)
+				v[i] = (*this)(v[i], VectorType::Point);
+		}
+	}
+
 }	// dnamespace handwork
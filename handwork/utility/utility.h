@@ -16,18 +16,28 @@
 #include <string.h>
 #include <stdint.h>
 #include <float.h>
+#if defined(_MSC_VER)
 #include <intrin.h>
+#else
+#include <alloca.h>
+#endif
 #include <glog/logging.h>
 #include "error.h"
 
+#if defined(_MSC_VER)
 #pragma warning(disable : 4305)  // double constant assigned to float
 #pragma warning(disable : 4244)  // int -> float conversion
 #pragma warning(disable : 4843)  // double -> float conversion
+#endif
 
 // Global Macros
+#if defined(_MSC_VER)
 #define snprintf _snprintf
 #define HANDWORK_THREAD_LOCAL __declspec(thread)
 #define alloca _alloca
+#else
+#define HANDWORK_THREAD_LOCAL thread_local
+#endif
 #ifndef HANDWORKHE_LINE_SIZE
 #define HANDWORK_L1_CACHE_LINE_SIZE 64
 #endif
@@ -181,15 +191,20 @@ namespace handwork
 
 	inline int Log2Int(uint32_t v)
 	{
+#if defined(_MSC_VER)
 		unsigned long lz = 0;
 		if (_BitScanReverse(&lz, v)) return lz;
 		return 0;
+#else
+		return v ? 31 - __builtin_clz(v) : 0;
+#endif
 	}
 
 	inline int Log2Int(int32_t v) { return Log2Int((uint32_t)v); }
 
 	inline int Log2Int(uint64_t v)
 	{
+#if defined(_MSC_VER)
 		unsigned long lz = 0;
 #if defined(_WIN64)
 		_BitScanReverse64(&lz, v);
@@ -200,6 +215,9 @@ namespace handwork
 			_BitScanReverse(&lz, v & 0xffffffff);
 #endif // _WIN64
 		return lz;
+#else
+		return v ? 63 - __builtin_clzll(v) : 0;
+#endif
 	}
 
 	inline int Log2Int(int64_t v) { return Log2Int((uint64_t)v); }
@@ -235,11 +253,15 @@ namespace handwork
 
 	inline int CountTrailingZeros(uint32_t v)
 	{
+#if defined(_MSC_VER)
 		unsigned long index;
 		if (_BitScanForward(&index, v))
 			return index;
 		else
 			return 32;
+#else
+		return v ? __builtin_ctz(v) : 32;
+#endif
 	}
 
 	inline float Lerp(float t, float v1, float v2) { return (1 - t) * v1 + t * v2; }